@@ -0,0 +1,100 @@
+#ifndef CORE_LIB_ARENA_H
+#define CORE_LIB_ARENA_H
+
+#include <string.h>
+#include <type_traits>
+#include "Common.h"
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+		// Bump allocator for many small objects that die together. Memory is handed out from
+		// large blocks and only returned by Clear() or the destructor; destructors of objects
+		// placed in the arena are never run. Not thread-safe.
+		class MemoryArena
+		{
+		private:
+			struct Block
+			{
+				Block * Next;
+				size_t Size;
+				char * Data()
+				{
+					return (char*)(this + 1);
+				}
+			};
+			Block * blocks;
+			char * ptr, * end;
+			size_t blockSize;
+			size_t bytesAllocated;
+			MemoryArena(const MemoryArena &) = delete;
+			MemoryArena & operator = (const MemoryArena &) = delete;
+			void NewBlock(size_t minSize)
+			{
+				size_t size = blockSize;
+				if (size < minSize)
+					size = minSize;
+				Block * block = (Block*)new char[sizeof(Block) + size];
+				block->Next = blocks;
+				block->Size = size;
+				blocks = block;
+				ptr = block->Data();
+				end = ptr + size;
+			}
+		public:
+			MemoryArena(size_t blockSize = 65536)
+				: blocks(0), ptr(0), end(0), blockSize(blockSize), bytesAllocated(0)
+			{}
+			~MemoryArena()
+			{
+				Clear();
+			}
+			// alignment must be a power of two
+			void * Alloc(size_t size, size_t alignment = sizeof(void*))
+			{
+				char * rs = (char*)(((size_t)ptr + alignment - 1) & ~(alignment - 1));
+				if (!ptr || rs + size > end)
+				{
+					NewBlock(size + alignment);
+					rs = (char*)(((size_t)ptr + alignment - 1) & ~(alignment - 1));
+				}
+				ptr = rs + size;
+				bytesAllocated += size;
+				return rs;
+			}
+			// uninitialized storage for count elements
+			template<typename T>
+			T * AllocArray(int count)
+			{
+				return (T*)Alloc(sizeof(T) * count, std::alignment_of<T>::value);
+			}
+			// null-terminated copy of str
+			template<typename TChar>
+			TChar * CopyString(const TChar * str, int length)
+			{
+				TChar * rs = AllocArray<TChar>(length + 1);
+				memcpy(rs, str, sizeof(TChar) * length);
+				rs[length] = 0;
+				return rs;
+			}
+			void Clear()
+			{
+				while (blocks)
+				{
+					Block * next = blocks->Next;
+					delete [] (char*)blocks;
+					blocks = next;
+				}
+				ptr = end = 0;
+				bytesAllocated = 0;
+			}
+			size_t BytesAllocated() const
+			{
+				return bytesAllocated;
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CORE_LIB_ARRAY_VIEW_H
+#define CORE_LIB_ARRAY_VIEW_H
+
+#include "Exception.h"
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+		// Non-owning range of elements, e.g. a typed window into a memory-mapped file.
+		// The viewed storage must outlive the view.
+		template<typename T>
+		class ArrayView
+		{
+		private:
+			T * _buffer;
+			int _count;
+		public:
+			ArrayView()
+				: _buffer(0), _count(0)
+			{}
+			ArrayView(T * buffer, int count)
+				: _buffer(buffer), _count(count)
+			{}
+			T * begin() const
+			{
+				return _buffer;
+			}
+			T * end() const
+			{
+				return _buffer + _count;
+			}
+			inline int Count() const
+			{
+				return _count;
+			}
+			inline T * Buffer() const
+			{
+				return _buffer;
+			}
+			inline T & operator [](int id) const
+			{
+#if _DEBUG
+				if (id >= _count || id < 0)
+					throw IndexOutofRangeException(L"Operator[]: Index out of Range.");
+#endif
+				return _buffer[id];
+			}
+			ArrayView<T> SubView(int start, int count) const
+			{
+#if _DEBUG
+				if (start < 0 || count < 0 || start + count > _count)
+					throw IndexOutofRangeException(L"SubView: range out of bounds.");
+#endif
+				return ArrayView<T>(_buffer + start, count);
+			}
+		};
+
+		template<typename T>
+		inline ArrayView<T> MakeArrayView(T * buffer, int count)
+		{
+			return ArrayView<T>(buffer, count);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,543 @@
+#include "AsyncIO.h"
+#include <climits>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CORE_LIB_IO_URING
+#endif
+#endif
+
+#ifdef CORE_LIB_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		using namespace CoreLib::Basic;
+		using namespace CoreLib::Threading;
+
+#ifdef CORE_LIB_IO_URING
+		// Minimal io_uring binding on raw syscalls, so there is no dependency on liburing.
+		class IoUring
+		{
+		private:
+			int fd;
+			unsigned * sqHead, * sqTail, * sqMask, * sqArray;
+			unsigned sqEntries;
+			io_uring_sqe * sqes;
+			unsigned * cqHead, * cqTail, * cqMask;
+			io_uring_cqe * cqes;
+			void * sqRing, * cqRing;
+			size_t sqRingSize, cqRingSize, sqesSize;
+			unsigned toSubmit;
+		public:
+			IoUring()
+				: fd(-1), sqes(0), sqRing(0), cqRing(0), toSubmit(0)
+			{}
+			~IoUring()
+			{
+				if (sqes)
+					munmap(sqes, sqesSize);
+				if (cqRing && cqRing != sqRing)
+					munmap(cqRing, cqRingSize);
+				if (sqRing)
+					munmap(sqRing, sqRingSize);
+				if (fd >= 0)
+					close(fd);
+			}
+			bool Init(unsigned entries)
+			{
+				io_uring_params params;
+				memset(&params, 0, sizeof(params));
+				fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+				if (fd < 0)
+					return false;
+				sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+				if (singleMap)
+					sqRingSize = cqRingSize = Math::Max(sqRingSize, cqRingSize);
+				sqRing = mmap(0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+				if (sqRing == MAP_FAILED)
+				{
+					sqRing = 0;
+					return false;
+				}
+				if (singleMap)
+					cqRing = sqRing;
+				else
+				{
+					cqRing = mmap(0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+					if (cqRing == MAP_FAILED)
+					{
+						cqRing = 0;
+						return false;
+					}
+				}
+				sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+				sqes = (io_uring_sqe*)mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+				if (sqes == MAP_FAILED)
+				{
+					sqes = 0;
+					return false;
+				}
+				char * sq = (char*)sqRing;
+				sqHead = (unsigned*)(sq + params.sq_off.head);
+				sqTail = (unsigned*)(sq + params.sq_off.tail);
+				sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+				sqArray = (unsigned*)(sq + params.sq_off.array);
+				sqEntries = params.sq_entries;
+				char * cq = (char*)cqRing;
+				cqHead = (unsigned*)(cq + params.cq_off.head);
+				cqTail = (unsigned*)(cq + params.cq_off.tail);
+				cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+				cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+				return true;
+			}
+			// returns a cleared entry to fill in; a full submission ring is handed to the kernel
+			// first, and null is returned only if that frees nothing
+			io_uring_sqe * GetSqe()
+			{
+				unsigned tail = *sqTail;
+				if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+				{
+					Submit();
+					if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+						return 0;
+				}
+				unsigned index = tail & *sqMask;
+				io_uring_sqe * sqe = sqes + index;
+				memset(sqe, 0, sizeof(io_uring_sqe));
+				sqArray[index] = index;
+				__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+				toSubmit++;
+				return sqe;
+			}
+			// submits queued entries without waiting
+			void Submit()
+			{
+				while (toSubmit)
+				{
+					int rs = (int)syscall(__NR_io_uring_enter, fd, toSubmit, 0, 0, 0, 0);
+					if (rs < 0 && errno == EINTR)
+						continue;
+					if (rs <= 0)
+						break;
+					toSubmit -= Math::Min((unsigned)rs, toSubmit);
+				}
+			}
+			// submits queued entries and waits for at least one completion
+			void SubmitAndWait()
+			{
+				int rs = (int)syscall(__NR_io_uring_enter, fd, toSubmit, 1, IORING_ENTER_GETEVENTS, 0, 0);
+				if (rs >= 0)
+					toSubmit -= Math::Min((unsigned)rs, toSubmit);
+			}
+			template<typename Func>
+			void ForEachCompletion(const Func & f)
+			{
+				unsigned head = *cqHead;
+				unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+				for (; head != tail; head++)
+				{
+					io_uring_cqe cqe = cqes[head & *cqMask];
+					__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+					f(cqe);
+				}
+			}
+		};
+
+		struct AsyncFileReader::Backend
+		{
+			struct ReadOp
+			{
+				RefPtr<AsyncReadRequest> Request;
+				int File;
+				Int64 Offset;
+				int Done;
+				iovec Vector;
+			};
+			AsyncFileReader * reader;
+			IoUring ring;
+			int wakeFd;
+			int maxInFlight, inFlight;
+			bool wakePollArmed;
+			MpmcQueue<RefPtr<AsyncReadRequest>> * queues[3];
+			std::atomic<bool> stopping;
+			std::thread driver;
+			Backend(AsyncFileReader * owner, int maxReads)
+				: reader(owner), wakeFd(-1), maxInFlight(maxReads), inFlight(0), wakePollArmed(false), stopping(false)
+			{
+				for (int i = 0; i < 3; i++)
+					queues[i] = 0;
+			}
+			~Backend()
+			{
+				if (driver.joinable())
+				{
+					stopping.store(true, std::memory_order_release);
+					Wake();
+					driver.join();
+				}
+				for (int i = 0; i < 3; i++)
+					delete queues[i];
+				if (wakeFd >= 0)
+					close(wakeFd);
+			}
+			bool Init()
+			{
+				// one entry per read plus the poll on wakeFd
+				if (!ring.Init((unsigned)maxInFlight + 1))
+					return false;
+				wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+				if (wakeFd < 0)
+					return false;
+				for (int i = 0; i < 3; i++)
+					queues[i] = new MpmcQueue<RefPtr<AsyncReadRequest>>(4096);
+				ArmWakePoll();
+				driver = std::thread([this]() { DriverMain(); });
+				return true;
+			}
+			bool Enqueue(const RefPtr<AsyncReadRequest> & request)
+			{
+				return queues[(int)request->priority]->TryEnqueue(request);
+			}
+			void Wake()
+			{
+				uint64_t one = 1;
+				ssize_t rs = write(wakeFd, &one, sizeof(one));
+				(void)rs;
+			}
+			void ArmWakePoll()
+			{
+				// with the ring full the poll is armed again before the driver next waits
+				io_uring_sqe * sqe = ring.GetSqe();
+				wakePollArmed = sqe != 0;
+				if (!sqe)
+					return;
+				sqe->opcode = IORING_OP_POLL_ADD;
+				sqe->fd = wakeFd;
+				sqe->poll_events = POLLIN;
+				sqe->user_data = 0;
+			}
+			bool TakeRequest(RefPtr<AsyncReadRequest> & request)
+			{
+				for (int i = 0; i < 3; i++)
+					if (queues[i]->TryDequeue(request))
+						return true;
+				return false;
+			}
+			void SubmitRead(ReadOp * op)
+			{
+				AsyncReadRequest * request = op->Request.Ptr();
+				op->Vector.iov_base = request->data.Buffer() + op->Done;
+				op->Vector.iov_len = request->data.Count() - op->Done;
+				io_uring_sqe * sqe = ring.GetSqe();
+				if (!sqe)
+				{
+					CompleteRead(op, AsyncReadStatus::Failed, L"Cannot queue read of '" + request->fileName + L"'.");
+					return;
+				}
+				sqe->opcode = IORING_OP_READV;
+				sqe->fd = op->File;
+				sqe->addr = (uint64_t)&op->Vector;
+				sqe->len = 1;
+				sqe->off = op->Offset + op->Done;
+				sqe->user_data = (uint64_t)op;
+			}
+			void CompleteRead(ReadOp * op, AsyncReadStatus status, const String & error)
+			{
+				close(op->File);
+				if (status == AsyncReadStatus::Completed)
+					op->Request->data.SetSize(op->Done);
+				else
+					op->Request->errorMessage = error;
+				reader->Finish(op->Request.Ptr(), status);
+				delete op;
+				inFlight--;
+			}
+			void StartRequest(const RefPtr<AsyncReadRequest> & request)
+			{
+				AsyncReadRequest * req = request.Ptr();
+				int file = open(req->fileName.ToMultiByteString(), O_RDONLY | O_CLOEXEC);
+				if (file < 0)
+				{
+					req->errorMessage = L"Cannot open file '" + req->fileName + L"'";
+					reader->Finish(req, AsyncReadStatus::Failed);
+					return;
+				}
+				struct stat info;
+				fstat(file, &info);
+				Int64 size = req->length;
+				if (size < 0 || req->offset + size > (Int64)info.st_size)
+					size = Math::Max((Int64)info.st_size - req->offset, (Int64)0);
+				if (size > INT_MAX)
+				{
+					close(file);
+					req->errorMessage = L"File '" + req->fileName + L"' is too large to read into memory.";
+					reader->Finish(req, AsyncReadStatus::Failed);
+					return;
+				}
+				req->data.SetSize((int)size);
+				ReadOp * op = new ReadOp();
+				op->Request = request;
+				op->File = file;
+				op->Offset = req->offset;
+				op->Done = 0;
+				inFlight++;
+				if (size == 0)
+					CompleteRead(op, AsyncReadStatus::Completed, String());
+				else
+					SubmitRead(op);
+			}
+			void DriverMain()
+			{
+				while (true)
+				{
+					RefPtr<AsyncReadRequest> request;
+					while (inFlight < maxInFlight && TakeRequest(request))
+					{
+						if (request->TryStart())
+							StartRequest(request);
+						request = 0;
+					}
+					if (inFlight == 0 && stopping.load(std::memory_order_acquire))
+						break;
+					if (!wakePollArmed)
+						ArmWakePoll();
+					ring.SubmitAndWait();
+					ring.ForEachCompletion([this](const io_uring_cqe & cqe)
+					{
+						if (cqe.user_data == 0)
+						{
+							// woken up for new requests, drain the counter and listen again
+							uint64_t count;
+							ssize_t rs = read(wakeFd, &count, sizeof(count));
+							(void)rs;
+							ArmWakePoll();
+							return;
+						}
+						ReadOp * op = (ReadOp*)cqe.user_data;
+						if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+							SubmitRead(op);
+						else if (cqe.res < 0)
+							CompleteRead(op, AsyncReadStatus::Failed, L"Read of '" + op->Request->fileName + L"' failed.");
+						else
+						{
+							op->Done += cqe.res;
+							// a zero-byte read means the file shrank under us
+							if (cqe.res == 0 || op->Done == op->Request->data.Count())
+								CompleteRead(op, AsyncReadStatus::Completed, String());
+							else
+								SubmitRead(op);
+						}
+					});
+				}
+			}
+		};
+#else
+		struct AsyncFileReader::Backend
+		{
+			Backend(AsyncFileReader *, int)
+			{}
+			bool Init()
+			{
+				return false;
+			}
+			bool Enqueue(const RefPtr<AsyncReadRequest> &)
+			{
+				return false;
+			}
+			void Wake()
+			{}
+		};
+#endif
+
+		AsyncReadRequest::AsyncReadRequest(AsyncFileReader * reader, const String & fileName, Int64 offset, Int64 length,
+			TaskPriority priority, const Callback & onComplete)
+			: reader(reader), status((int)AsyncReadStatus::Pending), fileName(fileName), offset(offset), length(length),
+			priority(priority), onComplete(onComplete)
+		{}
+
+		void AsyncReadRequest::Wait()
+		{
+			while (!IsDone())
+			{
+				int key = reader->requestDone.PrepareWait();
+				if (IsDone())
+				{
+					reader->requestDone.CancelWait();
+					break;
+				}
+				reader->requestDone.Wait(key);
+			}
+		}
+
+		bool AsyncReadRequest::Cancel()
+		{
+			int expected = (int)AsyncReadStatus::Pending;
+			if (!status.compare_exchange_strong(expected, (int)AsyncReadStatus::Cancelled))
+				return false;
+			reader->Finish(this, AsyncReadStatus::Cancelled);
+			return true;
+		}
+
+		AsyncFileReader::AsyncFileReader(int maxInFlight, ThreadPool * threadPool)
+			: pool(threadPool ? threadPool : &ThreadPool::Global()), tasks(*pool), outstanding(0)
+		{
+			backend = new Backend(this, Math::Max(maxInFlight, 1));
+			if (!backend->Init())
+			{
+				// no io_uring (other platform, old kernel or blocked by a sandbox)
+				delete backend;
+				backend = 0;
+			}
+		}
+
+		AsyncFileReader::~AsyncFileReader()
+		{
+			try
+			{
+				WaitAll();
+			}
+			catch (...)
+			{
+			}
+			delete backend;
+		}
+
+		bool AsyncFileReader::IsKernelAsync() const
+		{
+			return backend != 0;
+		}
+
+		void AsyncFileReader::ReadSync(AsyncReadRequest * request)
+		{
+			if (!request->TryStart())
+				return;
+			try
+			{
+				FileStream stream(request->fileName);
+				stream.Seek(SeekOrigin::End, 0);
+				Int64 fileSize = stream.GetPosition();
+				Int64 size = request->length;
+				if (size < 0 || request->offset + size > fileSize)
+					size = Math::Max(fileSize - request->offset, (Int64)0);
+				if (size > INT_MAX)
+					throw IOException(L"File '" + request->fileName + L"' is too large to read into memory.");
+				request->data.SetSize((int)size);
+				stream.Seek(SeekOrigin::Start, request->offset);
+				int done = 0;
+				while (done < (int)size)
+					done += stream.Read(request->data.Buffer() + done, (int)size - done);
+			}
+			catch (Exception & e)
+			{
+				request->errorMessage = e.Message;
+				Finish(request, AsyncReadStatus::Failed);
+				return;
+			}
+			Finish(request, AsyncReadStatus::Completed);
+		}
+
+		void AsyncFileReader::Finish(AsyncReadRequest * request, AsyncReadStatus status)
+		{
+			request->status.store((int)status, std::memory_order_release);
+			requestDone.Notify();
+			auto release = [this]()
+			{
+				if (outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					requestDone.Notify();
+			};
+			if (request->onComplete)
+			{
+				RefPtr<AsyncReadRequest> keep = request;
+				tasks.Submit([keep, release]()
+				{
+					try
+					{
+						keep->onComplete(*keep);
+					}
+					catch (...)
+					{
+						release();
+						throw;
+					}
+					release();
+				}, request->priority);
+			}
+			else
+				release();
+		}
+
+		RefPtr<AsyncReadRequest> AsyncFileReader::Read(const String & fileName, TaskPriority priority,
+			const AsyncReadRequest::Callback & onComplete)
+		{
+			return Read(fileName, 0, -1, priority, onComplete);
+		}
+
+		RefPtr<AsyncReadRequest> AsyncFileReader::Read(const String & fileName, Int64 offset, Int64 length,
+			TaskPriority priority, const AsyncReadRequest::Callback & onComplete)
+		{
+			RefPtr<AsyncReadRequest> request = new AsyncReadRequest(this, fileName, offset, length, priority, onComplete);
+			outstanding.fetch_add(1, std::memory_order_relaxed);
+			if (backend && backend->Enqueue(request))
+				backend->Wake();
+			else
+			{
+				RefPtr<AsyncReadRequest> keep = request;
+				tasks.Submit([this, keep]() { ReadSync(keep.Ptr()); }, priority);
+			}
+			return request;
+		}
+
+		List<RefPtr<AsyncReadRequest>> AsyncFileReader::ReadBatch(const List<String> & fileNames, TaskPriority priority,
+			const AsyncReadRequest::Callback & onComplete)
+		{
+			List<RefPtr<AsyncReadRequest>> requests;
+			bool queued = false;
+			for (int i = 0; i < fileNames.Count(); i++)
+			{
+				RefPtr<AsyncReadRequest> request = new AsyncReadRequest(this, fileNames[i], 0, -1, priority, onComplete);
+				outstanding.fetch_add(1, std::memory_order_relaxed);
+				if (backend && backend->Enqueue(request))
+					queued = true;
+				else
+				{
+					RefPtr<AsyncReadRequest> keep = request;
+					tasks.Submit([this, keep]() { ReadSync(keep.Ptr()); }, priority);
+				}
+				requests.Add(request);
+			}
+			// one wake-up for the whole batch
+			if (queued)
+				backend->Wake();
+			return requests;
+		}
+
+		void AsyncFileReader::WaitAll()
+		{
+			while (outstanding.load(std::memory_order_acquire) != 0)
+			{
+				int key = requestDone.PrepareWait();
+				if (outstanding.load(std::memory_order_acquire) == 0)
+				{
+					requestDone.CancelWait();
+					break;
+				}
+				requestDone.Wait(key);
+			}
+			tasks.Wait();
+		}
+	}
+}
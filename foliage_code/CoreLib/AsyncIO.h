@@ -0,0 +1,116 @@
+#ifndef CORE_LIB_ASYNC_IO_H
+#define CORE_LIB_ASYNC_IO_H
+
+#include "ThreadPool.h"
+#include "Stream.h"
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		enum class AsyncReadStatus
+		{
+			Pending, Running, Completed, Failed, Cancelled
+		};
+
+		class AsyncFileReader;
+
+		// One file read issued through AsyncFileReader; doubles as the future for its result.
+		class AsyncReadRequest : public CoreLib::Basic::RefCounted
+		{
+			friend class AsyncFileReader;
+		public:
+			typedef std::function<void(AsyncReadRequest &)> Callback;
+		private:
+			AsyncFileReader * reader;
+			std::atomic<int> status;
+			String fileName;
+			Int64 offset, length;
+			Threading::TaskPriority priority;
+			Callback onComplete;
+			CoreLib::Basic::List<unsigned char> data;
+			String errorMessage;
+			AsyncReadRequest(AsyncFileReader * reader, const String & fileName, Int64 offset, Int64 length,
+				Threading::TaskPriority priority, const Callback & onComplete);
+			bool TryStart()
+			{
+				int expected = (int)AsyncReadStatus::Pending;
+				return status.compare_exchange_strong(expected, (int)AsyncReadStatus::Running);
+			}
+		public:
+			const String & GetFileName() const
+			{
+				return fileName;
+			}
+			AsyncReadStatus GetStatus() const
+			{
+				return (AsyncReadStatus)status.load(std::memory_order_acquire);
+			}
+			bool IsDone() const
+			{
+				AsyncReadStatus s = GetStatus();
+				return s != AsyncReadStatus::Pending && s != AsyncReadStatus::Running;
+			}
+			// blocks until the request has completed, failed or been cancelled
+			void Wait();
+			// Cancels the request if it has not started yet. Returns false if it is already running
+			// or done; a running read is allowed to finish.
+			bool Cancel();
+			// the bytes read, valid once the status is Completed
+			CoreLib::Basic::List<unsigned char> & GetData()
+			{
+				return data;
+			}
+			const String & GetErrorMessage() const
+			{
+				return errorMessage;
+			}
+		};
+
+		// Reads whole files or file ranges in the background. On Linux the reads go through
+		// io_uring, driven by a single thread that keeps up to maxInFlight reads queued in the
+		// kernel; elsewhere, or when io_uring is unavailable, each read is a task on a thread pool.
+		// Completion callbacks always run on the thread pool, so parsing and decoding of finished
+		// files overlaps with the reads still in flight.
+		class AsyncFileReader : public CoreLib::Basic::Object
+		{
+			friend class AsyncReadRequest;
+		private:
+			struct Backend;
+			Backend * backend;
+			Threading::ThreadPool * pool;
+			// the reads and callbacks this reader runs on the pool
+			Threading::TaskGroup tasks;
+			Threading::EventCount requestDone;
+			std::atomic<int> outstanding;
+			AsyncFileReader(const AsyncFileReader &) = delete;
+			AsyncFileReader & operator = (const AsyncFileReader &) = delete;
+			void ReadSync(AsyncReadRequest * request);
+			void Finish(AsyncReadRequest * request, AsyncReadStatus status);
+		public:
+			// pool runs callbacks (and reads, without io_uring); null uses ThreadPool::Global()
+			AsyncFileReader(int maxInFlight = 64, Threading::ThreadPool * pool = 0);
+			// waits for outstanding requests, dropping callback exceptions
+			~AsyncFileReader();
+			// reads the whole file
+			RefPtr<AsyncReadRequest> Read(const String & fileName,
+				Threading::TaskPriority priority = Threading::TaskPriority::Normal,
+				const AsyncReadRequest::Callback & onComplete = AsyncReadRequest::Callback());
+			// reads length bytes at offset, length < 0 reads to the end of the file
+			RefPtr<AsyncReadRequest> Read(const String & fileName, Int64 offset, Int64 length,
+				Threading::TaskPriority priority = Threading::TaskPriority::Normal,
+				const AsyncReadRequest::Callback & onComplete = AsyncReadRequest::Callback());
+			// issues all reads in one go
+			CoreLib::Basic::List<RefPtr<AsyncReadRequest>> ReadBatch(const CoreLib::Basic::List<String> & fileNames,
+				Threading::TaskPriority priority = Threading::TaskPriority::Normal,
+				const AsyncReadRequest::Callback & onComplete = AsyncReadRequest::Callback());
+			// Blocks until no request is pending or running, then rethrows the first exception a
+			// completion callback threw since the last call.
+			void WaitAll();
+			// true when reads go through io_uring
+			bool IsKernelAsync() const;
+		};
+	}
+}
+
+#endif
@@ -8,6 +8,10 @@
 #else
 #define CORE_LIB_ALIGN_16(x) __declspec(align(16)) x
 #endif
+
+// size used to pad concurrently written fields apart from each other
+#define CORE_LIB_CACHE_LINE_SIZE 64
+
 namespace CoreLib
 {
 	typedef int64_t Int64;
@@ -0,0 +1,409 @@
+#include "CompressedStream.h"
+#include "SimdKernels.h"
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		using namespace CoreLib::Basic;
+
+		namespace
+		{
+			const int HashBits = 14;
+			const int MinMatch = 4;
+			const int MaxOffset = 65535;
+			// the last match has to start this far from the end of the block, and the last
+			// literals are at least LastLiterals long
+			const int MatchFindLimit = 12;
+			const int LastLiterals = 5;
+			const unsigned int FooterMagic = 0x315A4C46; // "FLZ1"
+			const int FooterSize = 8 + 4 + 4 + 4;
+
+			inline unsigned int Read32(const unsigned char * p)
+			{
+				unsigned int rs;
+				memcpy(&rs, p, 4);
+				return rs;
+			}
+
+			inline int Hash(unsigned int sequence)
+			{
+				return (int)((sequence * 2654435761u) >> (32 - HashBits));
+			}
+
+			// length continuation bytes for a nibble that overflowed into 15
+			inline unsigned char * WriteLength(unsigned char * op, int len)
+			{
+				for (; len >= 255; len -= 255)
+					*op++ = 255;
+				*op++ = (unsigned char)len;
+				return op;
+			}
+
+			inline int ReadLength(const unsigned char * src, int & ip, int srcLength)
+			{
+				int rs = 0;
+				unsigned char b;
+				do
+				{
+					if (ip >= srcLength)
+						throw IOException(L"Corrupt compressed block.");
+					b = src[ip++];
+					rs += b;
+				} while (b == 255);
+				return rs;
+			}
+
+			void ReadFully(Stream * stream, void * buffer, int length)
+			{
+				int pos = 0;
+				while (pos < length)
+					pos += stream->Read((char*)buffer + pos, length - pos);
+			}
+		}
+
+		int LzCodec::Compress(unsigned char * dest, int destCapacity, const unsigned char * src, int length)
+		{
+			int table[1 << HashBits];
+			memset(table, 0, sizeof(table));
+			const SimdKernels & kernels = GetSimdKernels();
+			unsigned char * op = dest;
+			unsigned char * opEnd = dest + destCapacity;
+			int anchor = 0;
+			int ip = 0;
+			int matchLimit = length - LastLiterals;
+			int findLimit = length - MatchFindLimit;
+			while (ip < findLimit)
+			{
+				unsigned int sequence = Read32(src + ip);
+				int h = Hash(sequence);
+				int candidate = table[h];
+				table[h] = ip;
+				if (ip - candidate > MaxOffset || Read32(src + candidate) != sequence || candidate >= ip)
+				{
+					// step faster through data that does not match
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+				while (ip > anchor && candidate > 0 && src[ip - 1] == src[candidate - 1])
+				{
+					ip--;
+					candidate--;
+				}
+				int matchLength = MinMatch + kernels.MatchLength(src + ip + MinMatch, src + candidate + MinMatch, matchLimit - ip - MinMatch);
+				int literalLength = ip - anchor;
+				if (opEnd - op < 1 + literalLength + literalLength / 255 + 1 + 2 + matchLength / 255 + 1)
+					return 0;
+				unsigned char * token = op++;
+				*token = (unsigned char)((Math::Min(literalLength, 15) << 4) | Math::Min(matchLength - MinMatch, 15));
+				if (literalLength >= 15)
+					op = WriteLength(op, literalLength - 15);
+				memcpy(op, src + anchor, literalLength);
+				op += literalLength;
+				int offset = ip - candidate;
+				*op++ = (unsigned char)(offset & 0xFF);
+				*op++ = (unsigned char)(offset >> 8);
+				if (matchLength - MinMatch >= 15)
+					op = WriteLength(op, matchLength - MinMatch - 15);
+				ip += matchLength;
+				anchor = ip;
+				if (ip - 2 < findLimit)
+					table[Hash(Read32(src + ip - 2))] = ip - 2;
+			}
+			int literalLength = length - anchor;
+			if (opEnd - op < 1 + literalLength + literalLength / 255 + 1)
+				return 0;
+			*op++ = (unsigned char)(Math::Min(literalLength, 15) << 4);
+			if (literalLength >= 15)
+				op = WriteLength(op, literalLength - 15);
+			memcpy(op, src + anchor, literalLength);
+			op += literalLength;
+			return (int)(op - dest);
+		}
+
+		void LzCodec::Decompress(unsigned char * dest, int length, const unsigned char * src, int srcLength)
+		{
+			int ip = 0;
+			int op = 0;
+			while (true)
+			{
+				if (ip >= srcLength)
+					throw IOException(L"Corrupt compressed block.");
+				int token = src[ip++];
+				int literalLength = token >> 4;
+				if (literalLength == 15)
+					literalLength += ReadLength(src, ip, srcLength);
+				if (literalLength > srcLength - ip || literalLength > length - op)
+					throw IOException(L"Corrupt compressed block.");
+				memcpy(dest + op, src + ip, literalLength);
+				ip += literalLength;
+				op += literalLength;
+				// the last sequence has literals only
+				if (ip == srcLength)
+					break;
+				if (srcLength - ip < 2)
+					throw IOException(L"Corrupt compressed block.");
+				int offset = src[ip] | (src[ip + 1] << 8);
+				ip += 2;
+				int matchLength = token & 15;
+				if (matchLength == 15)
+					matchLength += ReadLength(src, ip, srcLength);
+				matchLength += MinMatch;
+				if (offset == 0 || offset > op || matchLength > length - op)
+					throw IOException(L"Corrupt compressed block.");
+				unsigned char * out = dest + op;
+				const unsigned char * match = out - offset;
+				if (offset >= matchLength)
+					memcpy(out, match, matchLength);
+				else if (offset >= 8)
+				{
+					// overlapping, but every 8 byte chunk reads bytes that are already written
+					int i = 0;
+					for (; i + 8 <= matchLength; i += 8)
+						memcpy(out + i, match + i, 8);
+					for (; i < matchLength; i++)
+						out[i] = match[i];
+				}
+				else
+				{
+					for (int i = 0; i < matchLength; i++)
+						out[i] = match[i];
+				}
+				op += matchLength;
+			}
+			if (op != length)
+				throw IOException(L"Corrupt compressed block.");
+		}
+
+		CompressedStream::CompressedStream(RefPtr<Stream> stream, CompressionMode mode, int blockSize, Threading::ThreadPool * pool)
+			: stream(stream), pool(pool), mode(mode), blockSize(blockSize), length(0), position(0),
+			blockFill(0), cachedBlock(-1), closed(false)
+		{
+			memory = dynamic_cast<MemoryBackedStream*>(stream.Ptr());
+			origin = stream->GetPosition();
+			if (mode == CompressionMode::Decompress)
+				ReadIndex();
+			else
+			{
+				if (blockSize <= 0)
+					throw ArgumentException(L"Invalid block size.");
+				blockOffsets.Add(0);
+			}
+			block.SetSize(this->blockSize);
+		}
+
+		CompressedStream::~CompressedStream()
+		{
+			try
+			{
+				Close();
+			}
+			catch (Exception &)
+			{
+			}
+		}
+
+		void CompressedStream::ReadIndex()
+		{
+			unsigned char footer[FooterSize];
+			stream->Seek(SeekOrigin::End, -FooterSize);
+			Int64 footerPos = stream->GetPosition();
+			ReadFully(stream.Ptr(), footer, FooterSize);
+			int blockCount;
+			unsigned int magic;
+			memcpy(&length, footer, 8);
+			memcpy(&blockSize, footer + 8, 4);
+			memcpy(&blockCount, footer + 12, 4);
+			memcpy(&magic, footer + 16, 4);
+			length = ToLittleEndian(length);
+			blockSize = ToLittleEndian(blockSize);
+			blockCount = ToLittleEndian(blockCount);
+			if (ToLittleEndian(magic) != FooterMagic || blockSize <= 0 || length < 0 || blockCount < 0 ||
+				(length + blockSize - 1) / blockSize != blockCount || footerPos - origin < (Int64)blockCount * 4)
+				throw IOException(L"Invalid compressed stream.");
+			CoreLib::Basic::List<unsigned int> sizes;
+			sizes.SetSize(blockCount);
+			stream->Seek(SeekOrigin::Start, footerPos - (Int64)blockCount * 4);
+			ReadFully(stream.Ptr(), sizes.Buffer(), blockCount * 4);
+			ToLittleEndian(sizes.Buffer(), blockCount);
+			blockOffsets.SetSize(blockCount + 1);
+			blockOffsets[0] = 0;
+			for (int i = 0; i < blockCount; i++)
+			{
+				if ((int)sizes[i] <= 0 || (int)sizes[i] > GetBlockLength(i))
+					throw IOException(L"Invalid compressed stream.");
+				blockOffsets[i + 1] = blockOffsets[i] + sizes[i];
+			}
+			if (origin + blockOffsets.Last() != footerPos - (Int64)blockCount * 4)
+				throw IOException(L"Invalid compressed stream.");
+		}
+
+		// compressed bytes of a range of blocks, in place for memory backed streams
+		const unsigned char * CompressedStream::ReadCompressed(int firstBlock, int blockCount)
+		{
+			Int64 start = origin + blockOffsets[firstBlock];
+			int size = (int)(blockOffsets[firstBlock + blockCount] - blockOffsets[firstBlock]);
+			if (memory)
+				return memory->GetData() + start;
+			compressed.SetSize(size);
+			stream->Seek(SeekOrigin::Start, start);
+			ReadFully(stream.Ptr(), compressed.Buffer(), size);
+			return compressed.Buffer();
+		}
+
+		void CompressedStream::DecodeBlocks(unsigned char * dest, int firstBlock, int blockCount)
+		{
+			const unsigned char * src = ReadCompressed(firstBlock, blockCount);
+			Int64 base = blockOffsets[firstBlock];
+			auto decode = [&](int i)
+			{
+				int blockId = firstBlock + i;
+				int blockLength = GetBlockLength(blockId);
+				const unsigned char * blockData = src + (blockOffsets[blockId] - base);
+				int storedLength = (int)(blockOffsets[blockId + 1] - blockOffsets[blockId]);
+				if (storedLength == blockLength)
+					memcpy(dest + (Int64)i * blockSize, blockData, blockLength);
+				else
+					LzCodec::Decompress(dest + (Int64)i * blockSize, blockLength, blockData, storedLength);
+			};
+			Threading::ThreadPool & workers = pool ? *pool : Threading::ThreadPool::Global();
+			try
+			{
+				workers.ParallelFor(blockCount, decode);
+			}
+			catch (...)
+			{
+				throw IOException(L"Corrupt compressed block.");
+			}
+		}
+
+		void CompressedStream::Seek(SeekOrigin seekOrigin, Int64 offset)
+		{
+			if (mode != CompressionMode::Decompress)
+				throw NotSupportedException(L"Cannot seek while compressing.");
+			switch (seekOrigin)
+			{
+			case SeekOrigin::Start:
+				break;
+			case SeekOrigin::End:
+				offset += length;
+				break;
+			case SeekOrigin::Current:
+				offset += position;
+				break;
+			default:
+				throw NotSupportedException(L"Unsupported seek origin.");
+			}
+			if (offset < 0 || offset > length)
+				throw IOException(L"CompressedStream seek out of range.");
+			position = offset;
+		}
+
+		int CompressedStream::Read(void * buffer, int count)
+		{
+			if (mode != CompressionMode::Decompress)
+				throw NotSupportedException(L"Stream is not readable.");
+			if (position >= length)
+				throw EndOfStreamException(L"End of stream reached when reading.");
+			count = (int)Math::Min((Int64)count, length - position);
+			unsigned char * dest = (unsigned char *)buffer;
+			int rs = 0;
+			while (rs < count)
+			{
+				int blockId = (int)(position / blockSize);
+				int blockPos = (int)(position % blockSize);
+				// whole blocks go straight to the caller's buffer, several at a time
+				if (blockPos == 0 && count - rs >= GetBlockLength(blockId))
+				{
+					int blockCount = 0;
+					int bytes = 0;
+					while (blockId + blockCount < blockOffsets.Count() - 1 && count - rs - bytes >= GetBlockLength(blockId + blockCount))
+					{
+						bytes += GetBlockLength(blockId + blockCount);
+						blockCount++;
+					}
+					DecodeBlocks(dest + rs, blockId, blockCount);
+					rs += bytes;
+					position += bytes;
+					continue;
+				}
+				if (cachedBlock != blockId)
+				{
+					cachedBlock = -1;
+					DecodeBlocks(block.Buffer(), blockId, 1);
+					cachedBlock = blockId;
+				}
+				int len = Math::Min(count - rs, GetBlockLength(blockId) - blockPos);
+				memcpy(dest + rs, block.Buffer() + blockPos, len);
+				rs += len;
+				position += len;
+			}
+			return rs;
+		}
+
+		void CompressedStream::WriteBlock()
+		{
+			compressed.SetSize(blockFill);
+			int size = blockFill > 1 ? LzCodec::Compress(compressed.Buffer(), blockFill - 1, block.Buffer(), blockFill) : 0;
+			if (size)
+				stream->Write(compressed.Buffer(), size);
+			else
+			{
+				size = blockFill;
+				stream->Write(block.Buffer(), size);
+			}
+			blockOffsets.Add(blockOffsets.Last() + size);
+			blockFill = 0;
+		}
+
+		int CompressedStream::Write(const void * buffer, int count)
+		{
+			if (mode != CompressionMode::Compress || closed)
+				throw NotSupportedException(L"Stream is not writable.");
+			const unsigned char * src = (const unsigned char *)buffer;
+			int rs = 0;
+			while (rs < count)
+			{
+				int len = Math::Min(count - rs, blockSize - blockFill);
+				memcpy(block.Buffer() + blockFill, src + rs, len);
+				blockFill += len;
+				rs += len;
+				if (blockFill == blockSize)
+					WriteBlock();
+			}
+			length += count;
+			position = length;
+			return count;
+		}
+
+		void CompressedStream::Close()
+		{
+			if (closed)
+				return;
+			closed = true;
+			if (mode == CompressionMode::Compress)
+			{
+				if (blockFill)
+					WriteBlock();
+				int blockCount = blockOffsets.Count() - 1;
+				CoreLib::Basic::List<unsigned int> sizes;
+				sizes.SetSize(blockCount);
+				for (int i = 0; i < blockCount; i++)
+					sizes[i] = ToLittleEndian((unsigned int)(blockOffsets[i + 1] - blockOffsets[i]));
+				if (blockCount)
+					stream->Write(sizes.Buffer(), blockCount * 4);
+				unsigned char footer[FooterSize];
+				Int64 footerLength = ToLittleEndian(length);
+				int footerBlockSize = ToLittleEndian(blockSize);
+				int footerBlockCount = ToLittleEndian(blockCount);
+				unsigned int magic = ToLittleEndian(FooterMagic);
+				memcpy(footer, &footerLength, 8);
+				memcpy(footer + 8, &footerBlockSize, 4);
+				memcpy(footer + 12, &footerBlockCount, 4);
+				memcpy(footer + 16, &magic, 4);
+				stream->Write(footer, FooterSize);
+			}
+			stream->Close();
+		}
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef CORE_LIB_COMPRESSED_STREAM_H
+#define CORE_LIB_COMPRESSED_STREAM_H
+
+#include "Stream.h"
+#include "ThreadPool.h"
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		// Byte-oriented LZ77 block codec in the style of LZ4: sequences of literals followed by
+		// a back reference of at least 4 bytes, within a 64K window. Each block is
+		// self-contained.
+		class LzCodec
+		{
+		public:
+			// Compresses length bytes into dest. Returns the compressed size, or 0 if it would
+			// not fit into destCapacity, so passing length - 1 rejects data that does not shrink.
+			static int Compress(unsigned char * dest, int destCapacity, const unsigned char * src, int length);
+			// Decompresses exactly length bytes; throws IOException if src is corrupt.
+			static void Decompress(unsigned char * dest, int length, const unsigned char * src, int srcLength);
+		};
+
+		enum class CompressionMode
+		{
+			Compress, Decompress
+		};
+
+		// Stream of LzCodec blocks. The uncompressed data is cut into blocks of blockSize bytes
+		// that are compressed independently; a block that does not shrink is stored as is. The
+		// blocks are followed by an index of their sizes and a footer, so a reader can seek to
+		// any block, and a read covering several blocks decodes them in parallel on a thread
+		// pool. Reading needs a seekable stream; compressed data stored in a memory backed
+		// stream is decoded in place.
+		class CompressedStream : public Stream
+		{
+		private:
+			RefPtr<Stream> stream;
+			MemoryBackedStream * memory;
+			Threading::ThreadPool * pool;
+			CompressionMode mode;
+			int blockSize;
+			// position of the first block in stream
+			Int64 origin;
+			// uncompressed length and position
+			Int64 length, position;
+			// start of each block relative to origin, plus the end of the last block
+			CoreLib::Basic::List<Int64> blockOffsets;
+			// uncompressed block being written, or the last block decoded for reading
+			CoreLib::Basic::List<unsigned char> block;
+			int blockFill;
+			int cachedBlock;
+			CoreLib::Basic::List<unsigned char> compressed;
+			bool closed;
+			CompressedStream(const CompressedStream &) = delete;
+			CompressedStream & operator = (const CompressedStream &) = delete;
+			void ReadIndex();
+			void WriteBlock();
+			int GetBlockLength(int blockId) const
+			{
+				return (int)Basic::Math::Min(length - (Int64)blockId * blockSize, (Int64)blockSize);
+			}
+			const unsigned char * ReadCompressed(int firstBlock, int blockCount);
+			void DecodeBlocks(unsigned char * dest, int firstBlock, int blockCount);
+		public:
+			static const int DefaultBlockSize = 1 << 18;
+			// With CompressionMode::Decompress the stream must start with compressed data;
+			// blockSize is then taken from the data. pool decodes blocks in parallel, null uses
+			// ThreadPool::Global().
+			CompressedStream(RefPtr<Stream> stream, CompressionMode mode, int blockSize = DefaultBlockSize,
+				Threading::ThreadPool * pool = 0);
+			// closes the stream, see Close
+			~CompressedStream();
+			// uncompressed length; while compressing, the number of bytes written so far
+			Int64 GetLength() const
+			{
+				return length;
+			}
+			virtual Int64 GetPosition()
+			{
+				return position;
+			}
+			// seeks within the uncompressed data, only supported when decompressing
+			virtual void Seek(SeekOrigin origin, Int64 offset);
+			virtual int Read(void * buffer, int length);
+			virtual int Write(const void * buffer, int length);
+			virtual bool CanRead()
+			{
+				return mode == CompressionMode::Decompress;
+			}
+			virtual bool CanWrite()
+			{
+				return mode == CompressionMode::Compress;
+			}
+			// writes the last block and the index when compressing, then closes the underlying stream
+			virtual void Close();
+		};
+	}
+}
+
+#endif
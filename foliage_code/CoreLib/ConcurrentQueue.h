@@ -0,0 +1,348 @@
+#ifndef CORE_LIB_CONCURRENT_QUEUE_H
+#define CORE_LIB_CONCURRENT_QUEUE_H
+
+#include <new>
+#include <type_traits>
+#include "Threading.h"
+
+namespace CoreLib
+{
+	namespace Threading
+	{
+		inline int QueueCapacity(int capacity)
+		{
+			int rs = 2;
+			while (rs < capacity)
+				rs <<= 1;
+			return rs;
+		}
+
+		// Bounded multi-producer/multi-consumer ring (D. Vyukov). Each cell carries a sequence
+		// number that tells producers and consumers whose turn it is, so the only contended
+		// writes are the CAS on the enqueue and dequeue positions.
+		template<typename T>
+		class MpmcQueue
+		{
+		private:
+			struct Cell
+			{
+				std::atomic<size_t> Sequence;
+				typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Storage;
+			};
+			char padding0[CORE_LIB_CACHE_LINE_SIZE];
+			Cell * buffer;
+			size_t bufferMask;
+			char padding1[CORE_LIB_CACHE_LINE_SIZE - sizeof(Cell*) - sizeof(size_t)];
+			std::atomic<size_t> enqueuePos;
+			char padding2[CORE_LIB_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+			std::atomic<size_t> dequeuePos;
+			char padding3[CORE_LIB_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+			MpmcQueue(const MpmcQueue &) = delete;
+			MpmcQueue & operator = (const MpmcQueue &) = delete;
+
+			inline Cell * AcquireEnqueueCell()
+			{
+				size_t pos = enqueuePos.load(std::memory_order_relaxed);
+				while (true)
+				{
+					Cell * cell = buffer + (pos & bufferMask);
+					size_t seq = cell->Sequence.load(std::memory_order_acquire);
+					intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+					if (diff == 0)
+					{
+						if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+							return cell;
+					}
+					else if (diff < 0)
+						return 0; // full
+					else
+						pos = enqueuePos.load(std::memory_order_relaxed);
+				}
+			}
+			inline void PublishCell(Cell * cell)
+			{
+				cell->Sequence.store(cell->Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			}
+		public:
+			typedef T ElementType;
+			MpmcQueue(int capacity)
+			{
+				int size = QueueCapacity(capacity);
+				buffer = (Cell*)Basic::AlignedAlloc(sizeof(Cell) * size, CORE_LIB_CACHE_LINE_SIZE);
+				bufferMask = size - 1;
+				for (int i = 0; i < size; i++)
+					new (&buffer[i].Sequence) std::atomic<size_t>(i);
+				enqueuePos.store(0, std::memory_order_relaxed);
+				dequeuePos.store(0, std::memory_order_relaxed);
+			}
+			~MpmcQueue()
+			{
+				// no other thread uses the queue any more, so every cell between the two positions
+				// holds a published element
+				size_t end = enqueuePos.load(std::memory_order_relaxed);
+				for (size_t pos = dequeuePos.load(std::memory_order_relaxed); pos != end; pos++)
+					((T*)&buffer[pos & bufferMask].Storage)->~T();
+				Basic::AlignedFree(buffer);
+			}
+			int Capacity() const
+			{
+				return (int)bufferMask + 1;
+			}
+			bool TryEnqueue(const T & item)
+			{
+				Cell * cell = AcquireEnqueueCell();
+				if (!cell)
+					return false;
+				new (&cell->Storage) T(item);
+				PublishCell(cell);
+				return true;
+			}
+			bool TryEnqueue(T && item)
+			{
+				Cell * cell = AcquireEnqueueCell();
+				if (!cell)
+					return false;
+				new (&cell->Storage) T(static_cast<T&&>(item));
+				PublishCell(cell);
+				return true;
+			}
+			bool TryDequeue(T & item)
+			{
+				Cell * cell;
+				size_t pos = dequeuePos.load(std::memory_order_relaxed);
+				while (true)
+				{
+					cell = buffer + (pos & bufferMask);
+					size_t seq = cell->Sequence.load(std::memory_order_acquire);
+					intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+					if (diff == 0)
+					{
+						if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+							break;
+					}
+					else if (diff < 0)
+						return false; // empty
+					else
+						pos = dequeuePos.load(std::memory_order_relaxed);
+				}
+				T * slot = (T*)&cell->Storage;
+				item = static_cast<T&&>(*slot);
+				slot->~T();
+				cell->Sequence.store(pos + bufferMask + 1, std::memory_order_release);
+				return true;
+			}
+			// approximate, other threads may change it before the caller looks at the result
+			bool IsEmpty() const
+			{
+				return enqueuePos.load(std::memory_order_relaxed) == dequeuePos.load(std::memory_order_relaxed);
+			}
+		};
+
+		// Bounded single-producer/single-consumer ring. Both sides are wait-free: each index is
+		// written by one thread only, and each side keeps a cached copy of the other side's index
+		// so it only touches the shared cache line when the ring looks full (or empty).
+		template<typename T>
+		class SpscQueue
+		{
+		private:
+			typedef typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Slot;
+			char padding0[CORE_LIB_CACHE_LINE_SIZE];
+			Slot * buffer;
+			size_t bufferMask;
+			char padding1[CORE_LIB_CACHE_LINE_SIZE - sizeof(Slot*) - sizeof(size_t)];
+			// written by producer
+			std::atomic<size_t> tail;
+			size_t cachedHead;
+			char padding2[CORE_LIB_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+			// written by consumer
+			std::atomic<size_t> head;
+			size_t cachedTail;
+			char padding3[CORE_LIB_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+			SpscQueue(const SpscQueue &) = delete;
+			SpscQueue & operator = (const SpscQueue &) = delete;
+
+			inline T * AcquireSlot()
+			{
+				size_t t = tail.load(std::memory_order_relaxed);
+				if (t - cachedHead > bufferMask)
+				{
+					cachedHead = head.load(std::memory_order_acquire);
+					if (t - cachedHead > bufferMask)
+						return 0;
+				}
+				return (T*)(buffer + (t & bufferMask));
+			}
+			inline void Publish()
+			{
+				tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			}
+		public:
+			typedef T ElementType;
+			SpscQueue(int capacity)
+			{
+				int size = QueueCapacity(capacity);
+				buffer = (Slot*)Basic::AlignedAlloc(sizeof(Slot) * size, CORE_LIB_CACHE_LINE_SIZE);
+				bufferMask = size - 1;
+				tail.store(0, std::memory_order_relaxed);
+				head.store(0, std::memory_order_relaxed);
+				cachedHead = cachedTail = 0;
+			}
+			~SpscQueue()
+			{
+				size_t end = tail.load(std::memory_order_relaxed);
+				for (size_t h = head.load(std::memory_order_relaxed); h != end; h++)
+					((T*)(buffer + (h & bufferMask)))->~T();
+				Basic::AlignedFree(buffer);
+			}
+			int Capacity() const
+			{
+				return (int)bufferMask + 1;
+			}
+			// producer thread only
+			bool TryEnqueue(const T & item)
+			{
+				T * slot = AcquireSlot();
+				if (!slot)
+					return false;
+				new (slot) T(item);
+				Publish();
+				return true;
+			}
+			// producer thread only
+			bool TryEnqueue(T && item)
+			{
+				T * slot = AcquireSlot();
+				if (!slot)
+					return false;
+				new (slot) T(static_cast<T&&>(item));
+				Publish();
+				return true;
+			}
+			// consumer thread only
+			bool TryDequeue(T & item)
+			{
+				size_t h = head.load(std::memory_order_relaxed);
+				if (h == cachedTail)
+				{
+					cachedTail = tail.load(std::memory_order_acquire);
+					if (h == cachedTail)
+						return false;
+				}
+				T * slot = (T*)(buffer + (h & bufferMask));
+				item = static_cast<T&&>(*slot);
+				slot->~T();
+				head.store(h + 1, std::memory_order_release);
+				return true;
+			}
+			bool IsEmpty() const
+			{
+				return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_relaxed);
+			}
+		};
+
+		// Blocking front end for MpmcQueue/SpscQueue. Enqueue waits while the ring is full and
+		// Dequeue waits while it is empty; Close() releases every waiter so worker loops can exit.
+		template<typename TQueue>
+		class BlockingQueue
+		{
+		public:
+			typedef typename TQueue::ElementType ElementType;
+		private:
+			TQueue queue;
+			EventCount notEmpty, notFull;
+			std::atomic<bool> closed;
+			template<typename TryFunc>
+			bool WaitFor(EventCount & evt, const TryFunc & tryFunc, bool failWhenClosed)
+			{
+				while (true)
+				{
+					for (int i = 0; i < 16; i++)
+					{
+						if (failWhenClosed && closed.load(std::memory_order_acquire))
+							return false;
+						if (tryFunc())
+							return true;
+					}
+					int key = evt.PrepareWait();
+					if (tryFunc())
+					{
+						evt.CancelWait();
+						return true;
+					}
+					if (closed.load(std::memory_order_acquire))
+					{
+						evt.CancelWait();
+						if (failWhenClosed || !tryFunc())
+							return false;
+						return true;
+					}
+					evt.Wait(key);
+				}
+			}
+		public:
+			BlockingQueue(int capacity, WaitMode waitMode = WaitMode::Futex)
+				: queue(capacity), notEmpty(waitMode), notFull(waitMode), closed(false)
+			{}
+			int Capacity() const
+			{
+				return queue.Capacity();
+			}
+			bool TryEnqueue(const ElementType & item)
+			{
+				if (!queue.TryEnqueue(item))
+					return false;
+				notEmpty.Notify();
+				return true;
+			}
+			bool TryEnqueue(ElementType && item)
+			{
+				if (!queue.TryEnqueue(static_cast<ElementType&&>(item)))
+					return false;
+				notEmpty.Notify();
+				return true;
+			}
+			bool TryDequeue(ElementType & item)
+			{
+				if (!queue.TryDequeue(item))
+					return false;
+				notFull.Notify();
+				return true;
+			}
+			// returns false if the queue has been closed
+			bool Enqueue(const ElementType & item)
+			{
+				if (!WaitFor(notFull, [&]{return queue.TryEnqueue(item);}, true))
+					return false;
+				notEmpty.Notify();
+				return true;
+			}
+			bool Enqueue(ElementType && item)
+			{
+				if (!WaitFor(notFull, [&]{return queue.TryEnqueue(static_cast<ElementType&&>(item));}, true))
+					return false;
+				notEmpty.Notify();
+				return true;
+			}
+			// returns false once the queue has been closed and drained
+			bool Dequeue(ElementType & item)
+			{
+				if (!WaitFor(notEmpty, [&]{return queue.TryDequeue(item);}, false))
+					return false;
+				notFull.Notify();
+				return true;
+			}
+			void Close()
+			{
+				closed.store(true, std::memory_order_release);
+				notEmpty.Notify();
+				notFull.Notify();
+			}
+			bool IsClosed() const
+			{
+				return closed.load(std::memory_order_acquire);
+			}
+		};
+	}
+}
+
+#endif
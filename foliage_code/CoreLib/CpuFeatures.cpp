@@ -0,0 +1,141 @@
+#include "CpuFeatures.h"
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+		static void CpuId(int leaf, int subLeaf, unsigned int regs[4])
+		{
+#ifdef _MSC_VER
+			__cpuidex((int*)regs, leaf, subLeaf);
+#else
+			__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		}
+
+		// register state the OS saves on context switches
+		static unsigned long long ReadXcr0()
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			unsigned int eax, edx;
+			__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return ((unsigned long long)edx << 32) | eax;
+#endif
+		}
+
+		static void DetectFeatures(CpuFeatures & f)
+		{
+			unsigned int regs[4];
+			CpuId(0, 0, regs);
+			unsigned int maxLeaf = regs[0];
+			if (maxLeaf < 1)
+				return;
+			CpuId(1, 0, regs);
+			unsigned int ecx1 = regs[2], edx1 = regs[3];
+			f.Sse2 = (edx1 & (1u << 26)) != 0;
+			f.Sse41 = (ecx1 & (1u << 19)) != 0;
+			f.Sse42 = (ecx1 & (1u << 20)) != 0;
+			f.Popcnt = (ecx1 & (1u << 23)) != 0;
+			bool osxsave = (ecx1 & (1u << 27)) != 0;
+			unsigned long long xcr0 = osxsave ? ReadXcr0() : 0;
+			// xmm and ymm state, then opmask and both halves of zmm state
+			bool osAvx = (xcr0 & 0x6) == 0x6;
+			bool osAvx512 = osAvx && (xcr0 & 0xE0) == 0xE0;
+			f.Avx = osAvx && (ecx1 & (1u << 28)) != 0;
+			f.Fma = f.Avx && (ecx1 & (1u << 12)) != 0;
+			if (maxLeaf < 7)
+				return;
+			CpuId(7, 0, regs);
+			unsigned int ebx7 = regs[1];
+			f.Bmi1 = (ebx7 & (1u << 3)) != 0;
+			f.Bmi2 = (ebx7 & (1u << 8)) != 0;
+			f.Avx2 = f.Avx && (ebx7 & (1u << 5)) != 0;
+			f.Avx512F = osAvx512 && (ebx7 & (1u << 16)) != 0;
+			f.Avx512DQ = f.Avx512F && (ebx7 & (1u << 17)) != 0;
+			f.Avx512BW = f.Avx512F && (ebx7 & (1u << 30)) != 0;
+			f.Avx512VL = f.Avx512F && (ebx7 & (1u << 31)) != 0;
+		}
+#else
+		static void DetectFeatures(CpuFeatures &)
+		{
+		}
+#endif
+
+		static CpuTier GetMaxTier(const CpuFeatures & f)
+		{
+			if (!f.Sse2)
+				return CpuTier::Scalar;
+			if (!f.Avx2 || !f.Popcnt || !f.Bmi1 || !f.Bmi2)
+				return CpuTier::Sse2;
+			if (!f.Avx512F || !f.Avx512BW || !f.Avx512DQ || !f.Avx512VL)
+				return CpuTier::Avx2;
+			return CpuTier::Avx512;
+		}
+
+		const CpuFeatures & CpuFeatures::Get()
+		{
+			static CpuFeatures features;
+			static std::once_flag detected;
+			std::call_once(detected, []()
+			{
+				memset(&features, 0, sizeof(features));
+				DetectFeatures(features);
+				features.MaxTier = GetMaxTier(features);
+			});
+			return features;
+		}
+
+		const char * GetCpuTierName(CpuTier tier)
+		{
+			switch (tier)
+			{
+			case CpuTier::Sse2:
+				return "sse2";
+			case CpuTier::Avx2:
+				return "avx2";
+			case CpuTier::Avx512:
+				return "avx512";
+			default:
+				return "scalar";
+			}
+		}
+
+		CpuTier GetCpuTier()
+		{
+			static CpuTier tier;
+			static std::once_flag selected;
+			std::call_once(selected, []()
+			{
+				tier = CpuFeatures::Get().MaxTier;
+#ifdef _MSC_VER
+#pragma warning(suppress: 4996)
+#endif
+				const char * forced = getenv("CORELIB_CPU_TIER");
+				if (!forced)
+					return;
+				for (int i = 0; i <= (int)CpuTier::Avx512; i++)
+				{
+					if (strcmp(forced, GetCpuTierName((CpuTier)i)) == 0)
+					{
+						// a tier above what the cpu supports would crash
+						if (i < (int)tier)
+							tier = (CpuTier)i;
+						break;
+					}
+				}
+			});
+			return tier;
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef CORE_LIB_CPU_FEATURES_H
+#define CORE_LIB_CPU_FEATURES_H
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+		// Instruction set levels the SIMD kernels are built for, in increasing order.
+		// Avx2 also requires POPCNT, BMI1 and BMI2; Avx512 requires AVX-512 F, BW, DQ and VL.
+		enum class CpuTier
+		{
+			Scalar, Sse2, Avx2, Avx512
+		};
+
+		class CpuFeatures
+		{
+		public:
+			bool Sse2, Sse41, Sse42, Popcnt, Avx, Avx2, Fma, Bmi1, Bmi2;
+			bool Avx512F, Avx512BW, Avx512DQ, Avx512VL;
+			// highest tier the cpu and the OS support
+			CpuTier MaxTier;
+			// detected with cpuid on first use
+			static const CpuFeatures & Get();
+		};
+
+		// Tier the SIMD kernels run at: CpuFeatures::Get().MaxTier, lowered to the value of the
+		// CORELIB_CPU_TIER environment variable (scalar, sse2, avx2 or avx512) if it is set.
+		// Read once.
+		CpuTier GetCpuTier();
+		const char * GetCpuTierName(CpuTier tier);
+	}
+}
+
+#endif
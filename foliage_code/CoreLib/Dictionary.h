@@ -45,7 +45,7 @@ namespace CoreLib
 			template<typename TKey>
 			static int GetHashCode(TKey & key)
 			{
-				return ((int)key)/sizeof(typename std::remove_pointer<TKey>::type);
+				return (int)((size_t)key/sizeof(typename std::remove_pointer<TKey>::type));
 			}
 		};
 		template<>
@@ -44,6 +44,12 @@ namespace CoreLib
 
 		};
 		
+		template<typename T>
+		void ThrowReleaseOfInlineObject(T *)
+		{
+			throw InvalidOperationException(L"RefPtr::Release() called on an object created by MakeRef or MakeRefArray.");
+		}
+		
 		class ArgumentException : public Exception
 		{
 		public:
@@ -0,0 +1,192 @@
+#ifndef CORE_LIB_FAST_MATH_H
+#define CORE_LIB_FAST_MATH_H
+
+#include "VectorMathWide.h"
+
+namespace VectorMath
+{
+namespace VECTOR_MATH_WIDE_TIER
+{
+	// Approximate transcendentals for hot loops. Each function is a template over the lane types
+	// of VectorMathWide.h, with a float overload, and uses only arithmetic, Select and the
+	// exponent helpers of the lane types, so every width and instruction set gives the same
+	// results (unless the compiler contracts them into FMA). Errors against double precision libm:
+	//   Exp2(x)      x in [-126, 127]           relative 1.2e-7
+	//   Log2(x)      x in [1/2, 2]              absolute 1.4e-7
+	//                other positive x           relative 1.4e-7; -150 for x = 0
+	//   Pow(x, y)    x > 0, |y*log2(x)| < 126   relative 1.2e-7 + 1e-7 * (|y| + |y*log2(x)|);
+	//                                           0 for x <= 0
+	//   Rsqrt(x)     x positive and normal      relative 5e-6
+	//   Sqrt(x)      x positive and normal      relative 5e-6; 0 for x <= 0
+	//   Sin, Cos(x)  |x| <= 100                 absolute 1e-7
+	//                |x| <= 1e5                 absolute 1e-6
+	//   Atan2(y, x)  finite                     absolute 3e-7; 0 for x = y = 0
+	// Exp2 clamps to 2^-126 below its domain, and NaNs are not propagated.
+	class FastMath
+	{
+	private:
+		// round to nearest even, for |x| < 2^22
+		template<typename F>
+		static F Round(const F & x)
+		{
+			return (x + F(12582912.0f)) - F(12582912.0f);
+		}
+	public:
+		template<typename F>
+		static F Exp2(const F & x)
+		{
+			F t = F::Min(F::Max(x, F(-126.0f)), F(127.0f));
+			F n = Round(t);
+			F f = t - n;
+			// 2^f on [-1/2, 1/2] (Cephes exp2f)
+			F p = F(1.535336188319500e-4f);
+			p = p * f + F(1.339887440266574e-3f);
+			p = p * f + F(9.618437357674640e-3f);
+			p = p * f + F(5.550332471162809e-2f);
+			p = p * f + F(2.402264791363012e-1f);
+			p = p * f + F(6.931472028550421e-1f);
+			p = p * f + F(1.0f);
+			return p * F::Exp2Int(n);
+		}
+		template<typename F>
+		static F Log2(const F & x)
+		{
+			// denormals are scaled into the normal range first
+			typename F::Mask denormal = x < F(1.17549435e-38f);
+			F e;
+			F m = F::Frexp(F::Select(denormal, x * F(8388608.0f), x), e);
+			e = F::Select(denormal, e - F(23.0f), e);
+			typename F::Mask high = m > F(1.41421356f);
+			m = F::Select(high, m * F(0.5f), m);
+			e = F::Select(high, e + F(1.0f), e);
+			// ln(m) = 2 atanh(t), |t| <= 0.172
+			F t = (m - F(1.0f)) / (m + F(1.0f));
+			F t2 = t * t;
+			F p = F(2.0f / 9.0f);
+			p = p * t2 + F(2.0f / 7.0f);
+			p = p * t2 + F(2.0f / 5.0f);
+			p = p * t2 + F(2.0f / 3.0f);
+			p = p * t2 + F(2.0f);
+			return e + t * p * F(1.44269504f);
+		}
+		template<typename F>
+		static F Pow(const F & x, const F & y)
+		{
+			return F::Select(x > F(0.0f), Exp2(y * Log2(x)), F(0.0f));
+		}
+		template<typename F>
+		static F Rsqrt(const F & x)
+		{
+			F h = x * F(0.5f);
+			F y = F::RsqrtEstimate(x);
+			y = y * (F(1.5f) - h * y * y);
+			y = y * (F(1.5f) - h * y * y);
+			return y;
+		}
+		template<typename F>
+		static F Sqrt(const F & x)
+		{
+			return F::Select(x > F(0.0f), x * Rsqrt(x), F(0.0f));
+		}
+		template<typename F>
+		static void SinCos(const F & x, F & s, F & c)
+		{
+			// x = r + k*pi/2, with pi/2 split so the first products are exact (Cephes sinf)
+			F k = Round(x * F(0.636619772f));
+			F r = ((x - k * F(1.5703125f)) - k * F(4.837512969970703125e-4f)) - k * F(7.54978995489188216e-8f);
+			F r2 = r * r;
+			F sr = F(-1.9515295891e-4f);
+			sr = sr * r2 + F(8.3321608736e-3f);
+			sr = sr * r2 + F(-1.6666654611e-1f);
+			sr = sr * r2 * r + r;
+			F cr = F(2.443315711809948e-5f);
+			cr = cr * r2 + F(-1.388731625493765e-3f);
+			cr = cr * r2 + F(4.166664568298827e-2f);
+			cr = cr * r2 * r2 - F(0.5f) * r2 + F(1.0f);
+			// quadrant, k mod 4
+			F q = k - F(4.0f) * Round((k - F(1.5f)) * F(0.25f));
+			typename F::Mask swap = (q == F(1.0f)) | (q == F(3.0f));
+			s = F::Select(swap, cr, sr);
+			c = F::Select(swap, sr, cr);
+			s = F::Select(q >= F(2.0f), -s, s);
+			c = F::Select((q == F(1.0f)) | (q == F(2.0f)), -c, c);
+		}
+		template<typename F>
+		static F Sin(const F & x)
+		{
+			F s, c;
+			SinCos(x, s, c);
+			return s;
+		}
+		template<typename F>
+		static F Cos(const F & x)
+		{
+			F s, c;
+			SinCos(x, s, c);
+			return c;
+		}
+		template<typename F>
+		static F Atan2(const F & y, const F & x)
+		{
+			F ax = F::Abs(x), ay = F::Abs(y);
+			F hi = F::Max(ax, ay);
+			F a = F::Min(ax, ay) / F::Select(hi > F(0.0f), hi, F(1.0f));
+			// atan on [-tan(pi/8), tan(pi/8)] (Cephes atanf)
+			typename F::Mask reduce = a > F(0.414213562f);
+			F z = F::Select(reduce, (a - F(1.0f)) / (a + F(1.0f)), a);
+			F z2 = z * z;
+			F p = F(8.05374449538e-2f);
+			p = p * z2 + F(-1.38776856032e-1f);
+			p = p * z2 + F(1.99777106478e-1f);
+			p = p * z2 + F(-3.33329491539e-1f);
+			F rs = p * z2 * z + z;
+			rs = F::Select(reduce, rs + F(0.785398163f), rs);
+			rs = F::Select(ay > ax, F(1.570796327f) - rs, rs);
+			rs = F::Select(x < F(0.0f), F(3.141592654f) - rs, rs);
+			return F::Select(y < F(0.0f), -rs, rs);
+		}
+
+		static inline float Exp2(float x)
+		{
+			return Exp2(FloatScalar<1>(x)).v[0];
+		}
+		static inline float Log2(float x)
+		{
+			return Log2(FloatScalar<1>(x)).v[0];
+		}
+		static inline float Pow(float x, float y)
+		{
+			return Pow(FloatScalar<1>(x), FloatScalar<1>(y)).v[0];
+		}
+		static inline float Rsqrt(float x)
+		{
+			return Rsqrt(FloatScalar<1>(x)).v[0];
+		}
+		static inline float Sqrt(float x)
+		{
+			return Sqrt(FloatScalar<1>(x)).v[0];
+		}
+		static inline void SinCos(float x, float & s, float & c)
+		{
+			FloatScalar<1> ws, wc;
+			SinCos(FloatScalar<1>(x), ws, wc);
+			s = ws.v[0];
+			c = wc.v[0];
+		}
+		static inline float Sin(float x)
+		{
+			return Sin(FloatScalar<1>(x)).v[0];
+		}
+		static inline float Cos(float x)
+		{
+			return Cos(FloatScalar<1>(x)).v[0];
+		}
+		static inline float Atan2(float y, float x)
+		{
+			return Atan2(FloatScalar<1>(y), FloatScalar<1>(x)).v[0];
+		}
+	};
+}
+}
+
+#endif
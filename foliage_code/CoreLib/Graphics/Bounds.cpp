@@ -0,0 +1,351 @@
+#include "Bounds.h"
+#include "../SimdKernels.h"
+
+using namespace CoreLib::Basic;
+
+namespace CoreLib
+{
+	namespace Graphics
+	{
+		static inline float PlaneDistance(const Vec4 & plane, const Vec3 & v)
+		{
+			return plane.x*v.x + plane.y*v.y + plane.z*v.z + plane.w;
+		}
+
+		// a volume reaching radius from center toward every plane normal; the arithmetic
+		// matches the CullSpheres and CullBoxes kernels, so the answers agree with them
+		static Containment Classify(const Frustum & frustum, const Vec3 & center, const float radius[6])
+		{
+			bool inside = true;
+			for (int i = 0; i < 6; i++)
+			{
+				float d = PlaneDistance(frustum.Planes[i], center);
+				if (d < -radius[i])
+					return Containment::Outside;
+				if (d < radius[i])
+					inside = false;
+			}
+			return inside ? Containment::Inside : Containment::Intersects;
+		}
+
+		static inline void GetCenterExtents(const BBox & box, Vec3 & center, Vec3 & extents)
+		{
+			center = Vec3((box.xMin + box.xMax) * 0.5f, (box.yMin + box.yMax) * 0.5f, (box.zMin + box.zMax) * 0.5f);
+			extents = Vec3((box.xMax - box.xMin) * 0.5f, (box.yMax - box.yMin) * 0.5f, (box.zMax - box.zMin) * 0.5f);
+		}
+
+		static inline void SetCenterExtents(BBox & box, const Vec3 & center, const Vec3 & extents)
+		{
+			box.xMin = center.x - extents.x; box.xMax = center.x + extents.x;
+			box.yMin = center.y - extents.y; box.yMax = center.y + extents.y;
+			box.zMin = center.z - extents.z; box.zMax = center.z + extents.z;
+		}
+
+		// point in the frame of an oriented box, where it is [-Extents, Extents]
+		static inline Vec3 ToBoxSpace(const OrientedBox & box, const Vec3 & v)
+		{
+			Vec3 rs;
+			Quat::Transform(rs, box.Orientation.Conjugate(), Vec3(v.x - box.Center.x, v.y - box.Center.y, v.z - box.Center.z));
+			return rs;
+		}
+
+		void Frustum::FromMatrix(Frustum & rs, const Matrix4 & viewProjection, bool zeroToOneDepth)
+		{
+			// clip coordinate i of a point is the dot product with row i of the matrix, and the
+			// volume is -w <= x, y <= w and -w (or 0) <= z <= w
+			Vec4 rows[4];
+			for (int i = 0; i < 4; i++)
+				rows[i] = Vec4(viewProjection.m[0][i], viewProjection.m[1][i], viewProjection.m[2][i], viewProjection.m[3][i]);
+			rs.Planes[0] = rows[3] + rows[0];
+			rs.Planes[1] = rows[3] - rows[0];
+			rs.Planes[2] = rows[3] + rows[1];
+			rs.Planes[3] = rows[3] - rows[1];
+			rs.Planes[4] = zeroToOneDepth ? rows[2] : rows[3] + rows[2];
+			rs.Planes[5] = rows[3] - rows[2];
+			for (int i = 0; i < 6; i++)
+			{
+				Vec4 & p = rs.Planes[i];
+				p *= 1.0f / sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+			}
+		}
+
+		Containment Contains(const Frustum & frustum, const Vec3 & point)
+		{
+			for (int i = 0; i < 6; i++)
+				if (PlaneDistance(frustum.Planes[i], point) < 0.0f)
+					return Containment::Outside;
+			return Containment::Inside;
+		}
+
+		Containment Contains(const Frustum & frustum, const Sphere & sphere)
+		{
+			float radius[6];
+			for (int i = 0; i < 6; i++)
+				radius[i] = sphere.Radius;
+			return Classify(frustum, sphere.Center, radius);
+		}
+
+		Containment Contains(const Frustum & frustum, const BBox & box)
+		{
+			Vec3 c, e;
+			GetCenterExtents(box, c, e);
+			float radius[6];
+			for (int i = 0; i < 6; i++)
+			{
+				const Vec4 & p = frustum.Planes[i];
+				radius[i] = fabs(p.x)*e.x + fabs(p.y)*e.y + fabs(p.z)*e.z;
+			}
+			return Classify(frustum, c, radius);
+		}
+
+		Containment Contains(const Frustum & frustum, const OrientedBox & box)
+		{
+			float r[3][3];
+			QuatToRotation(r, box.Orientation.x, box.Orientation.y, box.Orientation.z, box.Orientation.w);
+			const Vec3 & e = box.Extents;
+			float radius[6];
+			for (int i = 0; i < 6; i++)
+			{
+				const Vec4 & p = frustum.Planes[i];
+				radius[i] = e.x*fabs(p.x*r[0][0] + p.y*r[0][1] + p.z*r[0][2]) +
+					e.y*fabs(p.x*r[1][0] + p.y*r[1][1] + p.z*r[1][2]) +
+					e.z*fabs(p.x*r[2][0] + p.y*r[2][1] + p.z*r[2][2]);
+			}
+			return Classify(frustum, box.Center, radius);
+		}
+
+		Containment Contains(const BBox & box, const Vec3 & point)
+		{
+			return point.x >= box.xMin && point.x <= box.xMax &&
+				point.y >= box.yMin && point.y <= box.yMax &&
+				point.z >= box.zMin && point.z <= box.zMax ? Containment::Inside : Containment::Outside;
+		}
+
+		Containment Contains(const BBox & box, const BBox & other)
+		{
+			if (other.xMin > box.xMax || other.xMax < box.xMin ||
+				other.yMin > box.yMax || other.yMax < box.yMin ||
+				other.zMin > box.zMax || other.zMax < box.zMin)
+				return Containment::Outside;
+			if (other.xMin >= box.xMin && other.xMax <= box.xMax &&
+				other.yMin >= box.yMin && other.yMax <= box.yMax &&
+				other.zMin >= box.zMin && other.zMax <= box.zMax)
+				return Containment::Inside;
+			return Containment::Intersects;
+		}
+
+		Containment Contains(const BBox & box, const Sphere & sphere)
+		{
+			const Vec3 & c = sphere.Center;
+			float r = sphere.Radius;
+			// squared distance from the center to the closest point of the box
+			float dx = Math::Max(Math::Max(box.xMin - c.x, c.x - box.xMax), 0.0f);
+			float dy = Math::Max(Math::Max(box.yMin - c.y, c.y - box.yMax), 0.0f);
+			float dz = Math::Max(Math::Max(box.zMin - c.z, c.z - box.zMax), 0.0f);
+			if (dx*dx + dy*dy + dz*dz > r*r)
+				return Containment::Outside;
+			if (c.x - r >= box.xMin && c.x + r <= box.xMax &&
+				c.y - r >= box.yMin && c.y + r <= box.yMax &&
+				c.z - r >= box.zMin && c.z + r <= box.zMax)
+				return Containment::Inside;
+			return Containment::Intersects;
+		}
+
+		Containment Contains(const Sphere & sphere, const Vec3 & point)
+		{
+			Vec3 d(point.x - sphere.Center.x, point.y - sphere.Center.y, point.z - sphere.Center.z);
+			return Vec3::Dot(d, d) <= sphere.Radius * sphere.Radius ? Containment::Inside : Containment::Outside;
+		}
+
+		Containment Contains(const Sphere & sphere, const Sphere & other)
+		{
+			Vec3 d(other.Center.x - sphere.Center.x, other.Center.y - sphere.Center.y, other.Center.z - sphere.Center.z);
+			float distance = sqrt(Vec3::Dot(d, d));
+			if (distance > sphere.Radius + other.Radius)
+				return Containment::Outside;
+			if (distance + other.Radius <= sphere.Radius)
+				return Containment::Inside;
+			return Containment::Intersects;
+		}
+
+		Containment Contains(const Sphere & sphere, const BBox & box)
+		{
+			const Vec3 & c = sphere.Center;
+			float r2 = sphere.Radius * sphere.Radius;
+			float dx = Math::Max(Math::Max(box.xMin - c.x, c.x - box.xMax), 0.0f);
+			float dy = Math::Max(Math::Max(box.yMin - c.y, c.y - box.yMax), 0.0f);
+			float dz = Math::Max(Math::Max(box.zMin - c.z, c.z - box.zMax), 0.0f);
+			if (dx*dx + dy*dy + dz*dz > r2)
+				return Containment::Outside;
+			// the farthest corner
+			float fx = Math::Max(c.x - box.xMin, box.xMax - c.x);
+			float fy = Math::Max(c.y - box.yMin, box.yMax - c.y);
+			float fz = Math::Max(c.z - box.zMin, box.zMax - c.z);
+			if (fx*fx + fy*fy + fz*fz <= r2)
+				return Containment::Inside;
+			return Containment::Intersects;
+		}
+
+		Containment Contains(const OrientedBox & box, const Vec3 & point)
+		{
+			Vec3 p = ToBoxSpace(box, point);
+			return fabs(p.x) <= box.Extents.x && fabs(p.y) <= box.Extents.y && fabs(p.z) <= box.Extents.z
+				? Containment::Inside : Containment::Outside;
+		}
+
+		Containment Contains(const OrientedBox & box, const Sphere & sphere)
+		{
+			BBox local;
+			SetCenterExtents(local, Vec3(0.0f), box.Extents);
+			Sphere s;
+			s.Center = ToBoxSpace(box, sphere.Center);
+			s.Radius = sphere.Radius;
+			return Contains(local, s);
+		}
+
+		bool Intersects(const Ray & ray, const BBox & box, float & t)
+		{
+			// clip the ray against the three slabs of the box
+			const float * origin = &ray.Origin.x;
+			const float * direction = &ray.Direction.x;
+			const float * boxMin = &box.xMin;
+			const float * boxMax = &box.xMax;
+			float tMin = 0.0f, tMax = FLT_MAX;
+			for (int i = 0; i < 3; i++)
+			{
+				if (direction[i] == 0.0f)
+				{
+					if (origin[i] < boxMin[i] || origin[i] > boxMax[i])
+						return false;
+					continue;
+				}
+				float inv = 1.0f / direction[i];
+				float t1 = (boxMin[i] - origin[i]) * inv;
+				float t2 = (boxMax[i] - origin[i]) * inv;
+				tMin = Math::Max(tMin, Math::Min(t1, t2));
+				tMax = Math::Min(tMax, Math::Max(t1, t2));
+				if (tMin > tMax)
+					return false;
+			}
+			t = tMin;
+			return true;
+		}
+
+		bool Intersects(const Ray & ray, const Sphere & sphere, float & t)
+		{
+			Vec3 m(ray.Origin.x - sphere.Center.x, ray.Origin.y - sphere.Center.y, ray.Origin.z - sphere.Center.z);
+			float b = Vec3::Dot(m, ray.Direction);
+			float c = Vec3::Dot(m, m) - sphere.Radius * sphere.Radius;
+			// outside and pointing away
+			if (c > 0.0f && b > 0.0f)
+				return false;
+			if (c <= 0.0f)
+			{
+				t = 0.0f;
+				return true;
+			}
+			float a = Vec3::Dot(ray.Direction, ray.Direction);
+			float discriminant = b*b - a*c;
+			if (discriminant < 0.0f)
+				return false;
+			t = (-b - sqrt(discriminant)) / a;
+			return true;
+		}
+
+		bool Intersects(const Ray & ray, const OrientedBox & box, float & t)
+		{
+			Ray local;
+			local.Origin = ToBoxSpace(box, ray.Origin);
+			Quat::Transform(local.Direction, box.Orientation.Conjugate(), ray.Direction);
+			BBox localBox;
+			SetCenterExtents(localBox, Vec3(0.0f), box.Extents);
+			return Intersects(local, localBox, t);
+		}
+
+		void TransformBounds(BBox & rs, const Matrix4 & m, const BBox & box)
+		{
+			// each output extent sums the input extents along the matrix row, by absolute value
+			Vec3 c, e, tc;
+			GetCenterExtents(box, c, e);
+			m.Transform(tc, c);
+			Vec3 te(fabs(m.m[0][0])*e.x + fabs(m.m[1][0])*e.y + fabs(m.m[2][0])*e.z,
+				fabs(m.m[0][1])*e.x + fabs(m.m[1][1])*e.y + fabs(m.m[2][1])*e.z,
+				fabs(m.m[0][2])*e.x + fabs(m.m[1][2])*e.y + fabs(m.m[2][2])*e.z);
+			SetCenterExtents(rs, tc, te);
+		}
+
+		// m after the transform that places [-Extents, Extents] as the oriented box
+		static void GetBoxTransform(Matrix4 & rs, BBox & localBox, const Matrix4 & m, const OrientedBox & box)
+		{
+			Matrix4 local;
+			box.Orientation.ToMatrix(local);
+			local.m[3][0] = box.Center.x;
+			local.m[3][1] = box.Center.y;
+			local.m[3][2] = box.Center.z;
+			Matrix4::Multiply(rs, m, local);
+			SetCenterExtents(localBox, Vec3(0.0f), box.Extents);
+		}
+
+		void TransformBounds(BBox & rs, const Matrix4 & m, const OrientedBox & box)
+		{
+			Matrix4 world;
+			BBox localBox;
+			GetBoxTransform(world, localBox, m, box);
+			TransformBounds(rs, world, localBox);
+		}
+
+		void TransformBounds(OrientedBox & rs, const Matrix4 & m, const BBox & box)
+		{
+			// the columns of m are the box axes scaled by their length
+			Vec3 c, e;
+			GetCenterExtents(box, c, e);
+			m.Transform(rs.Center, c);
+			Matrix4 rotation;
+			Matrix4::CreateIdentityMatrix(rotation);
+			float lengths[3];
+			for (int i = 0; i < 3; i++)
+			{
+				lengths[i] = sqrt(m.m[i][0]*m.m[i][0] + m.m[i][1]*m.m[i][1] + m.m[i][2]*m.m[i][2]);
+				for (int j = 0; j < 3; j++)
+					rotation.m[i][j] = m.m[i][j] / lengths[i];
+			}
+			// a mirroring m flips an axis, which the symmetric box does not notice
+			Vec3 x(rotation.m[0][0], rotation.m[0][1], rotation.m[0][2]);
+			Vec3 y(rotation.m[1][0], rotation.m[1][1], rotation.m[1][2]);
+			Vec3 z(rotation.m[2][0], rotation.m[2][1], rotation.m[2][2]), xy;
+			Vec3::Cross(xy, x, y);
+			if (Vec3::Dot(xy, z) < 0.0f)
+				for (int j = 0; j < 3; j++)
+					rotation.m[2][j] = -rotation.m[2][j];
+			Quat::FromMatrix(rs.Orientation, rotation);
+			rs.Extents = Vec3(e.x * lengths[0], e.y * lengths[1], e.z * lengths[2]);
+		}
+
+		void TransformBounds(OrientedBox & rs, const Matrix4 & m, const OrientedBox & box)
+		{
+			Matrix4 world;
+			BBox localBox;
+			GetBoxTransform(world, localBox, m, box);
+			TransformBounds(rs, world, localBox);
+		}
+
+		void TransformBounds(Sphere & rs, const Matrix4 & m, const Sphere & sphere)
+		{
+			float scale = 0.0f;
+			for (int i = 0; i < 3; i++)
+				scale = Math::Max(scale, m.m[i][0]*m.m[i][0] + m.m[i][1]*m.m[i][1] + m.m[i][2]*m.m[i][2]);
+			m.Transform(rs.Center, sphere.Center);
+			rs.Radius = sphere.Radius * sqrt(scale);
+		}
+
+		int CullBoxes(const Frustum & frustum, const Vec3 * centers, const Vec3 * extents, const Quat * orientations, int count, int * visible)
+		{
+			return GetSimdKernels().CullBoxes(frustum.Planes, 6, centers, extents, orientations, count, visible);
+		}
+
+		int CullSpheres(const Frustum & frustum, const Vec3 * centers, const float * radii, int count, int * visible)
+		{
+			return GetSimdKernels().CullSpheres(frustum.Planes, 6, centers, radii, count, visible);
+		}
+	}
+}
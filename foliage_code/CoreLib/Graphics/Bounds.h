@@ -0,0 +1,94 @@
+#ifndef CORE_LIB_GRAPHICS_BOUNDS_H
+#define CORE_LIB_GRAPHICS_BOUNDS_H
+
+#include "BBox.h"
+#include "../Quat.h"
+
+namespace CoreLib
+{
+	namespace Graphics
+	{
+		using namespace VectorMath;
+
+		// where the second volume of a test lies relative to the first; only Outside is
+		// something that can be skipped
+		enum class Containment
+		{
+			Outside, Intersects, Inside
+		};
+
+		struct Sphere
+		{
+			Vec3 Center;
+			float Radius;
+		};
+
+		// Orientation turns the box axes into place, see Quat::Transform
+		struct OrientedBox
+		{
+			Vec3 Center;
+			Vec3 Extents;
+			Quat Orientation;
+		};
+
+		struct Ray
+		{
+			Vec3 Origin;
+			Vec3 Direction;
+		};
+
+		// Planes (x, y, z, w) with unit normals pointing inside, so a point p is inside a
+		// plane if x*p.x + y*p.y + z*p.z + w >= 0. Order: left, right, bottom, top, near, far.
+		class Frustum
+		{
+		public:
+			Vec4 Planes[6];
+			// Planes of the clip volume of viewProjection (a world to clip space Matrix4). Clip
+			// space depth is [-1, 1] as in Matrix4::CreatePerspectiveMatrix, or [0, 1] as in
+			// Direct3D if zeroToOneDepth is set; a Direct3D matrix has the layout of a Matrix4.
+			static void FromMatrix(Frustum & rs, const Matrix4 & viewProjection, bool zeroToOneDepth = false);
+		};
+
+		// Frustum tests check the volume against each plane. Outside is exact for volumes
+		// behind one plane; volumes near the frustum corners may be reported as Intersects
+		// although they are outside, which is harmless for culling.
+		Containment Contains(const Frustum & frustum, const Vec3 & point);
+		Containment Contains(const Frustum & frustum, const Sphere & sphere);
+		Containment Contains(const Frustum & frustum, const BBox & box);
+		Containment Contains(const Frustum & frustum, const OrientedBox & box);
+
+		Containment Contains(const BBox & box, const Vec3 & point);
+		Containment Contains(const BBox & box, const BBox & other);
+		Containment Contains(const BBox & box, const Sphere & sphere);
+		Containment Contains(const Sphere & sphere, const Vec3 & point);
+		Containment Contains(const Sphere & sphere, const Sphere & other);
+		Containment Contains(const Sphere & sphere, const BBox & box);
+		Containment Contains(const OrientedBox & box, const Vec3 & point);
+		Containment Contains(const OrientedBox & box, const Sphere & sphere);
+
+		// Ray tests write the first hit, Origin + t * Direction with t >= 0, to t; t is 0 when
+		// the origin is inside.
+		bool Intersects(const Ray & ray, const BBox & box, float & t);
+		bool Intersects(const Ray & ray, const Sphere & sphere, float & t);
+		bool Intersects(const Ray & ray, const OrientedBox & box, float & t);
+
+		// Bounds of a volume after an affine transform. The box results are exact; the sphere
+		// radius grows with the largest scale of m. An oriented box result needs m to scale the
+		// box along its own axes only (any scale for a BBox, uniform scale for an OrientedBox).
+		void TransformBounds(BBox & rs, const Matrix4 & m, const BBox & box);
+		void TransformBounds(BBox & rs, const Matrix4 & m, const OrientedBox & box);
+		void TransformBounds(OrientedBox & rs, const Matrix4 & m, const BBox & box);
+		void TransformBounds(OrientedBox & rs, const Matrix4 & m, const OrientedBox & box);
+		void TransformBounds(Sphere & rs, const Matrix4 & m, const Sphere & sphere);
+
+		// Batch frustum culling over arrays, run by the SimdKernels of this cpu. Writes the
+		// indices of the volumes that are not Outside to visible, in order, and returns how many
+		// there are. Box i has center centers[i], half extents extents[i] and orientation
+		// orientations[i], or is axis aligned if orientations is null. Gives the same answers as
+		// Contains.
+		int CullBoxes(const Frustum & frustum, const Vec3 * centers, const Vec3 * extents, const Quat * orientations, int count, int * visible);
+		int CullSpheres(const Frustum & frustum, const Vec3 * centers, const float * radii, int count, int * visible);
+	}
+}
+
+#endif
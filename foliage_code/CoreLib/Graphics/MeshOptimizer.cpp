@@ -0,0 +1,356 @@
+#include "MeshOptimizer.h"
+#include "../Basic.h"
+#include <float.h>
+#include <math.h>
+
+using namespace CoreLib::Basic;
+
+namespace CoreLib
+{
+	namespace Graphics
+	{
+		// Counts the vertices of a triangle missing a FIFO cache. A vertex is in the cache while
+		// fewer than cacheSize others came in after it; time counts the vertices that came in.
+		static inline int CacheMisses(const unsigned int * triangle, unsigned int * timestamps, unsigned int & time, int cacheSize)
+		{
+			int misses = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = triangle[k];
+				if (time - timestamps[v] > (unsigned int)cacheSize)
+				{
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+			return misses;
+		}
+
+		VertexCacheStats AnalyzeVertexCache(const unsigned int * indices, int indexCount, int vertexCount, int cacheSize)
+		{
+			VertexCacheStats rs;
+			int triangleCount = indexCount / 3;
+			List<unsigned int> timestamps;
+			timestamps.SetSize(vertexCount);
+			memset(timestamps.Buffer(), 0, vertexCount * sizeof(unsigned int));
+			unsigned int time = cacheSize + 1;
+			int misses = 0;
+			for (int i = 0; i < triangleCount; i++)
+				misses += CacheMisses(indices + i * 3, timestamps.Buffer(), time, cacheSize);
+			// every used vertex missed at least once, so its timestamp is set
+			int usedVertices = 0;
+			for (int i = 0; i < vertexCount; i++)
+				if (timestamps[i])
+					usedVertices++;
+			rs.Acmr = triangleCount ? misses / (float)triangleCount : 0.0f;
+			rs.Atvr = usedVertices ? misses / (float)usedVertices : 0.0f;
+			return rs;
+		}
+
+		// Forsyth's vertex scores. The triangle just drawn scores a little less than the next
+		// cache entries, so strips turn rather than fan; vertices with few triangles left are
+		// boosted, so they are finished off before they leave the cache.
+		static const int ForsythCacheSize = 32;
+		static const int ForsythValenceTableSize = 32;
+
+		struct ForsythScores
+		{
+			float CachePosition[ForsythCacheSize];
+			float Valence[ForsythValenceTableSize];
+			ForsythScores()
+			{
+				for (int i = 0; i < ForsythCacheSize; i++)
+					CachePosition[i] = i < 3 ? 0.75f : powf(1.0f - (i - 3) / (float)(ForsythCacheSize - 3), 1.5f);
+				Valence[0] = 0.0f;
+				for (int i = 1; i < ForsythValenceTableSize; i++)
+					Valence[i] = 2.0f / sqrtf((float)i);
+			}
+			// cachePosition is -1 for vertices outside the cache
+			inline float Score(int cachePosition, int liveTriangles) const
+			{
+				if (liveTriangles == 0)
+					return -1.0f;
+				float score = cachePosition >= 0 ? CachePosition[cachePosition] : 0.0f;
+				return score + (liveTriangles < ForsythValenceTableSize ? Valence[liveTriangles] : 2.0f / sqrtf((float)liveTriangles));
+			}
+		};
+
+		void OptimizeVertexCache(unsigned int * rs, const unsigned int * indices, int indexCount, int vertexCount)
+		{
+			int triangleCount = indexCount / 3;
+			List<unsigned int> source;
+			source.AddRange(indices, triangleCount * 3);
+			const unsigned int * triangles = source.Buffer();
+			ForsythScores scores;
+
+			// triangles of each vertex, the ones not yet drawn first
+			List<int> liveTriangles, triangleStart, vertexTriangles;
+			liveTriangles.SetSize(vertexCount);
+			memset(liveTriangles.Buffer(), 0, vertexCount * sizeof(int));
+			for (int i = 0; i < triangleCount * 3; i++)
+				liveTriangles[triangles[i]]++;
+			triangleStart.SetSize(vertexCount + 1);
+			triangleStart[0] = 0;
+			for (int i = 0; i < vertexCount; i++)
+				triangleStart[i + 1] = triangleStart[i] + liveTriangles[i];
+			vertexTriangles.SetSize(triangleCount * 3);
+			List<int> fill;
+			fill.AddRange(triangleStart.Buffer(), vertexCount);
+			for (int i = 0; i < triangleCount * 3; i++)
+				vertexTriangles[fill[triangles[i]]++] = i / 3;
+
+			List<float> vertexScores, triangleScores;
+			vertexScores.SetSize(vertexCount);
+			for (int i = 0; i < vertexCount; i++)
+				vertexScores[i] = scores.Score(-1, liveTriangles[i]);
+			triangleScores.SetSize(triangleCount);
+			List<bool> drawn;
+			drawn.SetSize(triangleCount);
+			int best = -1;
+			for (int i = 0; i < triangleCount; i++)
+			{
+				triangleScores[i] = vertexScores[triangles[i * 3]] + vertexScores[triangles[i * 3 + 1]] + vertexScores[triangles[i * 3 + 2]];
+				drawn[i] = false;
+				if (best == -1 || triangleScores[i] > triangleScores[best])
+					best = i;
+			}
+
+			// LRU cache, with room for the three vertices pushed in before the rest move down
+			int cache[ForsythCacheSize + 3], newCache[ForsythCacheSize + 3];
+			int cacheCount = 0;
+			int nextUndrawn = 0;
+			for (int i = 0; i < triangleCount; i++)
+			{
+				// nothing in the cache has triangles left; carry on in input order
+				if (best == -1)
+				{
+					while (drawn[nextUndrawn])
+						nextUndrawn++;
+					best = nextUndrawn;
+				}
+				const unsigned int * triangle = triangles + best * 3;
+				rs[i * 3] = triangle[0];
+				rs[i * 3 + 1] = triangle[1];
+				rs[i * 3 + 2] = triangle[2];
+				drawn[best] = true;
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = triangle[k];
+					int * list = vertexTriangles.Buffer() + triangleStart[v];
+					int & live = liveTriangles[v];
+					for (int j = 0; j < live; j++)
+					{
+						if (list[j] == best)
+						{
+							list[j] = list[live - 1];
+							break;
+						}
+					}
+					live--;
+				}
+
+				int newCount = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = triangle[k];
+					if (k == 0 || (v != triangle[0] && (k == 1 || v != triangle[1])))
+						newCache[newCount++] = (int)v;
+				}
+				for (int j = 0; j < cacheCount; j++)
+				{
+					int v = cache[j];
+					if (v != (int)triangle[0] && v != (int)triangle[1] && v != (int)triangle[2])
+						newCache[newCount++] = v;
+				}
+
+				// rescore the vertices that moved; the ones pushed out lose their cache score
+				for (int j = 0; j < newCount; j++)
+				{
+					int v = newCache[j];
+					float score = scores.Score(j < ForsythCacheSize ? j : -1, liveTriangles[v]);
+					float delta = score - vertexScores[v];
+					vertexScores[v] = score;
+					const int * list = vertexTriangles.Buffer() + triangleStart[v];
+					for (int t = 0; t < liveTriangles[v]; t++)
+						triangleScores[list[t]] += delta;
+				}
+				cacheCount = Math::Min(newCount, ForsythCacheSize);
+				best = -1;
+				for (int j = 0; j < cacheCount; j++)
+				{
+					int v = newCache[j];
+					cache[j] = v;
+					const int * list = vertexTriangles.Buffer() + triangleStart[v];
+					for (int t = 0; t < liveTriangles[v]; t++)
+						if (best == -1 || triangleScores[list[t]] > triangleScores[best])
+							best = list[t];
+				}
+			}
+		}
+
+		static inline void GetTriangleGeometry(const float * positions, int stride, const unsigned int * triangle, float centroid[3], float normal[3])
+		{
+			const float * p0 = positions + triangle[0] * stride;
+			const float * p1 = positions + triangle[1] * stride;
+			const float * p2 = positions + triangle[2] * stride;
+			float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			// twice the area in length
+			normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+			for (int k = 0; k < 3; k++)
+				centroid[k] = (p0[k] + p1[k] + p2[k]) * (1.0f / 3.0f);
+		}
+
+		void OptimizeOverdraw(unsigned int * rs, const unsigned int * indices, int indexCount, const float * positions, int stride, int vertexCount, float threshold)
+		{
+			const int cacheSize = DefaultVertexCacheSize;
+			int triangleCount = indexCount / 3;
+			if (triangleCount == 0)
+				return;
+			List<unsigned int> source;
+			source.AddRange(indices, triangleCount * 3);
+			const unsigned int * triangles = source.Buffer();
+			List<unsigned int> timestamps;
+			timestamps.SetSize(vertexCount);
+			memset(timestamps.Buffer(), 0, vertexCount * sizeof(unsigned int));
+			unsigned int time = cacheSize + 1;
+
+			// the cache starts over where a triangle misses on all of its vertices
+			List<int> hardBoundaries;
+			for (int i = 0; i < triangleCount; i++)
+				if (CacheMisses(triangles + i * 3, timestamps.Buffer(), time, cacheSize) == 3 || i == 0)
+					hardBoundaries.Add(i);
+			hardBoundaries.Add(triangleCount);
+
+			// Within those, a cluster ends once its ACMR gets down to threshold times the ACMR of
+			// the whole stretch. The cache is flushed at each cluster start, since the clusters
+			// will be drawn in another order.
+			List<int> clusters;
+			for (int h = 0; h + 1 < hardBoundaries.Count(); h++)
+			{
+				int start = hardBoundaries[h], end = hardBoundaries[h + 1];
+				time += cacheSize + 1;
+				int misses = 0;
+				for (int i = start; i < end; i++)
+					misses += CacheMisses(triangles + i * 3, timestamps.Buffer(), time, cacheSize);
+				float target = threshold * misses / (end - start);
+				int firstCluster = clusters.Count();
+				clusters.Add(start);
+				time += cacheSize + 1;
+				misses = 0;
+				int faces = 0;
+				for (int i = start; i < end; i++)
+				{
+					misses += CacheMisses(triangles + i * 3, timestamps.Buffer(), time, cacheSize);
+					faces++;
+					if (misses <= target * faces)
+					{
+						if (i + 1 < end)
+							clusters.Add(i + 1);
+						time += cacheSize + 1;
+						misses = 0;
+						faces = 0;
+					}
+				}
+				// the last cluster never got down to the target, so it joins the one before
+				if (faces && clusters.Count() - 1 > firstCluster)
+					clusters.RemoveAt(clusters.Count() - 1);
+			}
+			int clusterCount = clusters.Count();
+			clusters.Add(triangleCount);
+
+			// clusters far from the middle of the mesh and facing away from it are likely to
+			// hide the others, so they go first
+			float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+			float meshArea = 0.0f;
+			List<float> clusterCentroids, clusterNormals, clusterAreas;
+			clusterCentroids.SetSize(clusterCount * 3);
+			clusterNormals.SetSize(clusterCount * 3);
+			clusterAreas.SetSize(clusterCount);
+			for (int c = 0; c < clusterCount; c++)
+			{
+				float * centroid = clusterCentroids.Buffer() + c * 3;
+				float * normal = clusterNormals.Buffer() + c * 3;
+				float area = 0.0f;
+				for (int k = 0; k < 3; k++)
+					centroid[k] = normal[k] = 0.0f;
+				for (int i = clusters[c]; i < clusters[c + 1]; i++)
+				{
+					float triangleCentroid[3], triangleNormal[3];
+					GetTriangleGeometry(positions, stride, triangles + i * 3, triangleCentroid, triangleNormal);
+					float triangleArea = sqrtf(triangleNormal[0] * triangleNormal[0] + triangleNormal[1] * triangleNormal[1] + triangleNormal[2] * triangleNormal[2]);
+					for (int k = 0; k < 3; k++)
+					{
+						centroid[k] += triangleCentroid[k] * triangleArea;
+						normal[k] += triangleNormal[k];
+					}
+					area += triangleArea;
+				}
+				for (int k = 0; k < 3; k++)
+					meshCentroid[k] += centroid[k];
+				meshArea += area;
+				clusterAreas[c] = area;
+			}
+			if (meshArea > 0.0f)
+			{
+				for (int k = 0; k < 3; k++)
+					meshCentroid[k] /= meshArea;
+			}
+			List<float> keys;
+			keys.SetSize(clusterCount);
+			for (int c = 0; c < clusterCount; c++)
+			{
+				const float * centroid = clusterCentroids.Buffer() + c * 3;
+				const float * normal = clusterNormals.Buffer() + c * 3;
+				float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+				keys[c] = 0.0f;
+				if (clusterAreas[c] > 0.0f && normalLength > 0.0f)
+				{
+					for (int k = 0; k < 3; k++)
+						keys[c] += (centroid[k] / clusterAreas[c] - meshCentroid[k]) * normal[k];
+					keys[c] /= normalLength;
+				}
+			}
+			List<int> order;
+			order.SetSize(clusterCount);
+			for (int c = 0; c < clusterCount; c++)
+				order[c] = c;
+			order.Sort([&](int & a, int & b) { return keys[a] > keys[b] || (keys[a] == keys[b] && a < b); });
+
+			int pos = 0;
+			for (int c = 0; c < clusterCount; c++)
+			{
+				int cluster = order[c];
+				int count = (clusters[cluster + 1] - clusters[cluster]) * 3;
+				memcpy(rs + pos, triangles + clusters[cluster] * 3, count * sizeof(unsigned int));
+				pos += count;
+			}
+		}
+
+		int OptimizeVertexFetch(void * vertices, unsigned int * indices, int indexCount, int vertexCount, int vertexSize)
+		{
+			List<int> remap;
+			remap.SetSize(vertexCount);
+			for (int i = 0; i < vertexCount; i++)
+				remap[i] = -1;
+			int newCount = 0;
+			for (int i = 0; i < indexCount; i++)
+			{
+				int & newIndex = remap[indices[i]];
+				if (newIndex == -1)
+					newIndex = newCount++;
+				indices[i] = newIndex;
+			}
+			List<unsigned char> reordered;
+			reordered.SetSize(newCount * vertexSize);
+			const unsigned char * source = (const unsigned char*)vertices;
+			for (int i = 0; i < vertexCount; i++)
+				if (remap[i] != -1)
+					memcpy(reordered.Buffer() + remap[i] * vertexSize, source + i * vertexSize, vertexSize);
+			memcpy(vertices, reordered.Buffer(), newCount * vertexSize);
+			return newCount;
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef CORE_LIB_GRAPHICS_MESH_OPTIMIZER_H
+#define CORE_LIB_GRAPHICS_MESH_OPTIMIZER_H
+
+namespace CoreLib
+{
+	namespace Graphics
+	{
+		// Post-transform vertex cache efficiency of a triangle list, on a FIFO cache
+		struct VertexCacheStats
+		{
+			// vertex shader runs per triangle (0.5 at best for large grids, 3 at worst)
+			float Acmr;
+			// vertex shader runs per vertex used (1 at best)
+			float Atvr;
+		};
+
+		const int DefaultVertexCacheSize = 16;
+
+		VertexCacheStats AnalyzeVertexCache(const unsigned int * indices, int indexCount, int vertexCount, int cacheSize = DefaultVertexCacheSize);
+
+		// Reorders the triangles of a triangle list for the post-transform vertex cache, using
+		// Forsyth's linear-speed vertex cache optimization. rs may be indices.
+		void OptimizeVertexCache(unsigned int * rs, const unsigned int * indices, int indexCount, int vertexCount);
+
+		// Reorders a triangle list optimized by OptimizeVertexCache to cut overdraw (Sander et
+		// al., Tipsify). The list is split into clusters wherever the cache restarts, as long as
+		// the ACMR grows by no more than threshold, and clusters facing away from the middle of
+		// the mesh are drawn first. Vertex i is at positions + i * stride; rs may be indices.
+		void OptimizeOverdraw(unsigned int * rs, const unsigned int * indices, int indexCount, const float * positions, int stride, int vertexCount, float threshold = 1.05f);
+
+		// Moves the vertices into the order the triangles first use them, for vertex fetch
+		// locality, and rewrites indices to match. Unused vertices are dropped; returns how
+		// many are left.
+		int OptimizeVertexFetch(void * vertices, unsigned int * indices, int indexCount, int vertexCount, int vertexSize);
+	}
+}
+
+#endif
@@ -0,0 +1,778 @@
+#include "MeshSimplifier.h"
+#include "../Basic.h"
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+
+using namespace CoreLib::Basic;
+
+namespace CoreLib
+{
+	namespace Graphics
+	{
+		// Sum of weighted squared errors as a function of position, p A p + 2 b p + c, with W the
+		// sum of the weights so that Evaluate / W is a weighted mean
+		struct Quadric
+		{
+			double A00, A11, A22, A01, A02, A12;
+			double B0, B1, B2;
+			double C;
+			double W;
+			void Clear()
+			{
+				memset(this, 0, sizeof(Quadric));
+			}
+			// squared distance to the plane n p + d = 0, n of unit length
+			void AddPlane(const double n[3], double d, double weight)
+			{
+				A00 += weight * n[0] * n[0];
+				A11 += weight * n[1] * n[1];
+				A22 += weight * n[2] * n[2];
+				A01 += weight * n[0] * n[1];
+				A02 += weight * n[0] * n[2];
+				A12 += weight * n[1] * n[2];
+				B0 += weight * n[0] * d;
+				B1 += weight * n[1] * d;
+				B2 += weight * n[2] * d;
+				C += weight * d * d;
+				W += weight;
+			}
+			void Add(const Quadric & q)
+			{
+				A00 += q.A00; A11 += q.A11; A22 += q.A22;
+				A01 += q.A01; A02 += q.A02; A12 += q.A12;
+				B0 += q.B0; B1 += q.B1; B2 += q.B2;
+				C += q.C;
+				W += q.W;
+			}
+			double Evaluate(const float p[3]) const
+			{
+				double x = p[0], y = p[1], z = p[2];
+				return A00 * x * x + A11 * y * y + A22 * z * z + 2.0 * (A01 * x * y + A02 * x * z + A12 * y * z) +
+					2.0 * (B0 * x + B1 * y + B2 * z) + C;
+			}
+		};
+
+		// What may happen to a position. A seam position has two vertices, one on each side of
+		// an attribute seam, and may only slide along the seam; a border position only along
+		// the border.
+		enum class SimplifyVertexKind
+		{
+			Manifold, Border, Seam, Locked
+		};
+
+		// Moves every vertex at one position onto the vertex at a neighbouring position that
+		// it shares a triangle with, so the vertices on both sides of a seam move together
+		struct EdgeCollapse
+		{
+			// welded positions
+			unsigned int Vertex, Target;
+			unsigned int Wedges[2], WedgeTargets[2];
+			int WedgeCount;
+			// error of the collapse with the attributes, for ordering, and without, to leave
+			// out collapses well past maxError
+			double Cost, Error;
+		};
+
+		struct SimplifyHalfEdge
+		{
+			// welded positions of the ends, from in the high bits
+			Int64 Key;
+			unsigned int From, To;
+		};
+
+		static inline void Cross(double rs[3], const double a[3], const double b[3])
+		{
+			rs[0] = a[1] * b[2] - a[2] * b[1];
+			rs[1] = a[2] * b[0] - a[0] * b[2];
+			rs[2] = a[0] * b[1] - a[1] * b[0];
+		}
+
+		static inline double Dot(const double a[3], const double b[3])
+		{
+			return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		}
+
+		static inline void Difference(double rs[3], const float * a, const float * b)
+		{
+			rs[0] = (double)a[0] - b[0];
+			rs[1] = (double)a[1] - b[1];
+			rs[2] = (double)a[2] - b[2];
+		}
+
+		static inline Int64 EdgeKey(unsigned int from, unsigned int to)
+		{
+			return ((Int64)from << 32) | to;
+		}
+
+		// first half-edge with the key in the sorted list, or -1
+		static int FindHalfEdge(const List<SimplifyHalfEdge> & halfEdges, Int64 key)
+		{
+			int imin = 0, imax = halfEdges.Count();
+			while (imin < imax)
+			{
+				int imid = (imin + imax) >> 1;
+				if (halfEdges[imid].Key < key)
+					imin = imid + 1;
+				else
+					imax = imid;
+			}
+			return imin < halfEdges.Count() && halfEdges[imin].Key == key ? imin : -1;
+		}
+
+		// Squared error of moving a vertex with attributes s to p. The attribute quadric holds the
+		// terms of (g p + gw)^2 for the gradients (g, gw) of the attributes on each triangle; the
+		// gradients summed with their weights are in gradients.
+		static double AttributeError(const Quadric & attributeQuadric, const double * gradients, const float * p, const float * s, int attributeCount)
+		{
+			double error = attributeQuadric.Evaluate(p);
+			for (int k = 0; k < attributeCount; k++)
+			{
+				const double * g = gradients + k * 4;
+				error += attributeQuadric.W * s[k] * s[k] - 2.0 * s[k] * (g[0] * p[0] + g[1] * p[1] + g[2] * p[2] + g[3]);
+			}
+			return error;
+		}
+
+		// distance of p from the segment ab
+		static double SegmentDistance(const float * p, const float * a, const float * b)
+		{
+			double ab[3], ap[3];
+			Difference(ab, b, a);
+			Difference(ap, p, a);
+			double length = Dot(ab, ab);
+			double t = length > 0.0 ? Math::Clamp(Dot(ap, ab) / length, 0.0, 1.0) : 0.0;
+			for (int c = 0; c < 3; c++)
+				ap[c] -= ab[c] * t;
+			return sqrt(Dot(ap, ap));
+		}
+
+		// The triangles with their vertices welded by position, and the live triangles around
+		// each vertex, rebuilt every pass
+		struct SimplifyTopology
+		{
+			List<unsigned int> Triangles;
+			List<int> Weld;
+			// the vertices at each position, linked in a ring
+			List<unsigned int> WedgeNext;
+			List<int> TriangleCount, TriangleStart, VertexTriangles;
+			// neighbour marks for the link condition
+			List<int> Marks;
+			int Stamp;
+
+			void Build(int vertexCount)
+			{
+				TriangleCount.SetSize(vertexCount);
+				TriangleStart.SetSize(vertexCount + 1);
+				memset(TriangleCount.Buffer(), 0, vertexCount * sizeof(int));
+				for (int i = 0; i < Triangles.Count(); i++)
+					TriangleCount[Triangles[i]]++;
+				TriangleStart[0] = 0;
+				for (int i = 0; i < vertexCount; i++)
+					TriangleStart[i + 1] = TriangleStart[i] + TriangleCount[i];
+				VertexTriangles.SetSize(Triangles.Count());
+				List<int> fill;
+				fill.AddRange(TriangleStart.Buffer(), vertexCount);
+				for (int i = 0; i < Triangles.Count(); i++)
+					VertexTriangles[fill[Triangles[i]]++] = i / 3;
+			}
+
+			const unsigned int * Triangle(int i) const
+			{
+				return Triangles.Buffer() + i * 3;
+			}
+
+			// Pairs every live vertex at the collapsing position with the vertex at the target
+			// position on its triangles. Fails when a vertex has no triangle on the edge, or
+			// reaches the target through different vertices.
+			bool MapWedges(EdgeCollapse & collapse) const
+			{
+				collapse.WedgeCount = 0;
+				unsigned int w = collapse.Vertex;
+				do
+				{
+					if (TriangleCount[w])
+					{
+						unsigned int target = UINT_MAX;
+						for (int i = 0; i < TriangleCount[w]; i++)
+						{
+							const unsigned int * triangle = Triangle(VertexTriangles[TriangleStart[w] + i]);
+							for (int k = 0; k < 3; k++)
+							{
+								if ((unsigned int)Weld[triangle[k]] != collapse.Target)
+									continue;
+								if (target != UINT_MAX && target != triangle[k])
+									return false;
+								target = triangle[k];
+							}
+						}
+						if (target == UINT_MAX || collapse.WedgeCount == 2)
+							return false;
+						collapse.Wedges[collapse.WedgeCount] = w;
+						collapse.WedgeTargets[collapse.WedgeCount] = target;
+						collapse.WedgeCount++;
+					}
+					w = WedgeNext[w];
+				} while (w != collapse.Vertex);
+				return collapse.WedgeCount > 0;
+			}
+
+			// Link condition: the positions next to both ends must be exactly those across the
+			// triangles on the edge, or the collapse would fold the surface onto itself or close
+			// a hole. shared is set to the number of triangles on the edge, which the collapse
+			// removes.
+			bool LinkHolds(const EdgeCollapse & collapse, int & shared)
+			{
+				Stamp += 2;
+				shared = 0;
+				for (int j = 0; j < collapse.WedgeCount; j++)
+				{
+					unsigned int w = collapse.Wedges[j];
+					for (int i = 0; i < TriangleCount[w]; i++)
+					{
+						const unsigned int * triangle = Triangle(VertexTriangles[TriangleStart[w] + i]);
+						bool onEdge = false;
+						for (int k = 0; k < 3; k++)
+						{
+							int p = Weld[triangle[k]];
+							if ((unsigned int)p == collapse.Target)
+								onEdge = true;
+							else if ((unsigned int)p != collapse.Vertex)
+								Marks[p] = Stamp;
+						}
+						if (onEdge)
+							shared++;
+					}
+				}
+				int common = 0;
+				unsigned int t = collapse.Target;
+				do
+				{
+					for (int i = 0; i < TriangleCount[t]; i++)
+					{
+						const unsigned int * triangle = Triangle(VertexTriangles[TriangleStart[t] + i]);
+						for (int k = 0; k < 3; k++)
+						{
+							int p = Weld[triangle[k]];
+							if (Marks[p] == Stamp)
+							{
+								Marks[p] = Stamp + 1;
+								common++;
+							}
+						}
+					}
+					t = WedgeNext[t];
+				} while (t != collapse.Target);
+				if (shared == 0 || common != shared)
+					return false;
+				// a triangle that stays between the two across the edge would lie on one already there,
+				// as when a tetrahedron collapses
+				for (int j = 0; j < collapse.WedgeCount; j++)
+				{
+					unsigned int w = collapse.Wedges[j];
+					for (int i = 0; i < TriangleCount[w]; i++)
+					{
+						const unsigned int * triangle = Triangle(VertexTriangles[TriangleStart[w] + i]);
+						int across = 0;
+						for (int k = 0; k < 3; k++)
+						{
+							if (Marks[Weld[triangle[k]]] == Stamp + 1)
+								across++;
+						}
+						if (across == 2)
+							return false;
+					}
+				}
+				return true;
+			}
+
+			// Whether the collapse turns over any triangle that stays, and how far it moves the
+			// surface: the distance of the target from the planes of the triangles before, and
+			// of the collapsing position from the planes after
+			bool Flips(const EdgeCollapse & collapse, const float * positions, double & distance) const
+			{
+				const float * pv = positions + collapse.Vertex * 3;
+				const float * pt = positions + collapse.Target * 3;
+				double move[3];
+				Difference(move, pt, pv);
+				distance = 0.0;
+				for (int j = 0; j < collapse.WedgeCount; j++)
+				{
+					unsigned int w = collapse.Wedges[j];
+					for (int i = 0; i < TriangleCount[w]; i++)
+					{
+						const unsigned int * triangle = Triangle(VertexTriangles[TriangleStart[w] + i]);
+						int k = triangle[0] == w ? 0 : triangle[1] == w ? 1 : 2;
+						unsigned int a = triangle[(k + 1) % 3], b = triangle[(k + 2) % 3];
+						if ((unsigned int)Weld[a] == collapse.Target || (unsigned int)Weld[b] == collapse.Target)
+							continue;
+						double ea[3], eb[3], before[3], after[3];
+						Difference(ea, positions + a * 3, pv);
+						Difference(eb, positions + b * 3, pv);
+						Cross(before, ea, eb);
+						Difference(ea, positions + a * 3, pt);
+						Difference(eb, positions + b * 3, pt);
+						Cross(after, ea, eb);
+						double lengthBefore = sqrt(Dot(before, before)), lengthAfter = sqrt(Dot(after, after));
+						// also rejects triangles turned by more than about 75 degrees
+						if (Dot(before, after) <= 0.25 * lengthBefore * lengthAfter)
+							return true;
+						if (lengthBefore > 0.0)
+							distance = Math::Max(distance, fabs(Dot(before, move)) / lengthBefore);
+						distance = Math::Max(distance, fabs(Dot(after, move)) / lengthAfter);
+					}
+				}
+				return false;
+			}
+		};
+
+		// Border edges pull at ten times the weight of the triangles next to them. A seam lies
+		// inside the surface, whose planes already hold it across, so its edges pull only as much
+		// as a triangle, enough to keep the seam from sliding sideways along a flat surface.
+		static const double BorderWeight = 10.0;
+		static const double SeamWeight = 1.0;
+
+		int SimplifyMesh(unsigned int * rs, const unsigned int * indices, int indexCount, const float * vertices, int stride, int vertexCount,
+			int attributeCount, const float * attributeWeights, int targetIndexCount, float maxError, float & error)
+		{
+			if (attributeCount > MaxSimplifyAttributes)
+				throw ArgumentException(L"SimplifyMesh: too many vertex attributes.");
+			error = 0.0f;
+			SimplifyTopology topology;
+			List<unsigned int> & triangles = topology.Triangles;
+			triangles.AddRange(indices, indexCount / 3 * 3);
+			if (triangles.Count() <= targetIndexCount)
+			{
+				memmove(rs, triangles.Buffer(), triangles.Count() * sizeof(unsigned int));
+				return triangles.Count();
+			}
+
+			// positions in units of the mesh size, and weighted attributes
+			List<bool> used;
+			used.SetSize(vertexCount);
+			memset(used.Buffer(), 0, vertexCount * sizeof(bool));
+			float minPos[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, maxPos[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+			for (int i = 0; i < triangles.Count(); i++)
+			{
+				unsigned int v = triangles[i];
+				used[v] = true;
+				const float * p = vertices + v * stride;
+				for (int c = 0; c < 3; c++)
+				{
+					minPos[c] = Math::Min(minPos[c], p[c]);
+					maxPos[c] = Math::Max(maxPos[c], p[c]);
+				}
+			}
+			float scale = Math::Max(maxPos[0] - minPos[0], Math::Max(maxPos[1] - minPos[1], maxPos[2] - minPos[2]));
+			float invScale = scale > 0.0f ? 1.0f / scale : 0.0f;
+			List<float> positions, attributes;
+			positions.SetSize(vertexCount * 3);
+			attributes.SetSize(vertexCount * attributeCount);
+			for (int i = 0; i < vertexCount; i++)
+			{
+				const float * p = vertices + i * stride;
+				for (int c = 0; c < 3; c++)
+					positions[i * 3 + c] = (p[c] - minPos[c]) * invScale;
+				for (int k = 0; k < attributeCount; k++)
+					attributes[i * attributeCount + k] = p[3 + k] * attributeWeights[k];
+			}
+
+			// vertices at the same position are welded for the topology, onto the first of them;
+			// there is more than one where the attributes have a seam
+			List<int> & weld = topology.Weld;
+			List<unsigned int> & wedgeNext = topology.WedgeNext;
+			List<int> order, wedgeCount;
+			weld.SetSize(vertexCount);
+			wedgeNext.SetSize(vertexCount);
+			wedgeCount.SetSize(vertexCount);
+			for (int i = 0; i < vertexCount; i++)
+			{
+				weld[i] = i;
+				wedgeNext[i] = i;
+				wedgeCount[i] = 0;
+				if (used[i])
+					order.Add(i);
+			}
+			order.Sort([&](int a, int b)
+			{
+				const float * pa = vertices + a * stride;
+				const float * pb = vertices + b * stride;
+				for (int c = 0; c < 3; c++)
+					if (pa[c] != pb[c])
+						return pa[c] < pb[c];
+				return a < b;
+			});
+			auto samePosition = [&](int a, int b)
+			{
+				const float * pa = vertices + a * stride;
+				const float * pb = vertices + b * stride;
+				return pa[0] == pb[0] && pa[1] == pb[1] && pa[2] == pb[2];
+			};
+			for (int i = 0, first = 0; i < order.Count(); i++)
+			{
+				if (i > 0 && !samePosition(order[i - 1], order[i]))
+					first = i;
+				weld[order[i]] = order[first];
+				wedgeCount[order[first]]++;
+				bool last = i + 1 == order.Count() || !samePosition(order[i], order[i + 1]);
+				wedgeNext[order[i]] = last ? order[first] : order[i + 1];
+			}
+
+			// A border edge has no twin running the other way; a border position may only
+			// collapse along its two border edges, and is locked if it has more. An edge is on a
+			// seam when its twin uses other vertices; a seam position may only collapse along
+			// its two seam edges, and is locked where seams meet. A position with one vertex
+			// where a seam ends, or around a pole whose vertices all differ, collapses freely but
+			// is held in place by its seam edge planes.
+			List<SimplifyHalfEdge> halfEdges;
+			halfEdges.SetSize(triangles.Count());
+			for (int i = 0; i < triangles.Count(); i++)
+			{
+				SimplifyHalfEdge & halfEdge = halfEdges[i];
+				halfEdge.From = triangles[i];
+				halfEdge.To = triangles[i % 3 == 2 ? i - 2 : i + 1];
+				halfEdge.Key = EdgeKey(weld[halfEdge.From], weld[halfEdge.To]);
+			}
+			halfEdges.Sort([](const SimplifyHalfEdge & e1, const SimplifyHalfEdge & e2)
+			{
+				if (e1.Key != e2.Key)
+					return e1.Key < e2.Key;
+				return e1.From != e2.From ? e1.From < e2.From : e1.To < e2.To;
+			});
+			List<SimplifyVertexKind> kinds;
+			List<int> borderNext, borderPrev, seamNeighbours, seamCount;
+			kinds.SetSize(vertexCount);
+			borderNext.SetSize(vertexCount);
+			borderPrev.SetSize(vertexCount);
+			seamNeighbours.SetSize(vertexCount * 2);
+			seamCount.SetSize(vertexCount);
+			for (int i = 0; i < vertexCount; i++)
+			{
+				kinds[i] = SimplifyVertexKind::Manifold;
+				borderNext[i] = borderPrev[i] = -1;
+				seamNeighbours[i * 2] = seamNeighbours[i * 2 + 1] = -1;
+				seamCount[i] = 0;
+			}
+			for (int i = 0; i < halfEdges.Count(); i++)
+			{
+				const SimplifyHalfEdge & halfEdge = halfEdges[i];
+				unsigned int from = (unsigned int)(halfEdge.Key >> 32), to = (unsigned int)halfEdge.Key;
+				if (from == to)
+					continue;
+				if (i > 0 && halfEdges[i - 1].Key == halfEdge.Key)
+				{
+					// an edge shared by more than two triangles
+					kinds[from] = kinds[to] = SimplifyVertexKind::Locked;
+					continue;
+				}
+				int twin = FindHalfEdge(halfEdges, EdgeKey(to, from));
+				if (twin == -1)
+				{
+					if (borderNext[from] != -1 || borderPrev[to] != -1)
+						kinds[from] = kinds[to] = SimplifyVertexKind::Locked;
+					borderNext[from] = to;
+					borderPrev[to] = from;
+				}
+				else if (from < to && (halfEdges[twin].From != halfEdge.To || halfEdges[twin].To != halfEdge.From))
+				{
+					unsigned int ends[2] = {from, to};
+					for (int k = 0; k < 2; k++)
+					{
+						if (seamCount[ends[k]] < 2)
+							seamNeighbours[ends[k] * 2 + seamCount[ends[k]]] = ends[1 - k];
+						seamCount[ends[k]]++;
+					}
+				}
+			}
+			for (int i = 0; i < order.Count(); i++)
+			{
+				int p = order[i];
+				if (weld[p] != p || kinds[p] == SimplifyVertexKind::Locked)
+					continue;
+				if (borderNext[p] != -1 || borderPrev[p] != -1)
+					kinds[p] = borderNext[p] != -1 && borderPrev[p] != -1 && wedgeCount[p] == 1 ? SimplifyVertexKind::Border : SimplifyVertexKind::Locked;
+				else if (seamCount[p] == 2 && wedgeCount[p] == 2)
+					kinds[p] = SimplifyVertexKind::Seam;
+				else if (wedgeCount[p] != 1)
+					kinds[p] = SimplifyVertexKind::Locked;
+			}
+
+			// quadrics of the triangle planes and the border and seam edges for each position, and
+			// of the attribute gradients for each vertex, weighted by area
+			List<Quadric> geometry, attributeQuadrics;
+			List<double> gradients;
+			geometry.SetSize(vertexCount);
+			attributeQuadrics.SetSize(vertexCount);
+			gradients.SetSize(vertexCount * attributeCount * 4);
+			for (int i = 0; i < vertexCount; i++)
+			{
+				geometry[i].Clear();
+				attributeQuadrics[i].Clear();
+			}
+			if (attributeCount)
+				memset(gradients.Buffer(), 0, gradients.Count() * sizeof(double));
+			for (int i = 0; i < triangles.Count(); i += 3)
+			{
+				const unsigned int * triangle = triangles.Buffer() + i;
+				const float * p0 = positions.Buffer() + triangle[0] * 3;
+				const float * p1 = positions.Buffer() + triangle[1] * 3;
+				const float * p2 = positions.Buffer() + triangle[2] * 3;
+				double e1[3], e2[3], normal[3];
+				Difference(e1, p1, p0);
+				Difference(e2, p2, p0);
+				Cross(normal, e1, e2);
+				double length = sqrt(Dot(normal, normal));
+				if (length == 0.0)
+					continue;
+				double area = length * 0.5;
+				normal[0] /= length; normal[1] /= length; normal[2] /= length;
+				Quadric plane;
+				plane.Clear();
+				plane.AddPlane(normal, -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]), area);
+
+				// the gradient of a linear attribute over the triangle, from its barycentric
+				// coordinates; it lies in the triangle plane
+				Quadric attributeQuadric;
+				attributeQuadric.Clear();
+				attributeQuadric.W = area;
+				double d11 = Dot(e1, e1), d12 = Dot(e1, e2), d22 = Dot(e2, e2);
+				double invDenom = 1.0 / (d11 * d22 - d12 * d12);
+				double gradientU[3], gradientV[3];
+				for (int c = 0; c < 3; c++)
+				{
+					gradientU[c] = (d22 * e1[c] - d12 * e2[c]) * invDenom;
+					gradientV[c] = (d11 * e2[c] - d12 * e1[c]) * invDenom;
+				}
+				double triangleGradients[MaxSimplifyAttributes][4];
+				for (int k = 0; k < attributeCount; k++)
+				{
+					double a0 = attributes[triangle[0] * attributeCount + k];
+					double a1 = attributes[triangle[1] * attributeCount + k];
+					double a2 = attributes[triangle[2] * attributeCount + k];
+					double * g = triangleGradients[k];
+					for (int c = 0; c < 3; c++)
+						g[c] = gradientU[c] * (a1 - a0) + gradientV[c] * (a2 - a0);
+					g[3] = a0 - (g[0] * p0[0] + g[1] * p0[1] + g[2] * p0[2]);
+					attributeQuadric.A00 += area * g[0] * g[0];
+					attributeQuadric.A11 += area * g[1] * g[1];
+					attributeQuadric.A22 += area * g[2] * g[2];
+					attributeQuadric.A01 += area * g[0] * g[1];
+					attributeQuadric.A02 += area * g[0] * g[2];
+					attributeQuadric.A12 += area * g[1] * g[2];
+					attributeQuadric.B0 += area * g[0] * g[3];
+					attributeQuadric.B1 += area * g[1] * g[3];
+					attributeQuadric.B2 += area * g[2] * g[3];
+					attributeQuadric.C += area * g[3] * g[3];
+				}
+
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = triangle[k];
+					geometry[weld[v]].Add(plane);
+					attributeQuadrics[v].Add(attributeQuadric);
+					double * vertexGradients = gradients.Buffer() + v * attributeCount * 4;
+					for (int j = 0; j < attributeCount * 4; j++)
+						vertexGradients[j] += area * triangleGradients[j / 4][j % 4];
+
+					// a plane through a border or seam edge, upright on the triangle, holds the
+					// outline and the seam in place
+					unsigned int next = triangle[(k + 1) % 3];
+					bool onBorder = borderNext[weld[v]] == weld[next], onSeam = false;
+					if (!onBorder && weld[v] != weld[next])
+					{
+						int twin = FindHalfEdge(halfEdges, EdgeKey(weld[next], weld[v]));
+						onSeam = twin != -1 && (halfEdges[twin].From != next || halfEdges[twin].To != v);
+					}
+					if (onBorder || onSeam)
+					{
+						double edge[3], edgeNormal[3];
+						Difference(edge, positions.Buffer() + next * 3, positions.Buffer() + v * 3);
+						Cross(edgeNormal, edge, normal);
+						double edgeLength = sqrt(Dot(edgeNormal, edgeNormal));
+						if (edgeLength == 0.0)
+							continue;
+						for (int c = 0; c < 3; c++)
+							edgeNormal[c] /= edgeLength;
+						const float * pv = positions.Buffer() + v * 3;
+						Quadric edgePlane;
+						edgePlane.Clear();
+						edgePlane.AddPlane(edgeNormal, -(edgeNormal[0] * pv[0] + edgeNormal[1] * pv[1] + edgeNormal[2] * pv[2]),
+							edgeLength * edgeLength * (onBorder ? BorderWeight : SeamWeight));
+						geometry[weld[v]].Add(edgePlane);
+						geometry[weld[next]].Add(edgePlane);
+					}
+				}
+			}
+
+			// Collapse in passes: rank the edges, collapse the cheapest whose neighbourhoods do
+			// not overlap, then rebuild the triangle list. distances bounds how far the surface
+			// around each position has moved from the input, and the collapses that would take it
+			// past maxError are left out.
+			double maxDistance = maxError == FLT_MAX || scale == 0.0f ? DBL_MAX : (double)maxError * invScale;
+			double maxSquaredError = maxDistance == DBL_MAX ? DBL_MAX : maxDistance * maxDistance;
+			double resultError = 0.0;
+			List<EdgeCollapse> collapses;
+			List<unsigned int> collapseTarget;
+			List<bool> locked;
+			List<double> distances;
+			collapseTarget.SetSize(vertexCount);
+			locked.SetSize(vertexCount);
+			distances.SetSize(vertexCount);
+			topology.Marks.SetSize(vertexCount);
+			for (int i = 0; i < vertexCount; i++)
+			{
+				distances[i] = 0.0;
+				topology.Marks[i] = 0;
+			}
+			topology.Stamp = 0;
+			while (triangles.Count() > targetIndexCount)
+			{
+				int triangleCount = triangles.Count() / 3;
+				topology.Build(vertexCount);
+
+				// the cheaper way to collapse each edge; edges inside the mesh come up twice
+				collapses.Clear();
+				for (int i = 0; i < triangles.Count(); i++)
+				{
+					unsigned int a = weld[triangles[i]], b = weld[triangles[i % 3 == 2 ? i - 2 : i + 1]];
+					EdgeCollapse best;
+					best.Cost = DBL_MAX;
+					for (int d = 0; d < 2; d++)
+					{
+						EdgeCollapse collapse;
+						collapse.Vertex = d ? b : a;
+						collapse.Target = d ? a : b;
+						int v = collapse.Vertex, t = collapse.Target;
+						SimplifyVertexKind kind = kinds[v];
+						if (kind == SimplifyVertexKind::Locked)
+							continue;
+						if (kind == SimplifyVertexKind::Border && borderNext[v] != t && borderPrev[v] != t)
+							continue;
+						if (kind == SimplifyVertexKind::Seam && seamNeighbours[v * 2] != t && seamNeighbours[v * 2 + 1] != t)
+							continue;
+						if (!topology.MapWedges(collapse))
+							continue;
+						const float * p = positions.Buffer() + t * 3;
+						double geometryError = geometry[v].Evaluate(p);
+						double attributeError = 0.0;
+						for (int j = 0; j < collapse.WedgeCount; j++)
+						{
+							unsigned int w = collapse.Wedges[j];
+							attributeError += AttributeError(attributeQuadrics[w], gradients.Buffer() + w * attributeCount * 4, p,
+								attributes.Buffer() + collapse.WedgeTargets[j] * attributeCount, attributeCount);
+						}
+						double invWeight = geometry[v].W > 0.0 ? 1.0 / geometry[v].W : 0.0;
+						collapse.Error = Math::Max(geometryError * invWeight, 0.0);
+						collapse.Cost = Math::Max((geometryError + attributeError) * invWeight, 0.0);
+						if (collapse.Cost < best.Cost)
+							best = collapse;
+					}
+					if (best.Cost != DBL_MAX && best.Error <= maxSquaredError)
+						collapses.Add(best);
+				}
+				collapses.Sort([](const EdgeCollapse & c1, const EdgeCollapse & c2)
+				{
+					if (c1.Cost != c2.Cost)
+						return c1.Cost < c2.Cost;
+					return c1.Vertex != c2.Vertex ? c1.Vertex < c2.Vertex : c1.Target < c2.Target;
+				});
+
+				int goal = triangleCount - targetIndexCount / 3;
+				int removed = 0;
+				for (int i = 0; i < vertexCount; i++)
+				{
+					collapseTarget[i] = i;
+					locked[i] = false;
+				}
+				for (int i = 0; i < collapses.Count() && removed < goal; i++)
+				{
+					const EdgeCollapse & collapse = collapses[i];
+					unsigned int v = collapse.Vertex, t = collapse.Target;
+					if (locked[v] || locked[t])
+						continue;
+					int shared;
+					double distance;
+					if (!topology.LinkHolds(collapse, shared) || topology.Flips(collapse, positions.Buffer(), distance))
+						continue;
+					// the border stays within the distance of v from the border edge that replaces its two
+					int prev = -1, next = -1;
+					if (kinds[v] == SimplifyVertexKind::Border)
+					{
+						prev = borderNext[v] == (int)t ? borderPrev[v] : (int)t;
+						next = borderNext[v] == (int)t ? (int)t : borderNext[v];
+						distance = Math::Max(distance, SegmentDistance(positions.Buffer() + v * 3, positions.Buffer() + prev * 3, positions.Buffer() + next * 3));
+					}
+					// the triangles around v lay within distances[v] of the input
+					distance += distances[v];
+					if (distance > maxDistance)
+						continue;
+
+					for (int j = 0; j < collapse.WedgeCount; j++)
+					{
+						unsigned int w = collapse.Wedges[j], target = collapse.WedgeTargets[j];
+						collapseTarget[w] = target;
+						attributeQuadrics[target].Add(attributeQuadrics[w]);
+						double * targetGradients = gradients.Buffer() + target * attributeCount * 4;
+						const double * vertexGradients = gradients.Buffer() + w * attributeCount * 4;
+						for (int k = 0; k < attributeCount * 4; k++)
+							targetGradients[k] += vertexGradients[k];
+					}
+					geometry[t].Add(geometry[v]);
+					if (kinds[v] == SimplifyVertexKind::Border)
+					{
+						borderNext[prev] = next;
+						borderPrev[next] = prev;
+					}
+					else if (kinds[v] == SimplifyVertexKind::Seam)
+					{
+						// t takes the place of v on the seam
+						int other = seamNeighbours[v * 2] == (int)t ? seamNeighbours[v * 2 + 1] : seamNeighbours[v * 2];
+						for (int k = 0; k < 2; k++)
+						{
+							if (seamNeighbours[t * 2 + k] == (int)v)
+								seamNeighbours[t * 2 + k] = other;
+							if (seamNeighbours[other * 2 + k] == (int)v)
+								seamNeighbours[other * 2 + k] = t;
+						}
+					}
+					resultError = Math::Max(resultError, distance);
+					removed += shared;
+					// the triangles around v change shape, so nothing else may move them this pass
+					for (int j = 0; j < collapse.WedgeCount; j++)
+					{
+						unsigned int w = collapse.Wedges[j];
+						for (int k = 0; k < topology.TriangleCount[w]; k++)
+						{
+							const unsigned int * triangle = topology.Triangle(topology.VertexTriangles[topology.TriangleStart[w] + k]);
+							for (int c = 0; c < 3; c++)
+							{
+								int p = weld[triangle[c]];
+								locked[p] = true;
+								distances[p] = Math::Max(distances[p], distance);
+							}
+						}
+					}
+				}
+				if (removed == 0)
+					break;
+
+				int count = 0;
+				for (int i = 0; i < triangles.Count(); i += 3)
+				{
+					unsigned int a = collapseTarget[triangles[i]], b = collapseTarget[triangles[i + 1]], c = collapseTarget[triangles[i + 2]];
+					if (weld[a] != weld[b] && weld[b] != weld[c] && weld[a] != weld[c])
+					{
+						triangles[count++] = a;
+						triangles[count++] = b;
+						triangles[count++] = c;
+					}
+				}
+				triangles.SetSize(count);
+			}
+
+			memcpy(rs, triangles.Buffer(), triangles.Count() * sizeof(unsigned int));
+			error = (float)resultError * scale;
+			return triangles.Count();
+		}
+	}
+}
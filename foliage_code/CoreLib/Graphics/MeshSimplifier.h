@@ -0,0 +1,35 @@
+#ifndef CORE_LIB_GRAPHICS_MESH_SIMPLIFIER_H
+#define CORE_LIB_GRAPHICS_MESH_SIMPLIFIER_H
+
+namespace CoreLib
+{
+	namespace Graphics
+	{
+		const int MaxSimplifyAttributes = 8;
+
+		// Simplifies a triangle list by collapsing edges onto one of their vertices, cheapest
+		// first by the quadric error metric (Garland and Heckbert) with the attribute terms of
+		// Hoppe. Only the indices change, so the result draws from the same vertex buffer.
+		//
+		// Vertex i is at vertices + i * stride: a position, then attributeCount floats (normals,
+		// texture coordinates), each scaled by its weight in attributeWeights before the error is
+		// measured. Positions are measured in units of the mesh size, so an attribute weight of 1
+		// makes an attribute error of 1 cost as much as moving across the whole mesh.
+		//
+		// Vertices at the same position collapse together, so attribute seams (vertices that share
+		// a position but not their attributes) stay closed and only slide along themselves. Open
+		// borders only collapse along themselves too, and both are weighted against moving
+		// sideways. Corners of borders and places where seams meet are kept, and no collapse may
+		// fold the surface or close a hole, so the outline and the texture layout of the mesh hold.
+		//
+		// Stops at targetIndexCount indices, or when every collapse left would move the surface
+		// by more than maxError in model units. Writes the result to rs (which may be indices)
+		// and returns its index count; error is set to a bound on how far the surface moved, in
+		// model units, measured from the planes of the triangles around each collapse and summed
+		// where collapses follow one another.
+		int SimplifyMesh(unsigned int * rs, const unsigned int * indices, int indexCount, const float * vertices, int stride, int vertexCount,
+			int attributeCount, const float * attributeWeights, int targetIndexCount, float maxError, float & error);
+	}
+}
+
+#endif
@@ -1,7 +1,16 @@
 #include "ObjModel.h"
 #include "../LibIO.h"
 #include "../SecureCRT.h"
+#include "../Stream.h"
+#include "../ThreadPool.h"
+#include <float.h>
 #include <map>
+#include <mutex>
+#ifdef WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 using namespace CoreLib::Basic;
 using namespace CoreLib::IO;
 using namespace VectorMath;
@@ -33,10 +42,8 @@ namespace CoreLib
 
 #ifdef _MSC_VER
 #define SafeScan fscanf_s
-#define SafeSScan sscanf_s
 #else
 #define SafeScan fscanf
-#define SafeSScan sscanf
 #endif
 
 		void LoadObjMaterialLib(ObjModel & mdl, const String & filename, Dictionary<String, int> & matLookup);
@@ -56,194 +63,786 @@ namespace CoreLib
 				end--;
 			return name.SubString(pos, end-pos+1);
 		}
-		bool LoadObj(ObjModel & mdl, const char * fileName, PolygonType polygonType)
+		// copies src to dest element by element, as the vector types are not trivially copyable
+		template<typename T>
+		static void CopyElements(T * dest, const List<T> & src)
 		{
-			FILE * f = 0;
-			fopen_s(&f, fileName, "rt");
-			if (f == 0)
+			for (int i = 0; i < src.Count(); i++)
+				dest[i] = src[i];
+		}
+
+		enum class ObjStateKind
+		{
+			SmoothGroup, Material, Library
+		};
+
+		// An s, usemtl or mtllib line. These change the state of the faces after them, so they
+		// are applied in file order once every chunk is parsed.
+		struct ObjStateChange
+		{
+			int Face;
+			ObjStateKind Kind;
+			// smoothing group, or index into ObjChunk::Libraries; material id once resolved
+			int Value;
+			String Name;
+		};
+
+		// a file a model is built from, as it was when read; Size is -1 if it does not exist
+		struct ObjSourceFile
+		{
+			String FileName;
+			Int64 Size, LastWriteTime;
+		};
+
+		static ObjSourceFile GetObjSourceFile(const String & fileName)
+		{
+			ObjSourceFile rs;
+			FileInfo info;
+			rs.FileName = fileName;
+			rs.Size = -1;
+			rs.LastWriteTime = 0;
+			if (File::GetInfo(fileName, info))
+			{
+				rs.Size = info.Size;
+				rs.LastWriteTime = info.LastWriteTime;
+			}
+			return rs;
+		}
+
+		struct ObjMaterialLib
+		{
+			ObjSourceFile Source;
+			ObjModel Model;
+			Dictionary<String, int> Lookup;
+		};
+
+		// Lines [Begin, End) of the file and what was parsed from them. Face indices are global
+		// in OBJ files, so faces need no fixing up when chunks are merged.
+		struct ObjChunk
+		{
+			const char * Begin, * End;
+			List<Vec3> Vertices, Normals;
+			List<Vec2> TexCoords;
+			List<ObjFace> Faces;
+			List<FaceVertex> FaceVerts;
+			List<ObjStateChange> StateChanges;
+			List<RefPtr<ObjMaterialLib>> Libraries;
+			// state at the first face, from the chunks before
+			int SmoothGroup, MaterialId;
+			bool Failed;
+		};
+
+		// whitespace within a line, as skipped by scanf
+		static inline bool IsObjSpace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+		}
+
+		static bool IsObjKeyword(const char * token, const char * tokenEnd, const char * keyword)
+		{
+			for (; token < tokenEnd; token++, keyword++)
+			{
+				if (*keyword == 0 || tolower((unsigned char)*token) != *keyword)
+					return false;
+			}
+			return *keyword == 0;
+		}
+
+		static const double ExactPowersOf10[] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		// Parses the next number of the line into rs with the result of strtof (as scanf's %f),
+		// which rounds correctly. Decimals of up to 19 significant digits and a small exponent are
+		// exact in double and are converted directly; anything else goes through strtof.
+		static bool ParseObjFloat(const char * & p, const char * end, float & rs)
+		{
+			while (p < end && IsObjSpace(*p))
+				p++;
+			const char * s = p;
+			bool negative = false;
+			if (s < end && (*s == '-' || *s == '+'))
+				negative = *s++ == '-';
+			unsigned long long mantissa = 0;
+			int digits = 0, exponent = 0;
+			bool anyDigit = false;
+			for (; s < end && *s >= '0' && *s <= '9'; s++)
+			{
+				anyDigit = true;
+				if (mantissa || *s != '0')
+				{
+					mantissa = mantissa * 10 + (*s - '0');
+					digits++;
+				}
+			}
+			if (s < end && *s == '.')
+			{
+				for (s++; s < end && *s >= '0' && *s <= '9'; s++)
+				{
+					anyDigit = true;
+					if (mantissa || *s != '0')
+					{
+						mantissa = mantissa * 10 + (*s - '0');
+						digits++;
+					}
+					exponent--;
+				}
+			}
+			bool fast = anyDigit && digits <= 19;
+			if (fast && s < end && (*s == 'e' || *s == 'E'))
+			{
+				s++;
+				bool negativeExponent = false;
+				if (s < end && (*s == '-' || *s == '+'))
+					negativeExponent = *s++ == '-';
+				if (s == end || *s < '0' || *s > '9')
+					fast = false;
+				int e = 0;
+				for (; s < end && *s >= '0' && *s <= '9'; s++)
+				{
+					if (e < 10000)
+						e = e * 10 + (*s - '0');
+				}
+				exponent += negativeExponent ? -e : e;
+			}
+			if (fast && (s == end || IsObjSpace(*s)))
+			{
+				if (mantissa == 0)
+				{
+					rs = negative ? -0.0f : 0.0f;
+					p = s;
+					return true;
+				}
+				if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22)
+				{
+					double d = (double)mantissa;
+					d = exponent < 0 ? d / ExactPowersOf10[-exponent] : d * ExactPowersOf10[exponent];
+					// d is rounded once already; one lying exactly halfway between two floats
+					// could round the wrong way a second time
+					unsigned long long bits;
+					memcpy(&bits, &d, sizeof(d));
+					if (d >= FLT_MIN && d <= FLT_MAX && (bits & 0x1FFFFFFF) != 0x10000000)
+					{
+						rs = negative ? -(float)d : (float)d;
+						p = s;
+						return true;
+					}
+				}
+			}
+			char buf[64];
+			int len = 0;
+			for (s = p; s < end && !IsObjSpace(*s) && len < 63; s++)
+				buf[len++] = *s;
+			buf[len] = 0;
+			char * stop;
+			rs = strtof(buf, &stop);
+			if (stop == buf)
 				return false;
-			bool retVal = true;
-			String matFileName;
-			const int bufferSize = 4096;
-			char buf[bufferSize];
-			int smoothGroup = 0;
-			int matId = -1;
-			List<FaceVertex> vertices;
-			Dictionary<String, int> matLookup;
-#define checkResult(succ) if (!(succ)){retVal = false; break;}
-			while (!feof(f))
+			p += stop - buf;
+			return true;
+		}
+
+		// as scanf's %d; leaves rs alone if there is no number
+		static const char * ParseObjInt(const char * p, const char * end, int & rs)
+		{
+			bool negative = false;
+			if (p < end && (*p == '-' || *p == '+'))
+				negative = *p++ == '-';
+			if (p == end || *p < '0' || *p > '9')
+				return p;
+			int v = 0;
+			for (; p < end && *p >= '0' && *p <= '9'; p++)
+				v = v * 10 + (*p - '0');
+			rs = negative ? -v : v;
+			return p;
+		}
+
+		static const char * ParseObjIndexAfterSlash(const char * p, const char * end, int & rs)
+		{
+			if (p < end && *p == '/')
+				return ParseObjInt(p + 1, end, rs);
+			return p;
+		}
+
+		// one face vertex: a, a/b, a//c or a/b/c
+		static FaceVertex ParseObjFaceVertex(const char * token, const char * end)
+		{
+			int vid = 0, tid = 0, nid = 0;
+			int slashCount = 0;
+			bool doubleSlash = false;
+			for (const char * s = token; s < end; s++)
 			{
-#ifdef _MSC_VER
-				checkResult(fscanf_s(f, "%s", buf, bufferSize));
-#else
-				checkResult(fscanf(f, "%s", buf));
-#endif
+				if (*s == '/')
+				{
+					slashCount++;
+					if (s + 1 < end && s[1] == '/')
+						doubleSlash = true;
+				}
+			}
+			const char * s = ParseObjInt(token, end, vid);
+			if (doubleSlash)
+			{
+				if (s + 1 < end && s[0] == '/' && s[1] == '/')
+					ParseObjInt(s + 2, end, nid);
+			}
+			else if (slashCount == 3)
+				ParseObjIndexAfterSlash(s, end, tid);
+			else if (slashCount != 0)
+			{
+				s = ParseObjIndexAfterSlash(s, end, tid);
+				ParseObjIndexAfterSlash(s, end, nid);
+			}
+			FaceVertex vtx;
+			vtx.vid = vid - 1;
+			vtx.tid = tid - 1;
+			vtx.nid = nid - 1;
+			return vtx;
+		}
 
-				if (_stricmp(buf, "v") == 0)
+		// rest of the line after a usemtl or mtllib, as fgets into the old 200 byte buffer
+		static String ParseObjName(const char * p, const char * end)
+		{
+			int len = Math::Min((int)(end - p), 198);
+			return RemoveLineBreakAndQuote(String::FromMultiByte(p, len));
+		}
+
+		static void AddObjFace(ObjChunk & chunk, List<FaceVertex> & vertices, PolygonType polygonType)
+		{
+			// simple triangulation
+			if (vertices.Count() == 4 && polygonType == PolygonType::Quad)
+			{
+				ObjFace face;
+				for (int k = 0; k<4; k++)
 				{
-					Vec3 v;
-					checkResult(SafeScan(f, "%f %f %f", &v.x, &v.y, &v.z));
-					mdl.Vertices.Add(v);
+					face.VertexIds[k] = vertices[k].vid;
+					face.NormalIds[k] = vertices[k].nid;
+					face.TexCoordIds[k] = vertices[k].tid;
+					chunk.FaceVerts.Add( vertices[k] );
 				}
-				else if (_stricmp(buf, "vn") == 0)
+				face.SmoothGroup = 0;
+				face.MaterialId = -1;
+				chunk.Faces.Add(face);
+			}
+			else
+			{
+				for (int i = 2; i<vertices.Count(); i++)
 				{
-					Vec3 v;
-					checkResult(SafeScan(f, "%f %f %f", &v.x, &v.y, &v.z));
-					mdl.Normals.Add(v);
+					ObjFace face;
+					face.VertexIds[0] = vertices[0].vid;
+					face.VertexIds[1] = vertices[i-1].vid;
+					face.VertexIds[2] = vertices[i].vid;
+					face.VertexIds[3] = -1;
+					face.NormalIds[0] = vertices[0].nid;
+					face.NormalIds[1] = vertices[i-1].nid;
+					face.NormalIds[2] = vertices[i].nid;
+					face.NormalIds[3] = -1;
+					face.TexCoordIds[0] = vertices[0].tid;
+					face.TexCoordIds[1] = vertices[i-1].tid;
+					face.TexCoordIds[2] = vertices[i].tid;
+					face.TexCoordIds[3] = -1;
+					face.SmoothGroup = 0;
+					face.MaterialId = -1;
+					chunk.Faces.Add(face);
+					chunk.FaceVerts.Add( vertices[0] );
+					chunk.FaceVerts.Add( vertices[i - 1] );
+					chunk.FaceVerts.Add( vertices[i] );
 				}
-				else if (_stricmp(buf, "vt") == 0)
+			}
+		}
+
+		// Parses the lines of a chunk. Material libraries are loaded right away, while the other
+		// chunks are being parsed.
+		static void ParseObjChunk(ObjChunk & chunk, const String & directory, PolygonType polygonType)
+		{
+			List<FaceVertex> vertices;
+			const char * p = chunk.Begin;
+			chunk.Failed = false;
+			while (p < chunk.End)
+			{
+				const char * lineEnd = (const char*)memchr(p, '\n', chunk.End - p);
+				if (!lineEnd)
+					lineEnd = chunk.End;
+				while (p < lineEnd && IsObjSpace(*p))
+					p++;
+				const char * token = p;
+				while (p < lineEnd && !IsObjSpace(*p))
+					p++;
+				const char * tokenEnd = p;
+				bool succ = true;
+				if (IsObjKeyword(token, tokenEnd, "v") || IsObjKeyword(token, tokenEnd, "vn"))
 				{
-					Vec2 v;
-					checkResult(SafeScan(f, "%f %f", &v.x, &v.y));
-					//v.y = -v.y;
-					mdl.TexCoords.Add(v);
+					Vec3 v(0.0f, 0.0f, 0.0f);
+					succ = ParseObjFloat(p, lineEnd, v.x);
+					if (succ && ParseObjFloat(p, lineEnd, v.y))
+						ParseObjFloat(p, lineEnd, v.z);
+					if (succ)
+						(tokenEnd - token == 1 ? chunk.Vertices : chunk.Normals).Add(v);
 				}
-				else if (_stricmp(buf, "f") == 0)
+				else if (IsObjKeyword(token, tokenEnd, "vt"))
+				{
+					Vec2 v(0.0f, 0.0f);
+					succ = ParseObjFloat(p, lineEnd, v.x);
+					if (succ)
+					{
+						ParseObjFloat(p, lineEnd, v.y);
+						chunk.TexCoords.Add(v);
+					}
+				}
+				else if (IsObjKeyword(token, tokenEnd, "f"))
 				{
-					checkResult(fgets(buf, bufferSize, f));
-					int len = (int)strlen(buf);
-					buf[len] = '\0';
-					int startPos = 0;
 					vertices.Clear();
-					for (int i = 0; i<=len; i++)
+					while (p < lineEnd)
 					{
-						if (buf[i] != ' ' && buf[i] != '\t' && buf[i] != '\n' && buf[i] != '\r' && buf[i] != '\0')
-						{
-							continue;
-						}
-						else if (i == startPos)
-						{
-							startPos++;
-							continue;
-						}
-						char str[50];
-						memset(str, 0, 50);
-						memcpy(str, buf+startPos, i-startPos);
-						if (strstr(str, "//"))
-						{
-							int vid, nid;
-							SafeSScan(str, "%d//%d", &vid, &nid);
-							FaceVertex vtx;
-							vtx.vid = vid - 1;
-							vtx.nid = nid - 1;
-							vtx.tid = -1;
-							vertices.Add(vtx);
-						}
-						else
-						{
-							int slashCount = 0;
-							for (int j = 0; j<i-startPos; j++)
-							{
-								if (str[j] == '/') slashCount ++;
-							}
-							if (slashCount == 0)
-							{
-								FaceVertex vtx;
-								vtx.nid = vtx.tid = -1;
-								SafeSScan(str, "%d", &vtx.vid);
-								vtx.vid --;
-								vertices.Add(vtx);
-							}
-							else if (slashCount == 3)
-							{
-								FaceVertex vtx;
-								vtx.nid = -1;
-								SafeSScan(str, "%d/%d", &vtx.vid, &vtx.tid);
-								vtx.vid --;
-								vtx.tid --;
-								vertices.Add(vtx);
-							}
-							else
-							{
-								FaceVertex vtx;
-								SafeSScan(str, "%d/%d/%d", &vtx.vid, &vtx.tid, &vtx.nid);
-								vtx.vid --;
-								vtx.tid --;
-								vtx.nid --;
-								vertices.Add(vtx);
-							}
-						}
-						startPos = i+1;
+						while (p < lineEnd && IsObjSpace(*p))
+							p++;
+						const char * vertex = p;
+						while (p < lineEnd && !IsObjSpace(*p))
+							p++;
+						if (p != vertex)
+							vertices.Add(ParseObjFaceVertex(vertex, p));
 					}
-					// simple triangulation
-					if (vertices.Count() == 4 && polygonType == PolygonType::Quad)
+					AddObjFace(chunk, vertices, polygonType);
+				}
+				else if (IsObjKeyword(token, tokenEnd, "usemtl"))
+				{
+					ObjStateChange change;
+					change.Face = chunk.Faces.Count();
+					change.Kind = ObjStateKind::Material;
+					change.Value = -1;
+					change.Name = ParseObjName(p, lineEnd);
+					chunk.StateChanges.Add(change);
+				}
+				else if (IsObjKeyword(token, tokenEnd, "s"))
+				{
+					while (p < lineEnd && IsObjSpace(*p))
+						p++;
+					int smoothGroup = 0;
+					if (p < lineEnd && *p >= '0' && *p <= '9')
+						ParseObjInt(p, lineEnd, smoothGroup);
+					ObjStateChange change;
+					change.Face = chunk.Faces.Count();
+					change.Kind = ObjStateKind::SmoothGroup;
+					change.Value = smoothGroup;
+					chunk.StateChanges.Add(change);
+				}
+				else if (IsObjKeyword(token, tokenEnd, "mtllib"))
+				{
+					auto lib = MakeRef<ObjMaterialLib>();
+					String libName = Path::Combine(directory, ParseObjName(p, lineEnd));
+					lib->Source = GetObjSourceFile(libName);
+					LoadObjMaterialLib(lib->Model, libName, lib->Lookup);
+					ObjStateChange change;
+					change.Face = chunk.Faces.Count();
+					change.Kind = ObjStateKind::Library;
+					change.Value = chunk.Libraries.Count();
+					chunk.Libraries.Add(lib);
+					chunk.StateChanges.Add(change);
+				}
+				if (!succ)
+				{
+					chunk.Failed = true;
+					break;
+				}
+				p = lineEnd + 1;
+			}
+		}
+
+		// Parses the OBJ file into mdl. Adds the material libraries used to sources.
+		static bool ParseObj(ObjModel & mdl, const char * fileName, PolygonType polygonType, List<ObjSourceFile> & sources)
+		{
+			RefPtr<MemoryMappedFileStream> file;
+			try
+			{
+				file = new MemoryMappedFileStream(String(fileName), MemoryAccessPattern::Sequential);
+			}
+			catch (const IOException &)
+			{
+				return false;
+			}
+			const char * data = (const char*)file->GetData();
+			const char * dataEnd = data + file->GetLength();
+			String directory = Path::GetDirectoryName(String(fileName));
+
+			// chunks end after a line break, so every line is parsed by one chunk
+			const Int64 chunkSize = 1 << 22;
+			List<ObjChunk> chunks;
+			for (const char * p = data; p < dataEnd; )
+			{
+				const char * end = dataEnd;
+				if (dataEnd - p > chunkSize)
+				{
+					end = (const char*)memchr(p + chunkSize, '\n', dataEnd - p - chunkSize);
+					end = end ? end + 1 : dataEnd;
+				}
+				ObjChunk chunk;
+				chunk.Begin = p;
+				chunk.End = end;
+				chunk.SmoothGroup = 0;
+				chunk.MaterialId = -1;
+				chunk.Failed = false;
+				chunks.Add(_Move(chunk));
+				p = end;
+			}
+			CoreLib::Threading::ThreadPool::Global().ParallelFor(chunks.Count(), [&](int i)
+			{
+				ParseObjChunk(chunks[i], directory, polygonType);
+			});
+
+			// parsing stops at the first bad line, like the old scanf loop
+			bool retVal = true;
+			int chunkCount = chunks.Count();
+			for (int i = 0; i < chunks.Count(); i++)
+			{
+				if (chunks[i].Failed)
+				{
+					chunkCount = i + 1;
+					retVal = false;
+					break;
+				}
+			}
+
+			// apply the state changes in file order: materials are numbered as the libraries
+			// come, and usemtl only sees the libraries before it
+			Dictionary<String, int> matLookup;
+			int smoothGroup = 0;
+			int matId = -1;
+			for (int i = 0; i < chunkCount; i++)
+			{
+				ObjChunk & chunk = chunks[i];
+				chunk.SmoothGroup = smoothGroup;
+				chunk.MaterialId = matId;
+				for (auto & change : chunk.StateChanges)
+				{
+					if (change.Kind == ObjStateKind::SmoothGroup)
+						smoothGroup = change.Value;
+					else if (change.Kind == ObjStateKind::Material)
 					{
-						ObjFace face;
-						for (int k = 0; k<4; k++)
-						{
-							face.VertexIds[k] = vertices[k].vid;
-							face.NormalIds[k] = vertices[k].nid;
-							face.TexCoordIds[k] = vertices[k].tid;
-							mdl.FaceVerts.Add( vertices[k] );
-						}
-						face.SmoothGroup = smoothGroup;
-						face.MaterialId = matId;
-						mdl.Faces.Add(face);
+						matLookup.TryGetValue(change.Name, matId);
+						change.Value = matId;
 					}
 					else
 					{
-						for (int i = 2; i<vertices.Count(); i++)
-						{
-							ObjFace face;
-							face.VertexIds[0] = vertices[0].vid;
-							face.VertexIds[1] = vertices[i-1].vid;
-							face.VertexIds[2] = vertices[i].vid;
-							face.VertexIds[3] = -1;
-							face.NormalIds[0] = vertices[0].nid;
-							face.NormalIds[1] = vertices[i-1].nid;
-							face.NormalIds[2] = vertices[i].nid;
-							face.NormalIds[3] = -1;
-							face.TexCoordIds[0] = vertices[0].tid;
-							face.TexCoordIds[1] = vertices[i-1].tid;
-							face.TexCoordIds[2] = vertices[i].tid;
-							face.TexCoordIds[3] = -1;
-							face.SmoothGroup = smoothGroup;
-							face.MaterialId = matId;
-							mdl.Faces.Add(face);
-							mdl.FaceVerts.Add( vertices[0] );
-							mdl.FaceVerts.Add( vertices[i - 1] );
-							mdl.FaceVerts.Add( vertices[i] );
-						}
+						ObjMaterialLib & lib = *chunk.Libraries[change.Value];
+						sources.Add(lib.Source);
+						int materialBase = mdl.Materials.Count();
+						mdl.Materials.AddRange(lib.Model.Materials);
+						for (auto & mat : lib.Lookup)
+							matLookup[mat.Key] = materialBase + mat.Value;
 					}
 				}
-				else if (_stricmp(buf, "usemtl") == 0)
+			}
+
+			// prefix sums of the chunk sizes give where each chunk goes
+			List<int> vertexStart, normalStart, texCoordStart, faceStart, faceVertStart;
+			vertexStart.SetSize(chunkCount + 1);
+			normalStart.SetSize(chunkCount + 1);
+			texCoordStart.SetSize(chunkCount + 1);
+			faceStart.SetSize(chunkCount + 1);
+			faceVertStart.SetSize(chunkCount + 1);
+			vertexStart[0] = mdl.Vertices.Count();
+			normalStart[0] = mdl.Normals.Count();
+			texCoordStart[0] = mdl.TexCoords.Count();
+			faceStart[0] = mdl.Faces.Count();
+			faceVertStart[0] = mdl.FaceVerts.Count();
+			for (int i = 0; i < chunkCount; i++)
+			{
+				vertexStart[i + 1] = vertexStart[i] + chunks[i].Vertices.Count();
+				normalStart[i + 1] = normalStart[i] + chunks[i].Normals.Count();
+				texCoordStart[i + 1] = texCoordStart[i] + chunks[i].TexCoords.Count();
+				faceStart[i + 1] = faceStart[i] + chunks[i].Faces.Count();
+				faceVertStart[i + 1] = faceVertStart[i] + chunks[i].FaceVerts.Count();
+			}
+			mdl.Vertices.SetSize(vertexStart[chunkCount]);
+			mdl.Normals.SetSize(normalStart[chunkCount]);
+			mdl.TexCoords.SetSize(texCoordStart[chunkCount]);
+			mdl.Faces.SetSize(faceStart[chunkCount]);
+			mdl.FaceVerts.SetSize(faceVertStart[chunkCount]);
+			CoreLib::Threading::ThreadPool::Global().ParallelFor(chunkCount, [&](int i)
+			{
+				ObjChunk & chunk = chunks[i];
+				CopyElements(mdl.Vertices.Buffer() + vertexStart[i], chunk.Vertices);
+				CopyElements(mdl.Normals.Buffer() + normalStart[i], chunk.Normals);
+				CopyElements(mdl.TexCoords.Buffer() + texCoordStart[i], chunk.TexCoords);
+				CopyElements(mdl.FaceVerts.Buffer() + faceVertStart[i], chunk.FaceVerts);
+				ObjFace * faces = mdl.Faces.Buffer() + faceStart[i];
+				int smoothGroup = chunk.SmoothGroup;
+				int matId = chunk.MaterialId;
+				int change = 0;
+				for (int f = 0; f < chunk.Faces.Count(); f++)
 				{
-					String mtlName;
-					checkResult(fgets(buf, 199, f));
-					mtlName = buf;
-					mtlName = RemoveLineBreakAndQuote(mtlName);
-					matLookup.TryGetValue(mtlName, matId);
+					for (; change < chunk.StateChanges.Count() && chunk.StateChanges[change].Face == f; change++)
+					{
+						if (chunk.StateChanges[change].Kind == ObjStateKind::SmoothGroup)
+							smoothGroup = chunk.StateChanges[change].Value;
+						else if (chunk.StateChanges[change].Kind == ObjStateKind::Material)
+							matId = chunk.StateChanges[change].Value;
+					}
+					faces[f] = chunk.Faces[f];
+					faces[f].SmoothGroup = smoothGroup;
+					faces[f].MaterialId = matId;
 				}
-				else if (_stricmp(buf, "s") == 0)
+			});
+			return retVal;
+		}
+
+		static void WriteObjMaterials(BinaryWriter & writer, const List<RefPtr<ObjMaterial>> & materials)
+		{
+			writer.Write(materials.Count());
+			for (int i = 0; i<materials.Count(); i++)
+			{
+				writer.Write(materials[i]->Diffuse);
+				writer.Write(materials[i]->Specular);
+				writer.Write(materials[i]->SpecularRate);
+				writer.Write(materials[i]->BumpMap);
+				writer.Write(materials[i]->AlphaMap);
+				writer.Write(materials[i]->DiffuseMap);
+			}
+		}
+
+		static void ReadObjMaterials(BinaryReader & reader, List<RefPtr<ObjMaterial>> & materials)
+		{
+			int materialCount = reader.ReadInt32();
+			for (int i = 0; i<materialCount; i++)
+			{
+				RefPtr<ObjMaterial> mat = MakeRef<ObjMaterial>();
+				materials.Add(mat);
+				reader.Read(&mat->Diffuse, 1);
+				reader.Read(&mat->Specular, 1);
+				reader.Read(&mat->SpecularRate, 1);
+				mat->BumpMap = reader.ReadString();
+				mat->AlphaMap = reader.ReadString();
+				mat->DiffuseMap = reader.ReadString();
+			}
+		}
+
+		// A cache file starts with the files the model was built from, the OBJ file first, as
+		// they were when it was parsed. The arrays of the model follow, each aligned to
+		// ObjCacheAlignment so it can be used in place.
+		static const int ObjCacheMagic = 0x4A424F43; // "COBJ"
+		static const int ObjCacheVersion = 1;
+		static const int ObjCacheAlignment = 16;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		// the arrays are stored little-endian, so they cannot be used in place here
+		static const bool ObjCacheEnabled = false;
+#else
+		static const bool ObjCacheEnabled = true;
+#endif
+
+		template<typename T>
+		static void WriteObjCacheArray(BinaryWriter & writer, const List<T> & list)
+		{
+			writer.Write(list.Count());
+			while (writer.GetPosition() % ObjCacheAlignment)
+				writer.Write((unsigned char)0);
+			writer.WriteArray(list.Buffer(), list.Count());
+		}
+
+		template<typename T>
+		static void ReadObjCacheArray(BinaryReader & reader, ArrayView<const T> & view)
+		{
+			int count = reader.ReadInt32();
+			if (count < 0)
+				throw IOException(L"Invalid array length.");
+			while (reader.GetPosition() % ObjCacheAlignment)
+				reader.ReadByte();
+			view = reader.ReadView<T>(count);
+		}
+
+		static void SaveObjCache(const String & cacheFileName, const List<ObjSourceFile> & sources, PolygonType polygonType, const ObjModel & mdl)
+		{
+			// written under a temporary name and renamed, so no process maps a partial file
+#ifdef WIN32
+			String tempName = cacheFileName + L"." + String(_getpid()) + L".tmp";
+#else
+			String tempName = cacheFileName + L"." + String((int)getpid()) + L".tmp";
+#endif
+			try
+			{
+				BinaryWriter writer(new FileStream(tempName, FileMode::Create));
+				writer.Write(ObjCacheMagic);
+				writer.Write(ObjCacheVersion);
+				writer.Write(ObjMaterialVersion);
+				writer.Write((int)polygonType);
+				writer.Write(sources.Count());
+				for (int i = 0; i < sources.Count(); i++)
 				{
-#ifdef _MSC_VER
-					checkResult(fscanf_s(f, "%s", buf, 200));
+					writer.Write(sources[i].FileName);
+					writer.Write(sources[i].Size);
+					writer.Write(sources[i].LastWriteTime);
+				}
+				WriteObjMaterials(writer, mdl.Materials);
+				WriteObjCacheArray(writer, mdl.Vertices);
+				WriteObjCacheArray(writer, mdl.Normals);
+				WriteObjCacheArray(writer, mdl.TexCoords);
+				WriteObjCacheArray(writer, mdl.Faces);
+				WriteObjCacheArray(writer, mdl.FaceVerts);
+				writer.Close();
+			}
+			catch (const IOException &)
+			{
+				remove(tempName.ToMultiByteString());
+				return;
+			}
+#ifdef WIN32
+			if (_wrename(tempName.Buffer(), cacheFileName.Buffer()) != 0)
+				_wremove(tempName.Buffer());
 #else
-					checkResult(fscanf(f, "%s", buf));
+			if (rename(tempName.ToMultiByteString(), cacheFileName.ToMultiByteString()) != 0)
+				remove(tempName.ToMultiByteString());
 #endif
-					if (buf[0] >= '0' && buf[0] <= '9')
+		}
+
+		// Cache files being written by this process. The workers of the global pool are not
+		// joined, so exit waits for the writes here; an interrupted one would leave its
+		// temporary file behind.
+		struct ObjCacheWrites
+		{
+			std::mutex Mutex;
+			HashSet<String> FileNames;
+			CoreLib::Threading::TaskGroup Tasks;
+			ObjCacheWrites()
+				: Tasks(CoreLib::Threading::ThreadPool::Global())
+			{}
+			void Finish(const String & cacheFileName)
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				FileNames.Remove(cacheFileName);
+			}
+		};
+
+		static ObjCacheWrites & GetObjCacheWrites()
+		{
+			static std::once_flag created;
+			static ObjCacheWrites * writes = 0;
+			std::call_once(created, []()
+			{
+				writes = new ObjCacheWrites();
+				atexit([]()
+				{
+					try
 					{
-						checkResult(SafeSScan(buf, "%d", &smoothGroup));
+						writes->Tasks.Wait();
 					}
-					else
-						smoothGroup = 0;
+					catch (...)
+					{
+					}
+				});
+			});
+			return *writes;
+		}
+
+		static void SaveObjCacheAsync(const String & cacheFileName, const List<ObjSourceFile> & sources, PolygonType polygonType, RefPtr<ObjModel> mdl)
+		{
+			ObjCacheWrites & writes = GetObjCacheWrites();
+			{
+				// a load of the same file may already be writing it
+				std::lock_guard<std::mutex> lock(writes.Mutex);
+				if (!writes.FileNames.Add(cacheFileName))
+					return;
+			}
+			writes.Tasks.Submit([=, &writes]()
+			{
+				try
+				{
+					SaveObjCache(cacheFileName, sources, polygonType, *mdl);
 				}
-				else if (_stricmp(buf, "mtllib") == 0)
+				catch (...)
 				{
-					checkResult(fgets(buf, 199, f));
-					matFileName = buf;
-					matFileName = RemoveLineBreakAndQuote(matFileName);
-					String path = Path::GetDirectoryName(fileName);
-					LoadObjMaterialLib(mdl, Path::Combine(path, matFileName), matLookup);
+					writes.Finish(cacheFileName);
+					throw;
 				}
-				else
+				writes.Finish(cacheFileName);
+			}, CoreLib::Threading::TaskPriority::Low);
+		}
+
+		// false unless the cache exists and every file it was built from is unchanged
+		static bool LoadObjCache(ObjModelView & view, const String & cacheFileName, const String & fileName, PolygonType polygonType)
+		{
+			if (!File::Exists(cacheFileName))
+				return false;
+			try
+			{
+				RefPtr<MemoryMappedFileStream> file = new MemoryMappedFileStream(cacheFileName);
+				BinaryReader reader(file);
+				if (reader.ReadInt32() != ObjCacheMagic || reader.ReadInt32() != ObjCacheVersion ||
+					reader.ReadInt32() != ObjMaterialVersion || reader.ReadInt32() != (int)polygonType)
+					return false;
+				int sourceCount = reader.ReadInt32();
+				if (sourceCount < 1)
+					return false;
+				for (int i = 0; i < sourceCount; i++)
 				{
-					while (!feof(f) && fgetc(f) != '\n');
+					String sourceName = reader.ReadString();
+					Int64 size = reader.ReadInt64();
+					Int64 lastWriteTime = reader.ReadInt64();
+					if (i == 0 && !(sourceName == fileName))
+						return false;
+					ObjSourceFile source = GetObjSourceFile(sourceName);
+					if (source.Size != size || source.LastWriteTime != lastWriteTime)
+						return false;
 				}
+				ObjModelView rs;
+				ReadObjMaterials(reader, rs.Materials);
+				ReadObjCacheArray(reader, rs.Vertices);
+				ReadObjCacheArray(reader, rs.Normals);
+				ReadObjCacheArray(reader, rs.TexCoords);
+				ReadObjCacheArray(reader, rs.Faces);
+				ReadObjCacheArray(reader, rs.FaceVerts);
+				rs.CacheFile = file;
+				view = _Move(rs);
+				return true;
+			}
+			catch (const IOException &)
+			{
+				return false;
 			}
+		}
 
-			fclose(f);
-			return retVal;
+		bool LoadObj(ObjModelView & view, const char * fileName, PolygonType polygonType)
+		{
+			String cacheFileName = String(fileName) + L".cache";
+			if (ObjCacheEnabled && LoadObjCache(view, cacheFileName, String(fileName), polygonType))
+				return true;
+			// taken before parsing, so a file changed meanwhile makes the new cache stale
+			List<ObjSourceFile> sources;
+			sources.Add(GetObjSourceFile(String(fileName)));
+			RefPtr<ObjModel> mdl = MakeRef<ObjModel>();
+			bool rs = ParseObj(*mdl, fileName, polygonType, sources);
+			if (rs && ObjCacheEnabled)
+				SaveObjCacheAsync(cacheFileName, sources, polygonType, mdl);
+			view.CacheFile = 0;
+			view.Parsed = mdl;
+			view.Materials = mdl->Materials;
+			view.Vertices = ArrayView<const Vec3>(mdl->Vertices.Buffer(), mdl->Vertices.Count());
+			view.Normals = ArrayView<const Vec3>(mdl->Normals.Buffer(), mdl->Normals.Count());
+			view.TexCoords = ArrayView<const Vec2>(mdl->TexCoords.Buffer(), mdl->TexCoords.Count());
+			view.Faces = ArrayView<const ObjFace>(mdl->Faces.Buffer(), mdl->Faces.Count());
+			view.FaceVerts = ArrayView<const FaceVertex>(mdl->FaceVerts.Buffer(), mdl->FaceVerts.Count());
+			return rs;
+		}
+
+		bool LoadObj(ObjModel & mdl, const char * fileName, PolygonType polygonType)
+		{
+			ObjModelView view;
+			bool rs = LoadObj(view, fileName, polygonType);
+			// material ids continue after the materials already in mdl
+			int materialBase = mdl.Materials.Count();
+			int faceStart = mdl.Faces.Count();
+			mdl.Materials.AddRange(view.Materials);
+			mdl.Vertices.AddRange(view.Vertices.Buffer(), view.Vertices.Count());
+			mdl.Normals.AddRange(view.Normals.Buffer(), view.Normals.Count());
+			mdl.TexCoords.AddRange(view.TexCoords.Buffer(), view.TexCoords.Count());
+			mdl.Faces.AddRange(view.Faces.Buffer(), view.Faces.Count());
+			mdl.FaceVerts.AddRange(view.FaceVerts.Buffer(), view.FaceVerts.Count());
+			if (materialBase)
+			{
+				for (int i = faceStart; i < mdl.Faces.Count(); i++)
+					if (mdl.Faces[i].MaterialId != -1)
+						mdl.Faces[i].MaterialId += materialBase;
+			}
+			return rs;
 		}
 
 		void LoadObjMaterialLib(ObjModel & mdl, const String & filename, Dictionary<String, int> & matLookup)
@@ -269,8 +868,9 @@ namespace CoreLib
 					break;
 				if (_stricmp(buf, "newmtl") == 0)
 				{
-					curMat = new ObjMaterial();
-					mdl.Materials.Add(curMat);
+					auto mat = MakeRef<ObjMaterial>();
+					curMat = mat.Ptr();
+					mdl.Materials.Add(mat);
 					char *succ = fgets(buf, 199, f);
 					if (!succ)
 						break;
@@ -343,61 +943,26 @@ namespace CoreLib
 
 		void ObjModel::SaveToBinary(IO::BinaryWriter & writer)
 		{
-			writer.Write(Vertices.Count());
-			writer.Write(Vertices.Buffer(), Vertices.Count());
-
-			writer.Write(Normals.Count());
-			writer.Write(Normals.Buffer(), Normals.Count());
-
-			writer.Write(TexCoords.Count());
-			writer.Write(TexCoords.Buffer(), TexCoords.Count());
-
-			writer.Write(Faces.Count());
-			writer.Write(Faces.Buffer(), Faces.Count());
+			writer.WriteArray(Vertices);
+			writer.WriteArray(Normals);
+			writer.WriteArray(TexCoords);
+			writer.WriteArray(Faces);
 
 			writer.Write(ObjMaterialVersion); // version
-			writer.Write(Materials.Count());
-			for (int i = 0; i<Materials.Count(); i++)
-			{
-				writer.Write(Materials[i]->Diffuse);
-				writer.Write(Materials[i]->Specular);
-				writer.Write(Materials[i]->SpecularRate);
-				writer.Write(Materials[i]->BumpMap);
-				writer.Write(Materials[i]->AlphaMap);
-				writer.Write(Materials[i]->DiffuseMap);
-			}
+			WriteObjMaterials(writer, Materials);
 		}
 
 		bool ObjModel::LoadFromBinary(IO::BinaryReader & reader)
 		{
-			Vertices.SetSize(reader.ReadInt32());
-			reader.Read(Vertices.Buffer(), Vertices.Count());
-
-			Normals.SetSize(reader.ReadInt32());
-			reader.Read(Normals.Buffer(), Normals.Count());
-
-			TexCoords.SetSize(reader.ReadInt32());
-			reader.Read(TexCoords.Buffer(), TexCoords.Count());
-
-			Faces.SetSize(reader.ReadInt32());
-			reader.Read(Faces.Buffer(), Faces.Count());
+			reader.ReadArray(Vertices);
+			reader.ReadArray(Normals);
+			reader.ReadArray(TexCoords);
+			reader.ReadArray(Faces);
 
 			int ver = reader.ReadInt32();
 			if (ver != ObjMaterialVersion)
 				return false;
-			int materialCount = reader.ReadInt32();
-			for (int i = 0; i<materialCount; i++)
-			{
-				RefPtr<ObjMaterial> mat = new ObjMaterial();
-				Materials.Add(mat);
-				reader.Read(&mat->Diffuse, 1);
-				reader.Read(&mat->Specular, 1);
-				reader.Read(&mat->SpecularRate, 1);
-				mat->BumpMap = reader.ReadString();
-				mat->AlphaMap = reader.ReadString();
-				mat->DiffuseMap = reader.ReadString();
-				
-			}
+			ReadObjMaterials(reader, Materials);
 			return true;
 		}
 
@@ -25,7 +25,7 @@ namespace CoreLib
 		{
 			int vid, nid, tid;
 		};
-		const int ObjMaterialVersion = 1;
+		const int ObjMaterialVersion = 2;
 		struct ObjMaterial
 		{
 			float SpecularRate;
@@ -44,7 +44,23 @@ namespace CoreLib
 			void SaveToBinary(IO::BinaryWriter & writer);
 			bool LoadFromBinary(IO::BinaryReader & reader);
 		};
+		// An ObjModel used in place: the arrays point into the mapped cache file of the OBJ, or
+		// into a model parsed from it when there is no valid cache yet.
+		struct ObjModelView
+		{
+			Basic::RefPtr<IO::Stream> CacheFile;
+			Basic::RefPtr<ObjModel> Parsed;
+			Basic::List<Basic::RefPtr<ObjMaterial>> Materials;
+			Basic::ArrayView<const VectorMath::Vec3> Vertices, Normals;
+			Basic::ArrayView<const VectorMath::Vec2> TexCoords;
+			Basic::ArrayView<const ObjFace> Faces;
+			Basic::ArrayView<const FaceVertex> FaceVerts;
+		};
+		// Loads are cached in <fileName>.cache, which is used while the OBJ file, its material
+		// libraries and ObjMaterialVersion are unchanged. After a load without a valid cache the
+		// cache is written in the background.
 		bool LoadObj(ObjModel & mdl, const char * fileName, PolygonType polygonType = PolygonType::Triangle);
+		bool LoadObj(ObjModelView & view, const char * fileName, PolygonType polygonType = PolygonType::Triangle);
 		void RecomputeNormals(ObjModel & mdl);
 	}
 }
@@ -1,4 +1,5 @@
 #include "TextureData.h"
+#include "../SimdKernels.h"
 
 using namespace CoreLib::Basic;
 using namespace CoreLib::Imaging;
@@ -65,6 +66,16 @@ namespace CoreLib
 				Levels[level].Width = lwidth;
 				Levels[level].Height = lheight;
 				Levels[level].Pixels.SetSize(lwidth * lheight);
+				if (lwidth < oldWidth && lheight < oldHeight)
+				{
+					// every texel is a full 2x2 box of the previous level
+					const uint32_t * src = (const uint32_t*)Levels[oldLevel].Pixels.Buffer();
+					uint32_t * dst = (uint32_t*)Levels[level].Pixels.Buffer();
+					const SimdKernels & kernels = GetSimdKernels();
+					for (int i = 0; i<lheight; i++)
+						kernels.Downsample2x2(dst + i*lwidth, src + i*2*oldWidth, src + (i*2+1)*oldWidth, lwidth);
+					continue;
+				}
 				for (int i = 0; i<lheight; i++)
 				{
 					int i1, i2;
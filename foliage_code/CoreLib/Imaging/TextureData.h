@@ -3,6 +3,7 @@
 
 #include "../Basic.h"
 #include "../VectorMath.h"
+#include "../FastMath.h"
 #include "../LibMath.h"
 #include "Bitmap.h"
 
@@ -254,7 +255,7 @@ namespace CoreLib
 				lengthMinor = 1.0f;
 			}
 
-			float LOD = log(lengthMinor)* 1.442695f;
+			float LOD = FastMath::Log2(lengthMinor);
 			float invRate = 1.0f / (int)ratioOfAnisotropy;
 			float startU = uv.x * texture->Width - lengthMajor*anisoDir.x*0.5f;
 			float startV = uv.y * texture->Height - lengthMajor*anisoDir.y*0.5f;
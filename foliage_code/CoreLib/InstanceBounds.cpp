@@ -0,0 +1,50 @@
+#include "InstanceBounds.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include <float.h>
+
+using namespace CoreLib::Basic;
+
+namespace VectorMath
+{
+	static void Union(Vec3 & min, Vec3 & max, const Vec3 & bmin, const Vec3 & bmax)
+	{
+		min = Vec3(Math::Min(min.x, bmin.x), Math::Min(min.y, bmin.y), Math::Min(min.z, bmin.z));
+		max = Vec3(Math::Max(max.x, bmax.x), Math::Max(max.y, bmax.y), Math::Max(max.z, bmax.z));
+	}
+
+	static void Union(InstanceBounds & rs, const InstanceBounds & b)
+	{
+		Union(rs.LocalMin, rs.LocalMax, b.LocalMin, b.LocalMax);
+		Union(rs.WorldMin, rs.WorldMax, b.WorldMin, b.WorldMax);
+	}
+
+	InstanceBounds TransformInstances(Vec3 * centers, const Matrix4 & transform, const LeafInstance * instances, int count,
+		const Vec3 & leafMin, const Vec3 & leafMax, float leafScale, CoreLib::Threading::ThreadPool * pool)
+	{
+		const SimdKernels & kernels = GetSimdKernels();
+		InstanceBounds rs;
+		const int batchSize = 8192;
+		if (count <= batchSize * 2)
+		{
+			kernels.TransformInstances(centers, rs, transform, instances, count, leafMin, leafMax, leafScale);
+			return rs;
+		}
+		// batches are bounded in parallel and merged afterwards
+		int batchCount = (count + batchSize - 1) / batchSize;
+		List<InstanceBounds> batchBounds;
+		batchBounds.SetSize(batchCount);
+		CoreLib::Threading::ThreadPool & workers = pool ? *pool : CoreLib::Threading::ThreadPool::Global();
+		workers.ParallelFor(batchCount, [&](int i)
+		{
+			int start = i * batchSize;
+			int length = Math::Min(batchSize, count - start);
+			kernels.TransformInstances(centers ? centers + start : 0, batchBounds[i], transform, instances + start, length, leafMin, leafMax, leafScale);
+		});
+		rs.LocalMin = rs.WorldMin = Vec3(FLT_MAX);
+		rs.LocalMax = rs.WorldMax = Vec3(-FLT_MAX);
+		for (int i = 0; i < batchCount; i++)
+			Union(rs, batchBounds[i]);
+		return rs;
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef CORE_LIB_INSTANCE_BOUNDS_H
+#define CORE_LIB_INSTANCE_BOUNDS_H
+
+#include "VectorMath.h"
+
+namespace CoreLib
+{
+	namespace Threading
+	{
+		class ThreadPool;
+	}
+}
+
+namespace VectorMath
+{
+	// Placement of one instanced leaf, laid out like the per-instance data of the leaf shader:
+	// a point p of the leaf mesh lands at p * Rotation + Translation in model space.
+	struct LeafInstance
+	{
+		Vec3 Translation;
+		float Rotation[3][3];
+	};
+
+	// Bounds of a batch of placed leaves. Local is the box in model space, which together with
+	// the model transform is an oriented box; World is axis aligned after the model transform.
+	// Min > Max when the batch is empty.
+	struct InstanceBounds
+	{
+		Vec3 LocalMin, LocalMax;
+		Vec3 WorldMin, WorldMax;
+	};
+
+	// Places the leaf mesh box [leafMin, leafMax], scaled by leafScale, at every instance and maps
+	// it through transform (an affine matrix). Writes the world-space center of every placed box
+	// to centers unless it is null, and returns the union of the placed boxes, which is exact for
+	// each box. Large batches are split across pool (null uses ThreadPool::Global()).
+	InstanceBounds TransformInstances(Vec3 * centers, const Matrix4 & transform, const LeafInstance * instances, int count,
+		const Vec3 & leafMin, const Vec3 & leafMax, float leafScale = 1.0f, CoreLib::Threading::ThreadPool * pool = 0);
+}
+
+#endif
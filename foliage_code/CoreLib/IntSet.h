@@ -6,15 +6,224 @@
 #include "LibMath.h"
 #include "Common.h"
 #include "Exception.h"
+#include "SimdKernels.h"
+
+#if defined(__AVX2__)
+#define CORE_LIB_BITOPS_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CORE_LIB_BITOPS_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace CoreLib
 {
 	namespace Basic
 	{
+		// Word-array kernels shared by the bit sets. The bulk operations are vectorized with
+		// whatever the compiler is allowed to emit (AVX2 with /arch:AVX2 or -mavx2, SSE2 otherwise);
+		// PopCount falls back to the run-time dispatched kernel (SimdKernels.h) below AVX2.
+		class BitOps
+		{
+		private:
+			struct OrOp
+			{
+				static uint64_t Apply(uint64_t a, uint64_t b) { return a | b; }
+#if defined(CORE_LIB_BITOPS_AVX2)
+				static __m256i Apply(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+#elif defined(CORE_LIB_BITOPS_SSE2)
+				static __m128i Apply(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+#endif
+			};
+			struct AndOp
+			{
+				static uint64_t Apply(uint64_t a, uint64_t b) { return a & b; }
+#if defined(CORE_LIB_BITOPS_AVX2)
+				static __m256i Apply(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+#elif defined(CORE_LIB_BITOPS_SSE2)
+				static __m128i Apply(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+#endif
+			};
+			struct AndNotOp
+			{
+				static uint64_t Apply(uint64_t a, uint64_t b) { return a & ~b; }
+#if defined(CORE_LIB_BITOPS_AVX2)
+				static __m256i Apply(__m256i a, __m256i b) { return _mm256_andnot_si256(b, a); }
+#elif defined(CORE_LIB_BITOPS_SSE2)
+				static __m128i Apply(__m128i a, __m128i b) { return _mm_andnot_si128(b, a); }
+#endif
+			};
+			struct XorOp
+			{
+				static uint64_t Apply(uint64_t a, uint64_t b) { return a ^ b; }
+#if defined(CORE_LIB_BITOPS_AVX2)
+				static __m256i Apply(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+#elif defined(CORE_LIB_BITOPS_SSE2)
+				static __m128i Apply(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+#endif
+			};
+			// dst may alias a or b
+			template<typename Op>
+			static void Combine(uint64_t * dst, const uint64_t * a, const uint64_t * b, int count)
+			{
+				int i = 0;
+#if defined(CORE_LIB_BITOPS_AVX2)
+				for (; i + 4 <= count; i += 4)
+				{
+					__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+					__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+					_mm256_storeu_si256((__m256i*)(dst + i), Op::Apply(va, vb));
+				}
+#elif defined(CORE_LIB_BITOPS_SSE2)
+				for (; i + 2 <= count; i += 2)
+				{
+					__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+					__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+					_mm_storeu_si128((__m128i*)(dst + i), Op::Apply(va, vb));
+				}
+#endif
+				for (; i < count; i++)
+					dst[i] = Op::Apply(a[i], b[i]);
+			}
+		public:
+			static int PopCount(uint64_t w)
+			{
+#if defined(__GNUC__)
+				return __builtin_popcountll(w);
+#elif defined(_M_X64) && defined(__AVX__)
+				// every AVX capable cpu has popcnt
+				return (int)__popcnt64(w);
+#else
+				w = w - ((w >> 1) & 0x5555555555555555ull);
+				w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+				w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+				return (int)((w * 0x0101010101010101ull) >> 56);
+#endif
+			}
+			// index of the lowest set bit, w must not be zero
+			static int TrailingZeroCount(uint64_t w)
+			{
+#if defined(__GNUC__)
+				return __builtin_ctzll(w);
+#elif defined(_M_X64)
+				unsigned long rs;
+				_BitScanForward64(&rs, w);
+				return (int)rs;
+#else
+				unsigned long rs;
+				if (_BitScanForward(&rs, (unsigned long)w))
+					return (int)rs;
+				_BitScanForward(&rs, (unsigned long)(w >> 32));
+				return (int)rs + 32;
+#endif
+			}
+			static void Or(uint64_t * dst, const uint64_t * a, const uint64_t * b, int count)
+			{
+				Combine<OrOp>(dst, a, b, count);
+			}
+			static void And(uint64_t * dst, const uint64_t * a, const uint64_t * b, int count)
+			{
+				Combine<AndOp>(dst, a, b, count);
+			}
+			// dst = a & ~b
+			static void AndNot(uint64_t * dst, const uint64_t * a, const uint64_t * b, int count)
+			{
+				Combine<AndNotOp>(dst, a, b, count);
+			}
+			static void Xor(uint64_t * dst, const uint64_t * a, const uint64_t * b, int count)
+			{
+				Combine<XorOp>(dst, a, b, count);
+			}
+			static int PopCount(const uint64_t * words, int count)
+			{
+				int rs = 0;
+				int i = 0;
+#if defined(CORE_LIB_BITOPS_AVX2)
+				// nibble lookup (W. Mula), byte counts are summed into 64-bit lanes by sad
+				const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+				const __m256i lowMask = _mm256_set1_epi8(0x0F);
+				__m256i acc = _mm256_setzero_si256();
+				for (; i + 4 <= count; i += 4)
+				{
+					__m256i v = _mm256_loadu_si256((const __m256i*)(words + i));
+					__m256i lo = _mm256_and_si256(v, lowMask);
+					__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+					__m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+					acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+				}
+				uint64_t lanes[4];
+				_mm256_storeu_si256((__m256i*)lanes, acc);
+				rs = (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#else
+				// the cpu may still have AVX2 or AVX-512, so long arrays go to the kernel bound at run time
+				if (count >= 16)
+					return GetSimdKernels().PopCount(words, count);
+#endif
+				for (; i < count; i++)
+					rs += PopCount(words[i]);
+				return rs;
+			}
+			static bool Intersects(const uint64_t * a, const uint64_t * b, int count)
+			{
+				int i = 0;
+#if defined(CORE_LIB_BITOPS_AVX2)
+				for (; i + 4 <= count; i += 4)
+				{
+					__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+					__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+					if (!_mm256_testz_si256(va, vb))
+						return true;
+				}
+#endif
+				for (; i < count; i++)
+					if (a[i] & b[i])
+						return true;
+				return false;
+			}
+			// calls f(index) for every set bit, in increasing order
+			template<typename Func>
+			static void ForEachSetBit(const uint64_t * words, int count, const Func & f)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					uint64_t w = words[i];
+					while (w)
+					{
+						f((i << 6) + TrailingZeroCount(w));
+						w &= w - 1;
+					}
+				}
+			}
+		};
+
 		class IntSet
 		{
 		private:
-			List<int> buffer;
+			List<uint64_t> buffer;
+			static uint64_t Bit(int val)
+			{
+				return (uint64_t)1 << (val & 63);
+			}
+			// index of the word after the last non-zero one
+			int UsedWords() const
+			{
+				int n = buffer.Count();
+				while (n > 0 && buffer[n - 1] == 0)
+					n--;
+				return n;
+			}
+			void Grow(int wordCount)
+			{
+				int oldSize = buffer.Count();
+				if (wordCount <= oldSize)
+					return;
+				buffer.SetSize(wordCount);
+				memset(buffer.Buffer() + oldSize, 0, (wordCount - oldSize) * sizeof(uint64_t));
+			}
 		public:
 			IntSet()
 			{}
@@ -42,7 +251,7 @@ namespace CoreLib
 			}
 			int Size() const
 			{
-				return buffer.Count()*32;
+				return buffer.Count()*64;
 			}
 			void SetMax(int val)
 			{
@@ -52,101 +261,296 @@ namespace CoreLib
 			void Resize(int size)
 			{
 				int oldBufferSize = buffer.Count();
-				buffer.SetSize((size+31)>>5);
+				buffer.SetSize((size+63)>>6);
 				if (buffer.Count() > oldBufferSize)
-					memset(buffer.Buffer()+oldBufferSize, 0, (buffer.Count()-oldBufferSize) * sizeof(int));
+					memset(buffer.Buffer()+oldBufferSize, 0, (buffer.Count()-oldBufferSize) * sizeof(uint64_t));
 			}
 			void Clear()
 			{
-				memset(buffer.Buffer(), 0, sizeof(int)*buffer.Count());
+				int count = buffer.Count();
+				if (count > 0)
+					memset(buffer.Buffer(), 0, sizeof(uint64_t) * (size_t)count);
 			}
 			void Add(int val)
 			{
-				int id = val>>5;
-				if (id < buffer.Count())
-					buffer[id] |= (1<<(val&31));
-				else
-				{
-					int oldSize = buffer.Count();
-					buffer.SetSize(id+1);
-					memset(buffer.Buffer() + oldSize, 0, (buffer.Count()-oldSize)*sizeof(int));
-					buffer[id] |= (1<<(val&31));
-				}
+				int id = val>>6;
+				if (id >= buffer.Count())
+					Grow(id+1);
+				buffer[id] |= Bit(val);
 			}
 			void Remove(int val)
 			{
-				if ((val>>5) < buffer.Count())
-					buffer[(val>>5)] &= ~(1<<(val&31));
+				if ((val>>6) < buffer.Count())
+					buffer[(val>>6)] &= ~Bit(val);
 			}
 			bool Contains(int val) const
 			{
-				if ((val>>5) >= buffer.Count())
+				if ((val>>6) >= buffer.Count())
 					return false;
-				return (buffer[(val>>5)] & (1<<(val&31))) != 0;
+				return (buffer[(val>>6)] & Bit(val)) != 0;
 			}
-			void UnionWith(const IntSet & set)
+			// number of elements in the set
+			int Count() const
+			{
+				return BitOps::PopCount(buffer.Buffer(), buffer.Count());
+			}
+			bool IsEmpty() const
+			{
+				return UsedWords() == 0;
+			}
+			const uint64_t * Words() const
+			{
+				return buffer.Buffer();
+			}
+			int WordCount() const
+			{
+				return buffer.Count();
+			}
+			// calls f(val) for each element in increasing order
+			template<typename Func>
+			void ForEachSetBit(const Func & f) const
+			{
+				BitOps::ForEachSetBit(buffer.Buffer(), buffer.Count(), f);
+			}
+			// smallest element >= val, or -1
+			int NextSetBit(int val) const
 			{
-				for (int i = 0; i<Math::Min(set.buffer.Count(), buffer.Count()); i++)
+				if (val < 0)
+					val = 0;
+				int id = val>>6;
+				if (id >= buffer.Count())
+					return -1;
+				uint64_t w = buffer[id] & (~(uint64_t)0 << (val & 63));
+				while (true)
 				{
-					buffer[i] |= set.buffer[i];
+					if (w)
+						return (id << 6) + BitOps::TrailingZeroCount(w);
+					if (++id >= buffer.Count())
+						return -1;
+					w = buffer[id];
 				}
-				if (set.buffer.Count() > buffer.Count())
-					buffer.AddRange(set.buffer.Buffer()+buffer.Count(), set.buffer.Count()-buffer.Count());
 			}
-			bool operator == (const IntSet & set)
+			void UnionWith(const IntSet & set)
+			{
+				Grow(set.buffer.Count());
+				BitOps::Or(buffer.Buffer(), buffer.Buffer(), set.buffer.Buffer(), set.buffer.Count());
+			}
+			void IntersectWith(const IntSet & set)
 			{
-				if (buffer.Count() != set.buffer.Count())
+				int common = Math::Min(set.buffer.Count(), buffer.Count());
+				if (set.buffer.Count() < buffer.Count())
+					memset(buffer.Buffer() + common, 0, (buffer.Count()-common)*sizeof(uint64_t));
+				BitOps::And(buffer.Buffer(), buffer.Buffer(), set.buffer.Buffer(), common);
+			}
+			// removes the elements of set
+			void SubtractWith(const IntSet & set)
+			{
+				int common = Math::Min(set.buffer.Count(), buffer.Count());
+				BitOps::AndNot(buffer.Buffer(), buffer.Buffer(), set.buffer.Buffer(), common);
+			}
+			void SymmetricDifferenceWith(const IntSet & set)
+			{
+				Grow(set.buffer.Count());
+				BitOps::Xor(buffer.Buffer(), buffer.Buffer(), set.buffer.Buffer(), set.buffer.Count());
+			}
+			// sets compare equal if they hold the same elements, regardless of their capacity
+			bool operator == (const IntSet & set) const
+			{
+				int n = UsedWords();
+				if (n != set.UsedWords())
 					return false;
-				for (int i = 0; i<buffer.Count(); i++)
-					if (buffer[i] != set.buffer[i])
-						return false;
-				return true;
+				return n == 0 || memcmp(buffer.Buffer(), set.buffer.Buffer(), n * sizeof(uint64_t)) == 0;
 			}
-			bool operator != (const IntSet & set)
+			bool operator != (const IntSet & set) const
 			{
 				return !(*this == set);
 			}
-			void IntersectWith(const IntSet & set)
+			int GetHashCode() const
 			{
-				if (set.buffer.Count() < buffer.Count())
-					memset(buffer.Buffer() + set.buffer.Count(), 0, (buffer.Count()-set.buffer.Count())*sizeof(int));
-				for (int i = 0; i<Math::Min(set.buffer.Count(), buffer.Count()); i++)
-				{
-					buffer[i] &= set.buffer[i];
-				}
+				uint64_t hash = 0;
+				int n = UsedWords();
+				for (int i = 0; i < n; i++)
+					hash = (hash ^ buffer[i]) * 0x100000001B3ull;
+				return (int)(hash ^ (hash >> 32));
 			}
 			static void Union(IntSet & rs, const IntSet & set1, const IntSet & set2)
 			{
-				rs.buffer.SetSize(Math::Max(set1.buffer.Count(), set2.buffer.Count()));
-				rs.Clear();
-				for (int i = 0; i<set1.buffer.Count(); i++)
-					rs.buffer[i] |= set1.buffer[i];
-				for (int i = 0; i<set2.buffer.Count(); i++)
-					rs.buffer[i] |= set2.buffer[i];
+				// rs may be one of the operands, so take the sizes before resizing it
+				const IntSet & larger = set1.buffer.Count() >= set2.buffer.Count() ? set1 : set2;
+				const IntSet & smaller = set1.buffer.Count() >= set2.buffer.Count() ? set2 : set1;
+				int largeCount = larger.buffer.Count(), smallCount = smaller.buffer.Count();
+				rs.buffer.SetSize(largeCount);
+				BitOps::Or(rs.buffer.Buffer(), larger.buffer.Buffer(), smaller.buffer.Buffer(), smallCount);
+				if (largeCount > smallCount && &rs != &larger)
+					memcpy(rs.buffer.Buffer() + smallCount, larger.buffer.Buffer() + smallCount,
+						(largeCount - smallCount) * sizeof(uint64_t));
 			}
 			static void Intersect(IntSet & rs, const IntSet & set1, const IntSet & set2)
 			{
 				rs.buffer.SetSize(Math::Min(set1.buffer.Count(), set2.buffer.Count()));
-				for (int i = 0; i<rs.buffer.Count(); i++)
-					rs.buffer[i] = set1.buffer[i] & set2.buffer[i];
+				BitOps::And(rs.buffer.Buffer(), set1.buffer.Buffer(), set2.buffer.Buffer(), rs.buffer.Count());
 			}
 			static void Subtract(IntSet & rs, const IntSet & set1, const IntSet & set2)
 			{
-				rs.buffer.SetSize(set1.buffer.Count());
-				for (int i = 0; i<Math::Min(set1.buffer.Count(), set2.buffer.Count()); i++)
-					rs.buffer[i] = set1.buffer[i] & (~set2.buffer[i]);
+				int count = set1.buffer.Count();
+				int common = Math::Min(count, set2.buffer.Count());
+				rs.buffer.SetSize(count);
+				BitOps::AndNot(rs.buffer.Buffer(), set1.buffer.Buffer(), set2.buffer.Buffer(), common);
+				if (count > common && &rs != &set1)
+					memcpy(rs.buffer.Buffer() + common, set1.buffer.Buffer() + common,
+						(count - common) * sizeof(uint64_t));
+			}
+			static void SymmetricDifference(IntSet & rs, const IntSet & set1, const IntSet & set2)
+			{
+				// rs may be one of the operands, so take the sizes before resizing it
+				const IntSet & larger = set1.buffer.Count() >= set2.buffer.Count() ? set1 : set2;
+				const IntSet & smaller = set1.buffer.Count() >= set2.buffer.Count() ? set2 : set1;
+				int largeCount = larger.buffer.Count(), smallCount = smaller.buffer.Count();
+				rs.buffer.SetSize(largeCount);
+				BitOps::Xor(rs.buffer.Buffer(), larger.buffer.Buffer(), smaller.buffer.Buffer(), smallCount);
+				if (largeCount > smallCount && &rs != &larger)
+					memcpy(rs.buffer.Buffer() + smallCount, larger.buffer.Buffer() + smallCount,
+						(largeCount - smallCount) * sizeof(uint64_t));
 			}
 			static bool HasIntersection(const IntSet & set1, const IntSet & set2)
 			{
-				for (int i = 0; i<Math::Min(set1.buffer.Count(), set2.buffer.Count()); i++)
+				return BitOps::Intersects(set1.buffer.Buffer(), set2.buffer.Buffer(),
+					Math::Min(set1.buffer.Count(), set2.buffer.Count()));
+			}
+		};
+
+		// Two-level bit set for large, sparsely populated ranges: a summary word marks which
+		// 64-bit words of the element bitmap are non-zero, so Clear(), Count() and iteration
+		// only touch the words that hold elements.
+		class HierarchicalIntSet
+		{
+		private:
+			List<uint64_t> words;
+			List<uint64_t> summary;
+			static uint64_t Bit(int val)
+			{
+				return (uint64_t)1 << (val & 63);
+			}
+			template<typename Func>
+			void ForEachUsedWord(const Func & f) const
+			{
+				BitOps::ForEachSetBit(summary.Buffer(), summary.Count(), f);
+			}
+		public:
+			HierarchicalIntSet()
+			{}
+			HierarchicalIntSet(int maxVal)
+			{
+				SetMax(maxVal);
+			}
+			int Size() const
+			{
+				return words.Count()*64;
+			}
+			void SetMax(int val)
+			{
+				int wordCount = (val+63)>>6;
+				words.SetSize(wordCount);
+				summary.SetSize((wordCount+63)>>6);
+				if (words.Count())
+					memset(words.Buffer(), 0, words.Count() * sizeof(uint64_t));
+				if (summary.Count())
+					memset(summary.Buffer(), 0, summary.Count() * sizeof(uint64_t));
+			}
+			void Clear()
+			{
+				ForEachUsedWord([this](int w) { words[w] = 0; });
+				if (summary.Count())
+					memset(summary.Buffer(), 0, summary.Count() * sizeof(uint64_t));
+			}
+			// val must be below the capacity given to SetMax
+			void Add(int val)
+			{
+				int w = val>>6;
+				words[w] |= Bit(val);
+				summary[w>>6] |= Bit(w);
+			}
+			void Remove(int val)
+			{
+				int w = val>>6;
+				if (w >= words.Count())
+					return;
+				words[w] &= ~Bit(val);
+				if (words[w] == 0)
+					summary[w>>6] &= ~Bit(w);
+			}
+			bool Contains(int val) const
+			{
+				if ((val>>6) >= words.Count())
+					return false;
+				return (words[val>>6] & Bit(val)) != 0;
+			}
+			int Count() const
+			{
+				int rs = 0;
+				ForEachUsedWord([&](int w) { rs += BitOps::PopCount(words[w]); });
+				return rs;
+			}
+			bool IsEmpty() const
+			{
+				for (int i = 0; i < summary.Count(); i++)
+					if (summary[i])
+						return false;
+				return true;
+			}
+			template<typename Func>
+			void ForEachSetBit(const Func & f) const
+			{
+				ForEachUsedWord([&](int w)
 				{
-					if (set1.buffer[i] & set2.buffer[i])
-						return true;
+					uint64_t bits = words[w];
+					while (bits)
+					{
+						f((w << 6) + BitOps::TrailingZeroCount(bits));
+						bits &= bits - 1;
+					}
+				});
+			}
+			// both sets must have the same capacity
+			void UnionWith(const HierarchicalIntSet & set)
+			{
+				set.ForEachUsedWord([&](int w) { words[w] |= set.words[w]; });
+				BitOps::Or(summary.Buffer(), summary.Buffer(), set.summary.Buffer(), Math::Min(summary.Count(), set.summary.Count()));
+			}
+			void IntersectWith(const HierarchicalIntSet & set)
+			{
+				for (int i = 0; i < summary.Count(); i++)
+				{
+					uint64_t used = summary[i];
+					while (used)
+					{
+						int w = (i << 6) + BitOps::TrailingZeroCount(used);
+						used &= used - 1;
+						words[w] &= w < set.words.Count() ? set.words[w] : 0;
+						if (words[w] == 0)
+							summary[i] &= ~Bit(w);
+					}
 				}
-				return false;
+			}
+			void SubtractWith(const HierarchicalIntSet & set)
+			{
+				set.ForEachUsedWord([&](int w)
+				{
+					if (w < words.Count())
+					{
+						words[w] &= ~set.words[w];
+						if (words[w] == 0)
+							summary[w>>6] &= ~Bit(w);
+					}
+				});
+			}
+			void CopyTo(IntSet & rs) const
+			{
+				rs.SetMax(Size());
+				ForEachSetBit([&](int val) { rs.Add(val); });
 			}
 		};
 	}
 }
 
-#endif
\ No newline at end of file
+#endif
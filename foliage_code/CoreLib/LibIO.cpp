@@ -11,52 +11,73 @@ namespace CoreLib
 		bool File::Exists(const String & fileName)
 		{
 			struct stat sts;
-			return stat(((String)fileName).ToMultiByteString(), &sts) != -1;
+			return stat(fileName.ToMultiByteString(), &sts) != -1;
 		}
 
-		String Path::TruncateExt(const String & path)
+		bool File::GetInfo(const String & fileName, FileInfo & info)
+		{
+#ifdef WIN32
+			struct _stat64 sts;
+			if (_stat64(fileName.ToMultiByteString(), &sts) == -1)
+				return false;
+			info.LastWriteTime = (Int64)sts.st_mtime * 1000000000;
+#else
+			struct stat sts;
+			if (stat(fileName.ToMultiByteString(), &sts) == -1)
+				return false;
+#ifdef __APPLE__
+			info.LastWriteTime = (Int64)sts.st_mtimespec.tv_sec * 1000000000 + sts.st_mtimespec.tv_nsec;
+#else
+			info.LastWriteTime = (Int64)sts.st_mtim.tv_sec * 1000000000 + sts.st_mtim.tv_nsec;
+#endif
+#endif
+			info.Size = (Int64)sts.st_size;
+			return true;
+		}
+
+		String Path::TruncateExt(const StringView & path)
 		{
 			int dotPos = path.LastIndexOf(L'.');
 			if (dotPos != -1)
-				return path.SubString(0, dotPos);
+				return String(path.SubString(0, dotPos));
 			else
-				return path;
+				return String(path);
 		}
-		String Path::ReplaceExt(const String & path, const wchar_t * newExt)
+		String Path::ReplaceExt(const StringView & path, const StringView & newExt)
 		{
-			StringBuilder sb(path.Length()+10);
 			int dotPos = path.LastIndexOf(L'.');
 			if (dotPos == -1)
 				dotPos = path.Length();
+			StringBuilder sb(dotPos + newExt.Length() + 2);
 			sb.Append(path.Buffer(), dotPos);
 			sb.Append(L'.');
 			sb.Append(newExt);
 			return sb.ProduceString();
 		}
-		String Path::GetFileName(const String & path)
+		String Path::GetFileName(const StringView & path)
 		{
 			int pos = path.LastIndexOf(L'/');
 			pos = Math::Max(path.LastIndexOf(L'\\'), pos) + 1;
-			return path.SubString(pos, path.Length()-pos);
+			return String(path.SubString(pos, path.Length()-pos));
 		}
-		String Path::GetFileExt(const String & path)
+		String Path::GetFileExt(const StringView & path)
 		{
 			int dotPos = path.LastIndexOf(L'.');
 			if (dotPos != -1)
-				return path.SubString(dotPos+1, path.Length()-dotPos-1);
+				return String(path.SubString(dotPos+1, path.Length()-dotPos-1));
 			else
 				return L"";
 		}
-		String Path::GetDirectoryName(const String & path)
+		String Path::GetDirectoryName(const StringView & path)
 		{
 			int pos = path.LastIndexOf(L'/');
 			pos = Math::Max(path.LastIndexOf(L'\\'), pos);
 			if (pos != -1)
-				return path.SubString(0, pos);
+				return String(path.SubString(0, pos));
 			else
 				return L"";
 		}
-		String Path::Combine(const String & path1, const String & path2)
+		String Path::Combine(const StringView & path1, const StringView & path2)
 		{
 			StringBuilder sb(path1.Length()+path2.Length()+2);
 			sb.Append(path1);
@@ -65,7 +86,7 @@ namespace CoreLib
 			sb.Append(path2);
 			return sb.ProduceString();
 		}
-		String Path::Combine(const String & path1, const String & path2, const String & path3)
+		String Path::Combine(const StringView & path1, const StringView & path2, const StringView & path3)
 		{
 			StringBuilder sb(path1.Length()+path2.Length()+path3.Length()+3);
 			sb.Append(path1);
@@ -9,10 +9,19 @@ namespace CoreLib
 {
 	namespace IO
 	{
+		struct FileInfo
+		{
+			Int64 Size;
+			// modification time in nanoseconds since 1970, as precise as the file system keeps it
+			Int64 LastWriteTime;
+		};
+
 		class File
 		{
 		public:
 			static bool Exists(const CoreLib::Basic::String & fileName);
+			// false if the file does not exist
+			static bool GetInfo(const CoreLib::Basic::String & fileName, FileInfo & info);
 			static CoreLib::Basic::String ReadAllText(const CoreLib::Basic::String & fileName);
 		};
 
@@ -24,13 +33,13 @@ namespace CoreLib
 #else
 			static const wchar_t PathDelimiter = L'/';
 #endif
-			static String TruncateExt(const String & path);
-			static String ReplaceExt(const String & path, const wchar_t * newExt);
-			static String GetFileName(const String & path);
-			static String GetFileExt(const String & path);
-			static String GetDirectoryName(const String & path);
-			static String Combine(const String & path1, const String & path2);
-			static String Combine(const String & path1, const String & path2, const String & path3);
+			static String TruncateExt(const StringView & path);
+			static String ReplaceExt(const StringView & path, const StringView & newExt);
+			static String GetFileName(const StringView & path);
+			static String GetFileExt(const StringView & path);
+			static String GetDirectoryName(const StringView & path);
+			static String Combine(const StringView & path1, const StringView & path2);
+			static String Combine(const StringView & path1, const StringView & path2, const StringView & path3);
 		};
 	}
 }
@@ -1,4 +1,8 @@
 #include "LibString.h"
+#ifdef WINDOWS_PLATFORM
+#include <Windows.h>
+#endif
+
 namespace CoreLib
 {
 	namespace Basic
@@ -7,48 +11,158 @@ namespace CoreLib
 		String StringConcat(const wchar_t * lhs, int leftLen, const wchar_t * rhs, int rightLen)
 		{
 			String res;
-			res.length = leftLen + rightLen;
-			res.buffer = new wchar_t[res.length + 1];
-			wcscpy_s(res.buffer.Ptr(), res.length + 1, lhs);
-			wcscpy_s(res.buffer + leftLen, res.length + 1 - leftLen, rhs);
+			wchar_t * dest = res.Allocate(leftLen + rightLen);
+			memcpy(dest, lhs, sizeof(wchar_t) * leftLen);
+			memcpy(dest + leftLen, rhs, sizeof(wchar_t) * rightLen);
 			return res;
 		}
 		String operator+(const wchar_t * op1, const String & op2)
 		{
-			if(!op2.buffer)
-				return String(op1);
-
-			return StringConcat(op1, (int)wcslen(op1), op2.buffer.Ptr(), op2.length);
+			return StringConcat(op1, (int)wcslen(op1), op2.Buffer(), op2.length);
 		}
 
 		String operator+(const String & op1, const wchar_t*op2)
 		{
-			if(!op1.buffer)
-				return String(op2);
-
-			return StringConcat(op1.buffer.Ptr(), op1.length, op2, (int)wcslen(op2));
+			return StringConcat(op1.Buffer(), op1.length, op2, (int)wcslen(op2));
 		}
 
 		String operator+(const String & op1, const String & op2)
 		{
-			if(!op1.buffer && !op2.buffer)
-				return String();
-			else if(!op1.buffer)
-				return String(op2);
-			else if(!op2.buffer)
-				return String(op1);
+			if (op1.length == 0)
+				return op2;
+			else if (op2.length == 0)
+				return op1;
+			return StringConcat(op1.Buffer(), op1.length, op2.Buffer(), op2.length);
+		}
+
+		void String::Append(const wchar_t * str, int len)
+		{
+			if (len == 0)
+				return;
+			FreeMultiByteBuffer();
+			int newLength = length + len;
+			if (newLength < ShortBufferSize)
+			{
+				memmove(shortBuffer + length, str, sizeof(wchar_t) * len);
+				shortBuffer[newLength] = 0;
+				length = newLength;
+			}
+			else if (!IsShort() && heap->Capacity >= newLength &&
+				heap->RefCount.load(std::memory_order_acquire) == 1)
+			{
+				// sole owner with spare room: append in place
+				wchar_t * chars = heap->Chars();
+				memmove(chars + length, str, sizeof(wchar_t) * len);
+				chars[newLength] = 0;
+				length = newLength;
+			}
+			else
+			{
+				// grow geometrically so that repeated appends stay linear
+				int capacity = IsShort() ? newLength : heap->Capacity * 2;
+				if (capacity < newLength)
+					capacity = newLength;
+				HeapBuffer * newHeap = AllocHeap(capacity);
+				wchar_t * chars = newHeap->Chars();
+				memcpy(chars, Buffer(), sizeof(wchar_t) * length);
+				memcpy(chars + length, str, sizeof(wchar_t) * len);
+				chars[newLength] = 0;
+				if (!IsShort())
+					ReleaseHeap(heap);
+				heap = newHeap;
+				length = newLength;
+			}
+		}
+
+		void String::AssignMultiByte(const char * str, int len)
+		{
+#ifdef WINDOWS_PLATFORM
+			int i = 0;
+			while (i < len && (unsigned char)str[i] < 0x80)
+				i++;
+			if (i == len)
+			{
+				wchar_t * dest = Allocate(len);
+				for (int j = 0; j < len; j++)
+					dest[j] = (wchar_t)str[j];
+			}
+			else
+			{
+				int wlen = MultiByteToWideChar(CP_ACP, 0, str, len, NULL, 0);
+				MultiByteToWideChar(CP_ACP, 0, str, len, Allocate(wlen), wlen);
+			}
+#else
+			int wlen = Utf8ToWideChar(0, str, len);
+			Utf8ToWideChar(Allocate(wlen), str, len);
+#endif
+		}
+
+		String String::FromUtf8(const char * str, int len)
+		{
+			if (len < 0)
+				len = (int)strlen(str);
+			String rs;
+			int wlen = Utf8ToWideChar(0, str, len);
+			Utf8ToWideChar(rs.Allocate(wlen), str, len);
+			return rs;
+		}
+
+		char * String::ToUtf8(int * len) const
+		{
+			String * self = (String*)this;
+			if (!multiByteBuffer || !multiByteIsUtf8)
+			{
+				self->FreeMultiByteBuffer();
+				int mbLen = WideCharToUtf8(0, Buffer(), length);
+				self->multiByteBuffer = new char[mbLen + 1];
+				WideCharToUtf8(multiByteBuffer, Buffer(), length);
+				multiByteBuffer[mbLen] = 0;
+				self->multiByteIsUtf8 = true;
+			}
+			if (len)
+				*len = (int)strlen(multiByteBuffer);
+			return multiByteBuffer;
+		}
 
-			return StringConcat(op1.buffer.Ptr(), op1.length, op2.buffer.Ptr(), op2.length);
+		char * String::ToMultiByteString(int * len) const
+		{
+#ifdef WINDOWS_PLATFORM
+			String * self = (String*)this;
+			if (!multiByteBuffer || multiByteIsUtf8)
+			{
+				self->FreeMultiByteBuffer();
+				self->multiByteBuffer = WideCharToMByte(Buffer(), length);
+				self->multiByteIsUtf8 = false;
+			}
+			if (len)
+				*len = (int)strlen(multiByteBuffer);
+			return multiByteBuffer;
+#else
+			return ToUtf8(len);
+#endif
+		}
+
+		template<typename ConvertFunc>
+		auto ConvertNumber(const StringView & str, const ConvertFunc & convert) -> decltype(convert((const wchar_t*)0))
+		{
+			// the view need not be null-terminated
+			wchar_t buffer[64];
+			if (str.Length() < 64)
+			{
+				memcpy(buffer, str.Buffer(), sizeof(wchar_t) * str.Length());
+				buffer[str.Length()] = 0;
+				return convert(buffer);
+			}
+			return convert(String(str).Buffer());
 		}
 
-		int StringToInt(const String & str)
+		int StringToInt(const StringView & str)
 		{
-			return (int)wcstol(str.Buffer(), NULL, 10);
-			//return (int)_wcstoi64(str.Buffer(), NULL, 10);
+			return ConvertNumber(str, [](const wchar_t * s) { return (int)wcstol(s, NULL, 10); });
 		}
-		double StringToDouble(const String & str)
+		double StringToDouble(const StringView & str)
 		{
-			return (double)wcstod(str.Buffer(), NULL);
+			return ConvertNumber(str, [](const wchar_t * s) { return (double)wcstod(s, NULL); });
 		}
 	}
 }
@@ -1,8 +1,11 @@
 #ifndef FUNDAMENTAL_LIB_STRING_H
 #define FUNDAMENTAL_LIB_STRING_H
 #include <string.h>
+#include <wchar.h>
+#include <wctype.h>
 #include <cstdlib>
 #include <stdio.h>
+#include <atomic>
 #include "WideChar.h"
 #include "SmartPointer.h"
 #include "Common.h"
@@ -15,84 +18,318 @@ namespace CoreLib
 		class _EndLine
 		{};
 		extern _EndLine EndLine;
+
+		class String;
+
+		inline int StringHash(const wchar_t * str, int length)
+		{
+			unsigned int hash = 0;
+			for (int i = 0; i < length; i++)
+				hash = (unsigned int)str[i] + (hash << 6) + (hash << 16) - hash;
+			return (int)hash;
+		}
+
+		inline int StringCompare(const wchar_t * s1, int len1, const wchar_t * s2, int len2)
+		{
+			int len = len1 < len2 ? len1 : len2;
+			for (int i = 0; i < len; i++)
+			{
+				if (s1[i] != s2[i])
+					return s1[i] < s2[i] ? -1 : 1;
+			}
+			return len1 - len2;
+		}
+
+		// Non-owning, not necessarily null-terminated range of characters. The viewed storage
+		// must outlive the view.
+		class StringView
+		{
+		private:
+			const wchar_t * buffer;
+			int length;
+		public:
+			StringView()
+				: buffer(L""), length(0)
+			{}
+			StringView(const wchar_t * str)
+				: buffer(str), length((int)wcslen(str))
+			{}
+			StringView(const wchar_t * str, int len)
+				: buffer(str), length(len)
+			{}
+			StringView(const String & str);
+			const wchar_t * Buffer() const
+			{
+				return buffer;
+			}
+			int Length() const
+			{
+				return length;
+			}
+			wchar_t operator[](int id) const
+			{
+#if _DEBUG
+				if (id < 0 || id >= length)
+					throw "Operator[]: index out of range.";
+#endif
+				return buffer[id];
+			}
+			StringView SubString(int id, int len) const
+			{
+#if _DEBUG
+				if (id < 0 || len < 0 || id + len > length)
+					throw "SubString: index out of range.";
+#endif
+				return StringView(buffer + id, len);
+			}
+			StringView Trim() const
+			{
+				int startIndex = 0;
+				while (startIndex < length && (buffer[startIndex] == L' ' || buffer[startIndex] == L'\t'))
+					startIndex++;
+				int endIndex = length;
+				while (endIndex > startIndex && (buffer[endIndex - 1] == L' ' || buffer[endIndex - 1] == L'\t'))
+					endIndex--;
+				return StringView(buffer + startIndex, endIndex - startIndex);
+			}
+			int IndexOf(wchar_t ch, int id = 0) const
+			{
+				if (id >= length)
+					return -1;
+				auto rs = wmemchr(buffer + id, ch, length - id);
+				return rs ? (int)(rs - buffer) : -1;
+			}
+			int IndexOf(const StringView & str, int id = 0) const
+			{
+				if (str.length == 0)
+					return id <= length ? id : -1;
+				for (int i = IndexOf(str.buffer[0], id); i != -1 && i + str.length <= length; i = IndexOf(str.buffer[0], i + 1))
+				{
+					if (wmemcmp(buffer + i, str.buffer, str.length) == 0)
+						return i;
+				}
+				return -1;
+			}
+			int LastIndexOf(wchar_t ch) const
+			{
+				for (int i = length - 1; i >= 0; i--)
+					if (buffer[i] == ch)
+						return i;
+				return -1;
+			}
+			bool StartsWith(const StringView & str) const
+			{
+				return str.length <= length && wmemcmp(buffer, str.buffer, str.length) == 0;
+			}
+			bool EndsWith(const StringView & str) const
+			{
+				return str.length <= length && wmemcmp(buffer + length - str.length, str.buffer, str.length) == 0;
+			}
+			bool EndsWith(wchar_t ch) const
+			{
+				return length > 0 && buffer[length - 1] == ch;
+			}
+			bool Contains(const StringView & str) const
+			{
+				return IndexOf(str) != -1;
+			}
+			bool Equals(const StringView & str, bool caseSensitive = true) const
+			{
+				if (str.length != length)
+					return false;
+				if (caseSensitive)
+					return wmemcmp(buffer, str.buffer, length) == 0;
+				// folds with towlower, as wcscasecmp does, so letters outside ASCII match too
+				for (int i = 0; i < length; i++)
+				{
+					wchar_t c1 = buffer[i], c2 = str.buffer[i];
+					if (c1 != c2 && towlower(c1) != towlower(c2))
+						return false;
+				}
+				return true;
+			}
+			bool operator == (const StringView & str) const
+			{
+				return Equals(str);
+			}
+			bool operator != (const StringView & str) const
+			{
+				return !Equals(str);
+			}
+			bool operator < (const StringView & str) const
+			{
+				return StringCompare(buffer, length, str.buffer, str.length) < 0;
+			}
+			int GetHashCode() const
+			{
+				return StringHash(buffer, length);
+			}
+			String ToString() const;
+		};
+
+		// Reference counted immutable string. Strings shorter than ShortBufferSize characters
+		// (including the terminator) are stored inline and never touch the heap; longer ones
+		// share a single heap block holding the count and the characters.
 		class String
 		{
 			friend class StringBuilder;
+		public:
+			static const int ShortBufferSize = 32 / sizeof(wchar_t);
 		private:
-			RefPtr<wchar_t, RefPtrArrayDestructor> buffer;
+			struct HeapBuffer
+			{
+				std::atomic<int> RefCount;
+				int Capacity; // characters, excluding the terminator
+				wchar_t * Chars()
+				{
+					return (wchar_t*)(this + 1);
+				}
+			};
+			union
+			{
+				HeapBuffer * heap;
+				wchar_t shortBuffer[ShortBufferSize];
+			};
 			char * multiByteBuffer;
 			int length;
-			void Free()
+			bool multiByteIsUtf8;
+
+			bool IsShort() const
+			{
+				return length < ShortBufferSize;
+			}
+			static HeapBuffer * AllocHeap(int capacity)
+			{
+				auto rs = (HeapBuffer*)malloc(sizeof(HeapBuffer) + sizeof(wchar_t) * (capacity + 1));
+				new (&rs->RefCount) std::atomic<int>(1);
+				rs->Capacity = capacity;
+				return rs;
+			}
+			static void ReleaseHeap(HeapBuffer * buffer)
+			{
+				// the sole owner can skip the atomic decrement
+				if (buffer->RefCount.load(std::memory_order_acquire) == 1 ||
+					buffer->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					free(buffer);
+			}
+			void FreeMultiByteBuffer()
 			{
-				if (buffer)
-					buffer = 0;
 				if (multiByteBuffer)
 					delete [] multiByteBuffer;
-				buffer = 0;
 				multiByteBuffer = 0;
+			}
+			void Free()
+			{
+				if (!IsShort())
+					ReleaseHeap(heap);
+				FreeMultiByteBuffer();
+				shortBuffer[0] = 0;
 				length = 0;
 			}
+			// makes room for len characters plus the terminator, contents are left to the caller
+			wchar_t * Allocate(int len)
+			{
+				Free();
+				length = len;
+				wchar_t * rs;
+				if (IsShort())
+					rs = shortBuffer;
+				else
+				{
+					heap = AllocHeap(len);
+					rs = heap->Chars();
+				}
+				rs[len] = 0;
+				return rs;
+			}
+			void Assign(const wchar_t * str, int len)
+			{
+				wchar_t * dest = Allocate(len);
+				if (len)
+					wmemcpy(dest, str, len);
+			}
+			void AssignMultiByte(const char * str, int len);
+			void Append(const wchar_t * str, int len);
+			void InitEmpty()
+			{
+				heap = 0;
+				shortBuffer[0] = 0;
+				multiByteBuffer = 0;
+				length = 0;
+				multiByteIsUtf8 = false;
+			}
 		public:
-			static String FromBuffer(RefPtr<wchar_t, RefPtrArrayDestructor> buffer, int len)
+			static String FromBuffer(const wchar_t * buffer, int len)
+			{
+				String rs;
+				rs.Assign(buffer, len);
+				return rs;
+			}
+			static String FromUtf8(const char * str, int len = -1);
+			static String FromMultiByte(const char * str, int len)
 			{
 				String rs;
-				rs.buffer = buffer;
-				rs.length = len;
+				rs.AssignMultiByte(str, len);
 				return rs;
 			}
 			String()
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
+				InitEmpty();
 			}
 			String(const wchar_t * str)
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
-				this->operator=(str);
+				InitEmpty();
+				Assign(str, (int)wcslen(str));
+			}
+			String(const wchar_t * str, int len)
+			{
+				InitEmpty();
+				Assign(str, len);
+			}
+			explicit String(const StringView & str)
+			{
+				InitEmpty();
+				Assign(str.Buffer(), str.Length());
 			}
 			String(const wchar_t ch)
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
-				wchar_t arr[] = {ch, 0};
-				*this = String(arr);
+				InitEmpty();
+				Assign(&ch, 1);
 			}
 			String(int val, int radix = 10)
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
-				buffer = new wchar_t[33];
-				_itow_s(val, buffer.Ptr(), 33, radix);
-				length = (int)wcsnlen_s(buffer.Ptr(), 33);
+				InitEmpty();
+				wchar_t buffer[33];
+				_itow_s(val, buffer, 33, radix);
+				Assign(buffer, (int)wcsnlen_s(buffer, 33));
 			}
 			String(float val, const wchar_t * format = L"%g")
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
-				buffer = new wchar_t[48];
-				swprintf_s(buffer.Ptr(),48, format, val);
-				length = (int)wcsnlen_s(buffer.Ptr(), 48);
+				InitEmpty();
+				wchar_t buffer[48];
+				swprintf_s(buffer, 48, format, val);
+				Assign(buffer, (int)wcsnlen_s(buffer, 48));
 			}
 			String(double val, const wchar_t * format = L"%g")
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
-				buffer = new wchar_t[48];
-				swprintf_s(buffer.Ptr(),48, format, val);
-				length = (int)wcsnlen_s(buffer.Ptr(), 48);
+				InitEmpty();
+				wchar_t buffer[48];
+				swprintf_s(buffer, 48, format, val);
+				Assign(buffer, (int)wcsnlen_s(buffer, 48));
 			}
 			String(const char * str)
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
-				buffer = MByteToWideChar(str, (int)strlen(str));
-				if (buffer)
-					length = (int)wcslen(buffer.Ptr());
-				else
-					length = 0;
+				InitEmpty();
+				AssignMultiByte(str, (int)strlen(str));
 			}
 			String(const String & str)
-				:buffer(0), multiByteBuffer(0), length(0)
-			{				
+			{
+				InitEmpty();
 				this->operator=(str);
 			}
 			String(String&& other)
-				:buffer(0), multiByteBuffer(0), length(0)
 			{
+				InitEmpty();
 				this->operator=(static_cast<String&&>(other));
 			}
 			~String()
@@ -101,22 +338,21 @@ namespace CoreLib
 			}
 			String & operator=(const wchar_t * str)
 			{
-				Free();
-				length = (int)wcslen(str);
-				buffer = new wchar_t[length + 1];
-				wcscpy_s(buffer.Ptr(), length + 1, str);
-				return *this;
+				String tmp(str); // str may point into this string
+				return this->operator=(_Move(tmp));
 			}
 			String & operator=(const String & str)
 			{
-				if (str.buffer == buffer)
+				if (this == &str)
 					return *this;
 				Free();
-				if (str.buffer)
+				length = str.length;
+				if (str.IsShort())
+					wmemcpy(shortBuffer, str.shortBuffer, length + 1);
+				else
 				{
-					length = str.length;
-					buffer = str.buffer;
-					multiByteBuffer = 0;
+					heap = str.heap;
+					heap->RefCount.fetch_add(1, std::memory_order_relaxed);
 				}
 				return *this;
 			}
@@ -125,22 +361,44 @@ namespace CoreLib
 				if (this != &other)
 				{
 					Free();
-					buffer = _Move(other.buffer);
 					length = other.length;
+					if (other.IsShort())
+						wmemcpy(shortBuffer, other.shortBuffer, length + 1);
+					else
+						heap = other.heap;
 					multiByteBuffer = other.multiByteBuffer;
-					other.buffer = 0;
-					other.length = 0;
-					other.multiByteBuffer = 0;
+					multiByteIsUtf8 = other.multiByteIsUtf8;
+					other.InitEmpty();
 				}
 				return *this;
 			}
+			String & operator+=(const StringView & str)
+			{
+				Append(str.Buffer(), str.Length());
+				return *this;
+			}
+			String & operator+=(const String & str)
+			{
+				Append(str.Buffer(), str.Length());
+				return *this;
+			}
+			String & operator+=(const wchar_t * str)
+			{
+				Append(str, (int)wcslen(str));
+				return *this;
+			}
+			String & operator+=(wchar_t ch)
+			{
+				Append(&ch, 1);
+				return *this;
+			}
 			wchar_t operator[](int id) const
 			{
 #if _DEBUG
 				if (id < 0 || id >= length)
 					throw "Operator[]: index out of range.";
 #endif
-				return buffer.Ptr()[id];
+				return Buffer()[id];
 			}
 
 			friend String StringConcat(const wchar_t * lhs, int leftLen, const wchar_t * rhs, int rightLen);
@@ -150,51 +408,32 @@ namespace CoreLib
 
 			String TrimStart() const
 			{
-				if(!buffer)
-					return *this;
 				int startIndex = 0;
-				while (startIndex < length && 
-					(buffer[startIndex] == L' ' || buffer[startIndex] == L'\t'))
+				while (startIndex < length &&
+					(Buffer()[startIndex] == L' ' || Buffer()[startIndex] == L'\t'))
 						startIndex++;
-				return String(buffer + startIndex);
+				if (startIndex == 0)
+					return *this;
+				return String(Buffer() + startIndex, length - startIndex);
 			}
 
 			String TrimEnd() const
 			{
-				if(!buffer)
-					return *this;
-
-				int endIndex = length - 1;
-				while (endIndex >= 0 &&
-					(buffer[endIndex] == L' ' || buffer[endIndex] == L'\t'))
+				int endIndex = length;
+				while (endIndex > 0 &&
+					(Buffer()[endIndex - 1] == L' ' || Buffer()[endIndex - 1] == L'\t'))
 					endIndex--;
-				String res;
-				res.length = endIndex + 1;
-				res.buffer = new wchar_t[endIndex + 2];
-				wcsncpy_s(res.buffer.Ptr(), endIndex + 2, buffer.Ptr(), endIndex + 1);
-				return res;
+				if (endIndex == length)
+					return *this;
+				return String(Buffer(), endIndex);
 			}
 
 			String Trim() const
 			{
-				if(!buffer)
+				StringView trimmed = StringView(*this).Trim();
+				if (trimmed.Length() == length)
 					return *this;
-
-				int startIndex = 0;
-				while (startIndex < length && 
-					(buffer[startIndex] == L' ' || buffer[startIndex] == L'\t'))
-						startIndex++;
-				int endIndex = length - 1;
-				while (endIndex >= startIndex &&
-					(buffer[endIndex] == L' ' || buffer[endIndex] == L'\t'))
-					endIndex--;
-
-				String res;
-				res.length = endIndex - startIndex + 1;
-				res.buffer = new wchar_t[res.length + 1];
-				memcpy(res.buffer.Ptr(), buffer + startIndex, sizeof(wchar_t) * res.length);
-				res.buffer[res.length] = L'\0';
-				return res;
+				return String(trimmed);
 			}
 
 			String SubString(int id, int len) const
@@ -205,168 +444,103 @@ namespace CoreLib
 				if (len < 0)
 					throw "SubString: length less than zero.";
 #endif
-				String res;
-				res.buffer = new wchar_t[len + 1];
-				res.length = len;
-				wcsncpy_s(res.buffer.Ptr(), len + 1, buffer + id, len);
-				res.buffer[len] = 0;
-				return res;
+				if (id == 0 && len == length)
+					return *this;
+				return String(Buffer() + id, len);
 			}
 
 			wchar_t * Buffer() const
 			{
-				if (buffer)
-					return buffer.Ptr();
+				if (IsShort())
+					return (wchar_t*)shortBuffer;
 				else
-					return (wchar_t*)L"";
+					return heap->Chars();
 			}
 
-			char * ToMultiByteString(int * len = 0) const
-			{
-				if (!buffer)
-					return (char*)"";
-				else
-				{
-					if (multiByteBuffer)
-						return multiByteBuffer;
-					((String*)this)->multiByteBuffer = WideCharToMByte(buffer.Ptr(), length);
-					if (len)
-						*len = (int)strnlen_s(multiByteBuffer, length*2);
-					return multiByteBuffer;
-					/*if (multiByteBuffer)
-						return multiByteBuffer;
-					size_t requiredBufferSize;
-					requiredBufferSize = WideCharToMultiByte(CP_OEMCP, NULL, buffer.Ptr(), length, 0, 0, NULL, NULL)+1;
-					if (len)
-						*len = requiredBufferSize-1;
-					if (requiredBufferSize)
-					{
-						multiByteBuffer = new char[requiredBufferSize];
-						WideCharToMultiByte(CP_OEMCP, NULL, buffer.Ptr(), length, multiByteBuffer, requiredBufferSize, NULL, NULL);
-						multiByteBuffer[requiredBufferSize-1] = 0;
-						return multiByteBuffer;
-					}
-					else
-						return "";*/
-				}
-			}
+			// system multi-byte encoding (UTF-8 outside of Windows), cached until the string changes
+			char * ToMultiByteString(int * len = 0) const;
+			// UTF-8, cached until the string changes
+			char * ToUtf8(int * len = 0) const;
 
-			bool Equals(const String & str, bool caseSensitive = true)
+			bool Equals(const String & str, bool caseSensitive = true) const
 			{
-				if (!buffer)
-					return (str.buffer == 0);
-				if (caseSensitive)
-					return (wcscmp(buffer.Ptr(), str.buffer.Ptr()) == 0);
-				else
-				{
-#ifdef _MSC_VER
-					return (_wcsicmp(buffer.Ptr(), str.buffer.Ptr()) == 0);
-#else
-					return (wcscasecmp(buffer.Ptr(), str.buffer.Ptr()) == 0);
-#endif
-				}
+				return StringView(*this).Equals(str, caseSensitive);
 			}
 
 			bool operator==(const String & str) const
 			{
-				if (!buffer)
-					return (str.buffer == 0 || wcscmp(str.buffer.Ptr(), L"")==0);
-				return (wcscmp(buffer.Ptr(), str.buffer.Ptr()) == 0);
+				return length == str.length && wmemcmp(Buffer(), str.Buffer(), length) == 0;
 			}
 			bool operator!=(const String & str) const
 			{
-				if (!buffer)
-					return (str.buffer != 0);
-				if (str.buffer.Ptr() == 0)
-					return length != 0;
-				return (wcscmp(buffer.Ptr(), str.buffer.Ptr()) != 0);
+				return !(*this == str);
 			}
 			bool operator>(const String & str) const
 			{
-				if (!buffer)
-					return false;
-				return (wcscmp(buffer.Ptr(), str.buffer.Ptr()) > 0);
+				return StringCompare(Buffer(), length, str.Buffer(), str.length) > 0;
 			}
 			bool operator<(const String & str) const
 			{
-				if (!buffer)
-					return (str.buffer != 0);
-				return (wcscmp(buffer.Ptr(), str.buffer.Ptr()) < 0);
+				return StringCompare(Buffer(), length, str.Buffer(), str.length) < 0;
 			}
 			bool operator>=(const String & str) const
 			{
-				if (!buffer)
-					return (str.buffer == 0);
-				int res = wcscmp(buffer.Ptr(), str.buffer.Ptr());
-				return (res > 0 || res == 0);
+				return StringCompare(Buffer(), length, str.Buffer(), str.length) >= 0;
 			}
 			bool operator<=(const String & str) const
 			{
-				if (!buffer)
-					return true;
-				int res = wcscmp(buffer.Ptr(), str.buffer.Ptr());
-				return (res < 0 || res == 0);
+				return StringCompare(Buffer(), length, str.Buffer(), str.length) <= 0;
 			}
 
 			String ToUpper() const
 			{
-				if(!buffer)
-					return *this;
 				String res;
-				res.length = length;
-				res.buffer = new wchar_t[length + 1];
-				for (int i = 0; i <= length; i++)
-					res.buffer[i] = (buffer[i] >= L'a' && buffer[i] <= L'z')? 
-									(buffer[i] - L'a' + L'A') : buffer[i];
+				wchar_t * dest = res.Allocate(length);
+				const wchar_t * src = Buffer();
+				for (int i = 0; i < length; i++)
+					dest[i] = (src[i] >= L'a' && src[i] <= L'z')?
+									(src[i] - L'a' + L'A') : src[i];
 				return res;
 			}
 
 			String ToLower() const
 			{
-				if(!buffer)
-					return *this;
 				String res;
-				res.length = length;
-				res.buffer = new wchar_t[length + 1];
-				for (int i = 0; i <= length; i++)
-					res.buffer[i] = (buffer[i] >= L'A' && buffer[i] <= L'Z')? 
-									(buffer[i] - L'A' + L'a') : buffer[i];
+				wchar_t * dest = res.Allocate(length);
+				const wchar_t * src = Buffer();
+				for (int i = 0; i < length; i++)
+					dest[i] = (src[i] >= L'A' && src[i] <= L'Z')?
+									(src[i] - L'A' + L'a') : src[i];
 				return res;
 			}
-			
+
 			int Length() const
 			{
 				return length;
 			}
 
-			int IndexOf(wchar_t * str, int id) const // String str
+			int IndexOf(const wchar_t * str, int id) const
 			{
 #if _DEBUG
 				if (id < 0 || id >= length)
 					throw "SubString: index out of range.";
 #endif
-				if(!buffer)
-					return -1;
-				int res = (int)(wcsstr(buffer + id, str) - buffer.Ptr());
-				if(res >= 0)
-					return res;
-				else
-					 return -1;
+				return StringView(*this).IndexOf(str, id);
 			}
-			
+
 			int IndexOf(const String & str, int id) const
 			{
-				return IndexOf(str.buffer.Ptr(), id);
+				return StringView(*this).IndexOf(str, id);
 			}
 
-			int IndexOf(wchar_t * str) const
+			int IndexOf(const wchar_t * str) const
 			{
 				return IndexOf(str, 0);
 			}
 
 			int IndexOf(const String & str) const
 			{
-				return IndexOf(str.buffer.Ptr(), 0);
+				return IndexOf(str, 0);
 			}
 
 			int IndexOf(wchar_t ch, int id) const
@@ -375,13 +549,7 @@ namespace CoreLib
 				if (id < 0 || id >= length)
 					throw "SubString: index out of range.";
 #endif
-				if(!buffer)
-					return -1;
-				int res = (int)(wcschr(buffer + id, ch) - buffer.Ptr());
-				if(res >= 0)
-					return res;
-				else
-					return -1;
+				return StringView(*this).IndexOf(ch, id);
 			}
 
 			int IndexOf(wchar_t ch) const
@@ -391,136 +559,97 @@ namespace CoreLib
 
 			int LastIndexOf(wchar_t ch) const
 			{
-				for (int i = length-1; i>=0; i--)
-					if (buffer[i] == ch)
-						return i;
-				return -1;
+				return StringView(*this).LastIndexOf(ch);
 			}
 
-			bool StartsWith(wchar_t * str) const // String str
+			bool StartsWith(const wchar_t * str) const
 			{
-				if(!buffer)
-					return false;
-				int strLen =(int) wcslen(str);
-				if (strLen > length)
-					return false;
-				for (int i = 0; i < strLen; i++)
-					if (str[i] != buffer[i])
-						return false;
-				return true;
+				return StringView(*this).StartsWith(str);
 			}
 
 			bool StartWith(const String & str) const
 			{
-				return StartWith(str.buffer.Ptr());
+				return StringView(*this).StartsWith(str);
 			}
 
-			bool EndsWith(wchar_t * str)  const // String str
+			bool EndsWith(const wchar_t * str) const
 			{
-				if(!buffer)
-					return false;
-				int strLen = (int)wcslen(str);
-				if (strLen > length)
-					return false;
-				for (int i = strLen - 1; i >= 0; i--)
-					if (str[i] != buffer[length - strLen + i])
-						return false;
-				return true;
+				return StringView(*this).EndsWith(str);
 			}
 
 			bool EndsWith(const String & str) const
 			{
-				return EndsWith(str.buffer.Ptr());
+				return StringView(*this).EndsWith(str);
 			}
 
-			bool Contains(wchar_t * str) const // String str
+			bool EndsWith(wchar_t ch) const
 			{
-				if(!buffer)
-					return false;
-				return (IndexOf(str) >= 0)? true : false;
+				return length > 0 && Buffer()[length - 1] == ch;
+			}
+
+			bool Contains(const wchar_t * str) const
+			{
+				return IndexOf(str) >= 0;
 			}
 
 			bool Contains(const String & str) const
 			{
-				return Contains(str.buffer.Ptr());
+				return IndexOf(str) >= 0;
 			}
 
 			int GetHashCode() const
 			{
-				if (!buffer)
-					return 0;
-				int hash = 0;
-				int c;
-				wchar_t * str = buffer.Ptr();
-				c = *str++;
-				while (c)
-				{
-					hash = c + (hash << 6) + (hash << 16) - hash;
-					c = *str++;
-				}
-				return hash;
+				return StringHash(Buffer(), length);
 			}
 		};
 
+		inline StringView::StringView(const String & str)
+			: buffer(str.Buffer()), length(str.Length())
+		{}
+
+		inline String StringView::ToString() const
+		{
+			return String(buffer, length);
+		}
+
 		class StringBuilder
 		{
 		private:
+			String::HeapBuffer * heap;
 			wchar_t * buffer;
 			int length;
 			int bufferSize;
 			static const int InitialSize = 512;
+			void Reallocate(int newBufferSize)
+			{
+				auto newHeap = String::AllocHeap(newBufferSize - 1);
+				if (heap)
+				{
+					memcpy(newHeap->Chars(), buffer, sizeof(wchar_t) * (length + 1));
+					free(heap);
+				}
+				else
+					newHeap->Chars()[0] = 0;
+				heap = newHeap;
+				buffer = heap->Chars();
+				bufferSize = newBufferSize;
+			}
 		public:
 			StringBuilder(int bufferSize = 1024)
-				:buffer(0), length(0), bufferSize(0)
+				:heap(0), buffer(0), length(0), bufferSize(0)
 			{
-				buffer = new wchar_t[InitialSize]; // new a larger buffer 
-				buffer[0] = L'\0';
-				length = 0;
-				bufferSize = InitialSize;
+				Reallocate(bufferSize > 0 ? bufferSize : InitialSize);
 			}
 			~StringBuilder()
 			{
-				if(buffer)
-					delete [] buffer;
+				if(heap)
+					free(heap);
 			}
 			void EnsureCapacity(int size)
 			{
-				if(bufferSize < size)
-				{
-					wchar_t * newBuffer = new wchar_t[size + 1];
-					if(buffer)
-					{
-						wcscpy_s(newBuffer, size + 1, buffer);
-						delete [] buffer;
-					}
-					buffer = newBuffer;
-					bufferSize = size;
-				}
+				if(bufferSize < size + 1)
+					Reallocate(size + 1);
 			}
-
-			//void Append(wchar_t * str)
-			//{
-			//	length += wcslen(str);
-			//	if(bufferSize < length + 1)
-			//	{
-			//		int newBufferSize = InitialSize;
-			//		while(newBufferSize < length + 1)
-			//			newBufferSize <<= 1;
-			//		wchar_t * newBuffer = new wchar_t[newBufferSize];
-			//		if (buffer)
-			//		{
-			//			wcscpy_s(newBuffer, newBufferSize, buffer);
-			//			delete [] buffer;
-			//		}
-			//		wcscat_s(newBuffer, newBufferSize, str); // use memcpy, manually deal with zero terminator
-			//		buffer = newBuffer;
-			//		bufferSize = newBufferSize;
-			//	}
-			//	else
-			//	{
-			//		wcscat_s(buffer, bufferSize, str); // use memcpy, manually deal with zero terminator
-			//	}
-			//}
 			StringBuilder & operator << (const wchar_t * str)
 			{
 				Append(str, (int)wcslen(str));
@@ -531,6 +660,11 @@ namespace CoreLib
 				Append(str);
 				return *this;
 			}
+			StringBuilder & operator << (const StringView & str)
+			{
+				Append(str.Buffer(), str.Length());
+				return *this;
+			}
 			StringBuilder & operator << (const _EndLine & endl)
 			{
 				Append(L'\n');
@@ -550,6 +684,10 @@ namespace CoreLib
 			{
 				Append(str.Buffer(), str.Length());
 			}
+			void Append(const StringView & str)
+			{
+				Append(str.Buffer(), str.Length());
+			}
 			void Append(const wchar_t * str)
 			{
 				Append(str, (int)wcslen(str));
@@ -562,25 +700,10 @@ namespace CoreLib
 					int newBufferSize = InitialSize;
 					while(newBufferSize < newLength + 1)
 						newBufferSize <<= 1;
-					wchar_t * newBuffer = new wchar_t[newBufferSize];
-					if (buffer)
-					{
-						//wcscpy_s(newBuffer, newBufferSize, buffer);
-						memcpy(newBuffer, buffer, sizeof(wchar_t) * length);
-						delete [] buffer;
-					}
-					//wcscat_s(newBuffer, newBufferSize, str);
-					memcpy(newBuffer + length, str, sizeof(wchar_t) * strLen);
-					newBuffer[newLength] = L'\0';
-					buffer = newBuffer;
-					bufferSize = newBufferSize;
-				}
-				else
-				{
-					memcpy(buffer + length, str, sizeof(wchar_t) * strLen);
-					buffer[newLength] = L'\0';
-					//wcscat_s(buffer, bufferSize, str); // use memcpy, manually deal with zero terminator
+					Reallocate(newBufferSize);
 				}
+				memcpy(buffer + length, str, sizeof(wchar_t) * strLen);
+				buffer[newLength] = L'\0';
 				length = newLength;
 			}
 
@@ -601,28 +724,33 @@ namespace CoreLib
 
 			String ToString()
 			{
-				return String(buffer);
+				return String(buffer, length);
 			}
 
+			// moves the content into a String without copying; the builder is left empty
 			String ProduceString()
 			{
 				String rs;
-				rs.buffer = buffer;
-				rs.length = length;
-				buffer = 0;
-				length = 0;
+				if (length < String::ShortBufferSize)
+				{
+					rs.Assign(buffer, length);
+					Clear();
+				}
+				else
+				{
+					rs.length = length;
+					rs.heap = heap;
+					heap = 0;
+					buffer = 0;
+					length = 0;
+					bufferSize = 0;
+				}
 				return rs;
-
 			}
 
 			String GetSubString(int start, int count)
 			{
-				String rs;
-				rs.buffer = new wchar_t[count+1];
-				rs.length = count;
-				wcsncpy_s(rs.buffer.Ptr(), count+1, buffer+start, count);
-				rs.buffer[count] = 0;
-				return rs;
+				return String(buffer + start, count);
 			}
 
 			void Remove(int id, int len)
@@ -647,8 +775,8 @@ namespace CoreLib
 			}
 		};
 
-		int StringToInt(const String & str);
-		double StringToDouble(const String & str);
+		int StringToInt(const StringView & str);
+		double StringToDouble(const StringView & str);
 	}
 }
 
@@ -7,7 +7,8 @@ namespace CoreLib
 	namespace Text
 	{
 		
-		Parser::Parser(String text)
+		Parser::Parser(const StringView & text)
+			: text(text), tokenPtr(0)
 		{
 			MetaLexer lexer;
 			lexer.SetLexProfile(
@@ -44,8 +45,8 @@ namespace CoreLib
 				L"OpOr = {\\|}\n"\
 				L"OpNot = {!}\n"\
 				L"OpAssign = {=}\n");
-			legal = lexer.Parse(text, stream);
-			curNode = stream.FirstNode();
+			// tokens refer to the parser's own copy of the text
+			legal = lexer.Parse(this->text, tokens);
 		}
 	}
 }
\ No newline at end of file
@@ -25,91 +25,105 @@ namespace CoreLib
 		class Parser
 		{
 		private:
-			LexStream stream;
+			String text;
+			List<LexTokenSpan> tokens;
+			int tokenPtr;
 			bool legal;
-			LinkedNode<LexToken> * curNode; 
-			
+			const LexTokenSpan & ReadSpan()
+			{
+				if (tokenPtr < tokens.Count())
+					return tokens[tokenPtr++];
+				throw TextFormatException(L"Unexpected ending.");
+			}
+			StringView GetText(const LexTokenSpan & token)
+			{
+				return StringView(text.Buffer() + token.Position, token.Length);
+			}
 		public:
-			Parser(Basic::String text);
+			Parser(const Basic::StringView & text);
 			int ReadInt()
 			{
-				auto token = ReadToken();
+				auto & token = ReadSpan();
 				if (token.TypeID == TokenType_Int)
 				{
-					return StringToInt(token.Str);
+					return StringToInt(GetText(token));
 				}
 				throw TextFormatException(L"Text parsing error: int expected.");
 			}
 			double ReadDouble()
 			{
-				auto token = ReadToken();
+				auto & token = ReadSpan();
 				if (token.TypeID == TokenType_Float || token.TypeID == TokenType_Int)
 				{
-					return StringToDouble(token.Str);
+					return StringToDouble(GetText(token));
 				}
 				throw TextFormatException(L"Text parsing error: floating point value expected.");
 			}
 			String ReadWord()
 			{
-				auto token = ReadToken();
+				auto & token = ReadSpan();
 				if (token.TypeID == TokenType_Identifier)
 				{
-					return token.Str;
+					return String(GetText(token));
 				}
 				throw TextFormatException(L"Text parsing error: identifier expected.");
 			}
 			String Read(const wchar_t * expectedStr)
 			{
-				auto token = ReadToken();
-				if (token.Str == expectedStr)
+				auto & token = ReadSpan();
+				if (GetText(token) == expectedStr)
 				{
-					return token.Str;
+					return expectedStr;
 				}
 				throw TextFormatException(L"Text parsing error: \'" + String(expectedStr) + L"\' expected.");
 			}
 			String Read(String expectedStr)
 			{
-				auto token = ReadToken();
-				if (token.Str == expectedStr)
+				auto & token = ReadSpan();
+				if (GetText(token) == expectedStr)
 				{
-					return token.Str;
+					return expectedStr;
 				}
 				throw TextFormatException(L"Text parsing error: \'" + expectedStr + L"\' expected.");
 			}
 			String ReadStringLiteral()
 			{
-				auto token = ReadToken();
+				auto & token = ReadSpan();
 				if (token.TypeID == TokenType_StringLiteral)
 				{
-					return token.Str.SubString(1, token.Str.Length()-2);
+					return String(GetText(token).SubString(1, token.Length-2));
 				}
 				throw TextFormatException(L"Text parsing error: string literal expected.");
 			}
 			LexToken ReadToken()
 			{
-				if (curNode)
-				{
-					LexToken rs = curNode->Value;
-					curNode = curNode->GetNext();
-					return rs;
-				}
-				throw TextFormatException(L"Unexpected ending.");
+				auto & token = ReadSpan();
+				LexToken rs;
+				rs.Str = String(GetText(token));
+				rs.TypeID = token.TypeID;
+				rs.Position = token.Position;
+				return rs;
 			}
 			LexToken NextToken()
 			{
-				if (curNode)
-					return curNode->Value;
+				LexToken rs;
+				if (tokenPtr < tokens.Count())
+				{
+					auto & token = tokens[tokenPtr];
+					rs.Str = String(GetText(token));
+					rs.TypeID = token.TypeID;
+					rs.Position = token.Position;
+				}
 				else
 				{
-					LexToken rs;
 					rs.TypeID = -1;
 					rs.Position = -1;
-					return rs;
 				}
+				return rs;
 			}
 			bool IsEnd()
 			{
-				return curNode == 0;
+				return tokenPtr == tokens.Count();
 			}
 		public:
 			bool IsLegalText()
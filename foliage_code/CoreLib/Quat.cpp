@@ -0,0 +1,193 @@
+#include "Quat.h"
+#include "FastMath.h"
+#include "SimdKernels.h"
+
+using namespace CoreLib::Basic;
+
+namespace VectorMath
+{
+	// Smallest-three components lie in [-1/sqrt(2), 1/sqrt(2)]. They are stored as codes 0 to
+	// 1022 around SmallestThreeZero, so 0 and the identity come back exactly.
+	static const int SmallestThreeZero = 511;
+	static const float SmallestThreeStep = 0.707106781f / 511.0f;
+
+	void Quat::FromAxisAngle(Quat & rs, const Vec3 & axis, float angle)
+	{
+		// Matrix4::Rotation turns clockwise looking down the axis, the opposite of q v q*
+		float s, c;
+		FastMath::SinCos(angle * -0.5f, s, c);
+		Vec3 nAxis;
+		Vec3::Normalize(nAxis, axis);
+		rs.x = nAxis.x * s;
+		rs.y = nAxis.y * s;
+		rs.z = nAxis.z * s;
+		rs.w = c;
+	}
+
+	void Quat::FromYawPitchRoll(Quat & rs, float yaw, float pitch, float roll)
+	{
+		// as in Matrix4::Rotation; Matrix4::RotationY turns the other way from Rotation about y
+		Quat qx, qz;
+		FromAxisAngle(rs, Vec3(0.0f, 1.0f, 0.0f), -yaw);
+		FromAxisAngle(qx, Vec3(1.0f, 0.0f, 0.0f), pitch);
+		FromAxisAngle(qz, Vec3(0.0f, 0.0f, 1.0f), roll);
+		Multiply(rs, rs, qx);
+		Multiply(rs, rs, qz);
+	}
+
+	void Quat::FromMatrix(Quat & rs, const Matrix4 & m)
+	{
+		// m.m[i][j] is row j, column i of the rotation; start from the largest of w, x, y, z
+		float trace = m.m[0][0] + m.m[1][1] + m.m[2][2];
+		if (trace > 0.0f)
+		{
+			float s = 0.5f / sqrt(trace + 1.0f);
+			rs.w = 0.25f / s;
+			rs.x = (m.m[1][2] - m.m[2][1]) * s;
+			rs.y = (m.m[2][0] - m.m[0][2]) * s;
+			rs.z = (m.m[0][1] - m.m[1][0]) * s;
+		}
+		else if (m.m[0][0] > m.m[1][1] && m.m[0][0] > m.m[2][2])
+		{
+			float s = 2.0f * sqrt(1.0f + m.m[0][0] - m.m[1][1] - m.m[2][2]);
+			float inv = 1.0f / s;
+			rs.w = (m.m[1][2] - m.m[2][1]) * inv;
+			rs.x = 0.25f * s;
+			rs.y = (m.m[1][0] + m.m[0][1]) * inv;
+			rs.z = (m.m[2][0] + m.m[0][2]) * inv;
+		}
+		else if (m.m[1][1] > m.m[2][2])
+		{
+			float s = 2.0f * sqrt(1.0f + m.m[1][1] - m.m[0][0] - m.m[2][2]);
+			float inv = 1.0f / s;
+			rs.w = (m.m[2][0] - m.m[0][2]) * inv;
+			rs.x = (m.m[1][0] + m.m[0][1]) * inv;
+			rs.y = 0.25f * s;
+			rs.z = (m.m[2][1] + m.m[1][2]) * inv;
+		}
+		else
+		{
+			float s = 2.0f * sqrt(1.0f + m.m[2][2] - m.m[0][0] - m.m[1][1]);
+			float inv = 1.0f / s;
+			rs.w = (m.m[0][1] - m.m[1][0]) * inv;
+			rs.x = (m.m[2][0] + m.m[0][2]) * inv;
+			rs.y = (m.m[2][1] + m.m[1][2]) * inv;
+			rs.z = 0.25f * s;
+		}
+	}
+
+	void Quat::ToMatrix(Matrix4 & rs, const Quat & q)
+	{
+		float r[3][3];
+		QuatToRotation(r, q.x, q.y, q.z, q.w);
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+				rs.m[i][j] = r[i][j];
+			rs.m[i][3] = 0.0f;
+			rs.m[3][i] = 0.0f;
+		}
+		rs.m[3][3] = 1.0f;
+	}
+
+	void Quat::Nlerp(Quat & rs, const Quat & q1, const Quat & q2, float t)
+	{
+		float k = Dot(q1, q2) < 0.0f ? -t : t;
+		float s = 1.0f - t;
+		Normalize(rs, Quat(q1.x*s + q2.x*k, q1.y*s + q2.y*k, q1.z*s + q2.z*k, q1.w*s + q2.w*k));
+	}
+
+	void Quat::Slerp(Quat & rs, const Quat & q1, const Quat & q2, float t)
+	{
+		float d = Dot(q1, q2);
+		float sign = d < 0.0f ? -1.0f : 1.0f;
+		d *= sign;
+		float k1 = 1.0f - t, k2 = t;
+		// close quaternions are interpolated linearly, where the sine ratio loses precision
+		if (d < 0.9995f)
+		{
+			float sinTheta = sqrt(1.0f - d*d);
+			float theta = FastMath::Atan2(sinTheta, d);
+			k1 = FastMath::Sin(k1 * theta) / sinTheta;
+			k2 = FastMath::Sin(k2 * theta) / sinTheta;
+		}
+		k2 *= sign;
+		Normalize(rs, Quat(q1.x*k1 + q2.x*k2, q1.y*k1 + q2.y*k2, q1.z*k1 + q2.z*k2, q1.w*k1 + q2.w*k2));
+	}
+
+	unsigned int Quat::PackSmallestThree(const Quat & q)
+	{
+		const float * v = &q.x;
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+			if (fabs(v[i]) > fabs(v[largest]))
+				largest = i;
+		// q and -q are the same rotation, so the largest is stored positive
+		float sign = v[largest] < 0.0f ? -1.0f : 1.0f;
+		unsigned int rs = (unsigned int)largest << 30;
+		int shift = 20;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+			float f = v[i] * sign / SmallestThreeStep + (SmallestThreeZero + 0.5f);
+			int bits = (int)Clamp(f, 0.0f, SmallestThreeZero * 2.0f);
+			rs |= (unsigned int)bits << shift;
+			shift -= 10;
+		}
+		return rs;
+	}
+
+	void Quat::UnpackSmallestThree(Quat & rs, unsigned int packed)
+	{
+		// same operations as the UnpackRotations kernels
+		int largest = (int)(packed >> 30);
+		float a = (float)((int)((packed >> 20) & 1023) - SmallestThreeZero) * SmallestThreeStep;
+		float b = (float)((int)((packed >> 10) & 1023) - SmallestThreeZero) * SmallestThreeStep;
+		float c = (float)((int)(packed & 1023) - SmallestThreeZero) * SmallestThreeStep;
+		float d = sqrt(Math::Max(1.0f - (a*a + b*b + c*c), 0.0f));
+		float * v = &rs.x;
+		int k = 0;
+		float others[3] = {a, b, c};
+		for (int i = 0; i < 4; i++)
+			v[i] = i == largest ? d : others[k++];
+	}
+
+	unsigned int PackOctahedral(const Vec3 & v)
+	{
+		// project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper
+		float invL1 = 1.0f / (fabs(v.x) + fabs(v.y) + fabs(v.z));
+		float px = v.x * invL1, py = v.y * invL1;
+		if (v.z < 0.0f)
+		{
+			float fx = (1.0f - fabs(py)) * (px < 0.0f ? -1.0f : 1.0f);
+			float fy = (1.0f - fabs(px)) * (py < 0.0f ? -1.0f : 1.0f);
+			px = fx;
+			py = fy;
+		}
+		int ix = (int)floor(Clamp(px, -1.0f, 1.0f) * 32767.0f + 0.5f);
+		int iy = (int)floor(Clamp(py, -1.0f, 1.0f) * 32767.0f + 0.5f);
+		return ((unsigned int)ix & 0xFFFF) | ((unsigned int)iy << 16);
+	}
+
+	void UnpackOctahedral(Vec3 & rs, unsigned int packed)
+	{
+		float px = (float)(short)(packed & 0xFFFF) * (1.0f / 32767.0f);
+		float py = (float)(short)(packed >> 16) * (1.0f / 32767.0f);
+		float pz = 1.0f - fabs(px) - fabs(py);
+		float t = Math::Max(-pz, 0.0f);
+		px += px < 0.0f ? t : -t;
+		py += py < 0.0f ? t : -t;
+		Vec3::Normalize(rs, Vec3(px, py, pz));
+	}
+
+	void QuatsToRotations(float * rotations, int stride, const Quat * quats, int count)
+	{
+		GetSimdKernels().QuatsToRotations(rotations, stride, quats, count);
+	}
+
+	void UnpackRotations(float * rotations, int stride, const unsigned int * packed, int count)
+	{
+		GetSimdKernels().UnpackRotations(rotations, stride, packed, count);
+	}
+}
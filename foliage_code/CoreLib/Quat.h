@@ -0,0 +1,141 @@
+#ifndef CORE_LIB_QUAT_H
+#define CORE_LIB_QUAT_H
+
+#include "VectorMath.h"
+
+namespace VectorMath
+{
+	// Rotation matrix of the unit quaternion (x, y, z, w), in the layout of Matrix4::m and
+	// LeafInstance::Rotation: r[i] is where the i-th axis goes. A template so the batch kernels
+	// can run it on lanes; it is only instantiated with float outside of them.
+	template<typename F>
+	inline void QuatToRotation(F r[3][3], const F & x, const F & y, const F & z, const F & w)
+	{
+		F tx = x + x, ty = y + y, tz = z + z;
+		F xx = x * tx, yy = y * ty, zz = z * tz;
+		F xy = x * ty, xz = x * tz, yz = y * tz;
+		F wx = w * tx, wy = w * ty, wz = w * tz;
+		r[0][0] = F(1.0f) - (yy + zz);
+		r[0][1] = xy + wz;
+		r[0][2] = xz - wy;
+		r[1][0] = xy - wz;
+		r[1][1] = F(1.0f) - (xx + zz);
+		r[1][2] = yz + wx;
+		r[2][0] = xz + wy;
+		r[2][1] = yz - wx;
+		r[2][2] = F(1.0f) - (xx + yy);
+	}
+
+	class Quat
+	{
+	public:
+		float x, y, z, w;
+		inline Quat()
+		{}
+		inline Quat(float vx, float vy, float vz, float vw)
+		{
+			x = vx; y = vy; z = vz; w = vw;
+		}
+		static inline Quat Identity()
+		{
+			return Quat(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		inline Quat operator * (const Quat & q) const
+		{
+			Quat rs;
+			Multiply(rs, *this, q);
+			return rs;
+		}
+		inline Quat Conjugate() const
+		{
+			return Quat(-x, -y, -z, w);
+		}
+		inline Quat Normalize() const
+		{
+			Quat rs;
+			Normalize(rs, *this);
+			return rs;
+		}
+		inline void ToMatrix(Matrix4 & rs) const
+		{
+			ToMatrix(rs, *this);
+		}
+		inline Matrix4 ToMatrix() const
+		{
+			Matrix4 rs;
+			ToMatrix(rs, *this);
+			return rs;
+		}
+		static inline float Dot(const Quat & q1, const Quat & q2);
+		static inline void Normalize(Quat & rs, const Quat & q);
+		// rs rotates by q2, then by q1, like Matrix4::Multiply of their matrices
+		static inline void Multiply(Quat & rs, const Quat & q1, const Quat & q2);
+		static inline void Transform(Vec3 & rs, const Quat & q, const Vec3 & v);
+		// same rotations as Matrix4::Rotation
+		static void FromAxisAngle(Quat & rs, const Vec3 & axis, float angle);
+		static void FromYawPitchRoll(Quat & rs, float yaw, float pitch, float roll);
+		// the upper 3x3 of m must be a rotation
+		static void FromMatrix(Quat & rs, const Matrix4 & m);
+		static void ToMatrix(Matrix4 & rs, const Quat & q);
+		// Interpolation along the shorter arc. Nlerp is cheaper but does not turn at a constant
+		// rate; Slerp does.
+		static void Nlerp(Quat & rs, const Quat & q1, const Quat & q2, float t);
+		static void Slerp(Quat & rs, const Quat & q1, const Quat & q2, float t);
+		// Smallest-three encoding of a unit quaternion in 32 bits: the index of the largest
+		// component in the top 2 bits and the other three in 10 bits each. The largest is
+		// rebuilt from the unit length, so the rotation is off by at most about 0.25 degree.
+		// Zero components, and so the identity, come back exactly.
+		static unsigned int PackSmallestThree(const Quat & q);
+		static void UnpackSmallestThree(Quat & rs, unsigned int packed);
+	};
+
+	// Octahedral encoding of a unit vector in 32 bits, 16 per coordinate, with an error below
+	// 0.05 degree. For normals and rotation axes.
+	unsigned int PackOctahedral(const Vec3 & v);
+	void UnpackOctahedral(Vec3 & rs, unsigned int packed);
+
+	// Batch conversions to rotation matrices, run by the SimdKernels of this cpu. The 9 floats
+	// of the i-th matrix go to rotations + i * stride, so they can fill LeafInstance::Rotation
+	// in place (stride 12).
+	void QuatsToRotations(float * rotations, int stride, const Quat * quats, int count);
+	void UnpackRotations(float * rotations, int stride, const unsigned int * packed, int count);
+
+	inline float Quat::Dot(const Quat & q1, const Quat & q2)
+	{
+		return q1.x*q2.x + q1.y*q2.y + q1.z*q2.z + q1.w*q2.w;
+	}
+	inline void Quat::Normalize(Quat & rs, const Quat & q)
+	{
+		float invLength = 1.0f / sqrt(Dot(q, q));
+		rs.x = q.x * invLength;
+		rs.y = q.y * invLength;
+		rs.z = q.z * invLength;
+		rs.w = q.w * invLength;
+	}
+	inline void Quat::Multiply(Quat & rs, const Quat & q1, const Quat & q2)
+	{
+		// one product of q2 with each component of q1, reordered and signed
+		__m128 a = _mm_loadu_ps(&q1.x);
+		__m128 b = _mm_loadu_ps(&q2.x);
+		__m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b);
+		__m128 t = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3)));
+		r = _mm_add_ps(r, _mm_xor_ps(t, _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f)));
+		t = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2)));
+		r = _mm_add_ps(r, _mm_xor_ps(t, _mm_set_ps(-0.0f, -0.0f, 0.0f, 0.0f)));
+		t = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)));
+		r = _mm_add_ps(r, _mm_xor_ps(t, _mm_set_ps(-0.0f, 0.0f, 0.0f, -0.0f)));
+		_mm_storeu_ps(&rs.x, r);
+	}
+	inline void Quat::Transform(Vec3 & rs, const Quat & q, const Vec3 & v)
+	{
+		// v + 2w (u x v) + 2u x (u x v), u = (x, y, z)
+		float tx = 2.0f * (q.y*v.z - q.z*v.y);
+		float ty = 2.0f * (q.z*v.x - q.x*v.z);
+		float tz = 2.0f * (q.x*v.y - q.y*v.x);
+		rs = Vec3(v.x + q.w*tx + (q.y*tz - q.z*ty),
+			v.y + q.w*ty + (q.z*tx - q.x*tz),
+			v.z + q.w*tz + (q.x*ty - q.y*tx));
+	}
+}
+
+#endif
@@ -215,121 +215,159 @@ namespace Text
 
 	void MetaLexer::ConstructDFA()
 	{
-		RegexParser parser;
-		NFA_Graph nfa;
-		NFA_Node * node = nfa.CreateNode();
-		nfa.SetStartNode(node);
+		// the table depends only on the rules, in order
+		StringBuilder source;
+		source << L"lexer:";
 		for (int i=0; i<Regex.Count(); i++)
+			source << String(Regex[i].Length()) << L":" << Regex[i];
+		dfa = DFA_Cache::GetTable(source.ProduceString(), [this]() -> RefPtr<DFA_Table>
 		{
-			RefPtr<RegexNode> tree = parser.Parse(Regex[i]);
-			if (tree)
+			RegexParser parser;
+			NFA_Graph nfa;
+			NFA_Node * node = nfa.CreateNode();
+			nfa.SetStartNode(node);
+			for (int i=0; i<Regex.Count(); i++)
 			{
-				NFA_Graph cNfa;
-				cNfa.GenerateFromRegexTree(tree.operator->(), true);
-				cNfa.SetTerminalIdentifier(i);
-				nfa.CombineNFA(&cNfa);
-				NFA_Translation * trans = nfa.CreateTranslation();
-				trans->NodeDest = cNfa.GetStartNode();
-				trans->NodeSrc = node;
-				trans->NodeDest->PrevTranslations.Add(trans);
-				trans->NodeSrc->Translations.Add(trans);
-			}
-			else
-			{
-				LexerError err;
-				err.Position = 0;
-				err.Text = L"Illegal regex for \"" + String(TokenNames[i]) + L"\"";
-				Errors.Add(err);
-				return;
+				RefPtr<RegexNode> tree = parser.Parse(Regex[i]);
+				if (tree)
+				{
+					NFA_Graph cNfa;
+					cNfa.GenerateFromRegexTree(tree.operator->(), true);
+					cNfa.SetTerminalIdentifier(i);
+					nfa.CombineNFA(&cNfa);
+					NFA_Translation * trans = nfa.CreateTranslation();
+					trans->NodeDest = cNfa.GetStartNode();
+					trans->NodeSrc = node;
+					trans->NodeDest->PrevTranslations.Add(trans);
+					trans->NodeSrc->Translations.Add(trans);
+				}
+				else
+				{
+					LexerError err;
+					err.Position = 0;
+					err.Text = L"Illegal regex for \"" + String(TokenNames[i]) + L"\"";
+					Errors.Add(err);
+					return 0;
+				}
 			}
-		}
-		nfa.PostGenerationProcess();
-		DFA_Graph dfaGraph;
-		dfaGraph.Generate(&nfa);
-		dfa = new DFA_Table();
-		dfaGraph.ToDfaTable(dfa.operator ->());
+			nfa.PostGenerationProcess();
+			DFA_Graph dfaGraph;
+			dfaGraph.Generate(&nfa);
+			RefPtr<DFA_Table> table = new DFA_Table();
+			dfaGraph.ToDfaTable(table.operator ->());
+			return table;
+		});
 	}
 
-	bool MetaLexer::Parse(String str, LexStream & stream)
+	bool MetaLexer::ReadToken(const StringView & str, int & ptr, LexTokenSpan & token)
 	{
-		TokensParsed = 0;
 		if (!dfa)
 			return false;
-		int ptr = 0;
-		int lastAcceptState = -1;
-		int lastAcceptPtr = -1;
-		int lastTokenPtr = 0;
-		int state = dfa->StartState;
+		// ptr is moved past the end once the last token has been returned
 		int len = str.Length();
-		while (ptr<str.Length())
+		while (ptr <= len)
 		{
-			if (dfa->Tags[state]->IsFinal)
-			{
-				lastAcceptState = state;
-				lastAcceptPtr = ptr;
-			}
-			Word charClass = (*dfa->CharTable)[str[ptr]];
-			if (charClass == 0xFFFF)
+			int lastAcceptState = -1;
+			int lastAcceptPtr = -1;
+			int lastTokenPtr = ptr;
+			int state = dfa->StartState;
+			bool accepted = false;
+			while (ptr<len)
 			{
-				LexerError err;
-				err.Text = String(L"Illegal character \'") + str[ptr] + L"\'";
-				err.Position = ptr;
-				Errors.Add(err);
-				ptr++;
-				continue;
-			}
-			int nextState = dfa->DFA[state][charClass];
-			if (nextState >= 0)
-			{
-				state = nextState;
-				ptr++;
-			}
-			else
-			{
-				if (lastAcceptState != -1)
+				if (dfa->Tags[state]->IsFinal)
 				{
-					state = lastAcceptState;
-					ptr = lastAcceptPtr;
-					if (!Ignore[dfa->Tags[state]->TerminalIdentifiers[0]])
-					{
-						LexToken tk;
-						tk.Str = str.SubString(lastTokenPtr, ptr-lastTokenPtr);
-						tk.TypeID = dfa->Tags[state]->TerminalIdentifiers[0];
-						tk.Position = lastTokenPtr;
-						stream.AddLast(tk);
-					}
-					TokensParsed ++;
-					lastTokenPtr = ptr;
-					state = dfa->StartState;
-					lastAcceptState = -1;
-					lastAcceptPtr = -1;
+					lastAcceptState = state;
+					lastAcceptPtr = ptr;
 				}
-				else
+				Word charClass = dfa->GetCharClass(str[ptr]);
+				// an illegal character ends the token before it, and is reported and skipped
+				// before the next one starts, so no token covers it
+				if (charClass == 0xFFFF && state == dfa->StartState)
 				{
 					LexerError err;
-					err.Text = L"Illegal token \'" +
-						str.SubString(lastTokenPtr, ptr-lastTokenPtr) + L"\'";
+					err.Text = String(L"Illegal character \'") + str[ptr] + L"\'";
 					err.Position = ptr;
 					Errors.Add(err);
 					ptr++;
-					lastAcceptState = lastAcceptPtr = -1;
 					lastTokenPtr = ptr;
-					state = dfa->StartState;
 					continue;
 				}
+				int nextState = charClass == 0xFFFF ? -1 : dfa->GetNextState(state, charClass);
+				if (nextState >= 0)
+				{
+					state = nextState;
+					ptr++;
+				}
+				else
+				{
+					if (lastAcceptState != -1)
+					{
+						state = lastAcceptState;
+						ptr = lastAcceptPtr;
+						TokensParsed ++;
+						accepted = true;
+					}
+					else
+					{
+						LexerError err;
+						err.Text = L"Illegal token \'" +
+							String(str.SubString(lastTokenPtr, ptr-lastTokenPtr)) + L"\'";
+						err.Position = ptr;
+						Errors.Add(err);
+						ptr++;
+						lastTokenPtr = ptr;
+						state = dfa->StartState;
+					}
+					break;
+				}
 			}
+			if (!accepted)
+			{
+				if (ptr < len)
+					continue;
+				ptr = len + 1;
+				if (!dfa->Tags[state]->IsFinal || Ignore[dfa->Tags[state]->TerminalIdentifiers[0]])
+					return false;
+				TokensParsed ++;
+			}
+			else if (Ignore[dfa->Tags[state]->TerminalIdentifiers[0]])
+				continue;
+			token.TypeID = dfa->Tags[state]->TerminalIdentifiers[0];
+			token.Position = lastTokenPtr;
+			token.Length = Math::Min(ptr, len) - lastTokenPtr;
+			return true;
 		}
+		return false;
+	}
 
-		if (dfa->Tags[state]->IsFinal &&
-			!Ignore[dfa->Tags[state]->TerminalIdentifiers[0]])
+	bool MetaLexer::Parse(const StringView & str, LexStream & stream)
+	{
+		TokensParsed = 0;
+		if (!dfa)
+			return false;
+		int ptr = 0;
+		LexTokenSpan span;
+		while (ReadToken(str, ptr, span))
 		{
 			LexToken tk;
-			tk.Str = str.SubString(lastTokenPtr, ptr-lastTokenPtr);
-			tk.TypeID = dfa->Tags[state]->TerminalIdentifiers[0];
+			tk.Str = String(str.SubString(span.Position, span.Length));
+			tk.TypeID = span.TypeID;
+			tk.Position = span.Position;
 			stream.AddLast(tk);
-			TokensParsed ++;
 		}
 		return (Errors.Count() == 0);
 	}
+
+	bool MetaLexer::Parse(const StringView & str, List<LexTokenSpan> & tokens)
+	{
+		TokensParsed = 0;
+		if (!dfa)
+			return false;
+		int ptr = 0;
+		LexTokenSpan span;
+		while (ReadToken(str, ptr, span))
+			tokens.Add(span);
+		return (Errors.Count() == 0);
+	}
 }
 }
\ No newline at end of file
@@ -16,6 +16,14 @@ namespace CoreLib
 		};
 
 		typedef LinkedList<LexToken> LexStream;
+
+		// Token as a range of the source text, which must outlive it.
+		struct LexTokenSpan
+		{
+			int TypeID;
+			int Position;
+			int Length;
+		};
 	
 		class LexerError
 		{
@@ -57,7 +65,33 @@ namespace CoreLib
 			String GetTokenName(int id);
 			int GetRuleCount();
 			void SetLexProfile(String lex);
-			bool Parse(String str, LexStream & stream);
+			bool Parse(const StringView & str, LexStream & stream);
+			// appends the tokens of str to tokens without copying their text
+			bool Parse(const StringView & str, List<LexTokenSpan> & tokens);
+			// Scans the next token that is not ignored, starting at ptr and advancing it. Errors
+			// are added to Errors and skipped. Returns false at the end of str.
+			bool ReadToken(const StringView & str, int & ptr, LexTokenSpan & token);
+		};
+
+		// Pulls the tokens of a string one at a time.
+		class LexTokenReader
+		{
+		private:
+			MetaLexer * lexer;
+			StringView str;
+			int ptr;
+		public:
+			LexTokenReader(MetaLexer * lexer, const StringView & str)
+				: lexer(lexer), str(str), ptr(0)
+			{}
+			bool Read(LexTokenSpan & token)
+			{
+				return lexer->ReadToken(str, ptr, token);
+			}
+			StringView GetText(const LexTokenSpan & token) const
+			{
+				return str.SubString(token.Position, token.Length);
+			}
 		};
 	}
 }
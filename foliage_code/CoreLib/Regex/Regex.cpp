@@ -1,25 +1,40 @@
 #include "Regex.h"
+#include "../IntSet.h"
+#include <memory.h>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CORE_LIB_REGEX_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace CoreLib
 {
 namespace Text
 {
 	RegexMatcher::RegexMatcher(DFA_Table * table)
-		:dfa(table)
+		:dfa(table), lazyDFA(0)
+	{
+	}
+
+	RegexMatcher::RegexMatcher(LazyDFA * lazyDFA)
+		:dfa(0), lazyDFA(lazyDFA)
 	{
 	}
 
-	int RegexMatcher::Match(const String & str, int startPos)
+	int RegexMatcher::Match(const StringView & str, int startPos)
 	{
+		if (lazyDFA)
+			return lazyDFA->Match(str, startPos);
 		int state = dfa->StartState;
 		if (state == -1)
 			return -1;
 		for (int i=startPos; i<str.Length(); i++)
 		{
-			Word charClass = (*dfa->CharTable)[str[i]];
+			Word charClass = dfa->GetCharClass(str[i]);
 			if (charClass == 0xFFFF)
 				return -1;
-			int nextState = dfa->DFA[state][charClass];
+			int nextState = dfa->GetNextState(state, charClass);
 			if (nextState == -1)
 			{
 				if (dfa->Tags[state]->IsFinal)
@@ -36,44 +51,274 @@ namespace Text
 			return -1;
 	}
 
+#ifdef CORE_LIB_REGEX_SSE2
+	static const int CharLanes = 16 / sizeof(wchar_t);
+
+	static inline __m128i SplatChar(wchar_t ch)
+	{
+		return sizeof(wchar_t) == 2 ? _mm_set1_epi16((short)ch) : _mm_set1_epi32((int)ch);
+	}
+
+	static inline __m128i LoadChars(const wchar_t * str)
+	{
+		return _mm_loadu_si128((const __m128i*)str);
+	}
+
+	static inline __m128i CompareChars(__m128i a, __m128i b)
+	{
+		return sizeof(wchar_t) == 2 ? _mm_cmpeq_epi16(a, b) : _mm_cmpeq_epi32(a, b);
+	}
+#endif
+
+	// Rough rank of how rare a character is in text and source code, higher is rarer.
+	static int CharRarity(wchar_t ch)
+	{
+		static const char commonChars[] = " etaoinsrhldcumfpgwybvkxjqz\n\t.,_()=;\"'0123456789"
+			"ETAOINSRHLDCUMFPGWYBVKXJQZ:/-<>{}[]*+#&|!?@$%^~`\\\r";
+		for (int i=0; commonChars[i]; i++)
+			if ((wchar_t)commonChars[i] == ch)
+				return i;
+		return (int)sizeof(commonChars);
+	}
+
+	RegexPrefilter::RegexPrefilter()
+		: rareOffset1(0), rareOffset2(0), firstCharCount(0)
+	{
+	}
+
+	void RegexPrefilter::Build(DFA_Table * dfa)
+	{
+		prefix = String();
+		rareOffset1 = rareOffset2 = 0;
+		firstCharCount = 0;
+		int state = dfa->StartState;
+		if (state == -1 || dfa->Tags[state]->IsFinal)
+			return;
+		// size of each char class and its first few chars
+		List<int> classSize;
+		List<wchar_t> classChars;
+		classSize.SetSize(dfa->AlphabetSize);
+		classChars.SetSize(dfa->AlphabetSize * MaxFirstChars);
+		for (int i=0; i<classSize.Count(); i++)
+			classSize[i] = 0;
+		RegexCharTable & table = *dfa->CharTable;
+		for (int i=0; i<table.Count(); i++)
+		{
+			Word charClass = table[i];
+			if (charClass >= dfa->AlphabetSize)
+				continue;
+			if (classSize[charClass] < MaxFirstChars)
+				classChars[charClass * MaxFirstChars + classSize[charClass]] = (wchar_t)i;
+			classSize[charClass]++;
+		}
+		int firstCount = 0;
+		for (int c=0; c<dfa->AlphabetSize; c++)
+			if (dfa->GetNextState(state, (Word)c) != -1)
+				firstCount += classSize[c];
+		if (firstCount > MaxFirstChars)
+			return;
+		for (int c=0; c<dfa->AlphabetSize; c++)
+			if (dfa->GetNextState(state, (Word)c) != -1)
+				for (int i=0; i<classSize[c]; i++)
+					firstChars[firstCharCount++] = classChars[c * MaxFirstChars + i];
+		// every match starts with the chars along the chain of non-final states that have a
+		// single transition on a single char
+		List<wchar_t> literal;
+		while (!dfa->Tags[state]->IsFinal && literal.Count() < MaxPrefixLength)
+		{
+			int charClass = -1;
+			for (int c=0; c<dfa->AlphabetSize; c++)
+				if (dfa->GetNextState(state, (Word)c) != -1)
+				{
+					if (charClass != -1)
+					{
+						charClass = -1;
+						break;
+					}
+					charClass = c;
+				}
+			if (charClass == -1 || classSize[charClass] != 1)
+				break;
+			literal.Add(classChars[charClass * MaxFirstChars]);
+			state = dfa->GetNextState(state, (Word)charClass);
+		}
+		if (literal.Count() < 2)
+			return;
+		prefix = String(literal.Buffer(), literal.Count());
+		rareOffset1 = 0;
+		for (int i=1; i<literal.Count(); i++)
+			if (CharRarity(literal[i]) > CharRarity(literal[rareOffset1]))
+				rareOffset1 = i;
+		rareOffset2 = rareOffset1 == 0 ? 1 : 0;
+		for (int i=0; i<literal.Count(); i++)
+			if (i != rareOffset1 && CharRarity(literal[i]) > CharRarity(literal[rareOffset2]))
+				rareOffset2 = i;
+	}
+
+	int RegexPrefilter::FindPrefix(const StringView & str, int pos)
+	{
+		const wchar_t * buffer = str.Buffer();
+		const wchar_t * literal = prefix.Buffer();
+		int length = prefix.Length();
+		int last = str.Length() - length;
+		wchar_t ch1 = literal[rareOffset1], ch2 = literal[rareOffset2];
+		int i = pos;
+#ifdef CORE_LIB_REGEX_SSE2
+		__m128i splat1 = SplatChar(ch1), splat2 = SplatChar(ch2);
+		for (; i + CharLanes - 1 <= last; i += CharLanes)
+		{
+			__m128i eq1 = CompareChars(LoadChars(buffer + i + rareOffset1), splat1);
+			__m128i eq2 = CompareChars(LoadChars(buffer + i + rareOffset2), splat2);
+			unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(eq1, eq2));
+			while (mask)
+			{
+				int lane = BitOps::TrailingZeroCount(mask) / (int)sizeof(wchar_t);
+				if (memcmp(buffer + i + lane, literal, length * sizeof(wchar_t)) == 0)
+					return i + lane;
+				mask &= ~(((1u << sizeof(wchar_t)) - 1) << (lane * sizeof(wchar_t)));
+			}
+		}
+#endif
+		for (; i <= last; i++)
+			if (buffer[i + rareOffset1] == ch1 && buffer[i + rareOffset2] == ch2 &&
+				memcmp(buffer + i, literal, length * sizeof(wchar_t)) == 0)
+				return i;
+		return -1;
+	}
+
+	int RegexPrefilter::FindFirstChar(const StringView & str, int pos)
+	{
+		const wchar_t * buffer = str.Buffer();
+		int length = str.Length();
+		int i = pos;
+#ifdef CORE_LIB_REGEX_SSE2
+		__m128i splats[MaxFirstChars];
+		for (int j=0; j<firstCharCount; j++)
+			splats[j] = SplatChar(firstChars[j]);
+		for (; i + CharLanes <= length; i += CharLanes)
+		{
+			__m128i chars = LoadChars(buffer + i);
+			__m128i eq = CompareChars(chars, splats[0]);
+			for (int j=1; j<firstCharCount; j++)
+				eq = _mm_or_si128(eq, CompareChars(chars, splats[j]));
+			unsigned int mask = (unsigned int)_mm_movemask_epi8(eq);
+			if (mask)
+				return i + BitOps::TrailingZeroCount(mask) / (int)sizeof(wchar_t);
+		}
+#endif
+		for (; i<length; i++)
+			for (int j=0; j<firstCharCount; j++)
+				if (buffer[i] == firstChars[j])
+					return i;
+		return -1;
+	}
+
+	int RegexPrefilter::Find(const StringView & str, int pos)
+	{
+		if (pos > str.Length())
+			return -1;
+		if (prefix.Length())
+			return FindPrefix(str, pos);
+		if (firstCharCount)
+			return FindFirstChar(str, pos);
+		return pos;
+	}
+
 	DFA_Table * PureRegex::GetDFA()
 	{
 		return dfaTable.operator->();
 	}
 
-	PureRegex::PureRegex(const String & regex)
+	static RefPtr<NFA_Graph> BuildNFA(const String & regex)
 	{
 		RegexParser p;
 		RefPtr<RegexNode> tree = p.Parse(regex);
-		if (tree)
-		{
-			NFA_Graph nfa;
-			nfa.GenerateFromRegexTree(tree.operator ->());
-			DFA_Graph dfa;
-			dfa.Generate(&nfa);
-			dfaTable = new DFA_Table();
-			dfa.ToDfaTable(dfaTable.operator->());
-		}
-		else
+		if (!tree)
 		{
 			IllegalRegexException ex;
 			if (p.Errors.Count())
 				ex.Message = p.Errors[0].Text;
 			throw ex;
 		}
+		RefPtr<NFA_Graph> nfa = new NFA_Graph();
+		nfa->GenerateFromRegexTree(tree.operator ->());
+		return nfa;
+	}
+
+	// Patterns whose full DFA went past MaxFullDFAStates, so Auto mode goes straight to a
+	// LazyDFA for them instead of running subset construction again.
+	struct OversizedPatterns
+	{
+		std::mutex Mutex;
+		HashSet<String> Patterns;
+	};
+
+	static OversizedPatterns & GetOversizedPatterns()
+	{
+		static std::once_flag created;
+		static OversizedPatterns * patterns = 0;
+		std::call_once(created, []() { patterns = new OversizedPatterns(); });
+		return *patterns;
+	}
+
+	PureRegex::PureRegex(const String & regex, RegexDFAMode mode)
+	{
+		RefPtr<NFA_Graph> nfa;
+		OversizedPatterns & oversized = GetOversizedPatterns();
+		if (mode == RegexDFAMode::Auto)
+		{
+			std::lock_guard<std::mutex> lock(oversized.Mutex);
+			if (oversized.Patterns.Contains(regex))
+				mode = RegexDFAMode::Lazy;
+		}
+		if (mode != RegexDFAMode::Lazy)
+		{
+			dfaTable = DFA_Cache::GetTable(L"regex:" + regex, [&]() -> RefPtr<DFA_Table>
+			{
+				nfa = BuildNFA(regex);
+				DFA_Graph dfa;
+				if (!dfa.Generate(nfa.operator->(), mode == RegexDFAMode::Auto ? MaxFullDFAStates : -1))
+				{
+					std::lock_guard<std::mutex> lock(oversized.Mutex);
+					oversized.Patterns.Add(regex);
+					return 0;
+				}
+				RefPtr<DFA_Table> table = new DFA_Table();
+				dfa.ToDfaTable(table.operator->());
+				return table;
+			});
+		}
+		if (dfaTable)
+			prefilter.Build(dfaTable.operator->());
+		else
+		{
+			if (!nfa)
+				nfa = BuildNFA(regex);
+			lazyDFA = new LazyDFA(nfa.operator->());
+		}
 	}
 
-	bool PureRegex::IsMatch(const String & str)
+	RegexMatcher PureRegex::GetMatcher()
 	{
-		RegexMatcher matcher(dfaTable.operator->());
+		if (lazyDFA)
+			return RegexMatcher(lazyDFA.operator->());
+		return RegexMatcher(dfaTable.operator->());
+	}
+
+	bool PureRegex::IsMatch(const StringView & str)
+	{
+		RegexMatcher matcher = GetMatcher();
 		return (matcher.Match(str, 0)==str.Length());
 	}
 
-	PureRegex::RegexMatchResult PureRegex::Search(const String & str, int startPos)
+	PureRegex::RegexMatchResult PureRegex::Search(const StringView & str, int startPos)
 	{
-		RegexMatcher matcher(dfaTable.operator ->());
+		RegexMatcher matcher = GetMatcher();
 		for (int i=startPos; i<str.Length(); i++)
 		{
+			i = prefilter.Find(str, i);
+			if (i == -1)
+				break;
 			int len = matcher.Match(str, i);
 			if (len >= 0)
 			{
@@ -88,5 +333,96 @@ namespace Text
 		rs.Length = -1;
 		return rs;
 	}
+
+	PureRegex::RegexMatchResult PureRegex::SearchLongest(const StringView & str, int startPos)
+	{
+		struct Thread
+		{
+			int State, Start;
+		};
+		RegexMatchResult rs;
+		rs.Start = 0;
+		rs.Length = -1;
+		if (lazyDFA)
+		{
+			for (int i=startPos; i<=str.Length(); i++)
+			{
+				int len = lazyDFA->MatchLongest(str, i);
+				if (len >= 0)
+				{
+					rs.Start = i;
+					rs.Length = len;
+					break;
+				}
+			}
+			return rs;
+		}
+		DFA_Table * dfa = dfaTable.operator->();
+		int startState = dfa->StartState;
+		if (startState == -1)
+			return rs;
+		// threads are ordered by start position; a state reached by several threads at the
+		// same position is kept only for the leftmost one, as their futures are identical
+		List<Thread> threads, nextThreads;
+		List<int> claimed;
+		claimed.SetSize(dfa->StateCount);
+		for (int i=0; i<claimed.Count(); i++)
+			claimed[i] = -1;
+		const wchar_t * buffer = str.Buffer();
+		int length = str.Length();
+		int pos = startPos;
+		while (pos <= length)
+		{
+			if (rs.Length == -1)
+			{
+				if (threads.Count() == 0)
+				{
+					pos = prefilter.Find(str, pos);
+					if (pos == -1)
+						break;
+				}
+				if (claimed[startState] != pos)
+				{
+					claimed[startState] = pos;
+					Thread thread;
+					thread.State = startState;
+					thread.Start = pos;
+					threads.Add(thread);
+					if (dfa->Tags[startState]->IsFinal)
+					{
+						rs.Start = pos;
+						rs.Length = 0;
+					}
+				}
+			}
+			if (pos == length || threads.Count() == 0)
+				break;
+			Word charClass = dfa->GetCharClass(buffer[pos]);
+			nextThreads.Clear();
+			if (charClass != 0xFFFF)
+			{
+				for (int i=0; i<threads.Count(); i++)
+				{
+					Thread thread = threads[i];
+					if (rs.Length != -1 && thread.Start > rs.Start)
+						break;
+					int nextState = dfa->GetNextState(thread.State, charClass);
+					if (nextState == -1 || claimed[nextState] == pos + 1)
+						continue;
+					claimed[nextState] = pos + 1;
+					thread.State = nextState;
+					nextThreads.Add(thread);
+					if (dfa->Tags[nextState]->IsFinal && (rs.Length == -1 || thread.Start <= rs.Start))
+					{
+						rs.Start = thread.Start;
+						rs.Length = pos + 1 - thread.Start;
+					}
+				}
+			}
+			threads.SwapWith(nextThreads);
+			pos++;
+		}
+		return rs;
+	}
 }
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define GX_REGEX_H
 
 #include "RegexDFA.h"
+#include "RegexLazyDFA.h"
 
 namespace CoreLib
 {
@@ -15,24 +16,74 @@ namespace CoreLib
 		{
 		private:
 			DFA_Table * dfa;
+			LazyDFA * lazyDFA;
 		public:
 			RegexMatcher(DFA_Table * table);
-			int Match(const String & str, int startPos = 0);
+			RegexMatcher(LazyDFA * lazyDFA);
+			int Match(const StringView & str, int startPos = 0);
+		};
+
+		// Skips ahead to positions where a match can start. Built from the DFA: either the
+		// literal every match starts with, or a set of at most MaxFirstChars first characters.
+		// Literals are found by scanning for their two rarest characters at once.
+		class RegexPrefilter
+		{
+		public:
+			static const int MaxFirstChars = 3;
+			static const int MaxPrefixLength = 64;
+		private:
+			String prefix;
+			int rareOffset1, rareOffset2;
+			wchar_t firstChars[MaxFirstChars];
+			int firstCharCount;
+			int FindPrefix(const StringView & str, int pos);
+			int FindFirstChar(const StringView & str, int pos);
+		public:
+			RegexPrefilter();
+			void Build(DFA_Table * dfa);
+			// first position >= pos where a match may start, -1 if there is none
+			int Find(const StringView & str, int pos);
+			// required literal prefix of every match, empty if there is none
+			const String & GetPrefix() const
+			{
+				return prefix;
+			}
+		};
+
+		// How PureRegex builds its automaton. Auto builds the full DFA unless subset construction
+		// goes past PureRegex::MaxFullDFAStates states, and then uses a LazyDFA. That outcome is
+		// remembered, so later regexes with the same pattern skip the attempt.
+		enum class RegexDFAMode
+		{
+			Auto, Full, Lazy
 		};
 
 		class PureRegex : public Object
 		{
 		private:
 			RefPtr<DFA_Table> dfaTable;
+			RefPtr<LazyDFA> lazyDFA;
+			RegexPrefilter prefilter;
+			RegexMatcher GetMatcher();
 		public:
+			static const int MaxFullDFAStates = 10000;
 			struct RegexMatchResult
 			{
 				int Start;
 				int Length;
 			};
-			PureRegex(const String & regex);
-			bool IsMatch(const String & str); // Match Whole Word
-			RegexMatchResult Search(const String & str, int startPos = 0);
+			// A regex with a lazy DFA updates it while matching, so it must not be used by
+			// several threads at once.
+			PureRegex(const String & regex, RegexDFAMode mode = RegexDFAMode::Auto);
+			bool IsMatch(const StringView & str); // Match Whole Word
+			// Finds the first position at which the DFA stops in a final state. Length is -1 if
+			// nothing matches.
+			RegexMatchResult Search(const StringView & str, int startPos = 0);
+			// Leftmost-longest match, found in a single pass over str: every live start position
+			// is advanced at once, at most one per DFA state, instead of restarting the DFA.
+			// With a lazy DFA each start position is tried in turn.
+			RegexMatchResult SearchLongest(const StringView & str, int startPos = 0);
+			// null if the regex uses a lazy DFA
 			DFA_Table * GetDFA();
 		};
 	}
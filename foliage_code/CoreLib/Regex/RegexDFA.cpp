@@ -1,5 +1,15 @@
 #include "RegexDFA.h"
 #include "../Basic.h"
+#include "../LibIO.h"
+#include <climits>
+#include <mutex>
+#ifdef WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace CoreLib::IO;
 
 namespace CoreLib
 {
@@ -90,19 +100,55 @@ namespace Text
 			Translations[i] = 0;
 	}
 
-	void DFA_Graph::CombineCharElements(NFA_Node * node, List<Word> & elem)
+	void NFA_MoveTable::Build(NFA_Node * startNode)
 	{
-		for (int i=0; i<node->Translations.Count(); i++)
+		Dictionary<NFA_Node *, int> index;
+		Nodes.Clear();
+		Nodes.Add(startNode);
+		index.Add(startNode, 0);
+		for (int i=0; i<Nodes.Count(); i++)
+		{
+			for (int j=0; j<Nodes[i]->Translations.Count(); j++)
+			{
+				NFA_Node * dest = Nodes[i]->Translations[j]->NodeDest;
+				if (!index.ContainsKey(dest))
+				{
+					index.Add(dest, Nodes.Count());
+					Nodes.Add(dest);
+				}
+			}
+		}
+		Start.Clear();
+		Elements.Clear();
+		Dests.Clear();
+		for (int i=0; i<Nodes.Count(); i++)
 		{
-			for (int j=0; j<node->Translations[i]->CharSet->Elements.Count(); j++)
+			Start.Add(Elements.Count());
+			for (int j=0; j<Nodes[i]->Translations.Count(); j++)
 			{
-				if (elem.IndexOf(node->Translations[i]->CharSet->Elements[j]) == -1)
-					elem.Add(node->Translations[i]->CharSet->Elements[j]);
+				NFA_Translation * trans = Nodes[i]->Translations[j];
+				int dest = index[trans->NodeDest];
+				for (int k=0; k<trans->CharSet->Elements.Count(); k++)
+				{
+					Elements.Add(trans->CharSet->Elements[k]);
+					Dests.Add(dest);
+				}
 			}
 		}
+		Start.Add(Elements.Count());
 	}
 
-	void DFA_Graph::Generate(NFA_Graph * nfa)
+	void NFA_MoveTable::Move(const IntSet & set, int element, IntSet & rs) const
+	{
+		set.ForEachSetBit([&](int n)
+		{
+			for (int m=Start[n]; m<Start[n+1]; m++)
+				if (Elements[m] == element)
+					rs.Add(Dests[m]);
+		});
+	}
+
+	bool DFA_Graph::Generate(NFA_Graph * nfa, int maxStates)
 	{
 		table = new RegexCharTable();
 		List<RegexCharSet * > charSets;
@@ -114,66 +160,69 @@ namespace Text
 		CharTableGenerator gen(table.operator ->());
 		int elements = gen.Generate(charSets);
 		CharElements = gen.elements;
-		List<DFA_Node *> L,D;
+
+		NFA_MoveTable moves;
+		moves.Build(nfa->start);
+
+		Dictionary<IntSet, int> stateIndex;
+		List<IntSet> stateSets;
+		List<IntSet> targets;
+		List<bool> targetUsed;
+		List<int> usedElements;
+		targets.SetSize(elements);
+		targetUsed.SetSize(elements);
+		for (int i=0; i<elements; i++)
+		{
+			targets[i].SetMax(moves.Nodes.Count());
+			targetUsed[i] = false;
+		}
 		startNode = new DFA_Node(elements);
 		startNode->ID = 0;
+		startNode->IsFinal = false;
 		startNode->Nodes.Add(nfa->start);
-		L.Add(startNode);
 		nodes.Add(startNode);
-		List<Word> charElem;
-		do
-		{
-			DFA_Node * node = L.Last();
-			L.RemoveAt(L.Count()-1);
-			charElem.Clear();
-			node->IsFinal = false;
-			for (int i=0; i<node->Nodes.Count(); i++)
-			{
-				CombineCharElements(node->Nodes[i], charElem);
-				if (node->Nodes[i]->IsFinal)
-					node->IsFinal = true;
-			}
-			for (int i=0; i<charElem.Count(); i++)
+		IntSet startSet(moves.Nodes.Count());
+		startSet.Add(0);
+		stateSets.Add(startSet);
+		stateIndex.Add(startSet, 0);
+		for (int s=0; s<nodes.Count(); s++)
+		{
+			usedElements.Clear();
+			stateSets[s].ForEachSetBit([&](int n)
 			{
-				DFA_Node * n = new DFA_Node(0);
-				for (int j=0; j<node->Nodes.Count(); j++)
+				for (int m=moves.Start[n]; m<moves.Start[n+1]; m++)
 				{
-					for (int k=0; k<node->Nodes[j]->Translations.Count(); k++)
+					int element = moves.Elements[m];
+					if (!targetUsed[element])
 					{
-						NFA_Translation * trans = node->Nodes[j]->Translations[k];
-						if (trans->CharSet->Elements.Contains(charElem[i]))
-						{
-							if (!n->Nodes.Contains(node->Nodes[j]->Translations[k]->NodeDest))
-								n->Nodes.Add(node->Nodes[j]->Translations[k]->NodeDest);
-						}
+						targetUsed[element] = true;
+						usedElements.Add(element);
 					}
+					targets[element].Add(moves.Dests[m]);
 				}
-				int fid = -1;
-				for (int j=0; j<nodes.Count(); j++)
-				{
-					if ((*nodes[j]) == *n)
-					{
-						fid = j;
-						break;
-					}
-				}
-				if (fid == -1)
+			});
+			for (int i=0; i<usedElements.Count(); i++)
+			{
+				int element = usedElements[i];
+				int id;
+				if (!stateIndex.TryGetValue(targets[element], id))
 				{
-					n->Translations.SetSize(elements);
-					for (int m=0; m<elements; m++)
-						n->Translations[m] = 0;
-					n->ID = nodes.Count();
-					L.Add(n);
+					if (maxStates >= 0 && nodes.Count() >= maxStates)
+						return false;
+					id = nodes.Count();
+					DFA_Node * n = new DFA_Node(elements);
+					n->ID = id;
+					n->IsFinal = false;
+					targets[element].ForEachSetBit([&](int k) { n->Nodes.Add(moves.Nodes[k]); });
 					nodes.Add(n);
-					fid = nodes.Count()-1;
+					stateSets.Add(targets[element]);
+					stateIndex.Add(targets[element], id);
 				}
-				else
-					delete n;
-				n = nodes[fid].operator ->();
-				node->Translations[charElem[i]] = n;
+				nodes[s]->Translations[element] = nodes[id].operator->();
+				targets[element].Clear();
+				targetUsed[element] = false;
 			}
 		}
-		while (L.Count());
 
 		// Set Terminal Identifiers
 		HashSet<int> terminalIdentifiers;
@@ -192,6 +241,226 @@ namespace Text
 			}
 			nodes[i]->TerminalIdentifiers.Sort();
 		}
+		Minimize();
+		return true;
+	}
+
+	// Hopcroft's partition refinement. Missing transitions lead to an explicit dead state that
+	// is kept apart from every real state, so the minimized DFA has no transition exactly where
+	// the original had none and matchers behave the same. States are only merged if they agree
+	// on IsFinal and TerminalIdentifiers.
+	void DFA_Graph::Minimize()
+	{
+		int n = nodes.Count();
+		int k = CharElements.Count();
+		if (n < 2 || k == 0)
+			return;
+		int dead = n;
+		int stateCount = n + 1;
+		auto next = [&](int s, int c) -> int
+		{
+			if (s == dead)
+				return dead;
+			DFA_Node * dest = nodes[s]->Translations[c];
+			return dest ? dest->ID : dead;
+		};
+		// predecessors of each state, ordered by char element
+		List<int> predStart, predStates, predElements;
+		predStart.SetSize(stateCount + 1);
+		for (int i=0; i<=stateCount; i++)
+			predStart[i] = 0;
+		for (int c=0; c<k; c++)
+			for (int s=0; s<stateCount; s++)
+				predStart[next(s, c) + 1]++;
+		for (int i=0; i<stateCount; i++)
+			predStart[i + 1] += predStart[i];
+		predStates.SetSize(predStart[stateCount]);
+		predElements.SetSize(predStart[stateCount]);
+		{
+			List<int> cursor;
+			cursor.AddRange(predStart.Buffer(), stateCount);
+			for (int c=0; c<k; c++)
+				for (int s=0; s<stateCount; s++)
+				{
+					int pos = cursor[next(s, c)]++;
+					predStates[pos] = s;
+					predElements[pos] = c;
+				}
+		}
+
+		// initial partition: the dead state alone, real states grouped by what they accept
+		List<int> elems, location, blockOf, blockStart, blockEnd, marked;
+		for (int s=0; s<n; s++)
+			elems.Add(s);
+		elems.Sort([&](int & a, int & b)
+		{
+			if (nodes[a]->IsFinal != nodes[b]->IsFinal)
+				return nodes[a]->IsFinal < nodes[b]->IsFinal;
+			auto & ta = nodes[a]->TerminalIdentifiers;
+			auto & tb = nodes[b]->TerminalIdentifiers;
+			for (int i=0; i<ta.Count() && i<tb.Count(); i++)
+				if (ta[i] != tb[i])
+					return ta[i] < tb[i];
+			if (ta.Count() != tb.Count())
+				return ta.Count() < tb.Count();
+			return a < b;
+		});
+		elems.Add(dead);
+		location.SetSize(stateCount);
+		blockOf.SetSize(stateCount);
+		for (int i=0; i<stateCount; i++)
+		{
+			int s = elems[i];
+			location[s] = i;
+			bool newBlock = i == 0 || s == dead;
+			if (!newBlock)
+			{
+				DFA_Node * prev = nodes[elems[i - 1]].operator->();
+				DFA_Node * cur = nodes[s].operator->();
+				newBlock = prev->IsFinal != cur->IsFinal || prev->TerminalIdentifiers.Count() != cur->TerminalIdentifiers.Count();
+				for (int j=0; !newBlock && j<cur->TerminalIdentifiers.Count(); j++)
+					newBlock = prev->TerminalIdentifiers[j] != cur->TerminalIdentifiers[j];
+			}
+			if (newBlock)
+			{
+				if (blockStart.Count())
+					blockEnd.Add(i);
+				blockStart.Add(i);
+				marked.Add(0);
+			}
+			blockOf[s] = blockStart.Count() - 1;
+		}
+		blockEnd.Add(stateCount);
+
+		// pending splitters (block, char element)
+		List<int> workBlocks, workElements;
+		List<bool> inWork;
+		inWork.SetSize(stateCount * k);
+		for (int i=0; i<inWork.Count(); i++)
+			inWork[i] = false;
+		auto addWork = [&](int block, int c)
+		{
+			if (!inWork[block * k + c])
+			{
+				inWork[block * k + c] = true;
+				workBlocks.Add(block);
+				workElements.Add(c);
+			}
+		};
+		for (int b=0; b<blockStart.Count(); b++)
+			for (int c=0; c<k; c++)
+				addWork(b, c);
+
+		List<int> splitter, touchedBlocks;
+		while (workBlocks.Count())
+		{
+			int a = workBlocks.Last();
+			int c = workElements.Last();
+			workBlocks.RemoveAt(workBlocks.Count() - 1);
+			workElements.RemoveAt(workElements.Count() - 1);
+			inWork[a * k + c] = false;
+			// marking reorders blocks, so take a copy of the splitter first
+			splitter.Clear();
+			splitter.AddRange(elems.Buffer() + blockStart[a], blockEnd[a] - blockStart[a]);
+			touchedBlocks.Clear();
+			for (int i=0; i<splitter.Count(); i++)
+			{
+				int t = splitter[i];
+				// the predecessors of t on c are a contiguous run
+				int lo = predStart[t], hi = predStart[t + 1];
+				while (lo < hi)
+				{
+					int mid = (lo + hi) >> 1;
+					if (predElements[mid] < c)
+						lo = mid + 1;
+					else
+						hi = mid;
+				}
+				for (int p=lo; p<predStart[t + 1] && predElements[p] == c; p++)
+				{
+					int s = predStates[p];
+					int b = blockOf[s];
+					int markPos = blockStart[b] + marked[b];
+					int pos = location[s];
+					if (pos < markPos)
+						continue;
+					// move s to the marked front of its block
+					int other = elems[markPos];
+					elems[markPos] = s;
+					location[s] = markPos;
+					elems[pos] = other;
+					location[other] = pos;
+					if (marked[b]++ == 0)
+						touchedBlocks.Add(b);
+				}
+			}
+			for (int i=0; i<touchedBlocks.Count(); i++)
+			{
+				int b = touchedBlocks[i];
+				int markedCount = marked[b];
+				marked[b] = 0;
+				int size = blockEnd[b] - blockStart[b];
+				if (markedCount == size)
+					continue;
+				// the smaller half becomes the new block, so states are relabeled O(log n) times
+				int nb = blockStart.Count();
+				int start = blockStart[b], end = blockEnd[b];
+				if (markedCount <= size - markedCount)
+				{
+					blockStart.Add(start);
+					blockEnd.Add(start + markedCount);
+					blockStart[b] = start + markedCount;
+				}
+				else
+				{
+					blockStart.Add(start + markedCount);
+					blockEnd.Add(end);
+					blockEnd[b] = start + markedCount;
+				}
+				marked.Add(0);
+				for (int j=blockStart[nb]; j<blockEnd[nb]; j++)
+					blockOf[elems[j]] = nb;
+				for (int d=0; d<k; d++)
+				{
+					if (inWork[b * k + d])
+						addWork(nb, d);
+					else if (blockEnd[nb] - blockStart[nb] <= blockEnd[b] - blockStart[b])
+						addWork(nb, d);
+					else
+						addWork(b, d);
+				}
+			}
+		}
+
+		if (blockStart.Count() == stateCount)
+			return;
+		// keep the first state of each block, in the original order so the start state stays first
+		List<int> newId;
+		newId.SetSize(blockStart.Count());
+		for (int i=0; i<newId.Count(); i++)
+			newId[i] = -1;
+		List<RefPtr<DFA_Node>> newNodes;
+		for (int s=0; s<n; s++)
+		{
+			if (newId[blockOf[s]] == -1)
+			{
+				newId[blockOf[s]] = newNodes.Count();
+				newNodes.Add(nodes[s]);
+			}
+		}
+		for (int i=0; i<newNodes.Count(); i++)
+		{
+			for (int c=0; c<k; c++)
+			{
+				DFA_Node * dest = newNodes[i]->Translations[c];
+				if (dest)
+					newNodes[i]->Translations[c] = newNodes[newId[blockOf[dest->ID]]].operator->();
+			}
+		}
+		for (int i=0; i<newNodes.Count(); i++)
+			newNodes[i]->ID = i;
+		nodes = _Move(newNodes);
+		startNode = nodes[0].operator->();
 	}
 
 	bool DFA_Node::operator == (const DFA_Node & node)
@@ -253,22 +522,24 @@ namespace Text
 
 	void DFA_Graph::ToDfaTable(DFA_Table * dfa)
 	{
+		if (nodes.Count() >= DFA_Table::MaxStateCount)
+			throw InvalidOperationException(L"Too many DFA states.");
 		dfa->CharTable = table;
-		dfa->DFA = new int*[nodes.Count()];
 		dfa->Tags.SetSize(nodes.Count());
 		for (int i=0; i<nodes.Count(); i++)
-			dfa->Tags[i] = new DFA_Table_Tag();
+			dfa->Tags[i] = MakeRef<DFA_Table_Tag>();
 		dfa->StateCount = nodes.Count();
 		dfa->AlphabetSize = CharElements.Count();
+		List<int> transitions;
+		transitions.SetSize(dfa->StateCount * dfa->AlphabetSize);
 		for (int i=0; i<nodes.Count(); i++)
 		{
-			dfa->DFA[i] = new int[table->Count()];
 			for (int j=0; j<nodes[i]->Translations.Count(); j++)
 			{
 				if (nodes[i]->Translations[j])
-					dfa->DFA[i][j] = nodes[i]->Translations[j]->ID;
+					transitions[i * dfa->AlphabetSize + j] = nodes[i]->Translations[j]->ID;
 				else
-					dfa->DFA[i][j] = -1;
+					transitions[i * dfa->AlphabetSize + j] = -1;
 			}
 			if (nodes[i] == startNode)
 				dfa->StartState = i;
@@ -278,24 +549,316 @@ namespace Text
 				dfa->Tags[i]->TerminalIdentifiers = nodes[i]->TerminalIdentifiers;
 			}
 		}
+		dfa->SetTransitions(transitions);
 	}
 
 	DFA_Table::DFA_Table()
 	{
-		DFA = 0;
 		StateCount = 0;
 		AlphabetSize = 0;
 		StartState = -1;
 	}
-	
-	DFA_Table::~DFA_Table()
+
+	void DFA_Table::SetTransitions(const List<int> & table)
+	{
+		// place the fullest rows first, each at the lowest offset where its transitions land
+		// on unused entries
+		List<int> rowSize, order, columns;
+		rowSize.SetSize(StateCount);
+		for (int i=0; i<StateCount; i++)
+		{
+			rowSize[i] = 0;
+			for (int j=0; j<AlphabetSize; j++)
+				if (table[i * AlphabetSize + j] != -1)
+					rowSize[i]++;
+			order.Add(i);
+		}
+		order.Sort([&](int & a, int & b) { return rowSize[a] > rowSize[b] || (rowSize[a] == rowSize[b] && a < b); });
+		DFA_Transition empty;
+		empty.Next = 0;
+		empty.Check = 0xFFFF;
+		Transitions.Clear();
+		for (int i=0; i<AlphabetSize; i++)
+			Transitions.Add(empty);
+		RowOffsets.SetSize(StateCount);
+		int firstFree = 0;
+		for (int i=0; i<order.Count(); i++)
+		{
+			int state = order[i];
+			RowOffsets[state] = 0;
+			columns.Clear();
+			for (int j=0; j<AlphabetSize; j++)
+				if (table[state * AlphabetSize + j] != -1)
+					columns.Add(j);
+			if (columns.Count() == 0)
+				continue;
+			int offset = Math::Max(0, firstFree - columns[0]);
+			while (true)
+			{
+				bool fits = true;
+				for (int j=0; j<columns.Count() && fits; j++)
+				{
+					int id = offset + columns[j];
+					fits = id >= Transitions.Count() || Transitions[id].Check == 0xFFFF;
+				}
+				if (fits)
+					break;
+				offset++;
+			}
+			while (Transitions.Count() < offset + AlphabetSize)
+				Transitions.Add(empty);
+			for (int j=0; j<columns.Count(); j++)
+			{
+				DFA_Transition & trans = Transitions[offset + columns[j]];
+				trans.Next = (Word)table[state * AlphabetSize + columns[j]];
+				trans.Check = (Word)state;
+			}
+			RowOffsets[state] = offset;
+			while (firstFree < Transitions.Count() && Transitions[firstFree].Check != 0xFFFF)
+				firstFree++;
+		}
+	}
+
+	static const int DFA_TableMagic = 0x41464446; // "FDFA"
+	static const int DFA_TableVersion = 1;
+
+	void DFA_Table::Save(BinaryWriter & writer)
+	{
+		writer.Write(DFA_TableMagic);
+		writer.Write(DFA_TableVersion);
+		writer.Write(StateCount);
+		writer.Write(AlphabetSize);
+		writer.Write(StartState);
+		// the char table is mostly long runs of the same class
+		int charCount = CharTable ? CharTable->Count() : 0;
+		writer.WriteVarUInt32(charCount);
+		for (int i=0; i<charCount; )
+		{
+			int runEnd = i + 1;
+			while (runEnd < charCount && (*CharTable)[runEnd] == (*CharTable)[i])
+				runEnd++;
+			writer.WriteVarUInt32(runEnd - i);
+			writer.Write((*CharTable)[i]);
+			i = runEnd;
+		}
+		writer.WriteArray(RowOffsets);
+		writer.Write(Transitions.Count());
+		writer.WriteArray((const Word*)Transitions.Buffer(), Transitions.Count() * 2);
+		for (int i=0; i<StateCount; i++)
+		{
+			writer.Write((unsigned char)(Tags[i]->IsFinal ? 1 : 0));
+			writer.WriteVarUInt32(Tags[i]->TerminalIdentifiers.Count());
+			for (int j=0; j<Tags[i]->TerminalIdentifiers.Count(); j++)
+				writer.WriteVarUInt32(Tags[i]->TerminalIdentifiers[j]);
+		}
+	}
+
+	void DFA_Table::Load(BinaryReader & reader)
+	{
+		if (reader.ReadInt32() != DFA_TableMagic || reader.ReadInt32() != DFA_TableVersion)
+			throw IOException(L"Not a DFA table of this version.");
+		StateCount = reader.ReadInt32();
+		AlphabetSize = reader.ReadInt32();
+		StartState = reader.ReadInt32();
+		if (StateCount < 0 || StateCount >= MaxStateCount || AlphabetSize < 0 || AlphabetSize >= 0xFFFF ||
+			StartState < -1 || StartState >= StateCount)
+			throw IOException(L"Corrupt DFA table.");
+		unsigned int charCount = reader.ReadVarUInt32();
+		if (charCount > 0x110000)
+			throw IOException(L"Corrupt DFA table.");
+		CharTable = new RegexCharTable();
+		CharTable->SetSize((int)charCount);
+		for (int i=0; i<(int)charCount; )
+		{
+			unsigned int run = reader.ReadVarUInt32();
+			Word charClass = reader.ReadInt16();
+			if (run == 0 || run > charCount - i)
+				throw IOException(L"Corrupt DFA table.");
+			for (int j=0; j<(int)run; j++)
+				(*CharTable)[i + j] = charClass;
+			i += run;
+		}
+		// counts are checked before anything is sized by them; SetTransitions starts with one
+		// row of entries and adds at most one row per state
+		if (reader.ReadInt32() != StateCount)
+			throw IOException(L"Corrupt DFA table.");
+		RowOffsets.SetSize(StateCount);
+		reader.ReadArray(RowOffsets.Buffer(), StateCount);
+		int transitionCount = reader.ReadInt32();
+		if (transitionCount < AlphabetSize || (Int64)transitionCount > (Int64)(StateCount + 1) * AlphabetSize ||
+			transitionCount > INT_MAX / (int)sizeof(DFA_Transition))
+			throw IOException(L"Corrupt DFA table.");
+		Transitions.SetSize(transitionCount);
+		reader.ReadArray((Word*)Transitions.Buffer(), transitionCount * 2);
+		// the matchers index with these without checking
+		for (int i=0; i<CharTable->Count(); i++)
+			if ((*CharTable)[i] >= AlphabetSize && (*CharTable)[i] != 0xFFFF)
+				throw IOException(L"Corrupt DFA table.");
+		for (int i=0; i<StateCount; i++)
+			if (RowOffsets[i] < 0 || RowOffsets[i] > transitionCount - AlphabetSize)
+				throw IOException(L"Corrupt DFA table.");
+		for (int i=0; i<transitionCount; i++)
+			if (Transitions[i].Check != 0xFFFF && (Transitions[i].Check >= StateCount || Transitions[i].Next >= StateCount))
+				throw IOException(L"Corrupt DFA table.");
+		Tags.SetSize(StateCount);
+		for (int i=0; i<StateCount; i++)
+		{
+			Tags[i] = MakeRef<DFA_Table_Tag>();
+			Tags[i]->IsFinal = reader.ReadByte() != 0;
+			unsigned int count = reader.ReadVarUInt32();
+			if (count > (unsigned int)MaxStateCount)
+				throw IOException(L"Corrupt DFA table.");
+			Tags[i]->TerminalIdentifiers.SetSize((int)count);
+			for (int j=0; j<(int)count; j++)
+				Tags[i]->TerminalIdentifiers[j] = (int)reader.ReadVarUInt32();
+		}
+	}
+
+	struct DFA_CacheState
+	{
+		std::mutex Mutex;
+		Dictionary<String, RefPtr<DFA_Table>> Tables;
+		String Directory;
+	};
+
+	static DFA_CacheState & GetCacheState()
+	{
+		static std::once_flag created;
+		static DFA_CacheState * state = 0;
+		std::call_once(created, []() { state = new DFA_CacheState(); });
+		return *state;
+	}
+
+	static String GetCacheFileName(const String & directory, const String & source)
 	{
-		if (DFA)
+		// 64-bit FNV-1a; the file also holds the source, so a collision is only a miss
+		uint64_t hash = 14695981039346656037ull;
+		for (int i=0; i<source.Length(); i++)
 		{
-			for (int i=0; i<StateCount; i++)
-				delete [] DFA[i];
-			delete [] DFA;
+			hash ^= (unsigned int)source[i];
+			hash *= 1099511628211ull;
 		}
+		wchar_t name[16];
+		for (int i=0; i<16; i++)
+			name[i] = L"0123456789abcdef"[(hash >> (60 - i * 4)) & 15];
+		return Path::Combine(directory, String(name, 16) + L".dfa");
+	}
+
+	// 64-bit FNV-1a of the bytes after the checksum at the start of a cache file
+	static uint64_t GetChecksum(const unsigned char * data, Int64 length)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (Int64 i=0; i<length; i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static RefPtr<DFA_Table> LoadCachedTable(const String & fileName, const String & source)
+	{
+		if (!File::Exists(fileName))
+			return 0;
+		try
+		{
+			// Load only rejects tables that are inconsistent, so a file damaged on disk could
+			// still give a table that matches the wrong strings; the checksum catches that
+			MemoryMappedFileStream * file = new MemoryMappedFileStream(fileName, MemoryAccessPattern::Sequential);
+			BinaryReader reader(file);
+			if (file->GetLength() < (Int64)sizeof(uint64_t))
+				return 0;
+			uint64_t checksum = (uint64_t)reader.ReadInt64();
+			if (checksum != GetChecksum(file->GetData() + sizeof(uint64_t), file->GetLength() - sizeof(uint64_t)))
+				return 0;
+			if (!(reader.ReadString() == source))
+				return 0;
+			RefPtr<DFA_Table> table = new DFA_Table();
+			table->Load(reader);
+			return table;
+		}
+		catch (const IOException &)
+		{
+			return 0;
+		}
+	}
+
+	static void SaveCachedTable(const String & fileName, const String & source, DFA_Table * table)
+	{
+		// written under a temporary name and renamed, so no process maps a partial file
+#ifdef WIN32
+		String tempName = fileName + L"." + String(_getpid()) + L".tmp";
+#else
+		String tempName = fileName + L"." + String((int)getpid()) + L".tmp";
+#endif
+		try
+		{
+			MemoryStream * contents = new MemoryStream();
+			BinaryWriter contentWriter(contents);
+			contentWriter.Write(source);
+			table->Save(contentWriter);
+			contentWriter.Flush();
+			BinaryWriter writer(new FileStream(tempName, FileMode::Create));
+			writer.Write((Int64)GetChecksum(contents->GetData(), contents->GetLength()));
+			writer.WriteArray(contents->GetData(), (int)contents->GetLength());
+			writer.Close();
+		}
+		catch (const IOException &)
+		{
+			return;
+		}
+#ifdef WIN32
+		if (_wrename(tempName.Buffer(), fileName.Buffer()) != 0)
+			_wremove(tempName.Buffer());
+#else
+		if (rename(tempName.ToMultiByteString(), fileName.ToMultiByteString()) != 0)
+			remove(tempName.ToMultiByteString());
+#endif
+	}
+
+	RefPtr<DFA_Table> DFA_Cache::GetTable(const String & source, const Builder & build)
+	{
+		DFA_CacheState & cache = GetCacheState();
+		RefPtr<DFA_Table> table;
+		String directory;
+		{
+			std::lock_guard<std::mutex> lock(cache.Mutex);
+			if (cache.Tables.TryGetValue(source, table))
+				return table;
+			directory = cache.Directory;
+		}
+		// compiled outside the lock; a table built twice concurrently is harmless
+		String fileName;
+		if (directory.Length())
+		{
+			fileName = GetCacheFileName(directory, source);
+			table = LoadCachedTable(fileName, source);
+		}
+		if (!table)
+		{
+			table = build();
+			if (!table)
+				return table;
+			if (fileName.Length())
+				SaveCachedTable(fileName, source, table.Ptr());
+		}
+		std::lock_guard<std::mutex> lock(cache.Mutex);
+		cache.Tables[source] = table;
+		return table;
+	}
+
+	void DFA_Cache::SetDirectory(const String & directory)
+	{
+		DFA_CacheState & cache = GetCacheState();
+		std::lock_guard<std::mutex> lock(cache.Mutex);
+		cache.Directory = directory;
+	}
+
+	void DFA_Cache::Clear()
+	{
+		DFA_CacheState & cache = GetCacheState();
+		std::lock_guard<std::mutex> lock(cache.Mutex);
+		cache.Tables.Clear();
 	}
 }
 }
\ No newline at end of file
@@ -2,9 +2,17 @@
 #define REGEX_DFA_H
 
 #include "RegexNFA.h"
+#include "../IntSet.h"
+#include <functional>
 
 namespace CoreLib
 {
+	namespace IO
+	{
+		class BinaryReader;
+		class BinaryWriter;
+	}
+
 	namespace Text
 	{
 		using namespace CoreLib::Basic;
@@ -23,6 +31,19 @@ namespace CoreLib
 			int Generate(List<RegexCharSet *> & charSets);
 		};
 
+		// The NFA reachable from a start node, numbered densely with the start node as 0, and the
+		// moves of each node flattened per char element. Input to subset construction.
+		class NFA_MoveTable
+		{
+		public:
+			List<NFA_Node *> Nodes;
+			// the moves of node i are Elements/Dests[Start[i] .. Start[i+1])
+			List<int> Start, Elements, Dests;
+			void Build(NFA_Node * startNode);
+			// adds the nodes reached from set on element to rs
+			void Move(const IntSet & set, int element, IntSet & rs) const;
+		};
+
 		class DFA_Table_Tag
 		{
 		public:
@@ -31,17 +52,64 @@ namespace CoreLib
 			DFA_Table_Tag();
 		};
 
+		// Entry of the compressed transition table. It belongs to the state in Check; entries
+		// owned by other states or unused (Check == 0xFFFF) mean there is no transition.
+		struct DFA_Transition
+		{
+			Word Next;
+			Word Check;
+		};
+
 		class DFA_Table : public Object
 		{
 		public:
+			// States are stored as Words, 0xFFFF marking an unused transition, so a table holds
+			// at most MaxStateCount - 1 states. Patterns that need more have to use a LazyDFA.
+			static const int MaxStateCount = 0xFFFF;
 			int StateCount;
 			int AlphabetSize;
-			int ** DFA;
+			// The row of state s starts at RowOffsets[s] and is indexed by char class. Rows are
+			// overlaid (comb compression) wherever their transitions do not collide.
+			List<int> RowOffsets;
+			List<DFA_Transition> Transitions;
 			List<RefPtr<DFA_Table_Tag>> Tags;
 			int StartState;
 			RefPtr<RegexCharTable> CharTable;
 			DFA_Table();
-			~DFA_Table();
+			// 0xFFFF if ch is not in any char class
+			inline Word GetCharClass(wchar_t ch) const
+			{
+				return (unsigned int)ch < (unsigned int)CharTable->Count() ? (*CharTable)[ch] : (Word)0xFFFF;
+			}
+			// -1 if there is no transition
+			inline int GetNextState(int state, Word charClass) const
+			{
+				const DFA_Transition & trans = Transitions[RowOffsets[state] + charClass];
+				return trans.Check == state ? trans.Next : -1;
+			}
+			// builds the compressed table from a dense StateCount x AlphabetSize one, -1 meaning no transition
+			void SetTransitions(const List<int> & table);
+			// Versioned binary form of the table. Load throws IOException unless the data is a
+			// consistent table written by the same version.
+			void Save(IO::BinaryWriter & writer);
+			void Load(IO::BinaryReader & reader);
+		};
+
+		// Compiled tables shared by everything built from the same source (a regex or a lexer
+		// profile). Tables stay in memory for the life of the process. Once a directory is set
+		// they are also saved there, and later processes map those files instead of compiling.
+		// Files are checksummed; a damaged or outdated file is compiled again and rewritten.
+		class DFA_Cache
+		{
+		public:
+			typedef std::function<RefPtr<DFA_Table>()> Builder;
+			// Returns the table compiled from source, calling build on a miss. A null result
+			// from build is not cached.
+			static RefPtr<DFA_Table> GetTable(const String & source, const Builder & build);
+			// an empty directory turns the on-disk cache off
+			static void SetDirectory(const String & directory);
+			// drops the tables held in memory
+			static void Clear();
 		};
 
 		class DFA_Node : public Object
@@ -63,10 +131,13 @@ namespace CoreLib
 			RefPtr<RegexCharTable> table;
 			DFA_Node * startNode;
 			List<RefPtr<DFA_Node>> nodes;
-			void CombineCharElements(NFA_Node * node, List<Word> & elem);
+			void Minimize();
 		public:
-			void Generate(NFA_Graph * nfa);
+			// Returns false, leaving the graph unusable, if subset construction produces more
+			// than maxStates states; maxStates < 0 means no limit.
+			bool Generate(NFA_Graph * nfa, int maxStates = -1);
 			String Interpret();
+			// throws InvalidOperationException if the graph has DFA_Table::MaxStateCount states or more
 			void ToDfaTable(DFA_Table * dfa);
 		};
 	}
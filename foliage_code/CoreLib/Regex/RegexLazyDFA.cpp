@@ -0,0 +1,150 @@
+#include "RegexLazyDFA.h"
+
+namespace CoreLib
+{
+namespace Text
+{
+	LazyDFA::LazyDFA(NFA_Graph * nfa, int maxStates)
+		: maxStates(Math::Max(maxStates, 2)), flushCount(0)
+	{
+		charTable = new RegexCharTable();
+		List<RegexCharSet * > charSets;
+		for (int i=0; i<nfa->translations.Count(); i++)
+		{
+			if (nfa->translations[i]->CharSet && nfa->translations[i]->CharSet->Ranges.Count())
+				charSets.Add(nfa->translations[i]->CharSet.operator->());
+		}
+		CharTableGenerator gen(charTable.operator ->());
+		alphabetSize = gen.Generate(charSets);
+		moves.Build(nfa->start);
+		nfaNodeCount = moves.Nodes.Count();
+		finalNodes.SetMax(nfaNodeCount);
+		for (int i=0; i<nfaNodeCount; i++)
+			if (moves.Nodes[i]->IsFinal)
+				finalNodes.Add(i);
+		moves.Nodes.Clear();
+		Flush();
+		flushCount = 0;
+	}
+
+	void LazyDFA::Flush()
+	{
+		stateIndex.Clear();
+		stateSets.Clear();
+		stateFinal.Clear();
+		transitions.Clear();
+		flushCount++;
+		IntSet start(nfaNodeCount);
+		start.Add(0);
+		AddState(start);
+	}
+
+	int LazyDFA::AddState(const IntSet & set)
+	{
+		int id = stateSets.Count();
+		stateIndex.Add(set, id);
+		stateSets.Add(set);
+		stateFinal.Add(IntSet::HasIntersection(set, finalNodes));
+		int rowStart = transitions.Count();
+		transitions.SetSize(rowStart + alphabetSize);
+		for (int i=rowStart; i<transitions.Count(); i++)
+			transitions[i] = UnknownState;
+		return id;
+	}
+
+	int LazyDFA::ComputeNextState(int state, Word charClass)
+	{
+		IntSet target(nfaNodeCount);
+		moves.Move(stateSets[state], charClass, target);
+		int next = -1;
+		if (!target.IsEmpty() && !stateIndex.TryGetValue(target, next))
+		{
+			if (stateSets.Count() >= maxStates)
+			{
+				// state is dropped as well, so its row is not updated
+				Flush();
+				if (!stateIndex.TryGetValue(target, next))
+					next = AddState(target);
+				return next;
+			}
+			next = AddState(target);
+		}
+		transitions[state * alphabetSize + charClass] = next;
+		return next;
+	}
+
+	int LazyDFA::MatchNFA(const StringView & str, int startPos, int pos, IntSet state, bool longest, int lastMatch)
+	{
+		IntSet next(nfaNodeCount);
+		for (int i=pos; i<str.Length(); i++)
+		{
+			Word charClass = GetCharClass(str[i]);
+			if (charClass == 0xFFFF)
+				return longest ? lastMatch : -1;
+			next.Clear();
+			moves.Move(state, charClass, next);
+			if (next.IsEmpty())
+			{
+				if (longest)
+					return lastMatch;
+				return IntSet::HasIntersection(state, finalNodes) ? i - startPos : -1;
+			}
+			Swap(state, next);
+			if (longest && IntSet::HasIntersection(state, finalNodes))
+				lastMatch = i + 1 - startPos;
+		}
+		if (longest)
+			return lastMatch;
+		return IntSet::HasIntersection(state, finalNodes) ? str.Length() - startPos : -1;
+	}
+
+	int LazyDFA::Match(const StringView & str, int startPos)
+	{
+		int startFlushCount = flushCount;
+		int state = 0;
+		for (int i=startPos; i<str.Length(); i++)
+		{
+			Word charClass = GetCharClass(str[i]);
+			if (charClass == 0xFFFF)
+				return -1;
+			int next = transitions[state * alphabetSize + charClass];
+			if (next == UnknownState)
+			{
+				if (flushCount - startFlushCount >= MaxFlushesPerMatch)
+					return MatchNFA(str, startPos, i, stateSets[state], false, -1);
+				next = ComputeNextState(state, charClass);
+			}
+			if (next == -1)
+				return stateFinal[state] ? i - startPos : -1;
+			state = next;
+		}
+		return stateFinal[state] ? str.Length() - startPos : -1;
+	}
+
+	int LazyDFA::MatchLongest(const StringView & str, int startPos)
+	{
+		int startFlushCount = flushCount;
+		int state = 0;
+		int lastMatch = stateFinal[state] ? 0 : -1;
+		for (int i=startPos; i<str.Length(); i++)
+		{
+			Word charClass = GetCharClass(str[i]);
+			if (charClass == 0xFFFF)
+				break;
+			int next = transitions[state * alphabetSize + charClass];
+			if (next == UnknownState)
+			{
+				if (flushCount - startFlushCount >= MaxFlushesPerMatch)
+					return MatchNFA(str, startPos, i, stateSets[state], true, lastMatch);
+				next = ComputeNextState(state, charClass);
+			}
+			if (next == -1)
+				break;
+			state = next;
+			if (stateFinal[state])
+				lastMatch = i + 1 - startPos;
+		}
+		return lastMatch;
+	}
+}
+}
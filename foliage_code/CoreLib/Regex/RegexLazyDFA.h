@@ -0,0 +1,66 @@
+#ifndef REGEX_LAZY_DFA_H
+#define REGEX_LAZY_DFA_H
+
+#include "RegexDFA.h"
+
+namespace CoreLib
+{
+	namespace Text
+	{
+		// DFA whose states are built from the NFA the first time a match reaches them, for
+		// patterns whose full subset construction is too large. At most maxStates states are
+		// kept; when the cache is full it is flushed and rebuilt as matching goes on, and a
+		// match that keeps flushing finishes by simulating the NFA directly. Matching updates
+		// the cache, so a LazyDFA must not be used by several threads at once.
+		class LazyDFA : public Object
+		{
+		public:
+			static const int DefaultMaxStates = 2048;
+			// flushes within one match before it falls back to NFA simulation
+			static const int MaxFlushesPerMatch = 2;
+		private:
+			static const int UnknownState = -2;
+			RefPtr<RegexCharTable> charTable;
+			int alphabetSize;
+			int maxStates;
+			// the NFA itself is not kept, only its moves
+			NFA_MoveTable moves;
+			int nfaNodeCount;
+			IntSet finalNodes;
+			// Cached states; state 0 is the start state. Row s of transitions holds the
+			// successors of state s, UnknownState until computed and -1 where there is none.
+			Dictionary<IntSet, int> stateIndex;
+			List<IntSet> stateSets;
+			List<bool> stateFinal;
+			List<int> transitions;
+			int flushCount;
+			int AddState(const IntSet & set);
+			void Flush();
+			int ComputeNextState(int state, Word charClass);
+			int MatchNFA(const StringView & str, int startPos, int pos, IntSet state, bool longest, int lastMatch);
+		public:
+			LazyDFA(NFA_Graph * nfa, int maxStates = DefaultMaxStates);
+			// 0xFFFF if ch is not in any char class
+			inline Word GetCharClass(wchar_t ch) const
+			{
+				return (unsigned int)ch < (unsigned int)charTable->Count() ? (*charTable)[ch] : (Word)0xFFFF;
+			}
+			// Same result as RegexMatcher::Match on the full DFA: the length matched when no
+			// transition is left and the state is final, -1 otherwise.
+			int Match(const StringView & str, int startPos);
+			// length of the longest match starting at startPos, -1 if there is none
+			int MatchLongest(const StringView & str, int startPos);
+			int GetStateCount() const
+			{
+				return stateSets.Count();
+			}
+			// number of times the state cache has been flushed
+			int GetFlushCount() const
+			{
+				return flushCount;
+			}
+		};
+	}
+}
+
+#endif
@@ -44,16 +44,16 @@ namespace Text
 
 	NFA_Node * NFA_Graph::CreateNode()
 	{
-		NFA_Node * nNode = new NFA_Node();
+		auto nNode = MakeRef<NFA_Node>();
 		nodes.Add(nNode);
-		return nNode;
+		return nNode.Ptr();
 	}
 
 	NFA_Translation * NFA_Graph::CreateTranslation()
 	{
-		NFA_Translation * trans = new NFA_Translation();
+		auto trans = MakeRef<NFA_Translation>();
 		translations.Add(trans);
-		return trans;
+		return trans.Ptr();
 	}
 
 	void NFA_Graph::ClearNodes()
@@ -127,175 +127,70 @@ namespace Text
 		PushState(s);
 	}
 
+	void NFA_Graph::AddEpsilonTranslation(NFA_Node * src, NFA_Node * dest)
+	{
+		NFA_Translation * trans = CreateTranslation();
+		trans->NodeSrc = src;
+		trans->NodeDest = dest;
+		src->Translations.Add(trans);
+		dest->PrevTranslations.Add(trans);
+	}
+
+	// Every fragment keeps its start free of incoming translations and its end free of outgoing
+	// ones, so the skip and loop translations added around a fragment cannot combine into
+	// paths the pattern does not have: in ((a{1,3})+a)? the skip of ? and the loop of + would
+	// otherwise share the start node and accept "".
 	void NFA_Graph::VisitRepeatNode(RegexRepeatNode * node)
 	{
 		NFA_StatePair sr;
 		node->Child->Accept(this);
 		NFA_StatePair s = PopState();
-		if (node->RepeatType == RegexRepeatNode::rtArbitary)
+		int minRepeat = 0, maxRepeat = -1;
+		if (node->RepeatType == RegexRepeatNode::rtOptional)
+			maxRepeat = 1;
+		else if (node->RepeatType == RegexRepeatNode::rtMoreThanOnce)
+			minRepeat = 1;
+		else if (node->RepeatType == RegexRepeatNode::rtSpecified)
+		{
+			minRepeat = node->MinRepeat;
+			maxRepeat = node->MaxRepeat;
+		}
+		if (maxRepeat == 0)
 		{
 			sr.start = CreateNode();
 			sr.end = CreateNode();
-
-			NFA_Translation * trans = CreateTranslation();
-			trans->NodeSrc = sr.start;
-			trans->NodeDest = sr.end;
-			sr.start->Translations.Add(trans);
-			sr.end->PrevTranslations.Add(trans);
-			
-			NFA_Translation * trans1 = CreateTranslation();
-			trans1->NodeSrc = sr.end;
-			trans1->NodeDest = s.start;
-			sr.end->Translations.Add(trans1);
-			s.start->PrevTranslations.Add(trans1);
-
-			NFA_Translation * trans2 = CreateTranslation();
-			trans2->NodeSrc = s.end;
-			trans2->NodeDest = sr.end;
-			s.end->Translations.Add(trans2);
-			sr.end->PrevTranslations.Add(trans2);
+			AddEpsilonTranslation(sr.start, sr.end);
+			PushState(sr);
+			return;
 		}
-		else if (node->RepeatType == RegexRepeatNode::rtOptional)
+		sr.start = CreateNode();
+		sr.end = CreateNode();
+		// copies of the child chained one after the other, at least one
+		int copies = Math::Max(minRepeat, maxRepeat == -1 ? 1 : maxRepeat);
+		List<NFA_StatePair> chain;
+		chain.Add(s);
+		for (int i=1; i<copies; i++)
 		{
-			sr = s;
-
-			NFA_Translation * trans = CreateTranslation();
-			trans->NodeSrc = sr.start;
-			trans->NodeDest = sr.end;
-			sr.start->Translations.Add(trans);
-			sr.end->PrevTranslations.Add(trans);
+			node->Child->Accept(this);
+			chain.Add(PopState());
+			AddEpsilonTranslation(chain[i-1].end, chain[i].start);
 		}
-		else if (node->RepeatType == RegexRepeatNode::rtMoreThanOnce)
+		AddEpsilonTranslation(sr.start, chain[0].start);
+		AddEpsilonTranslation(chain.Last().end, sr.end);
+		if (maxRepeat == -1)
 		{
-			sr = s;
-
-			NFA_Translation * trans = CreateTranslation();
-			trans->NodeSrc = sr.end;
-			trans->NodeDest = sr.start;
-			sr.start->PrevTranslations.Add(trans);
-			sr.end->Translations.Add(trans);
+			// the last copy repeats, and may be skipped when no copy is required
+			AddEpsilonTranslation(chain.Last().end, chain.Last().start);
+			if (minRepeat == 0)
+				AddEpsilonTranslation(sr.start, sr.end);
 		}
-		else if (node->RepeatType == RegexRepeatNode::rtSpecified)
+		else
 		{
-			if (node->MinRepeat == 0)
-			{
-				if (node->MaxRepeat > 0)
-				{
-					for (int i=1; i<node->MaxRepeat; i++)
-					{
-						node->Child->Accept(this);
-						NFA_StatePair s1 = PopState();
-						NFA_Translation * trans = CreateTranslation();
-						trans->NodeDest = s1.start;
-						trans->NodeSrc = s.end;
-						trans->NodeDest->PrevTranslations.Add(trans);
-						trans->NodeSrc->Translations.Add(trans);
-
-						trans = CreateTranslation();
-						trans->NodeDest = s1.start;
-						trans->NodeSrc = s.start;
-						trans->NodeDest->PrevTranslations.Add(trans);
-						trans->NodeSrc->Translations.Add(trans);
-
-						s.end = s1.end;
-					}
-					NFA_Translation * trans = CreateTranslation();
-					trans->NodeDest = s.end;
-					trans->NodeSrc = s.start;
-					trans->NodeDest->PrevTranslations.Add(trans);
-					trans->NodeSrc->Translations.Add(trans);
-					sr = s;
-				}
-				else if (node->MaxRepeat == 0)
-				{
-					sr.start = CreateNode();
-					sr.end = CreateNode();
-					NFA_Translation * trans = CreateTranslation();
-					trans->NodeDest = sr.end;
-					trans->NodeSrc = sr.start;
-					trans->NodeDest->PrevTranslations.Add(trans);
-					trans->NodeSrc->Translations.Add(trans);
-				}
-				else
-				{
-					// Arbitary repeat
-					sr.start = CreateNode();
-					sr.end = CreateNode();
-
-					NFA_Translation * trans = CreateTranslation();
-					trans->NodeSrc = sr.start;
-					trans->NodeDest = sr.end;
-					sr.start->Translations.Add(trans);
-					sr.end->PrevTranslations.Add(trans);
-					
-					NFA_Translation * trans1 = CreateTranslation();
-					trans1->NodeSrc = sr.end;
-					trans1->NodeDest = s.start;
-					sr.end->Translations.Add(trans1);
-					s.start->PrevTranslations.Add(trans1);
-
-					NFA_Translation * trans2 = CreateTranslation();
-					trans2->NodeSrc = s.end;
-					trans2->NodeDest = sr.end;
-					s.end->Translations.Add(trans2);
-					sr.end->PrevTranslations.Add(trans2);
-				}
-			}
-			else
-			{
-				NFA_Node * lastBegin = s.start;
-				for (int i=1; i<node->MinRepeat; i++)
-				{
-					node->Child->Accept(this);
-					NFA_StatePair s1 = PopState();
-					NFA_Translation * trans = CreateTranslation();
-					trans->NodeDest = s1.start;
-					trans->NodeSrc = s.end;
-					trans->NodeDest->PrevTranslations.Add(trans);
-					trans->NodeSrc->Translations.Add(trans);
-					s.end = s1.end;
-					lastBegin = s1.start;
-				}
-				if (node->MaxRepeat == -1)
-				{
-					NFA_Translation * trans = CreateTranslation();
-					trans->NodeDest = lastBegin;
-					trans->NodeSrc = s.end;
-					trans->NodeDest->PrevTranslations.Add(trans);
-					trans->NodeSrc->Translations.Add(trans);
-				}
-				else if (node->MaxRepeat > node->MinRepeat)
-				{
-					NFA_Node * lastBegin = s.end;
-					for (int i=node->MinRepeat; i<node->MaxRepeat; i++)
-					{
-						node->Child->Accept(this);
-						NFA_StatePair s1 = PopState();
-						NFA_Translation * trans = CreateTranslation();
-						trans->NodeDest = s1.start;
-						trans->NodeSrc = s.end;
-						trans->NodeDest->PrevTranslations.Add(trans);
-						trans->NodeSrc->Translations.Add(trans);
-
-						trans = CreateTranslation();
-						trans->NodeDest = s1.start;
-						trans->NodeSrc = lastBegin;
-						trans->NodeDest->PrevTranslations.Add(trans);
-						trans->NodeSrc->Translations.Add(trans);
-
-						s.end = s1.end;
-					}
-
-					NFA_Translation * trans = CreateTranslation();
-					trans->NodeDest = s.end;
-					trans->NodeSrc = lastBegin;
-					trans->NodeDest->PrevTranslations.Add(trans);
-					trans->NodeSrc->Translations.Add(trans);
-				}
-
-				sr = s;
-			}
-			
+			// every optional copy can be left for the end
+			for (int i=Math::Max(minRepeat, 1); i<copies; i++)
+				AddEpsilonTranslation(chain[i-1].end, sr.end);
+			if (minRepeat == 0)
+				AddEpsilonTranslation(sr.start, sr.end);
 		}
 		PushState(sr);
 	}
@@ -373,11 +268,13 @@ namespace Text
 
 	void NFA_Graph::GetValidStates(List<NFA_Node *> & states)
 	{
-		RefPtr<List<NFA_Node *>> list1 = new List<NFA_Node *>();
-		RefPtr<List<NFA_Node *>> list2 = new List<NFA_Node *>();
+		RefPtr<List<NFA_Node *>> list1 = MakeRef<List<NFA_Node *>>();
+		RefPtr<List<NFA_Node *>> list2 = MakeRef<List<NFA_Node *>>();
 		list1->Add(start);
 		states.Add(start);
 		ClearNodeFlags();
+		// nodes are flagged when queued, a node reached along several paths is visited once
+		start->Flag = true;
 		while (list1->Count())
 		{
 			list2->Clear();
@@ -385,7 +282,6 @@ namespace Text
 			{
 				bool isValid = false;
 				NFA_Node * curNode = (*list1)[i];
-				curNode->Flag = true;
 				for (int j=0; j<curNode->PrevTranslations.Count(); j++)
 				{
 					if (curNode->PrevTranslations[j]->CharSet)
@@ -402,6 +298,7 @@ namespace Text
 					if (!curNode->Translations[j]->NodeDest->Flag)
 					{
 						list2->Add(curNode->Translations[j]->NodeDest);
+						curNode->Translations[j]->NodeDest->Flag = true;
 					}
 				}
 			}
@@ -413,10 +310,13 @@ namespace Text
 
 	void NFA_Graph::GetEpsilonClosure(NFA_Node * node, List<NFA_Node *> & states)
 	{
-		RefPtr<List<NFA_Node *>> list1 = new List<NFA_Node *>();
-		RefPtr<List<NFA_Node *>> list2 = new List<NFA_Node *>();
+		RefPtr<List<NFA_Node *>> list1 = MakeRef<List<NFA_Node *>>();
+		RefPtr<List<NFA_Node *>> list2 = MakeRef<List<NFA_Node *>>();
 		list1->Add(node);
 		ClearNodeFlags();
+		// node is left out even when an epsilon cycle such as (a?)* leads back to it, as
+		// EliminateEpsilon copies the closure's translations onto node while it walks them
+		node->Flag = true;
 		while (list1->Count())
 		{
 			list2->Clear();
@@ -527,6 +427,8 @@ namespace Text
 						translations[fid] = 0;
 						translations.RemoveAt(fid);
 					}
+					// the next translation has moved into slot j
+					j--;
 				}
 			}
 		}
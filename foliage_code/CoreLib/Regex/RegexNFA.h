@@ -13,7 +13,7 @@ namespace CoreLib
 
 		class NFA_Node;
 
-		class NFA_Translation : public Object
+		class NFA_Translation : public Object, public NonAtomicRefCount
 		{
 		public:
 			RefPtr<RegexCharSet> CharSet;
@@ -23,7 +23,7 @@ namespace CoreLib
 			NFA_Translation(NFA_Node * src, NFA_Node * dest);
 		};
 
-		class NFA_Node : public Object
+		class NFA_Node : public Object, public NonAtomicRefCount
 		{
 		private:
 			static int HandleCount;
@@ -42,6 +42,7 @@ namespace CoreLib
 		class NFA_Graph : public RegexNodeVisitor
 		{
 			friend class DFA_Graph;
+			friend class LazyDFA;
 		private:
 			NFA_Node * start, * end;
 			struct NFA_StatePair
@@ -59,6 +60,7 @@ namespace CoreLib
 			void GetValidStates(List<NFA_Node *> & states);
 			void GetEpsilonClosure(NFA_Node * node, List<NFA_Node *> & states);
 			void EliminateEpsilon();
+			void AddEpsilonTranslation(NFA_Node * src, NFA_Node * dest);
 		public:
 			NFA_Node * CreateNode();
 			NFA_Translation * CreateTranslation();
@@ -77,5 +79,4 @@ namespace CoreLib
 	}
 }
 
-
 #endif
\ No newline at end of file
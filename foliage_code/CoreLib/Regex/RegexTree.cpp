@@ -362,8 +362,9 @@ namespace Text
 					RegexCharRange nRange;
 					nRange.Begin = newR.Begin;
 					nRange.End = oriR.Begin-1;
-					Ranges.Add(nRange);
 					newR.Begin = oriR.Begin;
+					// Add may move the ranges, oriR is not valid after it
+					Ranges.Add(nRange);
 					i--;
 				}
 				else if (newR.End == oriR.End)
@@ -376,14 +377,14 @@ namespace Text
 				}
 				else if (newR.End < oriR.End && newR.End >= oriR.Begin)
 				{
-					RegexCharRange nRange;
+					RegexCharRange nRange, nRange2;
 					nRange.Begin = newR.Begin;
 					nRange.End = oriR.Begin-1;
-					Ranges.Add(nRange);
-					nRange.Begin = newR.End+1;
-					nRange.End = oriR.End;
-					Ranges.Add(nRange);
+					nRange2.Begin = newR.End+1;
+					nRange2.End = oriR.End;
 					oriR.End = newR.End;
+					Ranges.Add(nRange);
+					Ranges.Add(nRange2);
 					return;
 				}
 				else
@@ -23,14 +23,15 @@ namespace CoreLib
 			virtual void VisitSelectionNode(RegexSelectionNode * node);
 		};
 
-		class RegexNode : public Object
+		// regex trees are built and consumed by a single thread
+		class RegexNode : public RefCounted, public NonAtomicRefCount
 		{
 		public:
 			virtual String Reinterpret() = 0;
 			virtual void Accept(RegexNodeVisitor * visitor) = 0;
 		};
 
-		class RegexCharSet : public Object
+		class RegexCharSet : public RefCounted, public NonAtomicRefCount
 		{
 		private:
 			List<RegexCharSet *> OriSet;
@@ -0,0 +1,38 @@
+#include "SimdKernels.h"
+#include <mutex>
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+		// defined in SimdKernels_<Tier>.cpp; return false when that file was not compiled
+		// for its tier
+		bool GetSimdKernels_Scalar(SimdKernels & kernels);
+		bool GetSimdKernels_Sse2(SimdKernels & kernels);
+		bool GetSimdKernels_Avx2(SimdKernels & kernels);
+		bool GetSimdKernels_Avx512(SimdKernels & kernels);
+
+		SimdKernels GetSimdKernels(CpuTier tier)
+		{
+			if ((int)tier > (int)CpuFeatures::Get().MaxTier)
+				tier = CpuFeatures::Get().MaxTier;
+			SimdKernels kernels;
+			if (tier == CpuTier::Avx512 && GetSimdKernels_Avx512(kernels))
+				return kernels;
+			if ((int)tier >= (int)CpuTier::Avx2 && GetSimdKernels_Avx2(kernels))
+				return kernels;
+			if ((int)tier >= (int)CpuTier::Sse2 && GetSimdKernels_Sse2(kernels))
+				return kernels;
+			GetSimdKernels_Scalar(kernels);
+			return kernels;
+		}
+
+		const SimdKernels & GetSimdKernels()
+		{
+			static SimdKernels kernels;
+			static std::once_flag bound;
+			std::call_once(bound, []() { kernels = GetSimdKernels(GetCpuTier()); });
+			return kernels;
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef CORE_LIB_SIMD_KERNELS_H
+#define CORE_LIB_SIMD_KERNELS_H
+
+#include "CpuFeatures.h"
+#include <stdint.h>
+
+namespace VectorMath
+{
+	class Vec3;
+	class Vec4;
+	class Matrix4;
+	struct LeafInstance;
+	class Quat;
+	struct InstanceBounds;
+}
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+		// Kernels built once per CpuTier (SimdKernels_<Tier>.cpp, compiled with that tier's
+		// flags) and bound at run time. Callers normally go through the wrappers in
+		// VectorMathWide.h, InstanceBounds.h, Quat.h, Graphics/Bounds.h, IntSet.h, CompressedStream and TextureData. Every
+		// tier gives the same results.
+		struct SimdKernels
+		{
+			CpuTier Tier;
+			// math batches, see VectorMathWide.h
+			void (*TransformPoints)(VectorMath::Vec3 * rs, const VectorMath::Matrix4 & m, const VectorMath::Vec3 * points, int count);
+			void (*TransformNormals)(VectorMath::Vec3 * rs, const VectorMath::Matrix4 & m, const VectorMath::Vec3 * normals, int count);
+			void (*TransformPointsHomogeneous)(VectorMath::Vec3 * rs, const VectorMath::Matrix4 & m, const VectorMath::Vec3 * points, int count);
+			void (*NormalizeAll)(VectorMath::Vec3 * vectors, int count);
+			// one batch of TransformInstances (InstanceBounds.h), run on the calling thread
+			void (*TransformInstances)(VectorMath::Vec3 * centers, VectorMath::InstanceBounds & bounds, const VectorMath::Matrix4 & transform,
+				const VectorMath::LeafInstance * instances, int count, const VectorMath::Vec3 & leafMin, const VectorMath::Vec3 & leafMax, float leafScale);
+			// rotation matrices, see Quat.h
+			void (*QuatsToRotations)(float * rotations, int stride, const VectorMath::Quat * quats, int count);
+			void (*UnpackRotations)(float * rotations, int stride, const unsigned int * packed, int count);
+			// culling
+			int (*CullSpheres)(const VectorMath::Vec4 * planes, int planeCount, const VectorMath::Vec3 * centers, const float * radii, int count, int * visible);
+			int (*CullBoxes)(const VectorMath::Vec4 * planes, int planeCount, const VectorMath::Vec3 * centers, const VectorMath::Vec3 * extents,
+				const VectorMath::Quat * orientations, int count, int * visible);
+			// texture filtering: dst[i] is the rounded-down average of the RGBA8 pixels
+			// row0[2i], row0[2i+1], row1[2i] and row1[2i+1], per channel
+			void (*Downsample2x2)(uint32_t * dst, const uint32_t * row0, const uint32_t * row1, int dstWidth);
+			// codecs: number of equal leading bytes of a and b, at most limit
+			int (*MatchLength)(const unsigned char * a, const unsigned char * b, int limit);
+			// bit operations: total number of set bits
+			int (*PopCount)(const uint64_t * words, int count);
+		};
+
+		// kernels for GetCpuTier(), bound on first use
+		const SimdKernels & GetSimdKernels();
+		// Kernels for a given tier, clamped to what this cpu and build support. For testing
+		// tiers against each other.
+		SimdKernels GetSimdKernels(CpuTier tier);
+	}
+}
+
+#endif
@@ -0,0 +1,504 @@
+// Kernel bodies shared by SimdKernels_<Tier>.cpp. Each of those files defines SIMD_KERNELS_TIER
+// and SIMD_KERNELS_LEVEL (the CpuTier value) and includes this file once, after the tier's
+// compiler flags are applied (see CMakeLists.txt). Only code from this file and the templates in
+// VectorMathWide.h may be used here: non-template inline functions of other headers would be
+// compiled with this tier's instruction set and could be picked by the linker for every caller.
+#include "SimdKernels.h"
+#include "VectorMathWide.h"
+#include "InstanceBounds.h"
+#include "Quat.h"
+#include <float.h>
+#include <string.h>
+
+#if defined(VECTOR_MATH_WIDE_AVX512) && defined(__AVX512BW__)
+#define SIMD_KERNELS_COMPILED_LEVEL 3
+#elif defined(VECTOR_MATH_WIDE_AVX2)
+#define SIMD_KERNELS_COMPILED_LEVEL 2
+#elif defined(VECTOR_MATH_WIDE_SSE)
+#define SIMD_KERNELS_COMPILED_LEVEL 1
+#else
+#define SIMD_KERNELS_COMPILED_LEVEL 0
+#endif
+
+#define SIMD_KERNELS_CONCAT_(a, b) a##b
+#define SIMD_KERNELS_CONCAT(a, b) SIMD_KERNELS_CONCAT_(a, b)
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+#if SIMD_KERNELS_COMPILED_LEVEL >= SIMD_KERNELS_LEVEL
+		namespace SIMD_KERNELS_CONCAT(Kernels_, SIMD_KERNELS_TIER)
+		{
+			using namespace VectorMath;
+
+			typedef Vec3xN<FloatXN> Vec3XN;
+
+			static inline int TrailingZeroCount64(uint64_t w)
+			{
+#if defined(__GNUC__)
+				return __builtin_ctzll(w);
+#elif defined(_M_X64)
+				unsigned long index;
+				_BitScanForward64(&index, w);
+				return (int)index;
+#else
+				int rs = 0;
+				while (!(w & 1))
+				{
+					w >>= 1;
+					rs++;
+				}
+				return rs;
+#endif
+			}
+
+			static inline int PopCount64(uint64_t w)
+			{
+#if defined(__GNUC__)
+				return __builtin_popcountll(w);
+#elif defined(_M_X64) && SIMD_KERNELS_LEVEL >= 2
+				return (int)_mm_popcnt_u64(w);
+#else
+				w = w - ((w >> 1) & 0x5555555555555555ull);
+				w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+				w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+				return (int)((w * 0x0101010101010101ull) >> 56);
+#endif
+			}
+
+			template<typename Func>
+			static void ForEachBatch(Vec3 * rs, const Vec3 * vectors, int count, const Func & f)
+			{
+				int i = 0;
+				for (; i + Vec3XN::Width <= count; i += Vec3XN::Width)
+					f(Vec3XN::Load(vectors + i)).Store(rs + i);
+				if (i < count)
+					f(Vec3XN::Load(vectors + i, count - i)).Store(rs + i, count - i);
+			}
+
+			static void TransformPoints(Vec3 * rs, const Matrix4 & m, const Vec3 * points, int count)
+			{
+				Matrix4xN<FloatXN> mat(m);
+				ForEachBatch(rs, points, count, [&](const Vec3XN & v) {return mat.Transform(v);});
+			}
+
+			static void TransformNormals(Vec3 * rs, const Matrix4 & m, const Vec3 * normals, int count)
+			{
+				Matrix4xN<FloatXN> mat(m);
+				ForEachBatch(rs, normals, count, [&](const Vec3XN & v) {return mat.TransformNormal(v);});
+			}
+
+			static void TransformPointsHomogeneous(Vec3 * rs, const Matrix4 & m, const Vec3 * points, int count)
+			{
+				Matrix4xN<FloatXN> mat(m);
+				ForEachBatch(rs, points, count, [&](const Vec3XN & v) {return mat.TransformHomogeneous(v);});
+			}
+
+			static void NormalizeAll(Vec3 * vectors, int count)
+			{
+				ForEachBatch(vectors, vectors, count, [](const Vec3XN & v) {return v.Normalize();});
+			}
+
+			// Each lane is one instance. The leaf box (center c, half extents e) lands at
+			// c * R + t in model space with half extents e * |R|, and the model transform M maps
+			// it to M(c * R + t) with half extents e * |R * M|, taking M as the 3x3 part.
+			static void TransformInstances(Vec3 * centers, InstanceBounds & bounds, const Matrix4 & transform,
+				const LeafInstance * instances, int count, const Vec3 & leafMin, const Vec3 & leafMax, float leafScale)
+			{
+				const int width = FloatXN::Width;
+				float half = leafScale * 0.5f;
+				Vec3XN c(FloatXN((leafMin.x + leafMax.x) * half), FloatXN((leafMin.y + leafMax.y) * half), FloatXN((leafMin.z + leafMax.z) * half));
+				Vec3XN e(FloatXN((leafMax.x - leafMin.x) * half), FloatXN((leafMax.y - leafMin.y) * half), FloatXN((leafMax.z - leafMin.z) * half));
+				Matrix4xN<FloatXN> mat(transform);
+				Vec3XN localMin(FloatXN(FLT_MAX), FloatXN(FLT_MAX), FloatXN(FLT_MAX));
+				Vec3XN localMax(FloatXN(-FLT_MAX), FloatXN(-FLT_MAX), FloatXN(-FLT_MAX));
+				Vec3XN worldMin = localMin, worldMax = localMax;
+				for (int i = 0; i < count; i += width)
+				{
+					int n = count - i < width ? count - i : width;
+					// transpose into lanes; lanes past the end repeat the last instance, so they
+					// do not change the bounds
+					float lanes[12][width];
+					for (int l = 0; l < width; l++)
+					{
+						const float * src = (const float*)(instances + i + (l < n ? l : n - 1));
+						for (int k = 0; k < 12; k++)
+							lanes[k][l] = src[k];
+					}
+					Vec3XN t(FloatXN::Load(lanes[0]), FloatXN::Load(lanes[1]), FloatXN::Load(lanes[2]));
+					FloatXN r[3][3];
+					for (int a = 0; a < 3; a++)
+						for (int b = 0; b < 3; b++)
+							r[a][b] = FloatXN::Load(lanes[3 + a * 3 + b]);
+					Vec3XN mc(c.x * r[0][0] + c.y * r[1][0] + c.z * r[2][0] + t.x,
+						c.x * r[0][1] + c.y * r[1][1] + c.z * r[2][1] + t.y,
+						c.x * r[0][2] + c.y * r[1][2] + c.z * r[2][2] + t.z);
+					Vec3XN me(e.x * FloatXN::Abs(r[0][0]) + e.y * FloatXN::Abs(r[1][0]) + e.z * FloatXN::Abs(r[2][0]),
+						e.x * FloatXN::Abs(r[0][1]) + e.y * FloatXN::Abs(r[1][1]) + e.z * FloatXN::Abs(r[2][1]),
+						e.x * FloatXN::Abs(r[0][2]) + e.y * FloatXN::Abs(r[1][2]) + e.z * FloatXN::Abs(r[2][2]));
+					// rows of R * M; Matrix4 keeps M column by column
+					FloatXN rm[3][3];
+					for (int a = 0; a < 3; a++)
+						for (int b = 0; b < 3; b++)
+							rm[a][b] = r[a][0] * mat.values[b] + r[a][1] * mat.values[4 + b] + r[a][2] * mat.values[8 + b];
+					Vec3XN wc = mat.Transform(mc);
+					Vec3XN we(e.x * FloatXN::Abs(rm[0][0]) + e.y * FloatXN::Abs(rm[1][0]) + e.z * FloatXN::Abs(rm[2][0]),
+						e.x * FloatXN::Abs(rm[0][1]) + e.y * FloatXN::Abs(rm[1][1]) + e.z * FloatXN::Abs(rm[2][1]),
+						e.x * FloatXN::Abs(rm[0][2]) + e.y * FloatXN::Abs(rm[1][2]) + e.z * FloatXN::Abs(rm[2][2]));
+					localMin = Vec3XN::Min(localMin, mc - me);
+					localMax = Vec3XN::Max(localMax, mc + me);
+					worldMin = Vec3XN::Min(worldMin, wc - we);
+					worldMax = Vec3XN::Max(worldMax, wc + we);
+					if (!centers)
+						continue;
+					if (n == width)
+						wc.Store(centers + i);
+					else
+						wc.Store(centers + i, n);
+				}
+				bounds.LocalMin.x = ReduceMin(localMin.x);
+				bounds.LocalMin.y = ReduceMin(localMin.y);
+				bounds.LocalMin.z = ReduceMin(localMin.z);
+				bounds.LocalMax.x = ReduceMax(localMax.x);
+				bounds.LocalMax.y = ReduceMax(localMax.y);
+				bounds.LocalMax.z = ReduceMax(localMax.z);
+				bounds.WorldMin.x = ReduceMin(worldMin.x);
+				bounds.WorldMin.y = ReduceMin(worldMin.y);
+				bounds.WorldMin.z = ReduceMin(worldMin.z);
+				bounds.WorldMax.x = ReduceMax(worldMax.x);
+				bounds.WorldMax.y = ReduceMax(worldMax.y);
+				bounds.WorldMax.z = ReduceMax(worldMax.z);
+			}
+
+			// Lanes are filled by load(q, i, n) with the quaternions of items i to i + n - 1,
+			// and the rotations are scattered to rotations + item * stride.
+			template<typename Func>
+			static void ForEachRotationBatch(float * rotations, int stride, int count, const Func & load)
+			{
+				const int width = FloatXN::Width;
+				for (int i = 0; i < count; i += width)
+				{
+					int n = count - i < width ? count - i : width;
+					FloatXN q[4];
+					load(q, i, n);
+					FloatXN r[3][3];
+					QuatToRotation(r, q[0], q[1], q[2], q[3]);
+					float lanes[9][width];
+					for (int k = 0; k < 9; k++)
+						r[k / 3][k % 3].Store(lanes[k]);
+					for (int l = 0; l < n; l++)
+					{
+						float * dst = rotations + (i + l) * stride;
+						for (int k = 0; k < 9; k++)
+							dst[k] = lanes[k][l];
+					}
+				}
+			}
+
+			static void QuatsToRotations(float * rotations, int stride, const Quat * quats, int count)
+			{
+				ForEachRotationBatch(rotations, stride, count, [&](FloatXN * q, int i, int n)
+				{
+					const int width = FloatXN::Width;
+					float lanes[4][width];
+					for (int l = 0; l < width; l++)
+					{
+						const float * src = (const float*)(quats + i + (l < n ? l : n - 1));
+						for (int k = 0; k < 4; k++)
+							lanes[k][l] = src[k];
+					}
+					for (int k = 0; k < 4; k++)
+						q[k] = FloatXN::Load(lanes[k]);
+				});
+			}
+
+			// smallest-three decoding, see Quat::UnpackSmallestThree
+			static void UnpackRotations(float * rotations, int stride, const unsigned int * packed, int count)
+			{
+				const int zero = 511;
+				const float step = 0.707106781f / 511.0f;
+				ForEachRotationBatch(rotations, stride, count, [&](FloatXN * q, int i, int n)
+				{
+					const int width = FloatXN::Width;
+					float lanes[4][width];
+					for (int l = 0; l < width; l++)
+					{
+						unsigned int bits = packed[i + (l < n ? l : n - 1)];
+						lanes[0][l] = (float)(bits >> 30);
+						lanes[1][l] = (float)((int)((bits >> 20) & 1023) - zero);
+						lanes[2][l] = (float)((int)((bits >> 10) & 1023) - zero);
+						lanes[3][l] = (float)((int)(bits & 1023) - zero);
+					}
+					FloatXN largest = FloatXN::Load(lanes[0]);
+					FloatXN a = FloatXN::Load(lanes[1]) * FloatXN(step);
+					FloatXN b = FloatXN::Load(lanes[2]) * FloatXN(step);
+					FloatXN c = FloatXN::Load(lanes[3]) * FloatXN(step);
+					FloatXN d = FloatXN::Sqrt(FloatXN::Max(FloatXN(1.0f) - (a * a + b * b + c * c), FloatXN(0.0f)));
+					// the stored three fill the other components in order
+					q[0] = FloatXN::Select(largest == FloatXN(0.0f), d, a);
+					q[1] = FloatXN::Select(largest == FloatXN(0.0f), a, FloatXN::Select(largest == FloatXN(1.0f), d, b));
+					q[2] = FloatXN::Select(largest <= FloatXN(1.0f), b, FloatXN::Select(largest == FloatXN(2.0f), d, c));
+					q[3] = FloatXN::Select(largest == FloatXN(3.0f), d, c);
+				});
+			}
+
+			static int CullSpheres(const Vec4 * planes, int planeCount, const Vec3 * centers, const float * radii, int count, int * visible)
+			{
+				const int width = FloatXN::Width;
+				int rs = 0;
+				for (int i = 0; i < count; i += width)
+				{
+					int n = count - i < width ? count - i : width;
+					Vec3XN c;
+					FloatXN r;
+					if (n == width)
+					{
+						c = Vec3XN::Load(centers + i);
+						r = FloatXN::Load(radii + i);
+					}
+					else
+					{
+						float buffer[width];
+						memset(buffer, 0, sizeof(buffer));
+						memcpy(buffer, radii + i, n * sizeof(float));
+						c = Vec3XN::Load(centers + i, n);
+						r = FloatXN::Load(buffer);
+					}
+					FloatXN negR = -r;
+					uint64_t bits = (1ull << n) - 1;
+					for (int j = 0; j < planeCount && bits; j++)
+					{
+						const float * p = (const float*)(planes + j);
+						FloatXN d = FloatXN(p[0]) * c.x + FloatXN(p[1]) * c.y + FloatXN(p[2]) * c.z + FloatXN(p[3]);
+						bits &= (uint64_t)(d >= negR).GetBits();
+					}
+					while (bits)
+					{
+						visible[rs++] = i + TrailingZeroCount64(bits);
+						bits &= bits - 1;
+					}
+				}
+				return rs;
+			}
+
+			// As CullSpheres, with the box radius along each plane normal n: e.x*|n.X| + e.y*|n.Y|
+			// + e.z*|n.Z| for box axes X, Y, Z, the rows of the orientation matrix. Same arithmetic
+			// as Contains(Frustum, OrientedBox) in Graphics/Bounds.cpp.
+			static int CullBoxes(const Vec4 * planes, int planeCount, const Vec3 * centers, const Vec3 * extents,
+				const Quat * orientations, int count, int * visible)
+			{
+				const int width = FloatXN::Width;
+				int rs = 0;
+				for (int i = 0; i < count; i += width)
+				{
+					int n = count - i < width ? count - i : width;
+					Vec3XN c, e;
+					if (n == width)
+					{
+						c = Vec3XN::Load(centers + i);
+						e = Vec3XN::Load(extents + i);
+					}
+					else
+					{
+						c = Vec3XN::Load(centers + i, n);
+						e = Vec3XN::Load(extents + i, n);
+					}
+					FloatXN r[3][3];
+					if (orientations)
+					{
+						float lanes[4][width];
+						for (int l = 0; l < width; l++)
+						{
+							const float * src = (const float*)(orientations + i + (l < n ? l : n - 1));
+							for (int k = 0; k < 4; k++)
+								lanes[k][l] = src[k];
+						}
+						QuatToRotation(r, FloatXN::Load(lanes[0]), FloatXN::Load(lanes[1]), FloatXN::Load(lanes[2]), FloatXN::Load(lanes[3]));
+					}
+					uint64_t bits = (1ull << n) - 1;
+					for (int j = 0; j < planeCount && bits; j++)
+					{
+						const float * p = (const float*)(planes + j);
+						FloatXN nx(p[0]), ny(p[1]), nz(p[2]);
+						FloatXN d = nx * c.x + ny * c.y + nz * c.z + FloatXN(p[3]);
+						FloatXN radius;
+						if (orientations)
+							radius = e.x * FloatXN::Abs(nx * r[0][0] + ny * r[0][1] + nz * r[0][2]) +
+								e.y * FloatXN::Abs(nx * r[1][0] + ny * r[1][1] + nz * r[1][2]) +
+								e.z * FloatXN::Abs(nx * r[2][0] + ny * r[2][1] + nz * r[2][2]);
+						else
+							radius = FloatXN(fabs(p[0])) * e.x + FloatXN(fabs(p[1])) * e.y + FloatXN(fabs(p[2])) * e.z;
+						bits &= (uint64_t)(d >= -radius).GetBits();
+					}
+					while (bits)
+					{
+						visible[rs++] = i + TrailingZeroCount64(bits);
+						bits &= bits - 1;
+					}
+				}
+				return rs;
+			}
+
+			static inline uint32_t Average2x2(uint32_t c1, uint32_t c2, uint32_t c3, uint32_t c4)
+			{
+				uint32_t rs = 0;
+				for (int shift = 0; shift < 32; shift += 8)
+				{
+					uint32_t sum = ((c1 >> shift) & 255) + ((c2 >> shift) & 255) + ((c3 >> shift) & 255) + ((c4 >> shift) & 255);
+					rs |= (sum >> 2) << shift;
+				}
+				return rs;
+			}
+
+			static void Downsample2x2(uint32_t * dst, const uint32_t * row0, const uint32_t * row1, int dstWidth)
+			{
+				int i = 0;
+#if SIMD_KERNELS_LEVEL >= 2
+				// 8 source pixels of each row to 4: the 128-bit lanes hold pixels 0,1,4,5 and
+				// 2,3,6,7 after unpacking, so the packed result is put back in order with a permute
+				__m256i zero256 = _mm256_setzero_si256();
+				for (; i + 4 <= dstWidth; i += 4)
+				{
+					__m256i a = _mm256_loadu_si256((const __m256i*)(row0 + i * 2));
+					__m256i b = _mm256_loadu_si256((const __m256i*)(row1 + i * 2));
+					__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero256), _mm256_unpacklo_epi8(b, zero256));
+					__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero256), _mm256_unpackhi_epi8(b, zero256));
+					__m256i s0 = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+					__m256i s1 = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+					__m256i s = _mm256_srli_epi16(_mm256_unpacklo_epi64(s0, s1), 2);
+					__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(s, s), _MM_SHUFFLE(3, 1, 2, 0));
+					_mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(packed));
+				}
+#endif
+#if SIMD_KERNELS_LEVEL >= 1
+				__m128i zero = _mm_setzero_si128();
+				for (; i + 2 <= dstWidth; i += 2)
+				{
+					__m128i a = _mm_loadu_si128((const __m128i*)(row0 + i * 2));
+					__m128i b = _mm_loadu_si128((const __m128i*)(row1 + i * 2));
+					__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+					__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+					__m128i s0 = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+					__m128i s1 = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+					__m128i s = _mm_srli_epi16(_mm_unpacklo_epi64(s0, s1), 2);
+					_mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(s, s));
+				}
+#endif
+				for (; i < dstWidth; i++)
+					dst[i] = Average2x2(row0[i * 2], row0[i * 2 + 1], row1[i * 2], row1[i * 2 + 1]);
+			}
+
+			static int MatchLength(const unsigned char * a, const unsigned char * b, int limit)
+			{
+				int n = 0;
+#if SIMD_KERNELS_LEVEL >= 3
+				for (; n + 64 <= limit; n += 64)
+				{
+					uint64_t equal = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(a + n), _mm512_loadu_si512(b + n));
+					if (equal != ~0ull)
+						return n + TrailingZeroCount64(~equal);
+				}
+#endif
+#if SIMD_KERNELS_LEVEL >= 2
+				for (; n + 32 <= limit; n += 32)
+				{
+					unsigned int equal = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+						_mm256_loadu_si256((const __m256i*)(a + n)), _mm256_loadu_si256((const __m256i*)(b + n))));
+					if (equal != 0xFFFFFFFFu)
+						return n + TrailingZeroCount64(~equal);
+				}
+#endif
+#if SIMD_KERNELS_LEVEL >= 1
+				for (; n + 16 <= limit; n += 16)
+				{
+					unsigned int equal = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+						_mm_loadu_si128((const __m128i*)(a + n)), _mm_loadu_si128((const __m128i*)(b + n))));
+					if (equal != 0xFFFFu)
+						return n + TrailingZeroCount64(~equal);
+				}
+#endif
+				// a word at a time; the first differing byte is the lowest one on little endian cpus
+				for (; n + 8 <= limit; n += 8)
+				{
+					uint64_t x, y;
+					memcpy(&x, a + n, 8);
+					memcpy(&y, b + n, 8);
+					if (x != y)
+						return n + (TrailingZeroCount64(x ^ y) >> 3);
+				}
+				while (n < limit && a[n] == b[n])
+					n++;
+				return n;
+			}
+
+			static int PopCount(const uint64_t * words, int count)
+			{
+				int i = 0;
+				int rs = 0;
+#if SIMD_KERNELS_LEVEL >= 3
+				// per-nibble table lookup, bytes summed into 64-bit lanes with sad
+				{
+					const __m512i table = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+					const __m512i low = _mm512_set1_epi8(0x0F);
+					__m512i acc = _mm512_setzero_si512();
+					for (; i + 8 <= count; i += 8)
+					{
+						__m512i v = _mm512_loadu_si512(words + i);
+						__m512i bytes = _mm512_add_epi8(_mm512_shuffle_epi8(table, _mm512_and_si512(v, low)),
+							_mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(v, 4), low)));
+						acc = _mm512_add_epi64(acc, _mm512_sad_epu8(bytes, _mm512_setzero_si512()));
+					}
+					rs += (int)_mm512_reduce_add_epi64(acc);
+				}
+#elif SIMD_KERNELS_LEVEL >= 2
+				{
+					const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+						0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+					const __m256i low = _mm256_set1_epi8(0x0F);
+					__m256i acc = _mm256_setzero_si256();
+					for (; i + 4 <= count; i += 4)
+					{
+						__m256i v = _mm256_loadu_si256((const __m256i*)(words + i));
+						__m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+							_mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+						acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+					}
+					uint64_t lanes[4];
+					_mm256_storeu_si256((__m256i*)lanes, acc);
+					rs += (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+				}
+#endif
+				for (; i < count; i++)
+					rs += PopCount64(words[i]);
+				return rs;
+			}
+		}
+
+		bool SIMD_KERNELS_CONCAT(GetSimdKernels_, SIMD_KERNELS_TIER)(SimdKernels & kernels)
+		{
+			using namespace SIMD_KERNELS_CONCAT(Kernels_, SIMD_KERNELS_TIER);
+			kernels.Tier = (CpuTier)SIMD_KERNELS_LEVEL;
+			kernels.TransformPoints = TransformPoints;
+			kernels.TransformNormals = TransformNormals;
+			kernels.TransformPointsHomogeneous = TransformPointsHomogeneous;
+			kernels.NormalizeAll = NormalizeAll;
+			kernels.TransformInstances = TransformInstances;
+			kernels.QuatsToRotations = QuatsToRotations;
+			kernels.UnpackRotations = UnpackRotations;
+			kernels.CullSpheres = CullSpheres;
+			kernels.CullBoxes = CullBoxes;
+			kernels.Downsample2x2 = Downsample2x2;
+			kernels.MatchLength = MatchLength;
+			kernels.PopCount = PopCount;
+			return true;
+		}
+#else
+		// the compiler did not target this tier, so there is nothing to bind
+		bool SIMD_KERNELS_CONCAT(GetSimdKernels_, SIMD_KERNELS_TIER)(SimdKernels &)
+		{
+			return false;
+		}
+#endif
+	}
+}
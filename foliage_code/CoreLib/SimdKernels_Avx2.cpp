@@ -0,0 +1,4 @@
+// Kernels for CpuTier::Avx2. This file alone is compiled with AVX2, POPCNT and BMI enabled.
+#define SIMD_KERNELS_TIER Avx2
+#define SIMD_KERNELS_LEVEL 2
+#include "SimdKernelsImpl.h"
@@ -0,0 +1,5 @@
+// Kernels for CpuTier::Avx512. This file alone is compiled with AVX-512 F, BW, DQ and VL
+// enabled; compilers without those options leave the tier unbound.
+#define SIMD_KERNELS_TIER Avx512
+#define SIMD_KERNELS_LEVEL 3
+#include "SimdKernelsImpl.h"
@@ -0,0 +1,5 @@
+// Kernels for CpuTier::Scalar, with the SIMD lane types of VectorMathWide.h turned off.
+#define VECTOR_MATH_WIDE_NO_SIMD
+#define SIMD_KERNELS_TIER Scalar
+#define SIMD_KERNELS_LEVEL 0
+#include "SimdKernelsImpl.h"
@@ -0,0 +1,4 @@
+// Kernels for CpuTier::Sse2.
+#define SIMD_KERNELS_TIER Sse2
+#define SIMD_KERNELS_LEVEL 1
+#include "SimdKernelsImpl.h"
@@ -1,6 +1,12 @@
 #ifndef FUNDAMENTAL_LIB_SMART_POINTER_H
 #define FUNDAMENTAL_LIB_SMART_POINTER_H
 
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "Common.h"
+
 namespace CoreLib
 {
 	namespace Basic
@@ -25,6 +31,216 @@ namespace CoreLib
 			}
 		};
 
+		// Tag base: objects of a class deriving from it, or from one of its subclasses, get
+		// non-atomic reference counts. Only for types never shared across threads.
+		class NonAtomicRefCount
+		{
+		};
+
+		// Reference counts are updated atomically unless the pointee type derives from
+		// NonAtomicRefCount.
+		template<typename T>
+		struct RefCountTraits
+		{
+			static const bool Atomic = !std::is_base_of<NonAtomicRefCount, T>::value;
+		};
+
+		// Throws InvalidOperationException for RefPtr::Release() on an object whose storage belongs
+		// to its reference count. Defined in Exception.h, which cannot be included from here.
+		template<typename T>
+		void ThrowReleaseOfInlineObject(T * ptr);
+
+		// Control block shared by all RefPtrs to the same object. The block is either allocated
+		// next to the object (MakeRef), embedded in it (RefCounted), or allocated separately
+		// when a RefPtr adopts a plain pointer.
+		class RefCountBlock
+		{
+			template<typename T1, typename Destructor1>
+			friend class RefPtr;
+		private:
+			std::atomic<int> refCount;
+			bool atomic;
+		protected:
+			// called when the last reference is dropped
+			virtual void Destroy() = 0;
+			// called when the last reference is given up by RefPtr::Release(), the object stays alive
+			virtual void Detach() = 0;
+			// false when the object lives in the block's allocation and cannot outlive it
+			virtual bool CanDetach() const
+			{
+				return true;
+			}
+			virtual ~RefCountBlock()
+			{}
+		public:
+			RefCountBlock()
+				: refCount(0), atomic(true)
+			{}
+			// the count belongs to the object's storage, never to its value
+			RefCountBlock(const RefCountBlock &)
+				: refCount(0), atomic(true)
+			{}
+			RefCountBlock & operator = (const RefCountBlock &)
+			{
+				return *this;
+			}
+			inline void AddRef()
+			{
+				if (atomic)
+					refCount.fetch_add(1, std::memory_order_relaxed);
+				else
+					refCount.store(refCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			}
+			// returns true when the caller dropped the last reference
+			inline bool ReleaseRef()
+			{
+				if (atomic)
+					return refCount.fetch_sub(1, std::memory_order_acq_rel) == 1;
+				int count = refCount.load(std::memory_order_relaxed) - 1;
+				refCount.store(count, std::memory_order_relaxed);
+				return count == 0;
+			}
+			int RefCount() const
+			{
+				return refCount.load(std::memory_order_relaxed);
+			}
+		};
+
+		// Intrusive base for objects managed by RefPtr: the count lives inside the object, so adopting
+		// a plain pointer costs no allocation, and the same raw pointer can be wrapped more than once.
+		class RefCounted : public Object, public RefCountBlock
+		{
+		protected:
+			virtual void Destroy()
+			{
+				delete this;
+			}
+			virtual void Detach()
+			{}
+		};
+
+		template<typename T, typename Destructor>
+		class PointerRefCountBlock : public RefCountBlock
+		{
+		private:
+			T * pointer;
+		protected:
+			virtual void Destroy()
+			{
+				Destructor destructor;
+				destructor(pointer);
+				delete this;
+			}
+			virtual void Detach()
+			{
+				delete this;
+			}
+		public:
+			PointerRefCountBlock(T * ptr)
+				: pointer(ptr)
+			{}
+		};
+
+		template<typename T>
+		class InlineRefCountBlock : public RefCountBlock
+		{
+		public:
+			typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Storage;
+		protected:
+			virtual void Destroy()
+			{
+				((T*)&Storage)->~T();
+				delete this;
+			}
+			// the object shares the allocation with the block and cannot outlive it
+			virtual void Detach()
+			{}
+			virtual bool CanDetach() const
+			{
+				return false;
+			}
+		};
+
+		template<typename T>
+		class InlineArrayRefCountBlock : public RefCountBlock
+		{
+		private:
+			int count;
+			InlineArrayRefCountBlock(int elementCount)
+				: count(elementCount)
+			{}
+		protected:
+			virtual void Destroy()
+			{
+				if (!std::is_pod<T>::value)
+				{
+					T * elements = Elements();
+					for (int i = 0; i < count; i++)
+						elements[i].~T();
+				}
+				this->~InlineArrayRefCountBlock();
+				::operator delete(this);
+			}
+			virtual void Detach()
+			{}
+			virtual bool CanDetach() const
+			{
+				return false;
+			}
+		public:
+			static size_t HeaderSize()
+			{
+				const size_t align = std::alignment_of<T>::value;
+				return (sizeof(InlineArrayRefCountBlock) + align - 1) / align * align;
+			}
+			T * Elements()
+			{
+				return (T*)((char*)this + HeaderSize());
+			}
+			static InlineArrayRefCountBlock * Create(int elementCount)
+			{
+				void * mem = ::operator new(HeaderSize() + sizeof(T) * elementCount);
+				auto block = new (mem) InlineArrayRefCountBlock(elementCount);
+				if (!std::is_pod<T>::value)
+				{
+					T * elements = block->Elements();
+					int i = 0;
+					try
+					{
+						for (; i < elementCount; i++)
+							new (elements + i) T();
+					}
+					catch (...)
+					{
+						while (i--)
+							elements[i].~T();
+						block->~InlineArrayRefCountBlock();
+						::operator delete(mem);
+						throw;
+					}
+				}
+				return block;
+			}
+		};
+
+		template<typename T, typename Destructor, bool intrusive = std::is_base_of<RefCounted, T>::value>
+		struct RefCountBlockFactory
+		{
+			static RefCountBlock * Create(T * ptr)
+			{
+				return new PointerRefCountBlock<T, Destructor>(ptr);
+			}
+		};
+
+		template<typename T, typename Destructor>
+		struct RefCountBlockFactory<T, Destructor, true>
+		{
+			static RefCountBlock * Create(T * ptr)
+			{
+				return static_cast<RefCounted*>(ptr);
+			}
+		};
+
 		template<typename T, typename Destructor = RefPtrDefaultDestructor>
 		class RefPtr
 		{
@@ -32,32 +248,47 @@ namespace CoreLib
 			friend class RefPtr;
 		private:
 			T * pointer;
-			int * refCount;
-			
+			RefCountBlock * block;
+			// atomic is taken from the most derived type the caller knows
+			void Adopt(T * ptr, RefCountBlock * refBlock, bool atomic)
+			{
+				pointer = ptr;
+				block = refBlock;
+				if (block->RefCount() == 0)
+					block->atomic = atomic;
+				block->AddRef();
+			}
 		public:
 			RefPtr()
 			{
 				pointer = 0;
-				refCount = 0;
+				block = 0;
 			}
 			RefPtr(T * ptr)
-				: pointer(0), refCount(0)
+				: pointer(0), block(0)
 			{
 				this->operator=(ptr);
 			}
 			template<typename T1>
 			RefPtr(T1 * ptr)
-				: pointer(0), refCount(0)
+				: pointer(0), block(0)
 			{
 				this->operator=(ptr);
 			}
+			// shares ownership of ptr with the other RefPtrs using refBlock (see MakeRef)
+			RefPtr(T * ptr, RefCountBlock * refBlock)
+				: pointer(0), block(0)
+			{
+				if (ptr)
+					Adopt(ptr, refBlock, RefCountTraits<T>::Atomic);
+			}
 			RefPtr(const RefPtr<T, Destructor> & ptr)
-				: pointer(0), refCount(0)
+				: pointer(0), block(0)
 			{
 				this->operator=(ptr);
 			}
 			RefPtr(RefPtr<T, Destructor> && str)
-				: pointer(0), refCount(0)
+				: pointer(0), block(0)
 			{
 				this->operator=(static_cast<RefPtr<T, Destructor> &&>(str));
 			}
@@ -65,14 +296,10 @@ namespace CoreLib
 			{
 				Dereferance();
 
-				pointer = ptr;
+				pointer = 0;
+				block = 0;
 				if(ptr)
-				{
-					refCount = new int;
-					(*refCount) = 1;
-				}
-				else
-					refCount = 0;
+					Adopt(ptr, RefCountBlockFactory<T, Destructor>::Create(ptr), RefCountTraits<T>::Atomic);
 				return *this;
 			}
 			template<typename T1>
@@ -80,14 +307,11 @@ namespace CoreLib
 			{
 				Dereferance();
 
-				pointer = dynamic_cast<T*>(ptr);
-				if(ptr)
-				{
-					refCount = new int;
-					(*refCount) = 1;
-				}
-				else
-					refCount = 0;
+				pointer = 0;
+				block = 0;
+				T * casted = dynamic_cast<T*>(ptr);
+				if(casted)
+					Adopt(casted, RefCountBlockFactory<T, Destructor>::Create(casted), RefCountTraits<T1>::Atomic);
 				return *this;
 			}
 			RefPtr<T,Destructor>& operator=(const RefPtr<T, Destructor> & ptr)
@@ -96,16 +320,16 @@ namespace CoreLib
 				{
 					Dereferance();
 					pointer = ptr.pointer;
-					refCount = ptr.refCount;
-					if (refCount)
-						(*refCount)++;
+					block = ptr.block;
+					if (block)
+						block->AddRef();
 				}
 				return *this;
 			}
 
 			template<typename T1>
 			RefPtr(const RefPtr<T1> & ptr)
-				: pointer(0), refCount(0)
+				: pointer(0), block(0)
 			{
 				this->operator=(ptr);
 			}
@@ -116,8 +340,9 @@ namespace CoreLib
 				{
 					Dereferance();
 					pointer = dynamic_cast<T*>(ptr.pointer);
-					refCount = ptr.refCount;
-					(*refCount)++;
+					block = pointer ? ptr.block : 0;
+					if (block)
+						block->AddRef();
 				}
 				return *this;
 			}
@@ -152,27 +377,26 @@ namespace CoreLib
 				{
 					Dereferance();
 					pointer = ptr.pointer;
-					refCount = ptr.refCount;
+					block = ptr.block;
 					ptr.pointer = 0;
-					ptr.refCount = 0;
+					ptr.block = 0;
 				}
 				return *this;
 			}
+			// Gives up this reference and returns the raw pointer. If it was the last reference
+			// the caller takes ownership. Objects created by MakeRef/MakeRefArray cannot be released
+			// (InvalidOperationException), as they share their allocation with the count.
 			T* Release()
 			{
 				if(pointer)
 				{
-					if((*refCount) > 1)
-					{
-						(*refCount)--;
-					}
-					else
-					{
-						delete refCount;
-					}
+					if (!block->CanDetach())
+						ThrowReleaseOfInlineObject(pointer);
+					if (block->ReleaseRef())
+						block->Detach();
 				}
 				auto rs = pointer;
-				refCount = 0;
+				block = 0;
 				pointer = 0;
 				return rs;
 			}
@@ -185,16 +409,8 @@ namespace CoreLib
 			{
 				if(pointer)
 				{
-					if((*refCount) > 1)
-					{
-						(*refCount)--;
-					}
-					else
-					{
-						Destructor destructor;
-						destructor(pointer);
-						delete refCount;
-					}
+					if (block->ReleaseRef())
+						block->Destroy();
 				}
 			}
 			T & operator *() const
@@ -216,7 +432,7 @@ namespace CoreLib
 				int Dummy;
 			};
 		public:
-			operator void*() const 
+			operator void*() const
 			{
 				if (pointer)
 					return (void*)(pointer);
@@ -224,7 +440,54 @@ namespace CoreLib
 					return 0;
 			}
 		};
+
+		template<typename T, bool intrusive = std::is_base_of<RefCounted, T>::value>
+		struct RefMaker
+		{
+			template<typename ... TArgs>
+			static RefPtr<T> Make(TArgs && ... args)
+			{
+				auto block = new InlineRefCountBlock<T>();
+				T * obj;
+				try
+				{
+					obj = new (&block->Storage) T(std::forward<TArgs>(args)...);
+				}
+				catch (...)
+				{
+					delete block;
+					throw;
+				}
+				return RefPtr<T>(obj, block);
+			}
+		};
+
+		template<typename T>
+		struct RefMaker<T, true>
+		{
+			template<typename ... TArgs>
+			static RefPtr<T> Make(TArgs && ... args)
+			{
+				return RefPtr<T>(new T(std::forward<TArgs>(args)...));
+			}
+		};
+
+		// Creates an object and its reference count with a single allocation.
+		template<typename T, typename ... TArgs>
+		inline RefPtr<T> MakeRef(TArgs && ... args)
+		{
+			return RefMaker<T>::Make(std::forward<TArgs>(args)...);
+		}
+
+		// Creates an array of count default-initialized elements and its reference count with a
+		// single allocation, as a drop-in for RefPtr<T, RefPtrArrayDestructor>(new T[count]).
+		template<typename T>
+		inline RefPtr<T, RefPtrArrayDestructor> MakeRefArray(int count)
+		{
+			auto block = InlineArrayRefCountBlock<T>::Create(count);
+			return RefPtr<T, RefPtrArrayDestructor>(block->Elements(), block);
+		}
 	}
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,8 +1,15 @@
 #include "Stream.h"
 #ifdef WIN32
 #include <share.h>
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 #include "LibIO.h"
+#include "WideChar.h"
 
 namespace CoreLib
 {
@@ -164,7 +171,7 @@ namespace CoreLib
 #ifdef WIN32
 			int rs = _fseeki64(handle, offset, _origin);
 #else
-			int rs = fseek(handle, (int)offset, _origin);
+			int rs = fseeko(handle, (off_t)offset, _origin);
 #endif
 			if (rs != 0)
 			{
@@ -208,5 +215,332 @@ namespace CoreLib
 				handle = 0;
 			}
 		}
+
+		BinaryReader::BinaryReader(RefPtr<Stream> stream, int blockSize)
+			: stream(stream), bufferPos(0), bufferEnd(0)
+		{
+			memory = dynamic_cast<MemoryBackedStream*>(stream.Ptr());
+			if (!memory)
+				buffer.SetSize(Math::Max(blockSize, 16));
+		}
+		void BinaryReader::Fill(int count)
+		{
+			// keep the unread tail and top the block up behind it
+			int remaining = bufferEnd - bufferPos;
+			memmove(buffer.Buffer(), buffer.Buffer() + bufferPos, remaining);
+			bufferPos = 0;
+			bufferEnd = remaining;
+			while (bufferEnd < count)
+			{
+				int bytes = stream->Read(buffer.Buffer() + bufferEnd, buffer.Count() - bufferEnd);
+				if (bytes <= 0)
+					throw EndOfStreamException(L"End of stream reached when reading.");
+				bufferEnd += bytes;
+			}
+		}
+		void BinaryReader::ReadBytesSlow(void * dest, int length)
+		{
+			unsigned char * ptr = (unsigned char*)dest;
+			int buffered = bufferEnd - bufferPos;
+			memcpy(ptr, buffer.Buffer() + bufferPos, buffered);
+			ptr += buffered;
+			length -= buffered;
+			bufferPos = bufferEnd = 0;
+			if (length < buffer.Count())
+			{
+				Fill(length);
+				memcpy(ptr, buffer.Buffer(), length);
+				bufferPos = length;
+				return;
+			}
+			// large reads bypass the block
+			while (length > 0)
+			{
+				int bytes = stream->Read(ptr, length);
+				if (bytes <= 0)
+					throw EndOfStreamException(L"End of stream reached when reading.");
+				ptr += bytes;
+				length -= bytes;
+			}
+		}
+		uint64_t BinaryReader::ReadVarInt(int maxBits)
+		{
+			uint64_t rs = 0;
+			for (int shift = 0; shift < maxBits; shift += 7)
+			{
+				unsigned char b = *Take(1);
+				rs |= (uint64_t)(b & 0x7F) << shift;
+				if (!(b & 0x80))
+					return rs;
+			}
+			throw IOException(L"Malformed var-int.");
+		}
+		String BinaryReader::ReadString()
+		{
+			int len = (int)ReadVarUInt32();
+			if (len < 0)
+				throw IOException(L"Invalid string length.");
+			if (memory)
+				return String::FromUtf8((const char*)memory->Consume(len), len);
+			if (len <= buffer.Count())
+				return String::FromUtf8((const char*)Take(len), len);
+			List<char> bytes;
+			ReadList(bytes, len);
+			return String::FromUtf8(bytes.Buffer(), len);
+		}
+		StringView BinaryReader::ReadString(MemoryArena & arena)
+		{
+			int len = (int)ReadVarUInt32();
+			if (len < 0)
+				throw IOException(L"Invalid string length.");
+			List<char> bytes;
+			const char * utf8;
+			if (memory)
+				utf8 = (const char*)memory->Consume(len);
+			else if (len <= buffer.Count())
+				utf8 = (const char*)Take(len);
+			else
+			{
+				ReadList(bytes, len);
+				utf8 = bytes.Buffer();
+			}
+			int wlen = Utf8ToWideChar(0, utf8, len);
+			wchar_t * chars = arena.AllocArray<wchar_t>(wlen + 1);
+			Utf8ToWideChar(chars, utf8, len);
+			chars[wlen] = 0;
+			return StringView(chars, wlen);
+		}
+
+		BinaryWriter::BinaryWriter(RefPtr<Stream> stream, int blockSize)
+			: stream(stream), bufferPos(0)
+		{
+			buffer.SetSize(Math::Max(blockSize, 16));
+		}
+		BinaryWriter::~BinaryWriter()
+		{
+			try
+			{
+				Flush();
+			}
+			catch (Exception &)
+			{
+			}
+		}
+		void BinaryWriter::WriteBytesSlow(const void * data, int length)
+		{
+			Flush();
+			if (length < buffer.Count())
+			{
+				memcpy(buffer.Buffer(), data, length);
+				bufferPos = length;
+			}
+			else
+				stream->Write(data, length);
+		}
+		void BinaryWriter::Write(const StringView & str)
+		{
+			int len = WideCharToUtf8(0, str.Buffer(), str.Length());
+			WriteVarUInt32(len);
+			if (len <= buffer.Count())
+				WideCharToUtf8((char*)Reserve(len), str.Buffer(), str.Length());
+			else
+			{
+				List<char> bytes;
+				bytes.SetSize(len);
+				WideCharToUtf8(bytes.Buffer(), str.Buffer(), str.Length());
+				WriteBytes(bytes.Buffer(), len);
+			}
+		}
+		void BinaryWriter::Flush()
+		{
+			if (bufferPos)
+			{
+				int count = bufferPos;
+				bufferPos = 0;
+				stream->Write(buffer.Buffer(), count);
+			}
+		}
+
+		void MemoryBackedStream::Seek(SeekOrigin origin, Int64 offset)
+		{
+			Int64 newPos;
+			switch (origin)
+			{
+			case CoreLib::IO::SeekOrigin::Start:
+				newPos = offset;
+				break;
+			case CoreLib::IO::SeekOrigin::End:
+				newPos = length + offset;
+				break;
+			case CoreLib::IO::SeekOrigin::Current:
+				newPos = position + offset;
+				break;
+			default:
+				throw NotSupportedException(L"Unsupported seek origin.");
+				break;
+			}
+			if (newPos < 0 || newPos > length)
+				throw IOException(L"MemoryStream seek out of range.");
+			position = newPos;
+		}
+		int MemoryBackedStream::Read(void * buffer, int length)
+		{
+			Int64 remaining = this->length - position;
+			if (remaining <= 0)
+				throw EndOfStreamException(L"End of stream reached when reading.");
+			int bytes = remaining < length ? (int)remaining : length;
+			memcpy(buffer, data + position, bytes);
+			position += bytes;
+			return bytes;
+		}
+
+		MemoryStream::MemoryStream()
+			: writable(true)
+		{}
+		MemoryStream::MemoryStream(List<unsigned char> && contents)
+			: buffer(_Move(contents)), writable(true)
+		{
+			data = buffer.Buffer();
+			length = buffer.Count();
+		}
+		MemoryStream::MemoryStream(const void * memory, Int64 size)
+			: writable(false)
+		{
+			data = (unsigned char*)memory;
+			length = size;
+		}
+		int MemoryStream::Write(const void * buffer, int length)
+		{
+			if (!writable)
+				throw IOException(L"MemoryStream is read-only.");
+			Int64 end = position + length;
+			if (end > this->buffer.Count())
+			{
+				if (end > this->buffer.Capacity())
+					this->buffer.Reserve((int)Math::Max(end, (Int64)this->buffer.Capacity() * 2));
+				this->buffer.SetSize((int)end);
+				data = this->buffer.Buffer();
+				this->length = end;
+			}
+			memcpy(data + position, buffer, length);
+			position = end;
+			return length;
+		}
+		void MemoryStream::Close()
+		{
+			buffer = List<unsigned char>();
+			data = 0;
+			length = position = 0;
+		}
+
+		MemoryMappedFileStream::MemoryMappedFileStream(const CoreLib::Basic::String & fileName, MemoryAccessPattern pattern)
+		{
+#ifdef WIN32
+			DWORD flags = FILE_ATTRIBUTE_NORMAL;
+			if (pattern == MemoryAccessPattern::Sequential)
+				flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+			else if (pattern == MemoryAccessPattern::Random)
+				flags |= FILE_FLAG_RANDOM_ACCESS;
+			mappingHandle = 0;
+			fileHandle = CreateFileW(fileName.Buffer(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+			if (fileHandle == INVALID_HANDLE_VALUE)
+			{
+				fileHandle = 0;
+				throw IOException(L"Cannot open file '" + fileName + L"'");
+			}
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(fileHandle, &size))
+			{
+				Close();
+				throw IOException(L"Cannot read the size of file '" + fileName + L"'");
+			}
+			length = size.QuadPart;
+			if (length == 0)
+				return;
+			mappingHandle = CreateFileMappingW(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mappingHandle)
+				data = (unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+			fileHandle = open(fileName.ToMultiByteString(), O_RDONLY);
+			if (fileHandle == -1)
+				throw IOException(L"Cannot open file '" + fileName + L"'");
+			struct stat info;
+			if (fstat(fileHandle, &info) != 0)
+			{
+				Close();
+				throw IOException(L"Cannot read the size of file '" + fileName + L"'");
+			}
+			length = info.st_size;
+			if (length == 0)
+				return;
+			void * mapping = mmap(0, (size_t)length, PROT_READ, MAP_PRIVATE, fileHandle, 0);
+			if (mapping != MAP_FAILED)
+			{
+				data = (unsigned char*)mapping;
+				if (pattern == MemoryAccessPattern::Sequential)
+					madvise(mapping, (size_t)length, MADV_SEQUENTIAL);
+				else if (pattern == MemoryAccessPattern::Random)
+					madvise(mapping, (size_t)length, MADV_RANDOM);
+			}
+#endif
+			if (!data)
+			{
+				Close();
+				throw IOException(L"Cannot map file '" + fileName + L"'");
+			}
+		}
+		MemoryMappedFileStream::~MemoryMappedFileStream()
+		{
+			Close();
+		}
+		void MemoryMappedFileStream::Prefetch(Int64 offset, Int64 size)
+		{
+			if (offset < 0)
+			{
+				size += offset;
+				offset = 0;
+			}
+			if (size > length - offset)
+				size = length - offset;
+			if (!data || size <= 0)
+				return;
+#ifdef WIN32
+#if _WIN32_WINNT >= 0x0602
+			WIN32_MEMORY_RANGE_ENTRY range;
+			range.VirtualAddress = data + offset;
+			range.NumberOfBytes = (SIZE_T)size;
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+			// madvise wants a page aligned start
+			size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+			size_t start = (size_t)offset / pageSize * pageSize;
+			madvise(data + start, (size_t)(offset + size) - start, MADV_WILLNEED);
+#endif
+		}
+		int MemoryMappedFileStream::Write(const void * /*buffer*/, int /*length*/)
+		{
+			throw NotSupportedException(L"MemoryMappedFileStream is read-only.");
+		}
+		void MemoryMappedFileStream::Close()
+		{
+#ifdef WIN32
+			if (data)
+				UnmapViewOfFile(data);
+			if (mappingHandle)
+				CloseHandle(mappingHandle);
+			if (fileHandle)
+				CloseHandle(fileHandle);
+			mappingHandle = fileHandle = 0;
+#else
+			if (data)
+				munmap(data, (size_t)length);
+			if (fileHandle != -1)
+				close(fileHandle);
+			fileHandle = -1;
+#endif
+			data = 0;
+			length = position = 0;
+		}
 	}
 }
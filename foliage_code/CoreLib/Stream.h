@@ -2,6 +2,8 @@
 #define CORE_LIB_STREAM_H
 
 #include "Basic.h"
+#include "ArrayView.h"
+#include "Arena.h"
 
 namespace CoreLib
 {
@@ -9,6 +11,7 @@ namespace CoreLib
 	{
 		using CoreLib::Basic::Exception;
 		using CoreLib::Basic::String;
+		using CoreLib::Basic::StringView;
 		using CoreLib::Basic::RefPtr;
 
 		class IOException : public Exception
@@ -50,108 +53,418 @@ namespace CoreLib
 			virtual void Close()=0;
 		};
 
+		// Stream over one contiguous block of memory. Readers can take data straight out of the
+		// block (Consume) instead of copying it through Read.
+		class MemoryBackedStream : public Stream
+		{
+		protected:
+			unsigned char * data;
+			Int64 length;
+			Int64 position;
+			MemoryBackedStream()
+				: data(0), length(0), position(0)
+			{}
+		public:
+			const unsigned char * GetData() const
+			{
+				return data;
+			}
+			Int64 GetLength() const
+			{
+				return length;
+			}
+			Int64 GetRemaining() const
+			{
+				return length - position;
+			}
+			// returns the next count bytes in place and moves past them
+			inline const unsigned char * Consume(Int64 count)
+			{
+				if (count < 0)
+					throw IOException(L"Invalid read length.");
+				if (count > length - position)
+					throw EndOfStreamException(L"End of stream reached when reading.");
+				const unsigned char * rs = data + position;
+				position += count;
+				return rs;
+			}
+			virtual Int64 GetPosition()
+			{
+				return position;
+			}
+			virtual void Seek(SeekOrigin origin, Int64 offset);
+			virtual int Read(void * buffer, int length);
+			virtual bool CanRead()
+			{
+				return true;
+			}
+		};
+
+		// In-memory stream. It either owns a growable buffer, or reads from memory owned by the
+		// caller without copying it.
+		class MemoryStream : public MemoryBackedStream
+		{
+		private:
+			CoreLib::Basic::List<unsigned char> buffer;
+			bool writable;
+		public:
+			// empty stream for writing
+			MemoryStream();
+			// takes over contents, readable and writable
+			MemoryStream(CoreLib::Basic::List<unsigned char> && contents);
+			// read-only view of memory that must outlive the stream
+			MemoryStream(const void * memory, Int64 size);
+			virtual int Write(const void * buffer, int length);
+			virtual bool CanWrite()
+			{
+				return writable;
+			}
+			virtual void Close();
+		};
+
+		enum class MemoryAccessPattern
+		{
+			Normal, Sequential, Random
+		};
+
+		// Read-only stream over a memory-mapped file (mmap / file mapping). Pages are faulted
+		// in on first access; use Prefetch to start reading a range ahead of time.
+		class MemoryMappedFileStream : public MemoryBackedStream
+		{
+		private:
+#ifdef WIN32
+			void * fileHandle;
+			void * mappingHandle;
+#else
+			int fileHandle;
+#endif
+		public:
+			MemoryMappedFileStream(const CoreLib::Basic::String & fileName, MemoryAccessPattern pattern = MemoryAccessPattern::Normal);
+			~MemoryMappedFileStream();
+			// asks the OS to read [offset, offset + size) in the background
+			void Prefetch(Int64 offset, Int64 size);
+			virtual int Write(const void * buffer, int length);
+			virtual bool CanWrite()
+			{
+				return false;
+			}
+			virtual void Close();
+		};
+
+		// Binary files are little-endian; on little-endian hosts these are no-ops.
+		template<typename T>
+		inline T ToLittleEndian(T val)
+		{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			if (std::is_arithmetic<T>::value && sizeof(T) > 1)
+			{
+				unsigned char * bytes = (unsigned char*)&val;
+				for (int i = 0; i < (int)sizeof(T) / 2; i++)
+					CoreLib::Basic::Swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+			}
+#endif
+			return val;
+		}
+
+		template<typename T>
+		inline void ToLittleEndian(T * vals, int count)
+		{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			if (std::is_arithmetic<T>::value && sizeof(T) > 1)
+			{
+				for (int i = 0; i < count; i++)
+					vals[i] = ToLittleEndian(vals[i]);
+			}
+#else
+			(void)vals; (void)count;
+#endif
+		}
+
+		// Reads little-endian binary data. Reads from memory backed streams go straight to the
+		// memory; other streams are read a block at a time, so the underlying stream is
+		// positioned ahead of what has been consumed (see GetPosition).
 		class BinaryReader
 		{
 		private:
 			RefPtr<Stream> stream;
-		public:
-			BinaryReader(RefPtr<Stream> stream)
+			// set when stream is memory backed, values are then read without virtual calls
+			MemoryBackedStream * memory;
+			CoreLib::Basic::List<unsigned char> buffer;
+			int bufferPos, bufferEnd;
+			void Fill(int count);
+			void ReadBytesSlow(void * dest, int length);
+			// next count bytes, count must not exceed the block size
+			inline const unsigned char * Take(int count)
+			{
+				if (memory)
+					return memory->Consume(count);
+				if (bufferEnd - bufferPos < count)
+					Fill(count);
+				const unsigned char * rs = buffer.Buffer() + bufferPos;
+				bufferPos += count;
+				return rs;
+			}
+			inline void ReadBytes(void * dest, int length)
+			{
+				if (memory)
+					memcpy(dest, memory->Consume(length), length);
+				else if (bufferEnd - bufferPos >= length)
+				{
+					memcpy(dest, buffer.Buffer() + bufferPos, length);
+					bufferPos += length;
+				}
+				else
+					ReadBytesSlow(dest, length);
+			}
+			template<typename T>
+			T ReadValue()
 			{
-				this->stream = stream;
+				T rs;
+				memcpy(&rs, Take(sizeof(T)), sizeof(T));
+				return ToLittleEndian(rs);
+			}
+			uint64_t ReadVarInt(int maxBits);
+			// Reads count elements into list. The length of a stream that is not memory backed is
+			// not known, so a corrupt count must not size the list up front; it grows as the data
+			// actually arrives, and a short stream ends in EndOfStreamException.
+			template<typename T>
+			void ReadList(CoreLib::Basic::List<T> & list, int count)
+			{
+				if (count < 0)
+					throw IOException(L"Invalid array length.");
+				if (memory)
+				{
+					if ((Int64)count * (Int64)sizeof(T) > memory->GetRemaining())
+						throw EndOfStreamException(L"Array length exceeds the data left in the stream.");
+					list.SetSize(count);
+					ReadArray(list.Buffer(), count);
+					return;
+				}
+				int minChunk = CoreLib::Basic::Math::Max(DefaultBlockSize / (int)sizeof(T), 1);
+				list.Clear();
+				while (list.Count() < count)
+				{
+					int done = list.Count();
+					int chunk = CoreLib::Basic::Math::Min(count - done, CoreLib::Basic::Math::Max(minChunk, done));
+					list.SetSize(done + chunk);
+					ReadArray(list.Buffer() + done, chunk);
+				}
 			}
+		public:
+			static const int DefaultBlockSize = 65536;
+			BinaryReader(RefPtr<Stream> stream, int blockSize = DefaultBlockSize);
 			Stream * GetStream()
 			{
 				return stream.Ptr();
 			}
+			// position of the next unread byte in the stream
+			Int64 GetPosition()
+			{
+				return stream->GetPosition() - (bufferEnd - bufferPos);
+			}
 			template<typename T>
 			void Read(T * buffer, int count)
 			{
-				stream->Read(buffer, sizeof(T)*count);
+				ReadArray(buffer, count);
+			}
+			// bulk read of count trivially copyable elements
+			template<typename T>
+			void ReadArray(T * buffer, int count)
+			{
+				// an empty list has no buffer to copy to
+				if (count == 0)
+					return;
+				ReadBytes(buffer, sizeof(T)*count);
+				ToLittleEndian(buffer, count);
+			}
+			// reads an Int32 count followed by the elements, see BinaryWriter::WriteArray
+			template<typename T>
+			void ReadArray(CoreLib::Basic::List<T> & list)
+			{
+				ReadList(list, ReadInt32());
+			}
+			// true if ReadView can be used on this stream
+			bool CanReadViews() const
+			{
+				return memory != 0;
+			}
+			// Returns the next count elements in place, without copying. Only for memory backed
+			// streams; the view is valid while the stream is open.
+			template<typename T>
+			CoreLib::Basic::ArrayView<const T> ReadView(int count)
+			{
+				if (!memory)
+					throw CoreLib::Basic::NotSupportedException(L"ReadView requires a memory backed stream.");
+				if ((size_t)(memory->GetData() + memory->GetPosition()) % std::alignment_of<T>::value)
+					throw IOException(L"ReadView: data is not aligned for the element type.");
+				return CoreLib::Basic::ArrayView<const T>((const T*)memory->Consume((Int64)sizeof(T)*count), count);
 			}
 			int ReadInt32()
 			{
-				int rs;
-				stream->Read(&rs, sizeof(int));
-				return rs;
+				return ReadValue<int>();
 			}
 			short ReadInt16()
 			{
-				short rs;
-				stream->Read(&rs, sizeof(short));
-				return rs;
+				return ReadValue<short>();
 			}
 			Int64 ReadInt64()
 			{
-				Int64 rs;
-				stream->Read(&rs, sizeof(Int64));
-				return rs;
+				return ReadValue<Int64>();
 			}
 			float ReadFloat()
 			{
-				float rs;
-				stream->Read(&rs, sizeof(float));
-				return rs;
+				return ReadValue<float>();
 			}
 			double ReadDouble()
 			{
-				double rs;
-				stream->Read(&rs, sizeof(double));
-				return rs;
+				return ReadValue<double>();
 			}
 			char ReadChar()
 			{
-				char rs;
-				stream->Read(&rs, sizeof(char));
-				return rs;
+				return ReadValue<char>();
 			}
-			String ReadString()
+			unsigned char ReadByte()
 			{
-				int len = ReadInt32();
-				wchar_t * buffer = new wchar_t[len+1];
-				try
-				{
-					stream->Read(buffer, sizeof(wchar_t)*len);
-				}
-				catch(IOException & e)
-				{
-					delete [] buffer;
-					throw e;
-				}
-				buffer[len] = 0;
-				return String::FromBuffer(buffer, len);
+				return *Take(1);
+			}
+			// LEB128 encoded unsigned integers
+			unsigned int ReadVarUInt32()
+			{
+				return (unsigned int)ReadVarInt(32);
+			}
+			uint64_t ReadVarUInt64()
+			{
+				return ReadVarInt(64);
+			}
+			// zigzag + LEB128 encoded signed integers
+			int ReadVarInt32()
+			{
+				unsigned int v = ReadVarUInt32();
+				return (int)(v >> 1) ^ -(int)(v & 1);
 			}
+			Int64 ReadVarInt64()
+			{
+				uint64_t v = ReadVarUInt64();
+				return (Int64)(v >> 1) ^ -(Int64)(v & 1);
+			}
+			String ReadString();
+			// decodes the string into arena, the view is valid as long as the arena
+			CoreLib::Basic::StringView ReadString(CoreLib::Basic::MemoryArena & arena);
 		};
 
+		// Writes little-endian binary data through a block buffer. Call Flush or Close when done;
+		// the destructor flushes too but cannot report errors.
 		class BinaryWriter
 		{
 		private:
 			RefPtr<Stream> stream;
-		public:
-			BinaryWriter(RefPtr<Stream> stream)
+			CoreLib::Basic::List<unsigned char> buffer;
+			int bufferPos;
+			void WriteBytesSlow(const void * data, int length);
+			// room for count bytes, count must not exceed the block size
+			inline unsigned char * Reserve(int count)
+			{
+				if (bufferPos + count > buffer.Count())
+					Flush();
+				unsigned char * rs = buffer.Buffer() + bufferPos;
+				bufferPos += count;
+				return rs;
+			}
+			inline void WriteBytes(const void * data, int length)
+			{
+				if (bufferPos + length <= buffer.Count())
+				{
+					memcpy(buffer.Buffer() + bufferPos, data, length);
+					bufferPos += length;
+				}
+				else
+					WriteBytesSlow(data, length);
+			}
+			void WriteVarInt(uint64_t val)
 			{
-				this->stream = stream;
+				unsigned char * dest = Reserve(10);
+				int len = 0;
+				while (val >= 0x80)
+				{
+					dest[len++] = (unsigned char)(val | 0x80);
+					val >>= 7;
+				}
+				dest[len++] = (unsigned char)val;
+				bufferPos -= 10 - len;
 			}
+		public:
+			static const int DefaultBlockSize = 65536;
+			BinaryWriter(RefPtr<Stream> stream, int blockSize = DefaultBlockSize);
+			~BinaryWriter();
 			Stream * GetStream()
 			{
 				return stream.Ptr();
 			}
+			// position in the stream of the next byte written
+			Int64 GetPosition()
+			{
+				return stream->GetPosition() + bufferPos;
+			}
 			template<typename T>
 			void Write(const T& val)
 			{
-				stream->Write(&val, sizeof(T));
+				T le = ToLittleEndian(val);
+				memcpy(Reserve(sizeof(T)), &le, sizeof(T));
 			}
 			template<typename T>
 			void Write(T * buffer, int count)
 			{
-				stream->Write(buffer, sizeof(T)*count);
+				WriteArray((const T*)buffer, count);
+			}
+			// bulk write of count trivially copyable elements
+			template<typename T>
+			void WriteArray(const T * buffer, int count)
+			{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+				if (std::is_arithmetic<T>::value && sizeof(T) > 1)
+				{
+					for (int i = 0; i < count; i++)
+						Write(buffer[i]);
+					return;
+				}
+#endif
+				if (count == 0)
+					return;
+				WriteBytes(buffer, sizeof(T)*count);
+			}
+			// writes an Int32 count followed by the elements
+			template<typename T>
+			void WriteArray(const CoreLib::Basic::List<T> & list)
+			{
+				Write(list.Count());
+				WriteArray(list.Buffer(), list.Count());
+			}
+			void WriteVarUInt32(unsigned int val)
+			{
+				WriteVarInt(val);
+			}
+			void WriteVarUInt64(uint64_t val)
+			{
+				WriteVarInt(val);
+			}
+			void WriteVarInt32(int val)
+			{
+				WriteVarInt(((unsigned int)val << 1) ^ (unsigned int)(val >> 31));
+			}
+			void WriteVarInt64(Int64 val)
+			{
+				WriteVarInt(((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
 			}
+			// strings are stored as a var-int byte count followed by UTF-8
+			void Write(const CoreLib::Basic::StringView & str);
 			void Write(const String & str)
 			{
-				Write(str.Length());
-				Write(str.Buffer(), str.Length());
+				Write(CoreLib::Basic::StringView(str));
 			}
+			void Flush();
 			void Close()
 			{
+				Flush();
 				stream->Close();
 			}
 		};
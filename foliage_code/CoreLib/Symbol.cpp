@@ -0,0 +1,169 @@
+#include "Symbol.h"
+#include "Exception.h"
+#include <wctype.h>
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+		class SpinLockGuard
+		{
+		private:
+			Threading::SpinLock & lock;
+		public:
+			SpinLockGuard(Threading::SpinLock & l)
+				: lock(l)
+			{
+				lock.Lock();
+			}
+			~SpinLockGuard()
+			{
+				lock.Unlock();
+			}
+		};
+
+		SymbolTable::SymbolTable()
+			: count(0)
+		{
+			for (int i = 0; i < MaxSegments; i++)
+				segments[i] = 0;
+			slotMask = 1023;
+			slots = new unsigned int[slotMask + 1];
+			memset(slots, 0, sizeof(unsigned int) * (slotMask + 1));
+			Intern(L"", 0);
+		}
+
+		SymbolTable::~SymbolTable()
+		{
+			for (int i = 0; i < MaxSegments && segments[i]; i++)
+				delete [] segments[i];
+			delete [] slots;
+		}
+
+		unsigned int * SymbolTable::FindSlot(const wchar_t * str, int length, unsigned int hash) const
+		{
+			unsigned int i = (hash ^ (hash >> 15)) & slotMask;
+			while (true)
+			{
+				unsigned int slot = slots[i];
+				if (slot == 0)
+					return slots + i;
+				const Entry & entry = GetEntry(slot - 1);
+				if (entry.Hash == hash && entry.Length == length &&
+					memcmp(entry.Chars, str, sizeof(wchar_t) * length) == 0)
+					return slots + i;
+				i = (i + 1) & slotMask;
+			}
+		}
+
+		void SymbolTable::Rehash()
+		{
+			unsigned int newMask = slotMask * 2 + 1;
+			unsigned int * newSlots = new unsigned int[newMask + 1];
+			memset(newSlots, 0, sizeof(unsigned int) * (newMask + 1));
+			int symbolCount = count.load(std::memory_order_relaxed);
+			for (int id = 0; id < symbolCount; id++)
+			{
+				unsigned int hash = GetEntry(id).Hash;
+				unsigned int i = (hash ^ (hash >> 15)) & newMask;
+				while (newSlots[i])
+					i = (i + 1) & newMask;
+				newSlots[i] = id + 1;
+			}
+			delete [] slots;
+			slots = newSlots;
+			slotMask = newMask;
+		}
+
+		Symbol SymbolTable::Intern(const wchar_t * str, int length)
+		{
+			unsigned int hash = Hash(str, length);
+			SpinLockGuard guard(lock);
+			unsigned int * slot = FindSlot(str, length, hash);
+			if (*slot)
+				return Symbol(*slot - 1);
+			int id = count.load(std::memory_order_relaxed);
+			if (id == MaxSegments * SegmentSize)
+				throw InvalidOperationException(L"Symbol table is full.");
+			if ((id & (SegmentSize - 1)) == 0)
+				segments[id >> SegmentBits] = new Entry[SegmentSize];
+			Entry & entry = GetEntry(id);
+			entry.Chars = arena.CopyString(str, length);
+			entry.Length = length;
+			entry.Hash = hash;
+			*slot = id + 1;
+			count.store(id + 1, std::memory_order_release);
+			// keep the load factor under 1/2 so probe sequences stay short
+			if ((unsigned int)(id + 1) * 2 > slotMask)
+				Rehash();
+			return Symbol(id);
+		}
+
+		Symbol SymbolTable::InternPath(const StringView & path)
+		{
+			wchar_t buffer[260];
+			if (path.Length() <= 260)
+				return Intern(buffer, NormalizePath(buffer, path));
+			return Intern(NormalizePath(path));
+		}
+
+		bool SymbolTable::TryGetSymbol(const StringView & name, Symbol & rs)
+		{
+			unsigned int hash = Hash(name.Buffer(), name.Length());
+			SpinLockGuard guard(lock);
+			unsigned int slot = *FindSlot(name.Buffer(), name.Length(), hash);
+			if (slot)
+				rs = Symbol(slot - 1);
+			return slot != 0;
+		}
+
+		int SymbolTable::NormalizePath(wchar_t * dest, const StringView & path)
+		{
+			int len = 0;
+			for (int i = 0; i < path.Length(); i++)
+			{
+				wchar_t ch = path[i];
+				if (ch == L'\\')
+					ch = L'/';
+				else
+					ch = (wchar_t)towlower(ch);
+				if (ch == L'/')
+				{
+					if (len > 0 && dest[len - 1] == L'/')
+						continue;
+					// drop "./" segments
+					if (len == 1 && dest[0] == L'.')
+					{
+						len = 0;
+						continue;
+					}
+					if (len >= 2 && dest[len - 1] == L'.' && dest[len - 2] == L'/')
+					{
+						len--;
+						continue;
+					}
+				}
+				dest[len++] = ch;
+			}
+			return len;
+		}
+
+		String SymbolTable::NormalizePath(const StringView & path)
+		{
+			List<wchar_t> buffer;
+			buffer.SetSize(path.Length());
+			int len = NormalizePath(buffer.Buffer(), path);
+			return String(buffer.Buffer(), len);
+		}
+
+		SymbolTable & SymbolTable::Global()
+		{
+			static SymbolTable table;
+			return table;
+		}
+
+		// construct the global table during static initialization, before any worker threads
+		// exist, for compilers without thread-safe local statics
+		static SymbolTable & globalSymbolTable = SymbolTable::Global();
+	}
+}
@@ -0,0 +1,138 @@
+#ifndef CORE_LIB_SYMBOL_H
+#define CORE_LIB_SYMBOL_H
+
+#include "LibString.h"
+#include "Arena.h"
+#include "Threading.h"
+
+namespace CoreLib
+{
+	namespace Basic
+	{
+		// Interned name. Two symbols from the same table are equal iff their names are equal,
+		// so symbols are compared and hashed as plain integers. Id 0 is the empty name.
+		class Symbol
+		{
+		private:
+			unsigned int id;
+		public:
+			Symbol()
+				: id(0)
+			{}
+			explicit Symbol(unsigned int symbolId)
+				: id(symbolId)
+			{}
+			unsigned int Id() const
+			{
+				return id;
+			}
+			bool IsEmpty() const
+			{
+				return id == 0;
+			}
+			bool operator == (const Symbol & other) const
+			{
+				return id == other.id;
+			}
+			bool operator != (const Symbol & other) const
+			{
+				return id != other.id;
+			}
+			bool operator < (const Symbol & other) const
+			{
+				return id < other.id;
+			}
+			int GetHashCode() const
+			{
+				return (int)id;
+			}
+			// name in the global table
+			StringView Name() const;
+			String ToString() const
+			{
+				return String(Name());
+			}
+		};
+
+		// Thread-safe string -> Symbol map. Ids are handed out densely in insertion order and stay
+		// valid for the lifetime of the table; names are stored in an arena and never move, so
+		// GetName() does not take the lock.
+		class SymbolTable : public Object
+		{
+		private:
+			static const int SegmentBits = 12;
+			static const int SegmentSize = 1 << SegmentBits;
+			static const int MaxSegments = 4096;
+			struct Entry
+			{
+				const wchar_t * Chars;
+				int Length;
+				unsigned int Hash;
+			};
+			Entry * segments[MaxSegments];
+			std::atomic<int> count;
+			// open addressing with linear probing, holds id + 1 (0 marks a free slot)
+			unsigned int * slots;
+			unsigned int slotMask;
+			MemoryArena arena;
+			Threading::SpinLock lock;
+			SymbolTable(const SymbolTable &) = delete;
+			SymbolTable & operator = (const SymbolTable &) = delete;
+			static unsigned int Hash(const wchar_t * str, int length)
+			{
+				// StringHash is weak in the low bits, which is all a power-of-two table looks at
+				return (unsigned int)StringHash(str, length) * 0x9E3779B1u;
+			}
+			Entry & GetEntry(unsigned int id) const
+			{
+				return segments[id >> SegmentBits][id & (SegmentSize - 1)];
+			}
+			unsigned int * FindSlot(const wchar_t * str, int length, unsigned int hash) const;
+			void Rehash();
+			Symbol Intern(const wchar_t * str, int length);
+		public:
+			SymbolTable();
+			~SymbolTable();
+			Symbol Intern(const StringView & name)
+			{
+				return Intern(name.Buffer(), name.Length());
+			}
+			// interns the normalized form of path (see NormalizePath)
+			Symbol InternPath(const StringView & path);
+			// looks name up without inserting it
+			bool TryGetSymbol(const StringView & name, Symbol & rs);
+			StringView GetName(Symbol symbol) const
+			{
+				const Entry & entry = GetEntry(symbol.Id());
+				return StringView(entry.Chars, entry.Length);
+			}
+			int Count() const
+			{
+				return count.load(std::memory_order_acquire);
+			}
+			// lower case, '/' as the only separator, no repeated separators or "." segments;
+			// returns the length written to dest, which needs room for path.Length() characters
+			static int NormalizePath(wchar_t * dest, const StringView & path);
+			static String NormalizePath(const StringView & path);
+
+			static SymbolTable & Global();
+		};
+
+		inline StringView Symbol::Name() const
+		{
+			return SymbolTable::Global().GetName(*this);
+		}
+
+		inline Symbol Intern(const StringView & name)
+		{
+			return SymbolTable::Global().Intern(name);
+		}
+
+		inline Symbol InternPath(const StringView & path)
+		{
+			return SymbolTable::Global().InternPath(path);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,207 @@
+// CullSpheres and CullBoxes against Contains: for random perspective and orthographic frustums
+// and volumes scattered across their planes, the kernels have to list exactly the volumes that
+// Contains does not find Outside, in order, for every tail length of the widest kernels.
+// Volumes that just touch a plane count as visible. Runs on the tier selected by
+// CORELIB_CPU_TIER, which the test list runs once per tier.
+
+#include "../Graphics/Bounds.h"
+#include "../SimdKernels.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+using namespace CoreLib::Basic;
+using namespace CoreLib::Graphics;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+static std::mt19937 rng(5);
+
+static float Random(float min, float max)
+{
+	return std::uniform_real_distribution<float>(min, max)(rng);
+}
+
+static float Round(float x)
+{
+	return floorf(x * 1024.0f + 0.5f) / 1024.0f;
+}
+
+static Quat RandomQuat()
+{
+	std::normal_distribution<float> dist;
+	Quat q(dist(rng), dist(rng), dist(rng), dist(rng));
+	float length = sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	return Quat(q.x / length, q.y / length, q.z / length, q.w / length);
+}
+
+// clip space depth [-1, 1], or [0, 1] if zeroToOneDepth is set
+static void CreateOrthoMatrix(Matrix4 & rs, float left, float right, float bottom, float top, float zNear, float zFar, bool zeroToOneDepth)
+{
+	memset(&rs, 0, sizeof(Matrix4));
+	rs.m[0][0] = 2.0f / (right - left);
+	rs.m[1][1] = 2.0f / (top - bottom);
+	rs.m[3][0] = -(right + left) / (right - left);
+	rs.m[3][1] = -(top + bottom) / (top - bottom);
+	if (zeroToOneDepth)
+	{
+		rs.m[2][2] = -1.0f / (zFar - zNear);
+		rs.m[3][2] = -zNear / (zFar - zNear);
+	}
+	else
+	{
+		rs.m[2][2] = -2.0f / (zFar - zNear);
+		rs.m[3][2] = -(zFar + zNear) / (zFar - zNear);
+	}
+	rs.m[3][3] = 1.0f;
+}
+
+// a camera at a random position looking at target
+static void RandomFrustum(Frustum & frustum, const Vec3 & target, bool perspective)
+{
+	Vec3 pos(target.x + Random(-20.0f, 20.0f), target.y + Random(-20.0f, 20.0f), target.z + Random(5.0f, 20.0f));
+	Matrix4 view, projection, viewProjection;
+	Matrix4::LookAt(view, pos, target, Vec3(0.0f, 1.0f, 0.0f));
+	bool zeroToOneDepth = !perspective && rng() % 2 == 0;
+	if (perspective)
+		Matrix4::CreatePerspectiveMatrixFromViewAngle(projection, Random(30.0f, 100.0f), Random(0.5f, 2.0f), Random(0.1f, 2.0f), Random(40.0f, 80.0f));
+	else
+		CreateOrthoMatrix(projection, Random(-10.0f, -2.0f), Random(2.0f, 10.0f), Random(-10.0f, -2.0f), Random(2.0f, 10.0f), Random(0.1f, 2.0f), Random(40.0f, 80.0f), zeroToOneDepth);
+	Matrix4::Multiply(viewProjection, projection, view);
+	Frustum::FromMatrix(frustum, viewProjection, zeroToOneDepth);
+	CHECK(Contains(frustum, target) == Containment::Inside);
+}
+
+struct Volumes
+{
+	std::vector<Vec3> Centers, Extents;
+	std::vector<float> Radii;
+	std::vector<Quat> Orientations;
+};
+
+// centers around the frustum and on its planes, so that many volumes straddle a plane or end
+// just at one
+static void RandomVolumes(Volumes & volumes, const Frustum & frustum, const Vec3 & target, int count)
+{
+	volumes = Volumes();
+	for (int i = 0; i < count; i++)
+	{
+		Vec3 c(target.x + Random(-30.0f, 30.0f), target.y + Random(-30.0f, 30.0f), target.z + Random(-30.0f, 30.0f));
+		float r = Random(0.0f, 3.0f);
+		if (i % 3 == 0)
+		{
+			// push the center to about r behind a plane
+			const Vec4 & p = frustum.Planes[rng() % 6];
+			float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w + r;
+			c = Vec3(c.x - p.x * d, c.y - p.y * d, c.z - p.z * d);
+		}
+		// on a grid of 1/1024, so a BBox built from center and extents gives them back exactly
+		volumes.Centers.push_back(Vec3(Round(c.x), Round(c.y), Round(c.z)));
+		volumes.Radii.push_back(r);
+		volumes.Extents.push_back(Vec3(Round(Random(0.0f, 3.0f)), Round(Random(0.0f, 3.0f)), Round(Random(0.0f, 3.0f))));
+		volumes.Orientations.push_back(RandomQuat());
+	}
+}
+
+static void CheckCulling(const Frustum & frustum, const Volumes & volumes)
+{
+	int count = (int)volumes.Centers.size();
+	std::vector<int> spheres, boxes, orientedBoxes;
+	for (int i = 0; i < count; i++)
+	{
+		Sphere sphere;
+		sphere.Center = volumes.Centers[i];
+		sphere.Radius = volumes.Radii[i];
+		if (Contains(frustum, sphere) != Containment::Outside)
+			spheres.push_back(i);
+		const Vec3 & c = volumes.Centers[i], & e = volumes.Extents[i];
+		BBox box;
+		box.xMin = c.x - e.x; box.yMin = c.y - e.y; box.zMin = c.z - e.z;
+		box.xMax = c.x + e.x; box.yMax = c.y + e.y; box.zMax = c.z + e.z;
+		if (Contains(frustum, box) != Containment::Outside)
+			boxes.push_back(i);
+		OrientedBox orientedBox;
+		orientedBox.Center = c;
+		orientedBox.Extents = e;
+		orientedBox.Orientation = volumes.Orientations[i];
+		if (Contains(frustum, orientedBox) != Containment::Outside)
+			orientedBoxes.push_back(i);
+	}
+
+	std::vector<int> visible(count + 1, -1);
+	int n = CullSpheres(frustum, volumes.Centers.data(), volumes.Radii.data(), count, visible.data());
+	CHECK(std::vector<int>(visible.begin(), visible.begin() + n) == spheres && visible[n] == -1);
+	std::fill(visible.begin(), visible.end(), -1);
+	n = CullBoxes(frustum, volumes.Centers.data(), volumes.Extents.data(), nullptr, count, visible.data());
+	CHECK(std::vector<int>(visible.begin(), visible.begin() + n) == boxes && visible[n] == -1);
+	std::fill(visible.begin(), visible.end(), -1);
+	n = CullBoxes(frustum, volumes.Centers.data(), volumes.Extents.data(), volumes.Orientations.data(), count, visible.data());
+	CHECK(std::vector<int>(visible.begin(), visible.begin() + n) == orientedBoxes && visible[n] == -1);
+}
+
+static void TestRandom()
+{
+	for (int pass = 0; pass < 200; pass++)
+	{
+		Frustum frustum;
+		Vec3 target(Random(-100.0f, 100.0f), Random(-100.0f, 100.0f), Random(-100.0f, 100.0f));
+		RandomFrustum(frustum, target, pass % 2 == 0);
+		Volumes volumes;
+		// every tail length, then longer runs
+		RandomVolumes(volumes, frustum, target, pass < 68 ? pass : 1000);
+		CheckCulling(frustum, volumes);
+	}
+}
+
+// the cube [-1, 1]^3, with volumes that end exactly on one of its planes or just short of it
+static void TestTangent()
+{
+	Frustum frustum;
+	for (int i = 0; i < 6; i++)
+	{
+		frustum.Planes[i] = Vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		(&frustum.Planes[i].x)[i / 2] = i % 2 == 0 ? 1.0f : -1.0f;
+	}
+	const Quat halfTurn(0.0f, 0.0f, 1.0f, 0.0f);
+	Volumes volumes;
+	for (int i = 0; i < 6; i++)
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			// center at 1.5 outside plane i, and a size of 0.5 or a little less
+			Vec3 c(0.0f, 0.0f, 0.0f);
+			(&c.x)[i / 2] = i % 2 == 0 ? -1.5f : 1.5f;
+			float r = k == 0 ? 0.5f : 0.4999f;
+			volumes.Centers.push_back(c);
+			volumes.Radii.push_back(r);
+			volumes.Extents.push_back(Vec3(r, r, r));
+			volumes.Orientations.push_back(k == 0 ? Quat(0.0f, 0.0f, 0.0f, 1.0f) : halfTurn);
+		}
+	}
+	CheckCulling(frustum, volumes);
+	std::vector<int> visible(volumes.Centers.size());
+	int n = CullSpheres(frustum, volumes.Centers.data(), volumes.Radii.data(), (int)volumes.Centers.size(), visible.data());
+	CHECK(n == 6);
+	for (int i = 0; i < n; i++)
+		CHECK(visible[i] == i * 2);
+	n = CullBoxes(frustum, volumes.Centers.data(), volumes.Extents.data(), volumes.Orientations.data(), (int)volumes.Centers.size(), visible.data());
+	CHECK(n == 6);
+}
+
+int main()
+{
+	printf("kernels: %s\n", GetCpuTierName(GetSimdKernels().Tier));
+	TestRandom();
+	TestTangent();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
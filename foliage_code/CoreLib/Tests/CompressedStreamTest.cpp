@@ -0,0 +1,345 @@
+// Round trips through LzCodec and CompressedStream over data that compresses well, poorly and
+// not at all, read back whole, in pieces and after seeks, from memory and from a stream that
+// has to be copied. Truncated or damaged input has to be rejected with IOException, never read
+// out of bounds.
+
+#include "../CompressedStream.h"
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+using namespace CoreLib;
+using namespace CoreLib::Basic;
+using namespace CoreLib::IO;
+using namespace CoreLib::Threading;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+static std::mt19937 rng(11);
+
+// keeps its contents after Close, so the compressed bytes can be read back
+class CaptureStream : public MemoryStream
+{
+public:
+	virtual void Close()
+	{
+	}
+};
+
+// a stream that is not memory backed, so CompressedStream copies the blocks out of it
+class CopyingStream : public Stream
+{
+private:
+	MemoryStream inner;
+public:
+	CopyingStream(const void * data, Int64 size)
+		: inner(data, size)
+	{}
+	virtual Int64 GetPosition()
+	{
+		return inner.GetPosition();
+	}
+	virtual void Seek(SeekOrigin origin, Int64 offset)
+	{
+		inner.Seek(origin, offset);
+	}
+	virtual int Read(void * buffer, int length)
+	{
+		return inner.Read(buffer, length);
+	}
+	virtual int Write(const void *, int)
+	{
+		throw NotSupportedException();
+	}
+	virtual bool CanRead()
+	{
+		return true;
+	}
+	virtual bool CanWrite()
+	{
+		return false;
+	}
+	virtual void Close()
+	{
+	}
+};
+
+enum class DataKind
+{
+	Zeros, Text, Records, Random
+};
+
+static std::vector<unsigned char> MakeData(DataKind kind, int length)
+{
+	std::vector<unsigned char> data(length);
+	const char * words[] = { "leaf ", "trunk ", "branch ", "*INSTANCES ", "0.25 ", "-1.5 ", "\n" };
+	int i = 0;
+	while (i < length)
+	{
+		switch (kind)
+		{
+		case DataKind::Zeros:
+			data[i++] = 0;
+			break;
+		case DataKind::Text:
+		{
+			const char * word = words[rng() % 7];
+			for (int k = 0; word[k] && i < length; k++)
+				data[i++] = (unsigned char)word[k];
+			break;
+		}
+		case DataKind::Records:
+		{
+			// instance records: a few varying floats between runs of repeated bytes, and
+			// short-distance repeats that overlap the bytes they copy
+			float f = (float)(rng() % 1000) * 0.01f;
+			for (int k = 0; k < 4 && i < length; k++)
+				data[i++] = ((unsigned char *)&f)[k];
+			int run = rng() % 12;
+			unsigned char b = (unsigned char)(rng() % 3);
+			for (int k = 0; k < run && i < length; k++)
+				data[i++] = b;
+			break;
+		}
+		case DataKind::Random:
+			data[i++] = (unsigned char)rng();
+			break;
+		}
+	}
+	return data;
+}
+
+// compressed size each kind of data has to stay under, as a fraction of its length
+static double MaxRatio(DataKind kind)
+{
+	switch (kind)
+	{
+	case DataKind::Zeros:
+		return 0.05;
+	case DataKind::Text:
+		return 0.5;
+	case DataKind::Records:
+		return 0.75;
+	default:
+		return 1.01;
+	}
+}
+
+static void TestCodec()
+{
+	const int lengths[] = { 1, 4, 12, 13, 17, 100, 255, 270, 4096, 70000, 300000 };
+	for (int kind = 0; kind < 4; kind++)
+	{
+		for (int length : lengths)
+		{
+			std::vector<unsigned char> data = MakeData((DataKind)kind, length);
+			std::vector<unsigned char> packed(length + length / 255 + 16), unpacked(length);
+			int size = LzCodec::Compress(packed.data(), (int)packed.size(), data.data(), length);
+			CHECK(size > 0);
+			if (length >= 4096)
+				CHECK(size < length * MaxRatio((DataKind)kind));
+			LzCodec::Decompress(unpacked.data(), length, packed.data(), size);
+			CHECK(unpacked == data);
+
+			// data that does not shrink is refused when the capacity is one byte short
+			if ((DataKind)kind == DataKind::Random && length >= 100)
+				CHECK(LzCodec::Compress(packed.data(), length - 1, data.data(), length) == 0);
+
+			// a truncated block or a wrong length must throw
+			bool thrown = false;
+			try
+			{
+				LzCodec::Decompress(unpacked.data(), length, packed.data(), size - 1);
+			}
+			catch (const IOException &)
+			{
+				thrown = true;
+			}
+			CHECK(thrown || size == 1);
+			thrown = false;
+			try
+			{
+				LzCodec::Decompress(unpacked.data(), length - 1, packed.data(), size);
+			}
+			catch (const IOException &)
+			{
+				thrown = true;
+			}
+			CHECK(thrown);
+		}
+	}
+
+	// damaged blocks either throw or decode to something, but never write past the output
+	std::vector<unsigned char> data = MakeData(DataKind::Records, 20000);
+	std::vector<unsigned char> packed(data.size() + 256);
+	int size = LzCodec::Compress(packed.data(), (int)packed.size(), data.data(), (int)data.size());
+	for (int i = 0; i < 2000; i++)
+	{
+		std::vector<unsigned char> damaged(packed.begin(), packed.begin() + size);
+		for (int k = 1 + rng() % 4; k > 0; k--)
+			damaged[rng() % size] = (unsigned char)rng();
+		std::vector<unsigned char> out(data.size());
+		try
+		{
+			LzCodec::Decompress(out.data(), (int)out.size(), damaged.data(), size);
+		}
+		catch (const IOException &)
+		{
+		}
+	}
+}
+
+static std::vector<unsigned char> CompressAll(const std::vector<unsigned char> & data, int blockSize)
+{
+	RefPtr<CaptureStream> capture = new CaptureStream();
+	{
+		CompressedStream writer(capture, CompressionMode::Compress, blockSize);
+		// odd sized writes that straddle the blocks
+		size_t pos = 0;
+		while (pos < data.size())
+		{
+			int len = (int)std::min(data.size() - pos, (size_t)(1 + rng() % (blockSize * 2)));
+			writer.Write(data.data() + pos, len);
+			pos += len;
+		}
+		CHECK(writer.GetLength() == (Int64)data.size());
+		writer.Close();
+	}
+	return std::vector<unsigned char>(capture->GetData(), capture->GetData() + capture->GetLength());
+}
+
+static void CheckRead(RefPtr<Stream> source, const std::vector<unsigned char> & data, ThreadPool & pool)
+{
+	CompressedStream reader(source, CompressionMode::Decompress, 0, &pool);
+	CHECK(reader.GetLength() == (Int64)data.size());
+	if (data.empty())
+		return;
+
+	// all at once, which decodes the blocks in parallel
+	std::vector<unsigned char> out(data.size());
+	CHECK(reader.Read(out.data(), (int)out.size()) == (int)out.size());
+	CHECK(out == data);
+
+	// random seeks and short reads, across block boundaries
+	for (int i = 0; i < 200; i++)
+	{
+		Int64 pos = rng() % data.size();
+		int len = (int)std::min((size_t)(1 + rng() % 10000), data.size() - (size_t)pos);
+		reader.Seek(SeekOrigin::Start, pos);
+		std::vector<unsigned char> piece(len);
+		CHECK(reader.Read(piece.data(), len) == len);
+		CHECK(memcmp(piece.data(), data.data() + pos, len) == 0);
+		CHECK(reader.GetPosition() == pos + len);
+	}
+	reader.Seek(SeekOrigin::End, 0);
+	bool thrown = false;
+	try
+	{
+		unsigned char b;
+		reader.Read(&b, 1);
+	}
+	catch (const EndOfStreamException &)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+static void TestStream()
+{
+	ThreadPool pool(4);
+	const int blockSizes[] = { 1000, 4096, CompressedStream::DefaultBlockSize };
+	for (int kind = 0; kind < 4; kind++)
+	{
+		for (int blockSize : blockSizes)
+		{
+			for (int length : { 0, 1, 4096, 100000, 600000 })
+			{
+				std::vector<unsigned char> data = MakeData((DataKind)kind, length);
+				std::vector<unsigned char> packed = CompressAll(data, blockSize);
+				if (length >= 100000)
+					CHECK(packed.size() < data.size() * MaxRatio((DataKind)kind));
+				// random data is stored as is, with only the index and footer added
+				if ((DataKind)kind == DataKind::Random)
+					CHECK(packed.size() <= data.size() + (data.size() / blockSize + 1) * 4 + 20);
+				CheckRead(new MemoryStream(packed.data(), packed.size()), data, pool);
+				CheckRead(new CopyingStream(packed.data(), packed.size()), data, pool);
+			}
+		}
+	}
+}
+
+// opens packed and reads it through, reporting whether IOException came out
+static bool Rejects(const std::vector<unsigned char> & packed, size_t length, ThreadPool & pool)
+{
+	try
+	{
+		CompressedStream reader(new MemoryStream(packed.data(), packed.size()), CompressionMode::Decompress, 0, &pool);
+		std::vector<unsigned char> out(length);
+		if (length)
+			reader.Read(out.data(), (int)length);
+	}
+	catch (const IOException &)
+	{
+		return true;
+	}
+	return false;
+}
+
+static void TestCorrupt()
+{
+	ThreadPool pool(4);
+	std::vector<unsigned char> data = MakeData(DataKind::Text, 50000);
+	std::vector<unsigned char> packed = CompressAll(data, 4096);
+	CHECK(!Rejects(packed, data.size(), pool));
+
+	// truncated anywhere, the footer or the index no longer add up
+	for (size_t cut : { (size_t)1, (size_t)4, (size_t)20, packed.size() / 2, packed.size() - 1 })
+		CHECK(Rejects(std::vector<unsigned char>(packed.begin(), packed.end() - cut), data.size(), pool));
+	CHECK(Rejects(std::vector<unsigned char>(), 0, pool));
+
+	// a wrong magic, length or block size in the footer
+	for (int field : { 0, 8, 12, 16 })
+	{
+		std::vector<unsigned char> damaged = packed;
+		damaged[damaged.size() - 20 + field] ^= 0x40;
+		CHECK(Rejects(damaged, data.size(), pool));
+	}
+
+	// a block size in the index larger than the block
+	std::vector<unsigned char> damaged = packed;
+	damaged[damaged.size() - 20 - 4 * 13 + 1] = 0xFF;
+	CHECK(Rejects(damaged, data.size(), pool));
+
+	// a block overwritten with bytes that cannot be a valid sequence
+	damaged = packed;
+	for (int i = 0; i < 64; i++)
+		damaged[i] = 0xFF;
+	CHECK(Rejects(damaged, data.size(), pool));
+
+	// random damage to the blocks throws or decodes, never reads out of bounds
+	for (int i = 0; i < 500; i++)
+	{
+		damaged = packed;
+		for (int k = 1 + rng() % 4; k > 0; k--)
+			damaged[rng() % (packed.size() - 20 - 4 * 13)] = (unsigned char)rng();
+		Rejects(damaged, data.size(), pool);
+	}
+}
+
+int main()
+{
+	TestCodec();
+	TestStream();
+	TestCorrupt();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,432 @@
+// Stress tests for the lock-free queues, EventCount and ThreadPool. Build with -DCORELIB_TSAN=ON
+// to run them under ThreadSanitizer; without it they still check that no item is lost,
+// duplicated or reordered and that no waiter misses a wakeup.
+
+#include "../ConcurrentQueue.h"
+#include "../ThreadPool.h"
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace CoreLib::Threading;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+#ifdef CORE_LIB_TSAN
+static const int ItemsPerProducer = 20000;
+#else
+static const int ItemsPerProducer = 200000;
+#endif
+
+// counts live instances, so leaked or double-destroyed items show up
+struct Tracked
+{
+	static std::atomic<int> Live;
+	int Value;
+	Tracked()
+		: Value(-1)
+	{
+		Live++;
+	}
+	Tracked(int value)
+		: Value(value)
+	{
+		Live++;
+	}
+	Tracked(const Tracked & other)
+		: Value(other.Value)
+	{
+		Live++;
+	}
+	Tracked & operator = (const Tracked & other)
+	{
+		Value = other.Value;
+		return *this;
+	}
+	~Tracked()
+	{
+		Live--;
+	}
+};
+std::atomic<int> Tracked::Live(0);
+
+// every producer pushes an increasing sequence; each consumer must see every producer's items in
+// order, and all consumers together must see every item exactly once
+static void TestMpmc(int producers, int consumers, int capacity)
+{
+	{
+		MpmcQueue<Tracked> queue(capacity);
+		std::vector<std::atomic<unsigned char>> seen(producers * ItemsPerProducer);
+		for (auto & s : seen)
+			s.store(0);
+		std::atomic<int> consumed(0);
+		std::atomic<bool> orderBroken(false);
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; p++)
+		{
+			threads.push_back(std::thread([&, p]()
+			{
+				for (int i = 0; i < ItemsPerProducer; i++)
+				{
+					Tracked item(p * ItemsPerProducer + i);
+					while (!queue.TryEnqueue(item))
+						std::this_thread::yield();
+				}
+			}));
+		}
+		for (int c = 0; c < consumers; c++)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				std::vector<int> last(producers, -1);
+				Tracked item;
+				while (consumed.load() < producers * ItemsPerProducer)
+				{
+					if (!queue.TryDequeue(item))
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					int p = item.Value / ItemsPerProducer;
+					if (item.Value <= last[p])
+						orderBroken = true;
+					last[p] = item.Value;
+					seen[item.Value]++;
+					consumed++;
+				}
+			}));
+		}
+		for (auto & t : threads)
+			t.join();
+		CHECK(!orderBroken);
+		CHECK(queue.IsEmpty());
+		int missing = 0;
+		for (auto & s : seen)
+			if (s.load() != 1)
+				missing++;
+		CHECK(missing == 0);
+
+		// items left in the ring are destroyed with it
+		for (int i = 0; i < capacity / 2; i++)
+			queue.TryEnqueue(Tracked(i));
+	}
+	CHECK(Tracked::Live == 0);
+}
+
+static void TestSpsc(int capacity)
+{
+	{
+		SpscQueue<Tracked> queue(capacity);
+		bool ordered = true;
+		std::thread producer([&]()
+		{
+			for (int i = 0; i < ItemsPerProducer; i++)
+			{
+				while (!queue.TryEnqueue(Tracked(i)))
+					std::this_thread::yield();
+			}
+		});
+		Tracked item;
+		for (int i = 0; i < ItemsPerProducer; i++)
+		{
+			while (!queue.TryDequeue(item))
+				std::this_thread::yield();
+			if (item.Value != i)
+				ordered = false;
+		}
+		producer.join();
+		CHECK(ordered);
+		CHECK(queue.IsEmpty());
+		queue.TryEnqueue(Tracked(0));
+	}
+	CHECK(Tracked::Live == 0);
+}
+
+// has no default constructor, which the queues must not need to destroy what is left in them
+struct NoDefault
+{
+	Tracked Item;
+	NoDefault(int value)
+		: Item(value)
+	{}
+};
+
+// elements left behind are destroyed in place, also after the positions have wrapped around
+static void TestLeftovers()
+{
+	{
+		MpmcQueue<NoDefault> mpmc(8);
+		SpscQueue<NoDefault> spsc(8);
+		NoDefault item(0);
+		for (int i = 0; i < 13; i++)
+		{
+			mpmc.TryEnqueue(NoDefault(i));
+			spsc.TryEnqueue(NoDefault(i));
+		}
+		for (int i = 0; i < 5; i++)
+		{
+			CHECK(mpmc.TryDequeue(item) && item.Item.Value == i);
+			CHECK(spsc.TryDequeue(item) && item.Item.Value == i);
+		}
+		for (int i = 0; i < 5; i++)
+		{
+			mpmc.TryEnqueue(NoDefault(i));
+			spsc.TryEnqueue(NoDefault(i));
+		}
+		CHECK(Tracked::Live == 17);
+	}
+	CHECK(Tracked::Live == 0);
+}
+
+// a tiny ring keeps both sides blocking on each other; Close must release every consumer once
+// the ring is drained
+static void TestBlocking(WaitMode mode)
+{
+	const int producers = 3, consumers = 3;
+	BlockingQueue<MpmcQueue<int>> queue(2, mode);
+	std::atomic<long long> sum(0);
+	std::atomic<int> count(0);
+	std::vector<std::thread> producerThreads, consumerThreads;
+	for (int p = 0; p < producers; p++)
+	{
+		producerThreads.push_back(std::thread([&]()
+		{
+			for (int i = 1; i <= ItemsPerProducer / 10; i++)
+				queue.Enqueue(i);
+		}));
+	}
+	for (int c = 0; c < consumers; c++)
+	{
+		consumerThreads.push_back(std::thread([&]()
+		{
+			int item;
+			while (queue.Dequeue(item))
+			{
+				sum += item;
+				count++;
+			}
+		}));
+	}
+	for (auto & t : producerThreads)
+		t.join();
+	queue.Close();
+	for (auto & t : consumerThreads)
+		t.join();
+	long long n = ItemsPerProducer / 10;
+	CHECK(count == producers * n);
+	CHECK(sum == producers * n * (n + 1) / 2);
+	CHECK(!queue.Enqueue(1));
+}
+
+// two threads hand a token back and forth, each sleeping until it is its turn; a lost wakeup
+// hangs the test
+static void TestEventCount(WaitMode mode)
+{
+	EventCount evt(mode);
+	std::atomic<int> turn(0);
+	const int rounds = ItemsPerProducer / 10;
+	auto player = [&](int self)
+	{
+		for (int i = 0; i < rounds; i++)
+		{
+			while (turn.load(std::memory_order_acquire) % 2 != self)
+			{
+				int key = evt.PrepareWait();
+				if (turn.load(std::memory_order_acquire) % 2 == self)
+				{
+					evt.CancelWait();
+					break;
+				}
+				evt.Wait(key);
+			}
+			turn.fetch_add(1, std::memory_order_release);
+			evt.Notify();
+		}
+	};
+	std::thread a(player, 0), b(player, 1);
+	a.join();
+	b.join();
+	CHECK(turn == rounds * 2);
+}
+
+// a task's exception comes back out of WaitAll once, and a task waiting on its own pool is refused
+static void TestThreadPool()
+{
+	ThreadPool pool(4);
+	std::atomic<int> ran(0);
+	for (int i = 0; i < 1000; i++)
+	{
+		pool.Submit([&, i]()
+		{
+			ran++;
+			if (i == 500)
+				throw std::runtime_error("task failed");
+		});
+	}
+	bool thrown = false;
+	try
+	{
+		pool.WaitAll();
+	}
+	catch (const std::runtime_error &)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(ran == 1000);
+	pool.WaitAll();
+
+	std::atomic<bool> refused(false);
+	pool.Submit([&]()
+	{
+		try
+		{
+			pool.WaitAll();
+		}
+		catch (const CoreLib::Basic::InvalidOperationException &)
+		{
+			refused = true;
+		}
+	});
+	pool.WaitAll();
+	CHECK(refused);
+}
+
+// a group waits only for its own tasks and keeps their exceptions to itself, and groups waited
+// on from tasks of a one-thread pool must not deadlock
+static void TestTaskGroup()
+{
+	ThreadPool pool(2);
+	std::atomic<bool> started(false), release(false);
+	pool.Submit([&]()
+	{
+		started = true;
+		while (!release)
+			std::this_thread::yield();
+	});
+	while (!started)
+		std::this_thread::yield();
+
+	std::atomic<int> ran(0);
+	TaskGroup group(pool), other(pool);
+	for (int i = 0; i < 100; i++)
+	{
+		group.Submit([&, i]()
+		{
+			ran++;
+			if (i == 50)
+				throw std::runtime_error("task failed");
+		});
+		other.Submit([&]() { ran++; });
+	}
+	bool thrown = false;
+	try
+	{
+		group.Wait();
+	}
+	catch (const std::runtime_error &)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+	thrown = false;
+	try
+	{
+		other.Wait();
+	}
+	catch (...)
+	{
+		thrown = true;
+	}
+	CHECK(!thrown);
+	CHECK(ran == 200);
+	// the task outside the groups is still running
+	CHECK(!release);
+	release = true;
+	try
+	{
+		pool.WaitAll();
+	}
+	catch (...)
+	{
+		thrown = true;
+	}
+	CHECK(!thrown);
+
+	ThreadPool single(1);
+	std::atomic<int> sum(0);
+	TaskGroup outer(single);
+	for (int i = 0; i < 8; i++)
+	{
+		outer.Submit([&, i]()
+		{
+			TaskGroup inner(single);
+			for (int j = 0; j < 10; j++)
+				inner.Submit([&, i, j]() { sum += i * 10 + j; });
+			inner.Wait();
+		});
+	}
+	outer.Wait();
+	CHECK(sum == 80 * 79 / 2);
+}
+
+// nested loops on a small pool would deadlock if a caller waited for queued helper tasks
+static void TestParallelFor()
+{
+	ThreadPool pool(2);
+	std::atomic<int> sum(0);
+	pool.ParallelFor(16, [&](int i)
+	{
+		pool.ParallelFor(100, [&](int j)
+		{
+			sum += i * 100 + j;
+		});
+	});
+	CHECK(sum == 1600 * 1599 / 2);
+
+	std::atomic<int> ran(0);
+	bool thrown = false;
+	try
+	{
+		pool.ParallelFor(64, [&](int i)
+		{
+			ran++;
+			if (i == 7)
+				throw std::runtime_error("body failed");
+		});
+	}
+	catch (const std::runtime_error &)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(ran == 64);
+	pool.WaitAll();
+}
+
+int main()
+{
+	TestMpmc(1, 1, 64);
+	TestMpmc(4, 4, 64);
+	TestMpmc(4, 1, 2);
+	TestMpmc(1, 4, 1024);
+	TestSpsc(2);
+	TestSpsc(256);
+	TestLeftovers();
+	TestBlocking(WaitMode::Futex);
+	TestBlocking(WaitMode::Spin);
+	TestEventCount(WaitMode::Futex);
+	TestEventCount(WaitMode::Spin);
+	TestThreadPool();
+	TestTaskGroup();
+	TestParallelFor();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,232 @@
+// Accuracy of the FastMath approximations against double precision libm, over the domains and
+// error bounds documented in FastMath.h, and the edge cases its callers rely on: Pow(0, y) in
+// gamma curves, Sqrt(0) of zero distances, denormal inputs, clamping outside the domain and large
+// angles. Every width must also give bit for bit the result of the float overload.
+
+#include "../FastMath.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+using namespace VectorMath;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+static const int SampleCount = 1 << 16;
+static std::mt19937 rng(7);
+
+static std::vector<float> Uniform(float a, float b)
+{
+	std::uniform_real_distribution<float> dist(a, b);
+	std::vector<float> rs(SampleCount);
+	for (auto & x : rs)
+		x = dist(rng);
+	return rs;
+}
+
+// spread evenly over the exponents of [a, b], a > 0
+static std::vector<float> LogUniform(float a, float b)
+{
+	std::uniform_real_distribution<double> dist(log((double)a), log((double)b));
+	std::vector<float> rs(SampleCount);
+	for (auto & x : rs)
+		x = (float)fmin(fmax(exp(dist(rng)), (double)a), (double)b);
+	return rs;
+}
+
+static std::vector<float> Constant(float c)
+{
+	return std::vector<float>(SampleCount, c);
+}
+
+struct Exp2Func
+{
+	template<typename F> F operator()(const F & x, const F &) const { return FastMath::Exp2(x); }
+};
+struct Log2Func
+{
+	template<typename F> F operator()(const F & x, const F &) const { return FastMath::Log2(x); }
+};
+struct PowFunc
+{
+	template<typename F> F operator()(const F & x, const F & y) const { return FastMath::Pow(x, y); }
+};
+struct RsqrtFunc
+{
+	template<typename F> F operator()(const F & x, const F &) const { return FastMath::Rsqrt(x); }
+};
+struct SqrtFunc
+{
+	template<typename F> F operator()(const F & x, const F &) const { return FastMath::Sqrt(x); }
+};
+struct SinFunc
+{
+	template<typename F> F operator()(const F & x, const F &) const { return FastMath::Sin(x); }
+};
+struct CosFunc
+{
+	template<typename F> F operator()(const F & x, const F &) const { return FastMath::Cos(x); }
+};
+struct Atan2Func
+{
+	template<typename F> F operator()(const F & y, const F & x) const { return FastMath::Atan2(y, x); }
+};
+
+// allowed error of a result, given the inputs and the libm value
+typedef double (*Bound)(double x, double y, double exact);
+
+// Largest error over the samples, as a multiple of its bound, so the check passes below 1.
+// Lanes that differ from the float overload count as failures.
+template<typename F, typename Func>
+static double WorstError(const std::vector<float> & xs, const std::vector<float> & ys, Func f,
+	double (*exact)(double, double), Bound bound, int & mismatches)
+{
+	double worst = 0.0;
+	float lanes[64];
+	for (int i = 0; i + F::Width <= (int)xs.size(); i += F::Width)
+	{
+		f(F::Load(&xs[i]), F::Load(&ys[i])).Store(lanes);
+		for (int l = 0; l < F::Width; l++)
+		{
+			float scalar = f(FloatScalar<1>(xs[i + l]), FloatScalar<1>(ys[i + l])).v[0];
+			if (memcmp(&scalar, &lanes[l], sizeof(float)) != 0)
+				mismatches++;
+			double e = exact(xs[i + l], ys[i + l]);
+			worst = fmax(worst, fabs(lanes[l] - e) / bound(xs[i + l], ys[i + l], e));
+		}
+	}
+	return worst;
+}
+
+template<typename Func>
+static void CheckAccuracy(const char * name, const std::vector<float> & xs, const std::vector<float> & ys, Func f,
+	double (*exact)(double, double), Bound bound)
+{
+	int mismatches = 0;
+	double worst = WorstError<FloatX4>(xs, ys, f, exact, bound, mismatches);
+	worst = fmax(worst, WorstError<FloatX8>(xs, ys, f, exact, bound, mismatches));
+	worst = fmax(worst, WorstError<FloatX16>(xs, ys, f, exact, bound, mismatches));
+	printf("%-28s %.3f of bound\n", name, worst);
+	if (worst > 1.0)
+	{
+		printf("check failed: %s exceeds its error bound\n", name);
+		failures++;
+	}
+	if (mismatches)
+	{
+		printf("check failed: %s differs from the float overload in %d lanes\n", name, mismatches);
+		failures++;
+	}
+}
+
+static double ExactExp2(double x, double) { return exp2(x); }
+static double ExactLog2(double x, double) { return log2(x); }
+static double ExactPow(double x, double y) { return pow(x, y); }
+static double ExactRsqrt(double x, double) { return 1.0 / sqrt(x); }
+static double ExactSqrt(double x, double) { return sqrt(x); }
+static double ExactSin(double x, double) { return sin(x); }
+static double ExactCos(double x, double) { return cos(x); }
+static double ExactAtan2(double y, double x) { return atan2(y, x); }
+
+// the bounds of the table in FastMath.h
+static double Relative1_2e7(double, double, double e) { return 1.2e-7 * fabs(e); }
+static double Relative1_4e7(double, double, double e) { return 1.4e-7 * fabs(e); }
+static double Absolute1_4e7(double, double, double) { return 1.4e-7; }
+static double PowBound(double x, double y, double e) { return (1.2e-7 + 1e-7 * (fabs(y) + fabs(y * log2(x)))) * fabs(e); }
+static double Relative5e6(double, double, double e) { return 5e-6 * fabs(e); }
+static double Absolute1e7(double, double, double) { return 1e-7; }
+static double Absolute1e6(double, double, double) { return 1e-6; }
+static double Absolute3e7(double, double, double) { return 3e-7; }
+
+static void TestAccuracy()
+{
+	std::vector<float> none = Constant(0.0f);
+	CheckAccuracy("Exp2 [-126, 127]", Uniform(-126.0f, 127.0f), none, Exp2Func(), ExactExp2, Relative1_2e7);
+	CheckAccuracy("Log2 [1/2, 2]", LogUniform(0.5f, 2.0f), none, Log2Func(), ExactLog2, Absolute1_4e7);
+	CheckAccuracy("Log2 [2, FLT_MAX]", LogUniform(2.0f, FLT_MAX), none, Log2Func(), ExactLog2, Relative1_4e7);
+	CheckAccuracy("Log2 [FLT_MIN, 1/2]", LogUniform(FLT_MIN, 0.5f), none, Log2Func(), ExactLog2, Relative1_4e7);
+	CheckAccuracy("Log2 denormal", LogUniform(1.4e-45f, FLT_MIN), none, Log2Func(), ExactLog2, Relative1_4e7);
+	CheckAccuracy("Pow [1e-3, 1e3]^[-8, 8]", LogUniform(1e-3f, 1e3f), Uniform(-8.0f, 8.0f), PowFunc(), ExactPow, PowBound);
+	CheckAccuracy("Pow [1/2, 2]^[-60, 60]", LogUniform(0.5f, 2.0f), Uniform(-60.0f, 60.0f), PowFunc(), ExactPow, PowBound);
+	// gamma curves of TextureData and the LOD blend of the scene
+	CheckAccuracy("Pow (0, 1]^2.2", Uniform(FLT_MIN, 1.0f), Constant(2.2f), PowFunc(), ExactPow, PowBound);
+	CheckAccuracy("Pow (0, 1]^(1/2.2)", Uniform(FLT_MIN, 1.0f), Constant(1.0f / 2.2f), PowFunc(), ExactPow, PowBound);
+	CheckAccuracy("Pow denormal^(1/2.2)", LogUniform(1.4e-45f, FLT_MIN), Constant(1.0f / 2.2f), PowFunc(), ExactPow, PowBound);
+	CheckAccuracy("Rsqrt [FLT_MIN, FLT_MAX]", LogUniform(FLT_MIN, FLT_MAX), none, RsqrtFunc(), ExactRsqrt, Relative5e6);
+	// distances of the scene LOD selection
+	CheckAccuracy("Sqrt [FLT_MIN, FLT_MAX]", LogUniform(FLT_MIN, FLT_MAX), none, SqrtFunc(), ExactSqrt, Relative5e6);
+	// rotation angles of Matrix4::Rotation and Quat
+	CheckAccuracy("Sin [-100, 100]", Uniform(-100.0f, 100.0f), none, SinFunc(), ExactSin, Absolute1e7);
+	CheckAccuracy("Cos [-100, 100]", Uniform(-100.0f, 100.0f), none, CosFunc(), ExactCos, Absolute1e7);
+	CheckAccuracy("Sin [-1e5, 1e5]", Uniform(-1e5f, 1e5f), none, SinFunc(), ExactSin, Absolute1e6);
+	CheckAccuracy("Cos [-1e5, 1e5]", Uniform(-1e5f, 1e5f), none, CosFunc(), ExactCos, Absolute1e6);
+	CheckAccuracy("Atan2 [-100, 100]^2", Uniform(-100.0f, 100.0f), Uniform(-100.0f, 100.0f), Atan2Func(), ExactAtan2, Absolute3e7);
+	CheckAccuracy("Atan2 tiny y", LogUniform(1.4e-45f, 1e-3f), Uniform(-1.0f, 1.0f), Atan2Func(), ExactAtan2, Absolute3e7);
+}
+
+static void TestEdgeCases()
+{
+	// Pow is 0 for x <= 0, whatever y is, where libm has pow(0, 0) = 1
+	CHECK(FastMath::Pow(0.0f, 2.2f) == 0.0f);
+	CHECK(FastMath::Pow(0.0f, 1.0f / 2.2f) == 0.0f);
+	CHECK(FastMath::Pow(0.0f, 0.0f) == 0.0f);
+	CHECK(FastMath::Pow(-0.0f, 2.0f) == 0.0f);
+	CHECK(FastMath::Pow(-1.0f, 2.0f) == 0.0f);
+	CHECK(FastMath::Pow(1.0f, 7.5f) == 1.0f);
+	CHECK(FastMath::Pow(0.3f, 0.0f) == 1.0f);
+	CHECK(FastMath::Pow(1e-40f, 0.0f) == 1.0f);
+
+	// Sqrt is 0 for x <= 0, so a zero distance does not turn into 0 * infinity
+	CHECK(FastMath::Sqrt(0.0f) == 0.0f);
+	CHECK(FastMath::Sqrt(-0.0f) == 0.0f);
+	CHECK(FastMath::Sqrt(-4.0f) == 0.0f);
+
+	// powers of two, denormals included, are exact
+	for (int k = -149; k <= 127; k++)
+	{
+		CHECK(FastMath::Log2(ldexpf(1.0f, k)) == (float)k);
+		if (k >= -126)
+			CHECK(FastMath::Exp2((float)k) == ldexpf(1.0f, k));
+	}
+	CHECK(FastMath::Log2(0.0f) == -150.0f);
+
+	// Exp2 clamps to its domain instead of going denormal or infinite
+	CHECK(FastMath::Exp2(-126.5f) == FLT_MIN);
+	CHECK(FastMath::Exp2(-1000.0f) == FLT_MIN);
+	CHECK(FastMath::Exp2(127.5f) == ldexpf(1.0f, 127));
+	CHECK(FastMath::Exp2(1000.0f) == ldexpf(1.0f, 127));
+
+	// large angles stay on the unit circle
+	const float angles[] = { 1e5f, -1e5f, 65536.0f, 12345.678f };
+	for (float a : angles)
+	{
+		float s, c;
+		FastMath::SinCos(a, s, c);
+		CHECK(fabs(s - sin((double)a)) <= 1e-6 && fabs(c - cos((double)a)) <= 1e-6);
+		CHECK(fabs((double)s * s + (double)c * c - 1.0) <= 1e-6);
+	}
+
+	CHECK(FastMath::Atan2(0.0f, 0.0f) == 0.0f);
+	CHECK(FastMath::Atan2(0.0f, -1.0f) == 3.141592654f);
+	CHECK(FastMath::Atan2(1.0f, 0.0f) == 1.570796327f);
+	CHECK(FastMath::Atan2(-1.0f, 0.0f) == -1.570796327f);
+	CHECK(FastMath::Atan2(1e-40f, 1.0f) == 1e-40f);
+}
+
+int main()
+{
+	TestAccuracy();
+	TestEdgeCases();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,150 @@
+// Token positions from MetaLexer and Parser: every token has to point at its own text in the
+// source, including the last token of the input, tokens after ignored whitespace and comments,
+// and tokens next to illegal characters, which are reported at their own position and belong
+// to no token. The span list, the LexStream and LexTokenReader have to produce the same tokens.
+
+#include "../Parser.h"
+#include <stdio.h>
+
+using namespace CoreLib::Basic;
+using namespace CoreLib::Text;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+struct ExpectedToken
+{
+	int TypeID;
+	int Position;
+	const wchar_t * Text;
+};
+
+static const int TokenType_Word = 0, TokenType_Number = 2, TokenType_Equal = 3;
+
+static const wchar_t * Profile =
+	L"Word = {[a-z]+}\n"
+	L"#WhiteSpace = {\\s+}\n"
+	L"Number = {\\d+}\n"
+	L"Equal = {=}\n";
+
+static void CheckLexer(const wchar_t * source, const ExpectedToken * expected, int count, int errorPosition)
+{
+	StringView str(source);
+
+	MetaLexer lexer(Profile);
+	List<LexTokenSpan> spans;
+	CHECK(lexer.Parse(str, spans) == (errorPosition == -1));
+	CHECK(spans.Count() == count);
+	for (int i = 0; i < count && i < spans.Count(); i++)
+	{
+		CHECK(spans[i].TypeID == expected[i].TypeID);
+		CHECK(spans[i].Position == expected[i].Position);
+		CHECK(str.SubString(spans[i].Position, spans[i].Length) == expected[i].Text);
+	}
+	if (errorPosition == -1)
+	{
+		CHECK(lexer.Errors.Count() == 0);
+	}
+	else
+	{
+		CHECK(lexer.Errors.Count() == 1 && lexer.Errors[0].Position == errorPosition);
+	}
+
+	MetaLexer streamLexer(Profile);
+	LexStream stream;
+	streamLexer.Parse(str, stream);
+	CHECK(stream.Count() == count);
+	int i = 0;
+	for (auto & token : stream)
+	{
+		if (i < count)
+		{
+			CHECK(token.TypeID == expected[i].TypeID);
+			CHECK(token.Position == expected[i].Position);
+			CHECK(token.Str == expected[i].Text);
+		}
+		i++;
+	}
+
+	MetaLexer readerLexer(Profile);
+	LexTokenReader reader(&readerLexer, str);
+	LexTokenSpan span;
+	i = 0;
+	while (reader.Read(span))
+	{
+		if (i < count)
+		{
+			CHECK(span.Position == expected[i].Position);
+			CHECK(reader.GetText(span) == expected[i].Text);
+		}
+		i++;
+	}
+	CHECK(i == count);
+	CHECK(readerLexer.Errors.Count() == lexer.Errors.Count());
+}
+
+static void TestLexer()
+{
+	// the last token runs to the end of the input
+	ExpectedToken assignment[] = { { TokenType_Word, 0, L"ab" }, { TokenType_Equal, 3, L"=" }, { TokenType_Number, 5, L"12" } };
+	CheckLexer(L"ab = 12", assignment, 3, -1);
+
+	// leading, repeated and trailing whitespace is skipped
+	ExpectedToken spaced[] = { { TokenType_Word, 2, L"ab" }, { TokenType_Number, 7, L"34" } };
+	CheckLexer(L"  ab \n\t34  ", spaced, 2, -1);
+
+	// adjacent tokens of different types split where the type changes
+	ExpectedToken adjacent[] = { { TokenType_Word, 0, L"x" }, { TokenType_Equal, 1, L"=" }, { TokenType_Number, 2, L"7" },
+		{ TokenType_Word, 3, L"y" } };
+	CheckLexer(L"x=7y", adjacent, 4, -1);
+
+	// an illegal character is reported where it is, and the tokens around it keep their own text
+	ExpectedToken illegal[] = { { TokenType_Word, 0, L"ab" }, { TokenType_Word, 4, L"cd" }, { TokenType_Number, 7, L"12" } };
+	CheckLexer(L"ab $cd 12", illegal, 3, 3);
+	ExpectedToken illegalFirst[] = { { TokenType_Word, 1, L"ab" } };
+	CheckLexer(L"$ab", illegalFirst, 1, 0);
+	ExpectedToken illegalInside[] = { { TokenType_Word, 0, L"ab" }, { TokenType_Word, 3, L"cd" } };
+	CheckLexer(L"ab$cd", illegalInside, 2, 2);
+	ExpectedToken illegalLast[] = { { TokenType_Number, 0, L"12" } };
+	CheckLexer(L"12$", illegalLast, 1, 2);
+
+	ExpectedToken none[1] = {};
+	CheckLexer(L"", none, 0, -1);
+	CheckLexer(L"   ", none, 0, -1);
+}
+
+static void TestParser()
+{
+	Parser parser(L"mesh /* size */ 12 // count\n  3.5 \"leaf\" x");
+	CHECK(parser.IsLegalText());
+	LexToken token = parser.NextToken();
+	CHECK(token.Position == 0 && token.Str == L"mesh");
+	token = parser.ReadToken();
+	CHECK(token.TypeID == TokenType_Identifier && token.Position == 0);
+	CHECK(parser.NextToken().Position == 16);
+	CHECK(parser.ReadInt() == 12);
+	token = parser.ReadToken();
+	CHECK(token.TypeID == TokenType_Float && token.Position == 30 && token.Str == L"3.5");
+	token = parser.NextToken();
+	CHECK(token.TypeID == TokenType_StringLiteral && token.Position == 34);
+	CHECK(parser.ReadStringLiteral() == L"leaf");
+	// the last token of the text
+	token = parser.ReadToken();
+	CHECK(token.TypeID == TokenType_Identifier && token.Position == 41 && token.Str == L"x");
+	CHECK(parser.IsEnd());
+	CHECK(parser.NextToken().Position == -1);
+}
+
+int main()
+{
+	TestLexer();
+	TestParser();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
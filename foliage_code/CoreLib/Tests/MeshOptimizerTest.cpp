@@ -0,0 +1,165 @@
+// The mesh optimizer on a grid whose triangles come in random order: the vertex cache order
+// has to bring the ACMR down close to the 0.5 a grid allows, the overdraw order may give back
+// only its threshold of that, and no pass may drop, add or turn over a triangle. The vertex
+// fetch order has to leave every triangle on the same positions.
+
+#include "../Graphics/MeshOptimizer.h"
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace CoreLib::Graphics;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+static std::mt19937 rng(5);
+
+struct Vertex
+{
+	float Position[3];
+	float TexCoord[2];
+};
+
+// a height field of size x size quads, a little bumpy so overdraw ordering has normals to sort
+static void MakeGrid(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, int size)
+{
+	for (int y = 0; y <= size; y++)
+	{
+		for (int x = 0; x <= size; x++)
+		{
+			Vertex v;
+			v.Position[0] = (float)x;
+			v.Position[1] = (float)((x * 7 + y * 3) % 5) * 0.1f;
+			v.Position[2] = (float)y;
+			v.TexCoord[0] = (float)x / size;
+			v.TexCoord[1] = (float)y / size;
+			vertices.push_back(v);
+		}
+	}
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			unsigned int a = y * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+			unsigned int quad[6] = { a, c, b, b, c, d };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	// shuffle whole triangles, so the input order has no locality
+	int triangleCount = (int)indices.size() / 3;
+	for (int i = triangleCount - 1; i > 0; i--)
+	{
+		int j = rng() % (i + 1);
+		for (int k = 0; k < 3; k++)
+			std::swap(indices[i * 3 + k], indices[j * 3 + k]);
+	}
+}
+
+typedef std::vector<std::vector<float>> Triangle;
+
+// the triangles by the positions of their corners, each rotated to start at its smallest corner
+// so that the winding is kept but not the starting corner, then sorted
+static std::vector<Triangle> Triangles(const std::vector<Vertex> & vertices, const unsigned int * indices, int indexCount)
+{
+	std::vector<Triangle> rs;
+	for (int i = 0; i < indexCount; i += 3)
+	{
+		Triangle triangle;
+		for (int k = 0; k < 3; k++)
+			triangle.push_back(std::vector<float>(vertices[indices[i + k]].Position, vertices[indices[i + k]].Position + 3));
+		std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+		rs.push_back(triangle);
+	}
+	std::sort(rs.begin(), rs.end());
+	return rs;
+}
+
+static void TestAnalyze()
+{
+	unsigned int triangle[3] = { 0, 1, 2 };
+	VertexCacheStats stats = AnalyzeVertexCache(triangle, 3, 3);
+	CHECK(stats.Acmr == 3.0f);
+	CHECK(stats.Atvr == 1.0f);
+
+	// two triangles sharing an edge load four vertices; repeating the first loads nothing new
+	unsigned int quad[9] = { 0, 1, 2, 2, 1, 3, 0, 1, 2 };
+	stats = AnalyzeVertexCache(quad, 9, 4);
+	CHECK(stats.Acmr == 4.0f / 3.0f);
+	CHECK(stats.Atvr == 1.0f);
+
+	// with a FIFO of three entries the fourth vertex pushes out the first, and reloading it
+	// pushes out the other two in turn
+	stats = AnalyzeVertexCache(quad, 9, 4, 3);
+	CHECK(stats.Acmr == 7.0f / 3.0f);
+	CHECK(stats.Atvr == 7.0f / 4.0f);
+}
+
+static void TestOptimize()
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	MakeGrid(vertices, indices, 64);
+	int indexCount = (int)indices.size(), vertexCount = (int)vertices.size();
+	std::vector<Triangle> input = Triangles(vertices, indices.data(), indexCount);
+
+	VertexCacheStats before = AnalyzeVertexCache(indices.data(), indexCount, vertexCount);
+	CHECK(before.Acmr > 2.9f);
+
+	std::vector<unsigned int> optimized(indexCount);
+	OptimizeVertexCache(optimized.data(), indices.data(), indexCount, vertexCount);
+	VertexCacheStats cached = AnalyzeVertexCache(optimized.data(), indexCount, vertexCount);
+	CHECK(cached.Acmr < 0.72f);
+	CHECK(cached.Atvr < 1.45f);
+	CHECK(Triangles(vertices, optimized.data(), indexCount) == input);
+
+	// in place gives the same order
+	std::vector<unsigned int> inPlace = indices;
+	OptimizeVertexCache(inPlace.data(), inPlace.data(), indexCount, vertexCount);
+	CHECK(inPlace == optimized);
+
+	OptimizeOverdraw(optimized.data(), optimized.data(), indexCount, vertices[0].Position, sizeof(Vertex) / sizeof(float), vertexCount);
+	VertexCacheStats overdraw = AnalyzeVertexCache(optimized.data(), indexCount, vertexCount);
+	CHECK(overdraw.Acmr <= cached.Acmr * 1.05f + 0.01f);
+	CHECK(Triangles(vertices, optimized.data(), indexCount) == input);
+
+	// vertices move to the order of first use and the indices follow them
+	std::vector<Vertex> fetched = vertices;
+	std::vector<unsigned int> fetchIndices = optimized;
+	int fetchedCount = OptimizeVertexFetch(fetched.data(), fetchIndices.data(), indexCount, vertexCount, sizeof(Vertex));
+	CHECK(fetchedCount == vertexCount);
+	CHECK(Triangles(fetched, fetchIndices.data(), indexCount) == input);
+	unsigned int next = 0;
+	bool firstUseOrder = true;
+	for (unsigned int i : fetchIndices)
+	{
+		if (i > next)
+			firstUseOrder = false;
+		if (i == next)
+			next++;
+	}
+	CHECK(firstUseOrder);
+	VertexCacheStats after = AnalyzeVertexCache(fetchIndices.data(), indexCount, fetchedCount);
+	CHECK(after.Acmr == overdraw.Acmr);
+
+	// unused vertices are dropped
+	std::vector<Vertex> sparse = vertices;
+	sparse.push_back(vertices[0]);
+	std::vector<unsigned int> sparseIndices = optimized;
+	CHECK(OptimizeVertexFetch(sparse.data(), sparseIndices.data(), indexCount, vertexCount + 1, sizeof(Vertex)) == vertexCount);
+}
+
+int main()
+{
+	TestAnalyze();
+	TestOptimize();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,293 @@
+// SimplifyMesh on UV spheres, which have a texture seam down one side and a pole at each end
+// where every triangle has its own vertex. The simplified sphere has to keep its shape and
+// place, stay within the error it reports, never stretch a triangle across the seam, and keep
+// going down to a few dozen triangles. An open hemisphere has to keep its rim.
+
+#include "../Graphics/MeshSimplifier.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace CoreLib::Graphics;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+struct Vertex
+{
+	float Position[3], Normal[3], TexCoord[2];
+};
+
+static const int AttributeCount = 5;
+static const float AttributeWeights[AttributeCount] = { 0.1f, 0.1f, 0.1f, 0.1f, 0.1f };
+
+// A unit sphere of rings x segments quads. The last column repeats the first at u = 1, and
+// each pole has a vertex per segment, as UV spheres are usually exported. A hemisphere stops at
+// the equator, which is left open.
+static void MakeSphere(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, int rings, int segments, bool hemisphere)
+{
+	const float pi = 3.14159265f;
+	int lastRing = hemisphere ? rings / 2 : rings;
+	for (int i = 0; i <= lastRing; i++)
+	{
+		for (int j = 0; j <= segments; j++)
+		{
+			float theta = pi * i / rings, phi = 2.0f * pi * (j % segments) / segments;
+			Vertex v;
+			v.Position[0] = sinf(theta) * cosf(phi);
+			v.Position[1] = cosf(theta);
+			v.Position[2] = sinf(theta) * sinf(phi);
+			if (i == 0 || i == rings)
+			{
+				v.Position[0] = v.Position[2] = 0.0f;
+				v.Position[1] = i == 0 ? 1.0f : -1.0f;
+			}
+			if (hemisphere && i == lastRing)
+				v.Position[1] = 0.0f;
+			for (int c = 0; c < 3; c++)
+				v.Normal[c] = v.Position[c];
+			v.TexCoord[0] = (float)j / segments;
+			v.TexCoord[1] = (float)i / rings;
+			vertices.push_back(v);
+		}
+	}
+	for (int i = 0; i < lastRing; i++)
+	{
+		for (int j = 0; j < segments; j++)
+		{
+			unsigned int a = i * (segments + 1) + j, b = a + segments + 1, c = b + 1, d = a + 1;
+			if (i != 0)
+			{
+				indices.push_back(a);
+				indices.push_back(d);
+				indices.push_back(b);
+			}
+			if (i != rings - 1)
+			{
+				indices.push_back(b);
+				indices.push_back(d);
+				indices.push_back(c);
+			}
+		}
+	}
+}
+
+static double Dot(const double a[3], const double b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// distance of p from the triangle abc
+static double TriangleDistance(const float * p, const float * a, const float * b, const float * c)
+{
+	double ab[3], ac[3], ap[3];
+	for (int k = 0; k < 3; k++)
+	{
+		ab[k] = (double)b[k] - a[k];
+		ac[k] = (double)c[k] - a[k];
+		ap[k] = (double)p[k] - a[k];
+	}
+	// minimize |ap - s ab - t ac| over s, t >= 0, s + t <= 1: the interior, then the three edges
+	double d00 = Dot(ab, ab), d01 = Dot(ab, ac), d11 = Dot(ac, ac), d20 = Dot(ap, ab), d21 = Dot(ap, ac);
+	double denom = d00 * d11 - d01 * d01;
+	double best = DBL_MAX;
+	auto at = [&](double s, double t)
+	{
+		double q[3];
+		for (int k = 0; k < 3; k++)
+			q[k] = ap[k] - s * ab[k] - t * ac[k];
+		best = std::min(best, sqrt(Dot(q, q)));
+	};
+	if (denom > 0.0)
+	{
+		double s = (d11 * d20 - d01 * d21) / denom, t = (d00 * d21 - d01 * d20) / denom;
+		if (s >= 0.0 && t >= 0.0 && s + t <= 1.0)
+			at(s, t);
+	}
+	if (d00 > 0.0)
+		at(std::min(std::max(d20 / d00, 0.0), 1.0), 0.0);
+	if (d11 > 0.0)
+		at(0.0, std::min(std::max(d21 / d11, 0.0), 1.0));
+	double bc[3], bp[3];
+	for (int k = 0; k < 3; k++)
+	{
+		bc[k] = ac[k] - ab[k];
+		bp[k] = ap[k] - ab[k];
+	}
+	double d = Dot(bc, bc);
+	double u = d > 0.0 ? std::min(std::max(Dot(bp, bc) / d, 0.0), 1.0) : 0.0;
+	at(1.0 - u, u);
+	return best;
+}
+
+struct Shape
+{
+	// how far the input vertices are from the result, and the result's area and area centroid
+	double Distance, Area, Centroid[3];
+	// the widest spread of u on a result triangle
+	double TexCoordSpread;
+};
+
+static Shape Measure(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices, const unsigned int * result, int count)
+{
+	Shape shape;
+	shape.Distance = shape.Area = shape.TexCoordSpread = 0.0;
+	shape.Centroid[0] = shape.Centroid[1] = shape.Centroid[2] = 0.0;
+	std::vector<bool> used(vertices.size(), false);
+	for (unsigned int i : indices)
+		used[i] = true;
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		if (!used[i])
+			continue;
+		double best = DBL_MAX;
+		for (int t = 0; t < count; t += 3)
+			best = std::min(best, TriangleDistance(vertices[i].Position, vertices[result[t]].Position,
+				vertices[result[t + 1]].Position, vertices[result[t + 2]].Position));
+		shape.Distance = std::max(shape.Distance, best);
+	}
+	for (int t = 0; t < count; t += 3)
+	{
+		const float * a = vertices[result[t]].Position, * b = vertices[result[t + 1]].Position, * c = vertices[result[t + 2]].Position;
+		double e1[3], e2[3], n[3];
+		for (int k = 0; k < 3; k++)
+		{
+			e1[k] = (double)b[k] - a[k];
+			e2[k] = (double)c[k] - a[k];
+		}
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		double area = sqrt(Dot(n, n)) * 0.5;
+		shape.Area += area;
+		for (int k = 0; k < 3; k++)
+			shape.Centroid[k] += area * ((double)a[k] + b[k] + c[k]) / 3.0;
+		float u0 = vertices[result[t]].TexCoord[0], u1 = vertices[result[t + 1]].TexCoord[0], u2 = vertices[result[t + 2]].TexCoord[0];
+		shape.TexCoordSpread = std::max(shape.TexCoordSpread, (double)std::max(u0, std::max(u1, u2)) - std::min(u0, std::min(u1, u2)));
+	}
+	for (int k = 0; k < 3; k++)
+		shape.Centroid[k] /= shape.Area;
+	return shape;
+}
+
+static int Simplify(std::vector<unsigned int> & result, const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+	int targetTriangles, float maxError, float & error)
+{
+	result.resize(indices.size());
+	int count = SimplifyMesh(result.data(), indices.data(), (int)indices.size(), vertices[0].Position, sizeof(Vertex) / sizeof(float),
+		(int)vertices.size(), AttributeCount, AttributeWeights, targetTriangles * 3, maxError, error);
+	result.resize(count);
+	return count;
+}
+
+static void TestSphere()
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	MakeSphere(vertices, indices, 16, 32, false);
+	CHECK(indices.size() == 960 * 3);
+	Shape input = Measure(vertices, indices, indices.data(), (int)indices.size());
+
+	// the largest distance of the input vertices from each level, on a unit sphere
+	const int targets[] = { 480, 240, 120, 60 };
+	const double maxDistances[] = { 0.05, 0.12, 0.2, 0.35 };
+	for (int i = 0; i < 4; i++)
+	{
+		std::vector<unsigned int> result;
+		float error;
+		int count = Simplify(result, vertices, indices, targets[i], FLT_MAX, error);
+		CHECK(count == targets[i] * 3);
+		Shape shape = Measure(vertices, indices, result.data(), count);
+		CHECK(shape.Distance <= maxDistances[i]);
+		CHECK(error >= shape.Distance);
+		CHECK(error <= maxDistances[i] * 10.0);
+		CHECK(shape.Area >= input.Area * 0.85);
+		for (int k = 0; k < 3; k++)
+			CHECK(fabs(shape.Centroid[k]) < 0.03);
+		// a triangle reaching across the seam would stretch the whole texture over it
+		CHECK(shape.TexCoordSpread < 0.5);
+	}
+
+	// the collapses stop at maxError
+	std::vector<unsigned int> result;
+	float error;
+	int count = Simplify(result, vertices, indices, 0, 0.05f, error);
+	CHECK(count < 960 * 3 && count > 0);
+	CHECK(error <= 0.05f);
+	CHECK(Measure(vertices, indices, result.data(), count).Distance <= error);
+
+	// levels simplified each from the one before, as the scene builds them, keep halving
+	std::vector<unsigned int> level = indices;
+	float totalError = 0.0f;
+	while (level.size() / 3 >= 64)
+	{
+		int target = (int)level.size() / 6;
+		count = Simplify(result, vertices, level, target, FLT_MAX, error);
+		CHECK(count == target * 3);
+		if (count != target * 3)
+			break;
+		totalError += error;
+		level = result;
+	}
+	CHECK(level.size() / 3 < 64);
+	Shape shape = Measure(vertices, indices, level.data(), (int)level.size());
+	CHECK(totalError >= shape.Distance);
+	for (int k = 0; k < 3; k++)
+		CHECK(fabs(shape.Centroid[k]) < 0.05);
+}
+
+static void TestHemisphere()
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	MakeSphere(vertices, indices, 16, 32, true);
+	std::vector<unsigned int> result;
+	float error;
+	int count = Simplify(result, vertices, indices, (int)indices.size() / 12, FLT_MAX, error);
+	CHECK(count == (int)indices.size() / 12 * 3);
+	CHECK(Measure(vertices, indices, result.data(), count).Distance <= error);
+
+	// every edge on the rim of the result still runs along the rim
+	std::map<std::pair<int, int>, int> edges;
+	// vertices at the same position, on the seam and the pole, stand for the first of them
+	std::map<std::vector<float>, int> firstAt;
+	std::vector<int> welded(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		std::vector<float> key(vertices[i].Position, vertices[i].Position + 3);
+		welded[i] = firstAt.insert(std::make_pair(key, (int)i)).first->second;
+	}
+	auto position = [&](unsigned int v)
+	{
+		return welded[v];
+	};
+	for (int t = 0; t < count; t += 3)
+		for (int k = 0; k < 3; k++)
+			edges[std::make_pair(position(result[t + k]), position(result[t + (k + 1) % 3]))]++;
+	int rimEdges = 0;
+	for (auto & edge : edges)
+	{
+		if (edges.count(std::make_pair(edge.first.second, edge.first.first)))
+			continue;
+		rimEdges++;
+		CHECK(vertices[edge.first.first].Position[1] == 0.0f && vertices[edge.first.second].Position[1] == 0.0f);
+	}
+	CHECK(rimEdges >= 3);
+}
+
+int main()
+{
+	TestSphere();
+	TestHemisphere();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
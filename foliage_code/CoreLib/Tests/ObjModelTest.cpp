@@ -0,0 +1,363 @@
+// LoadObj against a small fixture whose model is written out by hand: every face vertex form
+// (a, a/b, a//c and a/b/c, where a/b has no normal), materials and smoothing groups switching
+// between faces, quads kept or split, and a last line without a line break that must be read
+// once. A generated file of several chunks has to parse the same as it was written. The cache
+// file written after a load has to give back the same model, and must not be used once the
+// OBJ file or its material library has changed.
+
+#include "../Graphics/ObjModel.h"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+using namespace CoreLib::Basic;
+using namespace CoreLib::IO;
+using namespace CoreLib::Graphics;
+using namespace VectorMath;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+static const char * FixtureObj =
+	"# fixture\n"
+	"mtllib ObjModelTest.mtl\n"
+	"v 0 0 0\n"
+	"v 1 0 0\n"
+	"v 1 1 0\n"
+	"v 0 1 0.5\n"
+	"vt 0 0\n"
+	"vt 1 0\n"
+	"vt 1 1\n"
+	"vn 0 0 1\n"
+	"usemtl red\n"
+	"s 1\n"
+	"f 1/1 2/2 3/3\n"
+	"f 1//1 3//1 4//1\n"
+	"usemtl blue\n"
+	"s off\n"
+	"f 1/1/1 2/2/1 3/3/1 4/1/1\n"
+	"f 4 3 2";
+
+static const char * FixtureMtl =
+	"newmtl red\n"
+	"Kd 1 0 0\n"
+	"newmtl blue\n"
+	"Kd 0 0 1\n"
+	"Ks 0.5 0.5 0.5\n"
+	"Ns 20\n"
+	"map_Kd blue.png\n";
+
+static const char * ObjFileName = "./ObjModelTest.obj";
+static const char * MtlFileName = "./ObjModelTest.mtl";
+
+static void WriteFile(const char * fileName, const char * text)
+{
+	FILE * f = fopen(fileName, "wb");
+	fputs(text, f);
+	fclose(f);
+}
+
+struct ExpectedFace
+{
+	int VertexIds[4], NormalIds[4], TexCoordIds[4];
+	unsigned int SmoothGroup;
+	int MaterialId;
+};
+
+static bool Equal(const Vec3 & a, const Vec3 & b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool Equal(const Vec2 & a, const Vec2 & b)
+{
+	return a.x == b.x && a.y == b.y;
+}
+
+static bool Equal(const ObjFace & a, const ExpectedFace & b)
+{
+	for (int k = 0; k < 4; k++)
+		if (a.VertexIds[k] != b.VertexIds[k] || a.NormalIds[k] != b.NormalIds[k] || a.TexCoordIds[k] != b.TexCoordIds[k])
+			return false;
+	return a.SmoothGroup == b.SmoothGroup && a.MaterialId == b.MaterialId;
+}
+
+static bool Equal(const ObjFace & a, const ObjFace & b)
+{
+	ExpectedFace e;
+	for (int k = 0; k < 4; k++)
+	{
+		e.VertexIds[k] = b.VertexIds[k];
+		e.NormalIds[k] = b.NormalIds[k];
+		e.TexCoordIds[k] = b.TexCoordIds[k];
+	}
+	e.SmoothGroup = b.SmoothGroup;
+	e.MaterialId = b.MaterialId;
+	return Equal(a, e);
+}
+
+static bool Equal(const ObjMaterial & a, const ObjMaterial & b)
+{
+	return Equal(a.Diffuse, b.Diffuse) && Equal(a.Specular, b.Specular) && a.SpecularRate == b.SpecularRate &&
+		a.DiffuseMap == b.DiffuseMap && a.BumpMap == b.BumpMap && a.AlphaMap == b.AlphaMap;
+}
+
+template<typename T>
+static bool EqualArrays(const ArrayView<const T> & a, const ArrayView<const T> & b)
+{
+	if (a.Count() != b.Count())
+		return false;
+	for (int i = 0; i < a.Count(); i++)
+		if (!Equal(a[i], b[i]))
+			return false;
+	return true;
+}
+
+static bool EqualFaceVerts(const ArrayView<const FaceVertex> & a, const ArrayView<const FaceVertex> & b)
+{
+	if (a.Count() != b.Count())
+		return false;
+	for (int i = 0; i < a.Count(); i++)
+		if (a[i].vid != b[i].vid || a[i].tid != b[i].tid || a[i].nid != b[i].nid)
+			return false;
+	return true;
+}
+
+static bool EqualViews(const ObjModelView & a, const ObjModelView & b)
+{
+	if (a.Materials.Count() != b.Materials.Count())
+		return false;
+	for (int i = 0; i < a.Materials.Count(); i++)
+		if (!Equal(*a.Materials[i], *b.Materials[i]))
+			return false;
+	return EqualArrays(a.Vertices, b.Vertices) && EqualArrays(a.Normals, b.Normals) && EqualArrays(a.TexCoords, b.TexCoords) &&
+		EqualArrays(a.Faces, b.Faces) && EqualFaceVerts(a.FaceVerts, b.FaceVerts);
+}
+
+static void CheckFixture(const ObjModelView & mdl, PolygonType polygonType)
+{
+	CHECK(mdl.Vertices.Count() == 4);
+	if (mdl.Vertices.Count() == 4)
+	{
+		CHECK(Equal(mdl.Vertices[1], Vec3(1.0f, 0.0f, 0.0f)));
+		CHECK(Equal(mdl.Vertices[3], Vec3(0.0f, 1.0f, 0.5f)));
+	}
+	CHECK(mdl.TexCoords.Count() == 3 && Equal(mdl.TexCoords[2], Vec2(1.0f, 1.0f)));
+	CHECK(mdl.Normals.Count() == 1 && Equal(mdl.Normals[0], Vec3(0.0f, 0.0f, 1.0f)));
+
+	CHECK(mdl.Materials.Count() == 2);
+	if (mdl.Materials.Count() == 2)
+	{
+		CHECK(Equal(mdl.Materials[0]->Diffuse, Vec3(1.0f, 0.0f, 0.0f)));
+		CHECK(Equal(mdl.Materials[1]->Diffuse, Vec3(0.0f, 0.0f, 1.0f)));
+		CHECK(Equal(mdl.Materials[1]->Specular, Vec3(0.5f, 0.5f, 0.5f)));
+		CHECK(mdl.Materials[1]->SpecularRate == 20.0f);
+		CHECK(mdl.Materials[1]->DiffuseMap == L"blue.png");
+	}
+
+	// a/b has no normal (-1), a//c no texture coordinate; the quad is split into a fan or kept,
+	// and the last line, which has no line break, gives one face
+	ExpectedFace triangles[] =
+	{
+		{ { 0, 1, 2, -1 }, { -1, -1, -1, -1 }, { 0, 1, 2, -1 }, 1, 0 },
+		{ { 0, 2, 3, -1 }, { 0, 0, 0, -1 }, { -1, -1, -1, -1 }, 1, 0 },
+		{ { 0, 1, 2, -1 }, { 0, 0, 0, -1 }, { 0, 1, 2, -1 }, 0, 1 },
+		{ { 0, 2, 3, -1 }, { 0, 0, 0, -1 }, { 0, 2, 0, -1 }, 0, 1 },
+		{ { 3, 2, 1, -1 }, { -1, -1, -1, -1 }, { -1, -1, -1, -1 }, 0, 1 },
+	};
+	ExpectedFace quads[] =
+	{
+		triangles[0],
+		triangles[1],
+		{ { 0, 1, 2, 3 }, { 0, 0, 0, 0 }, { 0, 1, 2, 0 }, 0, 1 },
+		triangles[4],
+	};
+	const ExpectedFace * faces = polygonType == PolygonType::Triangle ? triangles : quads;
+	int faceCount = polygonType == PolygonType::Triangle ? 5 : 4;
+	CHECK(mdl.Faces.Count() == faceCount);
+	int faceVertCount = 0;
+	for (int i = 0; i < faceCount && i < mdl.Faces.Count(); i++)
+	{
+		CHECK(Equal(mdl.Faces[i], faces[i]));
+		faceVertCount += faces[i].VertexIds[3] == -1 ? 3 : 4;
+	}
+	// the face vertices list every corner of every face in order
+	CHECK(mdl.FaceVerts.Count() == faceVertCount);
+	if (mdl.FaceVerts.Count() == faceVertCount)
+	{
+		int v = 0;
+		for (int i = 0; i < faceCount; i++)
+		{
+			for (int k = 0; k < 4 && faces[i].VertexIds[k] != -1; k++, v++)
+			{
+				CHECK(mdl.FaceVerts[v].vid == faces[i].VertexIds[k]);
+				CHECK(mdl.FaceVerts[v].tid == faces[i].TexCoordIds[k]);
+				CHECK(mdl.FaceVerts[v].nid == faces[i].NormalIds[k]);
+			}
+		}
+	}
+}
+
+// loads the OBJ file until the load comes from the cache written in the background after a
+// load without a valid one
+static bool LoadCached(ObjModelView & view)
+{
+	for (int i = 0; i < 1000; i++)
+	{
+		view = ObjModelView();
+		if (LoadObj(view, ObjFileName) && view.CacheFile)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+static void TestFixture()
+{
+	remove("./ObjModelTest.obj.cache");
+	WriteFile(ObjFileName, FixtureObj);
+	WriteFile(MtlFileName, FixtureMtl);
+
+	ObjModelView parsed;
+	CHECK(LoadObj(parsed, ObjFileName));
+	CHECK(parsed.CacheFile == 0);
+	CheckFixture(parsed, PolygonType::Triangle);
+
+	// the ObjModel overload gives the same model, with material ids after those already in it
+	ObjModel mdl;
+	mdl.Materials.Add(MakeRef<ObjMaterial>());
+	CHECK(LoadObj(mdl, ObjFileName));
+	CHECK(mdl.Faces.Count() == 5 && mdl.Faces[0].MaterialId == 1 && mdl.Faces[4].MaterialId == 2);
+	CHECK(mdl.Vertices.Count() == 4 && mdl.FaceVerts.Count() == 15);
+
+	// the cache holds the same model
+	ObjModelView cached;
+	CHECK(LoadCached(cached));
+	CHECK(EqualViews(cached, parsed));
+
+	// a cache of triangles is not used for quads
+	ObjModelView quads;
+	CHECK(LoadObj(quads, ObjFileName, PolygonType::Quad));
+	CHECK(quads.CacheFile == 0);
+	CheckFixture(quads, PolygonType::Quad);
+	remove("./ObjModelTest.obj.cache");
+}
+
+static void TestStaleCache()
+{
+	remove("./ObjModelTest.obj.cache");
+	WriteFile(ObjFileName, FixtureObj);
+	WriteFile(MtlFileName, FixtureMtl);
+	ObjModelView view;
+	CHECK(LoadCached(view));
+	view = ObjModelView();
+
+	// a changed OBJ file is parsed again, and the cache rebuilt from it
+	String changedObj = String(FixtureObj) + L"\nv 2 2 2\n";
+	WriteFile(ObjFileName, changedObj.ToMultiByteString());
+	CHECK(LoadObj(view, ObjFileName));
+	CHECK(view.CacheFile == 0);
+	CHECK(view.Vertices.Count() == 5);
+	ObjModelView rebuilt;
+	CHECK(LoadCached(rebuilt));
+	CHECK(rebuilt.Vertices.Count() == 5);
+	CHECK(EqualViews(rebuilt, view));
+	rebuilt = ObjModelView();
+
+	// so is one whose material library changed
+	String changedMtl = String(FixtureMtl) + L"map_bump bump.png\n";
+	WriteFile(MtlFileName, changedMtl.ToMultiByteString());
+	view = ObjModelView();
+	CHECK(LoadObj(view, ObjFileName));
+	CHECK(view.CacheFile == 0);
+	CHECK(view.Materials.Count() == 2 && view.Materials[1]->BumpMap == L"bump.png");
+
+	view = ObjModelView();
+	CHECK(LoadCached(view));
+	CHECK(view.Materials.Count() == 2 && view.Materials[1]->BumpMap == L"bump.png");
+	remove("./ObjModelTest.obj.cache");
+	remove(ObjFileName);
+	remove(MtlFileName);
+}
+
+// more than one parse chunk of lines, so faces and state changes cross the chunk boundaries
+static void TestChunks()
+{
+	const int quadCount = 200000;
+	FILE * f = fopen(ObjFileName, "wb");
+	fprintf(f, "mtllib ObjModelTest.mtl\n");
+	for (int i = 0; i <= quadCount; i++)
+		fprintf(f, "v %d.25 %d.5 -%d\nv %d.25 %d.5 1\nvt %d.5 0.25\n", i, i, i, i, i, i);
+	for (int i = 0; i < quadCount; i++)
+	{
+		if (i % 1000 == 0)
+			fprintf(f, "usemtl %s\ns %d\n", (i / 1000) % 2 ? "blue" : "red", i / 1000);
+		int a = i * 2 + 1, b = a + 1, c = a + 3, d = a + 2;
+		if (i % 2)
+			fprintf(f, "f %d/%d %d/%d %d/%d %d/%d\n", a, i + 1, b, i + 1, c, i + 2, d, i + 2);
+		else
+			fprintf(f, "f %d %d %d %d\n", a, b, c, d);
+	}
+	fclose(f);
+	WriteFile(MtlFileName, FixtureMtl);
+	remove("./ObjModelTest.obj.cache");
+
+	ObjModelView mdl;
+	CHECK(LoadObj(mdl, ObjFileName));
+	CHECK(mdl.Vertices.Count() == (quadCount + 1) * 2);
+	CHECK(mdl.TexCoords.Count() == quadCount + 1);
+	CHECK(mdl.Faces.Count() == quadCount * 2);
+	CHECK(mdl.FaceVerts.Count() == quadCount * 6);
+	int wrong = 0;
+	for (int i = 0; i < mdl.Vertices.Count(); i++)
+	{
+		int row = i / 2;
+		if (!Equal(mdl.Vertices[i], Vec3(row + 0.25f, row + 0.5f, i % 2 ? 1.0f : -(float)row)))
+			wrong++;
+	}
+	for (int i = 0; i < mdl.TexCoords.Count(); i++)
+		if (!Equal(mdl.TexCoords[i], Vec2(i + 0.5f, 0.25f)))
+			wrong++;
+	for (int i = 0; i < mdl.Faces.Count(); i++)
+	{
+		int quad = i / 2;
+		int a = quad * 2, corners[4] = { a, a + 1, a + 3, a + 2 };
+		int t = quad % 2 ? quad : -1, texCoords[4] = { t, t, t == -1 ? -1 : t + 1, t == -1 ? -1 : t + 1 };
+		ExpectedFace face;
+		int first = i % 2 ? 2 : 1;
+		int ids[3] = { 0, first, first + 1 };
+		for (int k = 0; k < 3; k++)
+		{
+			face.VertexIds[k] = corners[ids[k]];
+			face.TexCoordIds[k] = texCoords[ids[k]];
+			face.NormalIds[k] = -1;
+		}
+		face.VertexIds[3] = face.TexCoordIds[3] = face.NormalIds[3] = -1;
+		face.SmoothGroup = quad / 1000;
+		face.MaterialId = (quad / 1000) % 2;
+		if (!Equal(mdl.Faces[i], face))
+			wrong++;
+	}
+	CHECK(wrong == 0);
+	ObjModelView cached;
+	CHECK(LoadCached(cached));
+	CHECK(EqualViews(cached, mdl));
+	remove("./ObjModelTest.obj.cache");
+	remove(ObjFileName);
+	remove(MtlFileName);
+}
+
+int main()
+{
+	TestFixture();
+	TestStaleCache();
+	TestChunks();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
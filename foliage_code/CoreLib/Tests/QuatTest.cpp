@@ -0,0 +1,215 @@
+// Round trips of the compact rotation encodings in Quat.h against their documented error bounds:
+// smallest-three within 0.25 degree of the rotation and octahedral within 0.05 degree of the
+// vector, over random inputs and the cases where components tie or sit on a fold. Rotations
+// about the axes, the identity included, have to come back exactly. The batch
+// kernels have to give bit for bit the results of Quat::UnpackSmallestThree and QuatToRotation
+// on the tier selected by CORELIB_CPU_TIER, which the test list runs once per tier.
+
+#include "../Quat.h"
+#include "../SimdKernels.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+using namespace CoreLib::Basic;
+using namespace VectorMath;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+static const int SampleCount = 1 << 20;
+static const double Pi = 3.14159265358979323846;
+static std::mt19937 rng(5);
+
+static Quat RandomQuat()
+{
+	std::normal_distribution<double> dist;
+	double v[4], length = 0.0;
+	for (int i = 0; i < 4; i++)
+	{
+		v[i] = dist(rng);
+		length += v[i] * v[i];
+	}
+	length = sqrt(length);
+	return Quat((float)(v[0] / length), (float)(v[1] / length), (float)(v[2] / length), (float)(v[3] / length));
+}
+
+static Vec3 RandomDirection()
+{
+	Quat q = RandomQuat();
+	double length = sqrt((double)q.x * q.x + (double)q.y * q.y + (double)q.z * q.z);
+	return Vec3((float)(q.x / length), (float)(q.y / length), (float)(q.z / length));
+}
+
+// angle in degrees between the rotations of q1 and q2, which need not be of unit length
+static double RotationError(const Quat & q1, const Quat & q2)
+{
+	double dot = (double)q1.x * q2.x + (double)q1.y * q2.y + (double)q1.z * q2.z + (double)q1.w * q2.w;
+	double l1 = (double)q1.x * q1.x + (double)q1.y * q1.y + (double)q1.z * q1.z + (double)q1.w * q1.w;
+	double l2 = (double)q2.x * q2.x + (double)q2.y * q2.y + (double)q2.z * q2.z + (double)q2.w * q2.w;
+	return 2.0 * acos(fmin(fabs(dot) / sqrt(l1 * l2), 1.0)) * 180.0 / Pi;
+}
+
+static double DirectionError(const Vec3 & v1, const Vec3 & v2)
+{
+	double dot = (double)v1.x * v2.x + (double)v1.y * v2.y + (double)v1.z * v2.z;
+	double l1 = (double)v1.x * v1.x + (double)v1.y * v1.y + (double)v1.z * v1.z;
+	double l2 = (double)v2.x * v2.x + (double)v2.y * v2.y + (double)v2.z * v2.z;
+	return acos(fmax(fmin(dot / sqrt(l1 * l2), 1.0), -1.0)) * 180.0 / Pi;
+}
+
+static double SmallestThreeError(const Quat & q)
+{
+	Quat unpacked;
+	Quat::UnpackSmallestThree(unpacked, Quat::PackSmallestThree(q));
+	return RotationError(q, unpacked);
+}
+
+static double OctahedralError(const Vec3 & v)
+{
+	Vec3 unpacked;
+	UnpackOctahedral(unpacked, PackOctahedral(v));
+	return DirectionError(v, unpacked);
+}
+
+static void CheckBound(const char * name, double worst, double bound)
+{
+	printf("%-28s %.4f degree, bound %.2f\n", name, worst, bound);
+	if (worst > bound)
+	{
+		printf("check failed: %s exceeds its error bound\n", name);
+		failures++;
+	}
+}
+
+static void TestSmallestThree()
+{
+	double worst = 0.0;
+	for (int i = 0; i < SampleCount; i++)
+	{
+		Quat q = RandomQuat();
+		worst = fmax(worst, SmallestThreeError(q));
+		// q and -q are the same rotation and the same code
+		if (i < 4096)
+			CHECK(Quat::PackSmallestThree(q) == Quat::PackSmallestThree(Quat(-q.x, -q.y, -q.z, -q.w)));
+	}
+	CheckBound("smallest-three random", worst, 0.25);
+
+	// identity, half turns, quarter turns where two components tie, and all four equal
+	const float h = 0.707106781f;
+	const Quat edges[] =
+	{
+		Quat(0.0f, 0.0f, 0.0f, 1.0f), Quat(0.0f, 0.0f, 0.0f, -1.0f), Quat(1.0f, 0.0f, 0.0f, 0.0f),
+		Quat(0.0f, -1.0f, 0.0f, 0.0f), Quat(0.0f, 0.0f, 1.0f, 0.0f), Quat(h, 0.0f, 0.0f, h),
+		Quat(0.0f, h, 0.0f, -h), Quat(0.0f, 0.0f, -h, h), Quat(h, -h, 0.0f, 0.0f),
+		Quat(0.5f, 0.5f, 0.5f, 0.5f), Quat(-0.5f, 0.5f, -0.5f, 0.5f), Quat(0.5f, -0.5f, -0.5f, -0.5f),
+	};
+	worst = 0.0;
+	for (auto & q : edges)
+		worst = fmax(worst, SmallestThreeError(q));
+	CheckBound("smallest-three ties", worst, 0.25);
+	Quat identity;
+	Quat::UnpackSmallestThree(identity, Quat::PackSmallestThree(Quat::Identity()));
+	// zero components are stored exactly, so unchanged instances keep an exact identity
+	CHECK(identity.x == 0.0f && identity.y == 0.0f && identity.z == 0.0f && identity.w == 1.0f);
+	Quat halfTurn;
+	Quat::UnpackSmallestThree(halfTurn, Quat::PackSmallestThree(Quat(0.0f, 0.0f, 1.0f, 0.0f)));
+	CHECK(halfTurn.x == 0.0f && halfTurn.y == 0.0f && halfTurn.z == 1.0f && halfTurn.w == 0.0f);
+}
+
+static void TestOctahedral()
+{
+	double worst = 0.0;
+	for (int i = 0; i < SampleCount; i++)
+		worst = fmax(worst, OctahedralError(RandomDirection()));
+	CheckBound("octahedral random", worst, 0.05);
+
+	// the axes, the folds at z = 0 and the octant diagonals
+	std::vector<Vec3> edges;
+	for (int i = 0; i < 3; i++)
+	{
+		for (float s = -1.0f; s <= 1.0f; s += 2.0f)
+		{
+			Vec3 v(0.0f, 0.0f, 0.0f);
+			(&v.x)[i] = s;
+			edges.push_back(v);
+		}
+	}
+	const float d = 0.577350269f;
+	for (int i = 0; i < 8; i++)
+		edges.push_back(Vec3(i & 1 ? -d : d, i & 2 ? -d : d, i & 4 ? -d : d));
+	for (int i = 0; i < 64; i++)
+	{
+		float a = (float)(2.0 * Pi * i / 64);
+		edges.push_back(Vec3(cosf(a), sinf(a), 0.0f));
+		edges.push_back(Vec3(cosf(a) * 0.9999995f, sinf(a) * 0.9999995f, -1e-3f));
+	}
+	worst = 0.0;
+	for (auto & v : edges)
+	{
+		worst = fmax(worst, OctahedralError(v));
+		Vec3 unpacked;
+		UnpackOctahedral(unpacked, PackOctahedral(v));
+		CHECK(fabs(sqrt((double)unpacked.x * unpacked.x + (double)unpacked.y * unpacked.y + (double)unpacked.z * unpacked.z) - 1.0) < 1e-6);
+	}
+	CheckBound("octahedral axes and folds", worst, 0.05);
+}
+
+static const int Stride = 12;
+
+// the 9 floats of each matrix, and the padding after them left alone
+static bool MatchesRotations(const std::vector<float> & rotations, const std::vector<Quat> & quats)
+{
+	for (int i = 0; i < (int)quats.size(); i++)
+	{
+		float r[3][3];
+		QuatToRotation(r, quats[i].x, quats[i].y, quats[i].z, quats[i].w);
+		if (memcmp(&rotations[i * Stride], r, sizeof(r)) != 0)
+			return false;
+		for (int k = 9; k < Stride; k++)
+			if (rotations[i * Stride + k] != -7.0f)
+				return false;
+	}
+	return true;
+}
+
+static void TestKernels()
+{
+	const SimdKernels & kernels = GetSimdKernels();
+	printf("kernels: %s\n", GetCpuTierName(kernels.Tier));
+	// every tail length of the widest kernels
+	for (int count = 0; count <= 40; count++)
+	{
+		std::vector<Quat> quats(count), unpacked(count);
+		std::vector<unsigned int> packed(count);
+		for (int i = 0; i < count; i++)
+		{
+			quats[i] = RandomQuat();
+			packed[i] = Quat::PackSmallestThree(quats[i]);
+			Quat::UnpackSmallestThree(unpacked[i], packed[i]);
+		}
+		std::vector<float> rotations(count * Stride + 1, -7.0f);
+		QuatsToRotations(rotations.data(), Stride, quats.data(), count);
+		CHECK(MatchesRotations(rotations, quats) && rotations.back() == -7.0f);
+		std::fill(rotations.begin(), rotations.end(), -7.0f);
+		UnpackRotations(rotations.data(), Stride, packed.data(), count);
+		CHECK(MatchesRotations(rotations, unpacked) && rotations.back() == -7.0f);
+	}
+}
+
+int main()
+{
+	TestSmallestThree();
+	TestOctahedral();
+	TestKernels();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
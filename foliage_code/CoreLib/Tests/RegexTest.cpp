@@ -0,0 +1,538 @@
+// PureRegex on random patterns against a brute-force matcher that works on the regex tree
+// directly. IsMatch, Search and SearchLongest have to agree with it from every start position
+// for the full DFA, the lazy DFA, a lazy DFA small enough to keep flushing, and a table mapped
+// from the cache directory. A cache file that is truncated or has any byte changed must not be
+// used: the regex compiles again and the file is written anew.
+
+#include "../Regex/Regex.h"
+#include "../LibIO.h"
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <sys/utime.h>
+#define utime _utime
+#define utimbuf _utimbuf
+#else
+#include <utime.h>
+#endif
+
+using namespace CoreLib::Basic;
+using namespace CoreLib::IO;
+using namespace CoreLib::Text;
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); failures++; }
+
+static std::mt19937 rng(11);
+
+static int Random(int n)
+{
+	return std::uniform_int_distribution<int>(0, n - 1)(rng);
+}
+
+// Patterns use the characters a, b and c; the inputs also contain d, which only a negated set
+// or \. matches, so the matchers see characters that are in no char class.
+enum class NodeType
+{
+	Set, Concat, Alt, Star, Plus, Optional, Repeat
+};
+
+struct Node
+{
+	NodeType Type;
+	int Chars; // Set: bits for a, b and c
+	bool Neg;
+	int MinRepeat, MaxRepeat;
+	std::vector<Node> Children;
+	bool Contains(wchar_t ch) const
+	{
+		if (ch >= L'a' && ch <= L'c')
+			return (((Chars >> (ch - L'a')) & 1) != 0) != Neg;
+		return Neg;
+	}
+};
+
+static Node RandomNode(int depth)
+{
+	Node node;
+	node.Chars = 0;
+	node.Neg = false;
+	node.MinRepeat = node.MaxRepeat = 0;
+	if (depth == 0 || Random(10) < 3)
+	{
+		node.Type = NodeType::Set;
+		switch (Random(6))
+		{
+		case 0:
+			node.Neg = true; // \.
+			break;
+		case 1:
+			node.Neg = true;
+			node.Chars = 1 << Random(3);
+			break;
+		case 2:
+			node.Chars = 1 + Random(7);
+			break;
+		default:
+			node.Chars = 1 << Random(3);
+		}
+		return node;
+	}
+	node.Type = (NodeType)(1 + Random(6));
+	int childCount = node.Type == NodeType::Concat || node.Type == NodeType::Alt ? 2 : 1;
+	for (int i = 0; i < childCount; i++)
+		node.Children.push_back(RandomNode(depth - 1));
+	if (node.Type == NodeType::Repeat)
+	{
+		node.MinRepeat = Random(3);
+		node.MaxRepeat = node.MinRepeat + Random(3);
+		if (node.MaxRepeat == 0)
+			node.MaxRepeat = 1;
+	}
+	return node;
+}
+
+// precedence: 0 alternation, 1 concatenation, 2 repetition, 3 atom
+static int Precedence(const Node & node)
+{
+	switch (node.Type)
+	{
+	case NodeType::Set:
+		return 3;
+	case NodeType::Concat:
+		return 1;
+	case NodeType::Alt:
+		return 0;
+	default:
+		return 2;
+	}
+}
+
+static std::wstring ToPattern(const Node & node, int minPrecedence)
+{
+	std::wstring rs;
+	switch (node.Type)
+	{
+	case NodeType::Set:
+		if (node.Neg && node.Chars == 0)
+			rs = L"\\.";
+		else if (!node.Neg && (node.Chars & (node.Chars - 1)) == 0)
+			rs = (wchar_t)(L'a' + (node.Chars == 1 ? 0 : node.Chars == 2 ? 1 : 2));
+		else if (!node.Neg && node.Chars == 7)
+			rs = L"[a-c]";
+		else
+		{
+			rs = node.Neg ? L"[^" : L"[";
+			for (int i = 0; i < 3; i++)
+				if (node.Chars & (1 << i))
+					rs += (wchar_t)(L'a' + i);
+			rs += L"]";
+		}
+		break;
+	case NodeType::Concat:
+		rs = ToPattern(node.Children[0], 1) + ToPattern(node.Children[1], 1);
+		break;
+	case NodeType::Alt:
+		rs = ToPattern(node.Children[0], 0) + L"|" + ToPattern(node.Children[1], 0);
+		break;
+	case NodeType::Star:
+		rs = ToPattern(node.Children[0], 3) + L"*";
+		break;
+	case NodeType::Plus:
+		rs = ToPattern(node.Children[0], 3) + L"+";
+		break;
+	case NodeType::Optional:
+		rs = ToPattern(node.Children[0], 3) + L"?";
+		break;
+	case NodeType::Repeat:
+		rs = ToPattern(node.Children[0], 3) + L"{" + std::to_wstring(node.MinRepeat);
+		if (node.MaxRepeat != node.MinRepeat)
+			rs += L"," + std::to_wstring(node.MaxRepeat);
+		rs += L"}";
+		break;
+	}
+	if (Precedence(node) < minPrecedence)
+		rs = L"(" + rs + L")";
+	return rs;
+}
+
+// Brute force over bit sets of positions in the input, which is at most 31 characters long.
+typedef unsigned int Positions;
+
+static Positions Ends(const Node & node, const std::wstring & str, Positions starts);
+
+static Positions StarEnds(const Node & child, const std::wstring & str, Positions starts)
+{
+	Positions rs = starts;
+	while (true)
+	{
+		Positions next = rs | Ends(child, str, rs);
+		if (next == rs)
+			return rs;
+		rs = next;
+	}
+}
+
+// positions j such that str[i, j) is in the language of node for some i in starts
+static Positions Ends(const Node & node, const std::wstring & str, Positions starts)
+{
+	Positions rs = 0;
+	switch (node.Type)
+	{
+	case NodeType::Set:
+		for (int i = 0; i < (int)str.length(); i++)
+			if ((starts >> i & 1) && node.Contains(str[i]))
+				rs |= 1u << (i + 1);
+		return rs;
+	case NodeType::Concat:
+		return Ends(node.Children[1], str, Ends(node.Children[0], str, starts));
+	case NodeType::Alt:
+		return Ends(node.Children[0], str, starts) | Ends(node.Children[1], str, starts);
+	case NodeType::Star:
+		return StarEnds(node.Children[0], str, starts);
+	case NodeType::Plus:
+		return StarEnds(node.Children[0], str, Ends(node.Children[0], str, starts));
+	case NodeType::Optional:
+		return starts | Ends(node.Children[0], str, starts);
+	case NodeType::Repeat:
+		for (int i = 0; i < node.MinRepeat; i++)
+			starts = Ends(node.Children[0], str, starts);
+		rs = starts;
+		for (int i = node.MinRepeat; i < node.MaxRepeat; i++)
+		{
+			starts = Ends(node.Children[0], str, starts);
+			rs |= starts;
+		}
+		return rs;
+	}
+	return rs;
+}
+
+// positions j such that str[i, j) is a prefix of a string in the language of node, which is
+// where a DFA without dead states still has a transition
+static Positions PrefixEnds(const Node & node, const std::wstring & str, Positions starts)
+{
+	Positions rs = 0;
+	switch (node.Type)
+	{
+	case NodeType::Set:
+		return starts | Ends(node, str, starts);
+	case NodeType::Concat:
+		return PrefixEnds(node.Children[0], str, starts) |
+			PrefixEnds(node.Children[1], str, Ends(node.Children[0], str, starts));
+	case NodeType::Alt:
+		return PrefixEnds(node.Children[0], str, starts) | PrefixEnds(node.Children[1], str, starts);
+	case NodeType::Star:
+	case NodeType::Plus:
+		return PrefixEnds(node.Children[0], str, StarEnds(node.Children[0], str, starts));
+	case NodeType::Optional:
+		return starts | PrefixEnds(node.Children[0], str, starts);
+	case NodeType::Repeat:
+		rs = starts;
+		for (int i = 0; i < node.MaxRepeat; i++)
+		{
+			rs |= PrefixEnds(node.Children[0], str, starts);
+			starts = Ends(node.Children[0], str, starts);
+		}
+		return rs;
+	}
+	return rs;
+}
+
+static bool IsLegal(const Node & node, wchar_t ch)
+{
+	if (node.Type == NodeType::Set)
+		return node.Contains(ch);
+	for (auto & child : node.Children)
+		if (IsLegal(child, ch))
+			return true;
+	return false;
+}
+
+// What RegexMatcher::Match does: follow transitions until there are none, and succeed if the
+// state reached is final. A character in no char class fails the match.
+static int ReferenceMatch(const Node & root, const std::wstring & str, int start)
+{
+	Positions ends = Ends(root, str, 1u << start);
+	Positions prefixes = PrefixEnds(root, str, 1u << start);
+	int pos = start;
+	while (pos < (int)str.length())
+	{
+		if (!IsLegal(root, str[pos]))
+			return -1;
+		if (!(prefixes >> (pos + 1) & 1))
+			break;
+		pos++;
+	}
+	return (ends >> pos & 1) ? pos - start : -1;
+}
+
+static int ReferenceMatchLongest(const Node & root, const std::wstring & str, int start)
+{
+	Positions ends = Ends(root, str, 1u << start);
+	for (int pos = (int)str.length(); pos >= start; pos--)
+		if (ends >> pos & 1)
+			return pos - start;
+	return -1;
+}
+
+static PureRegex::RegexMatchResult ReferenceSearch(const Node & root, const std::wstring & str, int start)
+{
+	PureRegex::RegexMatchResult rs;
+	rs.Start = 0;
+	rs.Length = -1;
+	for (int i = start; i < (int)str.length(); i++)
+	{
+		int len = ReferenceMatch(root, str, i);
+		if (len >= 0)
+		{
+			rs.Start = i;
+			rs.Length = len;
+			break;
+		}
+	}
+	return rs;
+}
+
+static PureRegex::RegexMatchResult ReferenceSearchLongest(const Node & root, const std::wstring & str, int start)
+{
+	PureRegex::RegexMatchResult rs;
+	rs.Start = 0;
+	rs.Length = -1;
+	for (int i = start; i <= (int)str.length(); i++)
+	{
+		int len = ReferenceMatchLongest(root, str, i);
+		if (len >= 0)
+		{
+			rs.Start = i;
+			rs.Length = len;
+			break;
+		}
+	}
+	return rs;
+}
+
+static std::wstring RandomInput()
+{
+	std::wstring rs;
+	int length = Random(13);
+	for (int i = 0; i < length; i++)
+		rs += (wchar_t)(Random(10) == 0 ? L'd' : L'a' + Random(3));
+	return rs;
+}
+
+static bool Equal(const PureRegex::RegexMatchResult & a, const PureRegex::RegexMatchResult & b)
+{
+	return a.Start == b.Start && a.Length == b.Length;
+}
+
+static int mismatchReports = 0;
+
+static void CheckRegex(PureRegex & regex, const char * mode, const Node & root, const std::wstring & pattern,
+	const std::vector<std::wstring> & inputs)
+{
+	for (auto & input : inputs)
+	{
+		String str(input.c_str());
+		bool ok = regex.IsMatch(str) == ((Ends(root, input, 1) >> input.length() & 1) != 0);
+		for (int start = 0; start <= (int)input.length(); start++)
+		{
+			ok = ok && Equal(regex.Search(str, start), ReferenceSearch(root, input, start));
+			ok = ok && Equal(regex.SearchLongest(str, start), ReferenceSearchLongest(root, input, start));
+		}
+		if (!ok)
+		{
+			if (mismatchReports++ < 10)
+				printf("check failed: %s DFA of %ls differs from the reference on \"%ls\"\n", mode, pattern.c_str(), input.c_str());
+			failures++;
+			return;
+		}
+	}
+}
+
+static void CheckLazyDFA(LazyDFA & dfa, const Node & root, const std::wstring & pattern,
+	const std::vector<std::wstring> & inputs)
+{
+	for (auto & input : inputs)
+	{
+		String str(input.c_str());
+		bool ok = true;
+		for (int start = 0; start <= (int)input.length(); start++)
+		{
+			ok = ok && dfa.Match(str, start) == ReferenceMatch(root, input, start);
+			ok = ok && dfa.MatchLongest(str, start) == ReferenceMatchLongest(root, input, start);
+		}
+		if (!ok)
+		{
+			if (mismatchReports++ < 10)
+				printf("check failed: flushing lazy DFA of %ls differs from the reference on \"%ls\"\n", pattern.c_str(), input.c_str());
+			failures++;
+			return;
+		}
+	}
+}
+
+// the file DFA_Cache keeps the table of a source in
+static String CacheFileName(const String & source)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (int i = 0; i < source.Length(); i++)
+	{
+		hash ^= (unsigned int)source[i];
+		hash *= 1099511628211ull;
+	}
+	wchar_t name[16];
+	for (int i = 0; i < 16; i++)
+		name[i] = L"0123456789abcdef"[(hash >> (60 - i * 4)) & 15];
+	return Path::Combine(L".", String(name, 16) + L".dfa");
+}
+
+static std::vector<unsigned char> ReadBytes(const String & fileName)
+{
+	std::vector<unsigned char> rs;
+	FILE * f = fopen(fileName.ToMultiByteString(), "rb");
+	if (!f)
+		return rs;
+	int ch;
+	while ((ch = fgetc(f)) != EOF)
+		rs.push_back((unsigned char)ch);
+	fclose(f);
+	return rs;
+}
+
+static void WriteBytes(const String & fileName, const std::vector<unsigned char> & bytes, size_t count)
+{
+	FILE * f = fopen(fileName.ToMultiByteString(), "wb");
+	if (count)
+		fwrite(bytes.data(), 1, count, f);
+	fclose(f);
+}
+
+// Dates the file back, so a file written again afterwards shows a newer time.
+static void DateBack(const String & fileName)
+{
+	utimbuf times;
+	times.actime = times.modtime = 1000000000;
+	utime(fileName.ToMultiByteString(), &times);
+}
+
+static bool IsDatedBack(const String & fileName)
+{
+	FileInfo info;
+	return File::GetInfo(fileName, info) && info.LastWriteTime == (CoreLib::Int64)1000000000 * 1000000000;
+}
+
+static void TestRandomPatterns()
+{
+	DFA_Cache::SetDirectory(L".");
+	for (int p = 0; p < 500; p++)
+	{
+		Node root = RandomNode(4);
+		std::wstring pattern = ToPattern(root, 0);
+		String patternStr(pattern.c_str());
+		std::vector<std::wstring> inputs;
+		for (int i = 0; i < 40; i++)
+			inputs.push_back(RandomInput());
+
+		PureRegex lazy(patternStr, RegexDFAMode::Lazy);
+		CheckRegex(lazy, "lazy", root, pattern, inputs);
+
+		RegexParser parser;
+		RefPtr<RegexNode> tree = parser.Parse(patternStr);
+		CHECK(tree);
+		NFA_Graph nfa;
+		nfa.GenerateFromRegexTree(tree.Ptr());
+		LazyDFA flushing(&nfa, 2);
+		CheckLazyDFA(flushing, root, pattern, inputs);
+
+		// compiled and saved, then mapped from the file
+		String fileName = CacheFileName(L"regex:" + patternStr);
+		remove(fileName.ToMultiByteString());
+		DFA_Cache::Clear();
+		PureRegex full(patternStr, RegexDFAMode::Full);
+		CHECK(File::Exists(fileName));
+		CheckRegex(full, "full", root, pattern, inputs);
+		DateBack(fileName);
+		DFA_Cache::Clear();
+		PureRegex cached(patternStr, RegexDFAMode::Full);
+		CHECK(IsDatedBack(fileName));
+		CheckRegex(cached, "cache-loaded", root, pattern, inputs);
+		remove(fileName.ToMultiByteString());
+	}
+	DFA_Cache::Clear();
+	DFA_Cache::SetDirectory(L"");
+}
+
+static bool Compiles(const Node & root, const std::wstring & pattern, const std::vector<std::wstring> & inputs,
+	const String & fileName, const std::vector<unsigned char> & saved)
+{
+	DateBack(fileName);
+	DFA_Cache::Clear();
+	PureRegex regex(pattern.c_str(), RegexDFAMode::Full);
+	int lastFailures = failures;
+	CheckRegex(regex, "recompiled", root, pattern, inputs);
+	return failures == lastFailures && !IsDatedBack(fileName) && ReadBytes(fileName) == saved;
+}
+
+static void TestCorruptCache()
+{
+	DFA_Cache::SetDirectory(L".");
+	const int patternCount = 4;
+	for (int p = 0; p < patternCount; p++)
+	{
+		Node root = RandomNode(3);
+		std::wstring pattern = ToPattern(root, 0);
+		std::vector<std::wstring> inputs;
+		for (int i = 0; i < 20; i++)
+			inputs.push_back(RandomInput());
+		String fileName = CacheFileName(L"regex:" + String(pattern.c_str()));
+		remove(fileName.ToMultiByteString());
+		DFA_Cache::Clear();
+		{
+			PureRegex regex(pattern.c_str(), RegexDFAMode::Full);
+		}
+		std::vector<unsigned char> saved = ReadBytes(fileName);
+		CHECK(saved.size() > 0);
+
+		int truncatedUsed = 0, changedUsed = 0;
+		for (size_t size = 0; size < saved.size(); size++)
+		{
+			WriteBytes(fileName, saved, size);
+			if (!Compiles(root, pattern, inputs, fileName, saved))
+				truncatedUsed++;
+		}
+		for (size_t i = 0; i < saved.size(); i++)
+		{
+			std::vector<unsigned char> changed = saved;
+			changed[i] ^= (unsigned char)(1 << (i % 8));
+			WriteBytes(fileName, changed, changed.size());
+			if (!Compiles(root, pattern, inputs, fileName, saved))
+				changedUsed++;
+		}
+		if (truncatedUsed || changedUsed)
+		{
+			printf("check failed: cache file of %ls used when truncated (%d times) or changed (%d times)\n",
+				pattern.c_str(), truncatedUsed, changedUsed);
+			failures++;
+		}
+		remove(fileName.ToMultiByteString());
+	}
+	DFA_Cache::Clear();
+	DFA_Cache::SetDirectory(L"");
+}
+
+int main()
+{
+	TestRandomPatterns();
+	TestCorruptCache();
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
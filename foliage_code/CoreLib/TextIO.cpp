@@ -1,75 +1,116 @@
 #include "TextIO.h"
 #include <ctype.h>
-#ifdef WINDOWS_PLATFORM
-#include <Windows.h>
-#endif
+#include <wchar.h>
 namespace CoreLib
 {
 	namespace IO
 	{
 		using namespace CoreLib::Basic;
 
+		String Encoding::GetString(const char * buffer, int length)
+		{
+			List<wchar_t> chars;
+			chars.SetSize(length);
+			int consumed;
+			int count = GetChars(chars.Buffer(), buffer, length, consumed, true);
+			return String::FromBuffer(chars.Buffer(), count);
+		}
+
 		class UnicodeEncoding : public Encoding
 		{
+		private:
+			bool bigEndian;
 		public:
+			UnicodeEncoding(bool bigEndian)
+				: bigEndian(bigEndian)
+			{}
 			virtual List<char> GetBytes(const String & str)
 			{
 				List<char> rs;
-				rs.Reserve(str.Length());
-				rs.AddRange((char*)str.Buffer(), str.Length()*2);
+				rs.Reserve(str.Length() * 2);
+				auto buffer = str.Buffer();
+				for (int i = 0; i < str.Length(); i++)
+				{
+					unsigned int codePoint = (unsigned int)buffer[i];
+					unsigned short units[2];
+					int count = 1;
+					if (codePoint >= 0x10000 && codePoint <= 0x10FFFF)
+					{
+						codePoint -= 0x10000;
+						units[0] = (unsigned short)(0xD800 + (codePoint >> 10));
+						units[1] = (unsigned short)(0xDC00 + (codePoint & 0x3FF));
+						count = 2;
+					}
+					else
+						units[0] = codePoint > 0x10FFFF ? 0xFFFD : (unsigned short)codePoint;
+					for (int j = 0; j < count; j++)
+					{
+						char lo = (char)(units[j] & 0xFF), hi = (char)(units[j] >> 8);
+						rs.Add(bigEndian ? hi : lo);
+						rs.Add(bigEndian ? lo : hi);
+					}
+				}
 				return rs;
 			}
 
-			virtual String GetString(char * buffer, int length)
+			virtual int GetChars(wchar_t * dest, const char * buffer, int length, int & consumed, bool flush)
 			{
-#ifdef WINDOWS_PLATFORM
-				int unicodeFlag;
-				int startPos = 0;
-				IsTextUnicode(buffer, length, &unicodeFlag);
-				if (unicodeFlag & IS_TEXT_UNICODE_UNICODE_MASK)
+				int complete = length & ~1;
+				if (!flush && complete >= 2)
 				{
-					if (unicodeFlag & IS_TEXT_UNICODE_SIGNATURE)
-					{
-						startPos += 2;
-					}
-					length = (int)wcsnlen_s((wchar_t*)buffer+startPos, length-startPos);
-					wchar_t * rbuffer = new wchar_t[length+1];
-					memcpy(rbuffer, buffer, length*sizeof(wchar_t));
-					return String::FromBuffer(rbuffer, length);
+					// keep a high surrogate back until its pair has been read
+					const unsigned char * last = (const unsigned char *)buffer + complete - 2;
+					unsigned int unit = bigEndian ? (last[0] << 8) | last[1] : last[0] | (last[1] << 8);
+					if (unit >= 0xD800 && unit <= 0xDBFF)
+						complete -= 2;
 				}
-				else if (unicodeFlag & IS_TEXT_UNICODE_REVERSE_MASK)
+				int rs = Utf16ToWideChar(dest, buffer, complete, bigEndian);
+				if (flush && complete < length)
 				{
-					if (unicodeFlag & IS_TEXT_UNICODE_REVERSE_SIGNATURE)
-					{
-						startPos += 2;
-					}
-					length = (int)wcsnlen_s((wchar_t*)buffer+startPos, length-startPos);
-					wchar_t * rbuffer = new wchar_t[length+1];
-					for (int i = 0; i<length; i++)
-					{
-						((char*)rbuffer)[i*2] = buffer[i*2+1];
-						((char*)rbuffer)[i*2+1] = buffer[i*2];
-					}
-					rbuffer[length] = 0;
-					return String::FromBuffer(rbuffer, length);
+					dest[rs++] = 0xFFFD;
+					complete = length;
 				}
-				else
+				consumed = complete;
+				return rs;
+			}
+		};
+
+		class Utf8Encoding : public Encoding
+		{
+		public:
+			virtual List<char> GetBytes(const String & str)
+			{
+				List<char> rs;
+				rs.SetSize(WideCharToUtf8(0, str.Buffer(), str.Length()));
+				WideCharToUtf8(rs.Buffer(), str.Buffer(), str.Length());
+				return rs;
+			}
+
+			virtual int GetChars(wchar_t * dest, const char * buffer, int length, int & consumed, bool flush)
+			{
+				int complete = length;
+				if (!flush)
 				{
-					throw ArgumentException(L"Invalid unicode text format.");
+					// back up to the start of a sequence cut off by the end of the buffer
+					const unsigned char * src = (const unsigned char *)buffer;
+					for (int i = length - 1; i >= 0 && i >= length - 3; i--)
+					{
+						if ((src[i] & 0xC0) != 0x80)
+						{
+							int sequenceLength = src[i] >= 0xF0 ? 4 : src[i] >= 0xE0 ? 3 : src[i] >= 0xC0 ? 2 : 1;
+							if (i + sequenceLength > length)
+								complete = i;
+							break;
+						}
+					}
 				}
-#else
-				throw NotImplementedException(L"UnicodeEncoding::GetString() not implemented for current platform.");
-#endif
+				consumed = complete;
+				return Utf8ToWideChar(dest, buffer, complete);
 			}
 		};
 
 		class AnsiEncoding : public Encoding
 		{
-		private:
-			static char * WideCharToAnsi(wchar_t * buffer, int length)
-			{
-				return WideCharToMByte(buffer, length);
-			}
 		public:
 			virtual List<char> GetBytes(const String & str)
 			{
@@ -81,17 +122,31 @@ namespace CoreLib
 				return rs;
 			}
 
-			virtual String GetString(char * buffer, int length)
+			virtual int GetChars(wchar_t * dest, const char * buffer, int length, int & consumed, bool flush)
+			{
+				int rs = MByteToWideCharPartial(dest, buffer, length, &consumed);
+				if (flush && consumed < length)
+				{
+					dest[rs++] = 0xFFFD;
+					consumed = length;
+				}
+				return rs;
+			}
+
+			virtual String GetString(const char * buffer, int length)
 			{
-				auto rbuffer = MByteToWideChar(buffer, length);
-				return String::FromBuffer(rbuffer, length);
+				return String::FromMultiByte(buffer, length);
 			}
 		};
 
-		UnicodeEncoding __unicodeEncoding;
+		UnicodeEncoding __unicodeEncoding(false);
+		UnicodeEncoding __bigEndianUnicodeEncoding(true);
+		Utf8Encoding __utf8Encoding;
 		AnsiEncoding __ansiEncoding;
 
 		Encoding * Encoding::Unicode = &__unicodeEncoding;
+		Encoding * Encoding::BigEndianUnicode = &__bigEndianUnicodeEncoding;
+		Encoding * Encoding::UTF8 = &__utf8Encoding;
 		Encoding * Encoding::Ansi = &__ansiEncoding;
 
 		StreamWriter::StreamWriter(const String & path, Encoding * encoding)
@@ -144,156 +199,200 @@ namespace CoreLib
 		StreamReader::StreamReader(const String & path)
 		{
 			stream = new FileStream(path, FileMode::Open);
-			ReadBuffer();
-			encoding = DetermineEncoding();
-			if (encoding == 0)
-				encoding = Encoding::Ansi;
+			Init(Encoding::Ansi);
 		}
 		StreamReader::StreamReader(RefPtr<Stream> stream, Encoding * encoding)
 		{
 			this->stream = stream;
-			this->encoding = encoding;
-			ReadBuffer();
-			encoding = DetermineEncoding();
-			if (this->encoding == 0)
-				this->encoding = encoding;
+			Init(encoding);
 		}
 
-		Encoding * StreamReader::DetermineEncoding()
+		void StreamReader::Init(Encoding * defaultEncoding)
 		{
-			int flag = 0;
-#ifdef WINDOWS_PLATFORM
-			int rs = IsTextUnicode(buffer.Buffer(), buffer.Count(), &flag);
-			if (flag & (IS_TEXT_UNICODE_SIGNATURE | IS_TEXT_UNICODE_REVERSE_SIGNATURE))
-				return Encoding::Unicode;
-			else if (rs)
-				return Encoding::Ansi;
-			else
-				return 0;
-#else
-			return Encoding::Ansi;
-#endif
-		}
-		
-		void StreamReader::ReadBuffer()
-		{
-			buffer.SetSize(4096);
-			int len = stream->Read(buffer.Buffer(), buffer.Count());
-			buffer.SetSize(len);
-			ptr = 0;
+			memory = dynamic_cast<MemoryBackedStream*>(stream.Ptr());
+			if (!memory)
+				buffer.SetSize(BlockSize);
+			raw = buffer.Buffer();
+			rawLength = ptr = charPtr = 0;
+			endOfStream = skipLineFeed = false;
+			ReadBuffer();
+			encoding = DetermineEncoding();
+			if (encoding == 0)
+				encoding = defaultEncoding ? defaultEncoding : Encoding::Ansi;
 		}
 
-		char StreamReader::ReadBufferChar()
+		// looks for a byte order mark and skips it
+		Encoding * StreamReader::DetermineEncoding()
 		{
-			if (ptr<buffer.Count())
+			const unsigned char * bytes = (const unsigned char *)raw;
+			if (rawLength >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
 			{
-				return buffer[ptr++];
+				ptr = 3;
+				return Encoding::UTF8;
 			}
-			ReadBuffer();
-			if (ptr<buffer.Count())
+			if (rawLength >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE)
+			{
+				ptr = 2;
+				return Encoding::Unicode;
+			}
+			if (rawLength >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF)
 			{
-				return buffer[ptr++];
+				ptr = 2;
+				return Encoding::BigEndianUnicode;
 			}
 			return 0;
 		}
 
-		char StreamReader::PeakBufferChar()
+		void StreamReader::ReadBuffer()
 		{
-			if (ptr<buffer.Count())
+			int tail = rawLength - ptr;
+			if (memory)
 			{
-				return buffer[ptr];
+				// the undecoded tail is still in place right in front of the stream position
+				int len = (int)Math::Min(memory->GetRemaining(), (Int64)BlockSize);
+				raw = (const char *)memory->Consume(len) - tail;
+				rawLength = tail + len;
+				ptr = 0;
+				if (len == 0)
+					endOfStream = true;
+				return;
 			}
+			// keep the undecoded tail, e.g. half of a UTF-8 sequence, and top the block up behind it
+			memmove(buffer.Buffer(), buffer.Buffer() + ptr, tail);
+			rawLength = tail;
+			ptr = 0;
 			try
 			{
-				ReadBuffer();
+				int len = stream->Read(buffer.Buffer() + tail, BlockSize - tail);
+				rawLength += len;
+				if (len == 0)
+					endOfStream = true;
 			}
 			catch (EndOfStreamException)
 			{
-				buffer.Clear();
-				ptr = 0;
+				endOfStream = true;
 			}
-			if (ptr<buffer.Count())
-			{
-				return buffer[ptr];
-			}
-			return 0;
 		}
-		int StreamReader::Read(wchar_t * buffer, int length)
+
+		bool StreamReader::DecodeBuffer()
 		{
-			int i = 0;
-			for (i = 0; i<length; i++)
+			charPtr = 0;
+			while (true)
 			{
-				try
+				int count = 0;
+				if (ptr < rawLength)
 				{
-					auto ch = Read();
-					if (ch == L'\r')
-					{
-						if (Peak() == L'\n')
-							Read();
-						break;
-					}
-					else if (ch == L'\n')
-					{
-						break;
-					}
-					buffer[i] = ch;
+					// no encoding produces more characters than bytes
+					chars.SetSize(rawLength - ptr);
+					int consumed = 0;
+					count = encoding->GetChars(chars.Buffer(), raw + ptr, rawLength - ptr, consumed, endOfStream);
+					ptr += consumed;
 				}
-				catch (EndOfStreamException)
+				chars.SetSize(count);
+				if (count)
+					return true;
+				if (endOfStream)
+					return false;
+				ReadBuffer();
+			}
+		}
+
+		bool StreamReader::EnsureCharsSlow()
+		{
+			while (true)
+			{
+				if (charPtr == chars.Count())
 				{
-					break;
+					if (!DecodeBuffer())
+						return false;
+					continue;
 				}
+				if (!skipLineFeed)
+					return true;
+				skipLineFeed = false;
+				if (chars[charPtr] == L'\n')
+					charPtr++;
 			}
-			return i;
 		}
-		String StreamReader::ReadLine()
+
+		// position of the first '\r' or '\n', -1 if there is none
+		static int FindLineBreak(const wchar_t * str, int length)
 		{
-			StringBuilder sb(256);
-			bool ignoreLineBreak = false;
-			while (true)
+			const wchar_t * lineFeed = wmemchr(str, L'\n', length);
+			int end = lineFeed ? (int)(lineFeed - str) : length;
+			const wchar_t * carriageReturn = wmemchr(str, L'\r', end);
+			if (carriageReturn)
+				return (int)(carriageReturn - str);
+			return lineFeed ? end : -1;
+		}
+
+		int StreamReader::Read(wchar_t * buffer, int count)
+		{
+			int rs = 0;
+			while (rs < count && EnsureChars())
 			{
-				try
+				int len = Math::Min(count - rs, chars.Count() - charPtr);
+				memcpy(buffer + rs, chars.Buffer() + charPtr, len * sizeof(wchar_t));
+				charPtr += len;
+				rs += len;
+			}
+			return rs;
+		}
+		bool StreamReader::ReadLine(StringView & line)
+		{
+			if (!EnsureChars())
+				return false;
+			lineBuffer.Clear();
+			bool straddles = false;
+			do
+			{
+				const wchar_t * start = chars.Buffer() + charPtr;
+				int remaining = chars.Count() - charPtr;
+				int lineBreak = FindLineBreak(start, remaining);
+				if (lineBreak == -1)
 				{
-					auto ch = Read();
-					if (ch == L'\r')
-					{
-						if (Peak() == L'\n')
-							Read();
-						break;
-					}
-					else if (ch == L'\n')
-					{
-						break;
-					}
-					sb.Append(ch);
+					lineBuffer.AddRange(start, remaining);
+					charPtr += remaining;
+					straddles = true;
+					continue;
 				}
-				catch (EndOfStreamException)
+				charPtr += lineBreak + 1;
+				skipLineFeed = start[lineBreak] == L'\r';
+				if (!straddles)
 				{
-					break;
+					line = StringView(start, lineBreak);
+					return true;
 				}
-			}
-			return sb.ProduceString();
+				lineBuffer.AddRange(start, lineBreak);
+				break;
+			} while (EnsureChars());
+			// either the line straddled blocks or it is the last line and has no line break
+			line = lineBuffer.Count() ? StringView(lineBuffer.Buffer(), lineBuffer.Count()) : StringView();
+			return true;
+		}
+		String StreamReader::ReadLine()
+		{
+			StringView line;
+			if (!ReadLine(line))
+				return String();
+			return String(line);
 		}
 		String StreamReader::ReadToEnd()
 		{
 			StringBuilder sb(16384);
-			bool ignoreLineBreak = false;
-			while (true)
+			while (EnsureChars())
 			{
-				try
-				{
-					auto ch = Read();
-					if (ch == L'\r')
-					{
-						sb.Append(L'\n');
-						if (Peak() == L'\n')
-							Read();
-					}
-					else
-						sb.Append(ch);
-				}
-				catch (EndOfStreamException)
+				const wchar_t * start = chars.Buffer() + charPtr;
+				int remaining = chars.Count() - charPtr;
+				const wchar_t * carriageReturn = wmemchr(start, L'\r', remaining);
+				int len = carriageReturn ? (int)(carriageReturn - start) : remaining;
+				sb.Append(start, len);
+				charPtr += len;
+				if (carriageReturn)
 				{
-					break;
+					sb.Append(L'\n');
+					charPtr++;
+					skipLineFeed = true;
 				}
 			}
 			return sb.ProduceString();
@@ -4,9 +4,6 @@
 #include "SecureCRT.h"
 #include "Stream.h"
 #include "WideChar.h"
-#ifdef WIN32
-#include <mbctype.h>
-#endif
 namespace CoreLib
 {
 	namespace IO
@@ -101,9 +98,14 @@ namespace CoreLib
 		class Encoding
 		{
 		public:
-			static Encoding * Unicode, * Ansi;
+			static Encoding * Unicode, * BigEndianUnicode, * UTF8, * Ansi;
 			virtual List<char> GetBytes(const String & str)=0;
-			virtual String GetString(char * buffer, int length)=0;
+			// Decodes buffer into dest, which must have room for length characters. A character
+			// cut off at the end of the buffer is left for the next call, unless flush is set,
+			// in which case it decodes to U+FFFD. Returns the number of characters written;
+			// consumed receives the number of bytes used.
+			virtual int GetChars(wchar_t * dest, const char * buffer, int length, int & consumed, bool flush)=0;
+			virtual String GetString(const char * buffer, int length);
 			virtual ~Encoding()
 			{}
 			String GetString(const List<char> & buffer)
@@ -129,61 +131,127 @@ namespace CoreLib
 			}
 		};
 
+		// Reads text a block at a time and decodes each block in one pass. A byte order mark
+		// selects the encoding; without one the encoding given to the constructor is used.
+		// Lines may end in "\n", "\r\n" or "\r".
 		class StreamReader : public TextReader
 		{
 		private:
+			static const int BlockSize = 65536;
 			RefPtr<Stream> stream;
-			List<char> buffer;
+			// set when stream is memory backed, blocks are then decoded straight from its memory
+			MemoryBackedStream * memory;
 			Encoding * encoding;
-			int ptr;
-			char ReadBufferChar();
-			char PeakBufferChar();
+			// raw bytes of the current block, [ptr, rawLength) is not decoded yet
+			List<char> buffer;
+			const char * raw;
+			int rawLength, ptr;
+			// decoded text of the current block, [charPtr, chars.Count()) is not read yet
+			List<wchar_t> chars;
+			int charPtr;
+			// holds lines that straddle two blocks
+			List<wchar_t> lineBuffer;
+			bool endOfStream;
+			// the last line ended in '\r', so a '\n' following it belongs to that line break
+			bool skipLineFeed;
 			void ReadBuffer();
-			template<typename GetFunc>
-			wchar_t GetChar(GetFunc get)
+			bool DecodeBuffer();
+			bool EnsureChars()
+			{
+				if (charPtr < chars.Count() && !skipLineFeed)
+					return true;
+				return EnsureCharsSlow();
+			}
+			bool EnsureCharsSlow();
+			Encoding * DetermineEncoding();
+			void Init(Encoding * defaultEncoding);
+		public:
+			class LineIterator
 			{
-				wchar_t rs = 0;
-				if (encoding == Encoding::Unicode)
+			private:
+				StreamReader * reader;
+				StringView line;
+			public:
+				LineIterator()
+					: reader(0)
+				{}
+				LineIterator(StreamReader * reader)
+					: reader(reader)
 				{
-					((char*)&rs)[0] = get();
-					((char*)&rs)[1] = get();
+					++*this;
 				}
-				else
+				const StringView & operator *() const
 				{
-					/*
-					char mb[2];
-					mb[0] = get();
-					if (_ismbblead(mb[0]))
-					{
-						mb[1] = get();
-						MByteToWideChar(&rs, 1, mb, 2);
-					}
-					else
-					{
-						rs = mb[0];
-					}
-					return rs;
-					*/
-					throw IOException( "why the fuck are you using MBCS?" );
+					return line;
 				}
-				return rs;
-			}
-			Encoding * DetermineEncoding();
-		public:
+				LineIterator & operator ++()
+				{
+					if (!reader->ReadLine(line))
+						reader = 0;
+					return *this;
+				}
+				bool operator != (const LineIterator & other) const
+				{
+					return reader != other.reader;
+				}
+			};
+			class LineRange
+			{
+			private:
+				StreamReader * reader;
+			public:
+				LineRange(StreamReader * reader)
+					: reader(reader)
+				{}
+				LineIterator begin() const
+				{
+					return LineIterator(reader);
+				}
+				LineIterator end() const
+				{
+					return LineIterator();
+				}
+			};
+
 			StreamReader(const String & path);
 			StreamReader(RefPtr<Stream> stream, Encoding * encoding = Encoding::Ansi);
-			
+
+			// throws EndOfStreamException past the end
 			virtual wchar_t Read()
 			{
-				return GetChar([&]{return ReadBufferChar();});
+				if (!EnsureChars())
+					throw EndOfStreamException(L"End of stream reached when reading.");
+				return chars[charPtr++];
 			}
+			// 0 past the end
 			virtual wchar_t Peak()
 			{
-				return GetChar([&]{return PeakBufferChar();});
+				return EnsureChars() ? chars[charPtr] : 0;
 			}
+			// Reads up to count characters, line breaks included as they are. Returns the number
+			// read, which is less than count only at the end of the stream.
 			virtual int Read(wchar_t * buffer, int count);
+			// the next line without its line break, empty at the end of the stream
 			virtual String ReadLine();
+			// Reads the next line without copying it where possible. The view stays valid until
+			// the next read from this reader. Returns false at the end of the stream.
+			bool ReadLine(StringView & line);
+			// the remaining text with line breaks converted to "\n"
 			virtual String ReadToEnd();
+			bool EndOfStream()
+			{
+				return !EnsureChars();
+			}
+			// Iterates the remaining lines as views, see ReadLine(StringView&):
+			// for (auto & line : reader.Lines()) ...
+			LineRange Lines()
+			{
+				return LineRange(this);
+			}
+			Encoding * GetEncoding()
+			{
+				return encoding;
+			}
 
 			virtual void Close()
 			{
@@ -0,0 +1,280 @@
+#include "ThreadPool.h"
+#include <condition_variable>
+#include <memory>
+
+#ifdef _MSC_VER
+#define CORE_LIB_THREAD_LOCAL __declspec(thread)
+#else
+#define CORE_LIB_THREAD_LOCAL __thread
+#endif
+
+namespace CoreLib
+{
+	namespace Threading
+	{
+		// pool whose task the current thread is running
+		static CORE_LIB_THREAD_LOCAL ThreadPool * runningPool = 0;
+
+		// shared with the helper tasks of a ParallelFor, which may start after it has returned
+		struct ParallelForState
+		{
+			const std::function<void(int)> * Body;
+			int Count;
+			std::atomic<int> Next, Done;
+			std::mutex Mutex;
+			std::condition_variable AllDone;
+			std::exception_ptr Error;
+		};
+
+		static void RunParallelFor(ParallelForState & state)
+		{
+			int i;
+			while ((i = state.Next.fetch_add(1, std::memory_order_relaxed)) < state.Count)
+			{
+				try
+				{
+					(*state.Body)(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(state.Mutex);
+					if (!state.Error)
+						state.Error = std::current_exception();
+				}
+				// signalled under the lock, so the caller cannot miss it between test and wait
+				if (state.Done.fetch_add(1, std::memory_order_acq_rel) + 1 == state.Count)
+				{
+					std::lock_guard<std::mutex> lock(state.Mutex);
+					state.AllDone.notify_all();
+				}
+			}
+		}
+
+		ThreadPool::ThreadPool(int threadCount, int queueCapacity)
+			: pendingTasks(0), stopping(false)
+		{
+			for (int i = 0; i < PriorityCount; i++)
+				queues[i] = new MpmcQueue<Task*>(queueCapacity);
+			if (threadCount <= 0)
+				threadCount = Basic::Math::Max((int)std::thread::hardware_concurrency(), 1);
+			for (int i = 0; i < threadCount; i++)
+				workers.Add(std::thread([this]() { WorkerMain(); }));
+		}
+
+		ThreadPool::~ThreadPool()
+		{
+			try
+			{
+				WaitAll();
+			}
+			catch (...)
+			{
+			}
+			stopping.store(true, std::memory_order_release);
+			taskAvailable.Notify();
+			for (int i = 0; i < workers.Count(); i++)
+				workers[i].join();
+			for (int i = 0; i < PriorityCount; i++)
+				delete queues[i];
+		}
+
+		ThreadPool::Task * ThreadPool::TryTakeTask()
+		{
+			Task * task;
+			for (int i = 0; i < PriorityCount; i++)
+				if (queues[i]->TryDequeue(task))
+					return task;
+			return 0;
+		}
+
+		void ThreadPool::RunTask(Task * task)
+		{
+			// a throwing task must not take the worker down with it; WaitAll rethrows
+			ThreadPool * outerPool = runningPool;
+			runningPool = this;
+			try
+			{
+				(*task)();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorLock);
+				if (!taskError)
+					taskError = std::current_exception();
+			}
+			runningPool = outerPool;
+			delete task;
+			if (pendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				taskFinished.Notify();
+		}
+
+		void ThreadPool::WorkerMain()
+		{
+			while (true)
+			{
+				Task * task = TryTakeTask();
+				if (task)
+				{
+					RunTask(task);
+					continue;
+				}
+				int key = taskAvailable.PrepareWait();
+				task = TryTakeTask();
+				if (task)
+				{
+					taskAvailable.CancelWait();
+					RunTask(task);
+					continue;
+				}
+				if (stopping.load(std::memory_order_acquire))
+				{
+					taskAvailable.CancelWait();
+					return;
+				}
+				taskAvailable.Wait(key);
+			}
+		}
+
+		void ThreadPool::Submit(const Task & task, TaskPriority priority)
+		{
+			pendingTasks.fetch_add(1, std::memory_order_relaxed);
+			Task * item = new Task(task);
+			if (!queues[(int)priority]->TryEnqueue(item))
+			{
+				RunTask(item);
+				return;
+			}
+			taskAvailable.Notify();
+		}
+
+		void ThreadPool::WaitAll()
+		{
+			if (runningPool == this)
+				throw Basic::InvalidOperationException(L"ThreadPool::WaitAll called from a task of the same pool.");
+			while (pendingTasks.load(std::memory_order_acquire) != 0)
+			{
+				Task * task = TryTakeTask();
+				if (task)
+				{
+					RunTask(task);
+					continue;
+				}
+				int key = taskFinished.PrepareWait();
+				if (pendingTasks.load(std::memory_order_acquire) == 0)
+				{
+					taskFinished.CancelWait();
+					break;
+				}
+				taskFinished.Wait(key);
+			}
+			std::exception_ptr error;
+			{
+				std::lock_guard<std::mutex> lock(errorLock);
+				error = taskError;
+				taskError = std::exception_ptr();
+			}
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		void ThreadPool::ParallelFor(int count, const std::function<void(int)> & body, TaskPriority priority)
+		{
+			if (count <= 0)
+				return;
+			if (count == 1)
+			{
+				body(0);
+				return;
+			}
+			std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+			state->Body = &body;
+			state->Count = count;
+			state->Next = 0;
+			state->Done = 0;
+			int taskCount = Basic::Math::Min(count - 1, GetThreadCount());
+			for (int t = 0; t < taskCount; t++)
+				Submit([state]() { RunParallelFor(*state); }, priority);
+			RunParallelFor(*state);
+			// helpers that have not started yet find nothing left and never touch body
+			std::unique_lock<std::mutex> lock(state->Mutex);
+			state->AllDone.wait(lock, [&]() { return state->Done.load(std::memory_order_acquire) == count; });
+			if (state->Error)
+				std::rethrow_exception(state->Error);
+		}
+
+		TaskGroup::TaskGroup(ThreadPool & threadPool)
+			: pool(threadPool), state(std::make_shared<State>())
+		{
+			state->Pending = 0;
+		}
+
+		TaskGroup::~TaskGroup()
+		{
+			try
+			{
+				Wait();
+			}
+			catch (...)
+			{
+			}
+		}
+
+		void TaskGroup::Submit(const ThreadPool::Task & task, TaskPriority priority)
+		{
+			state->Pending.fetch_add(1, std::memory_order_relaxed);
+			std::shared_ptr<State> groupState = state;
+			pool.Submit([groupState, task]()
+			{
+				try
+				{
+					task();
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(groupState->ErrorLock);
+					if (!groupState->Error)
+						groupState->Error = std::current_exception();
+				}
+				if (groupState->Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					groupState->Finished.Notify();
+			}, priority);
+		}
+
+		void TaskGroup::Wait()
+		{
+			while (state->Pending.load(std::memory_order_acquire) != 0)
+			{
+				ThreadPool::Task * task = pool.TryTakeTask();
+				if (task)
+				{
+					pool.RunTask(task);
+					continue;
+				}
+				// the tasks of the group are all running; they finish without help
+				int key = state->Finished.PrepareWait();
+				if (state->Pending.load(std::memory_order_acquire) == 0)
+				{
+					state->Finished.CancelWait();
+					break;
+				}
+				state->Finished.Wait(key);
+			}
+			std::exception_ptr error;
+			{
+				std::lock_guard<std::mutex> lock(state->ErrorLock);
+				error = state->Error;
+				state->Error = std::exception_ptr();
+			}
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		ThreadPool & ThreadPool::Global()
+		{
+			static std::once_flag created;
+			static ThreadPool * pool = 0;
+			std::call_once(created, []() { pool = new ThreadPool(); });
+			return *pool;
+		}
+	}
+}
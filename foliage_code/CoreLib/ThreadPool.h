@@ -0,0 +1,101 @@
+#ifndef CORE_LIB_THREAD_POOL_H
+#define CORE_LIB_THREAD_POOL_H
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "ConcurrentQueue.h"
+
+namespace CoreLib
+{
+	namespace Threading
+	{
+		enum class TaskPriority
+		{
+			High, Normal, Low
+		};
+
+		class TaskGroup;
+
+		// Fixed set of worker threads running submitted tasks. Workers always take the highest
+		// priority task available; tasks of the same priority start in submission order.
+		class ThreadPool : public CoreLib::Basic::Object
+		{
+			friend class TaskGroup;
+		public:
+			typedef std::function<void()> Task;
+		private:
+			static const int PriorityCount = 3;
+			MpmcQueue<Task*> * queues[PriorityCount];
+			EventCount taskAvailable, taskFinished;
+			std::atomic<int> pendingTasks;
+			std::atomic<bool> stopping;
+			// first exception thrown by a task since the last WaitAll
+			std::mutex errorLock;
+			std::exception_ptr taskError;
+			CoreLib::Basic::List<std::thread> workers;
+			ThreadPool(const ThreadPool &) = delete;
+			ThreadPool & operator = (const ThreadPool &) = delete;
+			Task * TryTakeTask();
+			void RunTask(Task * task);
+			void WorkerMain();
+		public:
+			// threadCount <= 0 uses one thread per hardware thread
+			ThreadPool(int threadCount = 0, int queueCapacity = 4096);
+			// runs the tasks already submitted, then stops the workers
+			~ThreadPool();
+			int GetThreadCount() const
+			{
+				return workers.Count();
+			}
+			// If the queue for this priority is full the task runs on the calling thread.
+			void Submit(const Task & task, TaskPriority priority = TaskPriority::Normal);
+			// Blocks until every submitted task has finished, then rethrows the first exception a
+			// task threw since the last call. This waits for and reports on everyone's tasks; to
+			// wait for a batch of your own, submit it through a TaskGroup. The calling thread helps out with queued tasks while
+			// it waits. A task of this pool must not call it, as it would wait for itself; that
+			// throws InvalidOperationException.
+			void WaitAll();
+			// Calls body(i) for every i in [0, count), spread over the workers and the calling
+			// thread, and returns when all calls have finished. The caller only waits on items
+			// already running, never on queued helper tasks, so it may be called from a task of
+			// this pool. Rethrows the first exception a call threw.
+			void ParallelFor(int count, const std::function<void(int)> & body, TaskPriority priority = TaskPriority::High);
+			// Shared pool for loading work, created on first use.
+			static ThreadPool & Global();
+		};
+
+		// A batch of tasks on a pool that is waited on by itself: Wait returns once the tasks
+		// submitted through this group have finished, whatever else the pool is running, and
+		// rethrows the first exception one of them threw. Their exceptions never reach
+		// ThreadPool::WaitAll or another group.
+		class TaskGroup : public CoreLib::Basic::Object
+		{
+		private:
+			// shared with the submitted tasks, which may still be signalling after Wait returned
+			struct State
+			{
+				std::atomic<int> Pending;
+				EventCount Finished;
+				std::mutex ErrorLock;
+				std::exception_ptr Error;
+			};
+			ThreadPool & pool;
+			std::shared_ptr<State> state;
+			TaskGroup(const TaskGroup &) = delete;
+			TaskGroup & operator = (const TaskGroup &) = delete;
+		public:
+			TaskGroup(ThreadPool & pool);
+			// waits for the tasks still running, dropping their exceptions
+			~TaskGroup();
+			void Submit(const ThreadPool::Task & task, TaskPriority priority = TaskPriority::Normal);
+			// Blocks until the tasks of this group have finished, helping out with queued tasks of
+			// the pool meanwhile, then rethrows the first exception they threw since the last call.
+			// May be called from a task of the pool, as long as it is not a task of this group.
+			void Wait();
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "Threading.h"
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace CoreLib
+{
+	namespace Threading
+	{
+		void EventCount::WakeAll()
+		{
+#ifdef __linux__
+			epoch.fetch_add(1, std::memory_order_release);
+			if (mode == WaitMode::Futex)
+				syscall(SYS_futex, (int*)&epoch, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+#else
+			if (mode == WaitMode::Futex)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					epoch.fetch_add(1, std::memory_order_release);
+				}
+				condition.notify_all();
+			}
+			else
+				epoch.fetch_add(1, std::memory_order_release);
+#endif
+		}
+
+		void EventCount::Sleep(int key)
+		{
+			if (mode == WaitMode::Spin)
+			{
+				int spins = 0;
+				while (epoch.load(std::memory_order_acquire) == key)
+				{
+					if (++spins > 64)
+						std::this_thread::yield();
+				}
+				return;
+			}
+#ifdef __linux__
+			// returns immediately with EAGAIN if the epoch already moved past key
+			while (epoch.load(std::memory_order_acquire) == key)
+				syscall(SYS_futex, (int*)&epoch, FUTEX_WAIT_PRIVATE, key, 0, 0, 0);
+#else
+			std::unique_lock<std::mutex> lock(mutex);
+			while (epoch.load(std::memory_order_acquire) == key)
+				condition.wait(lock);
+#endif
+		}
+
+		void EventCount::Wait(int key)
+		{
+			Sleep(key);
+			waiters.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+}
@@ -2,6 +2,10 @@
 #define CORE_LIB_THREADING_H
 #include <atomic>
 #include <thread>
+#ifndef __linux__
+#include <mutex>
+#include <condition_variable>
+#endif
 #include "Basic.h"
 
 namespace CoreLib
@@ -19,15 +23,64 @@ namespace CoreLib
 			}
 			inline bool TryLock()
 			{
-				return (lock.exchange(1, std::memory_order_relaxed) == 0);
+				return (lock.exchange(1, std::memory_order_acquire) == 0);
 			}
 			inline void Lock()
 			{
-				while (lock.exchange(1, std::memory_order_relaxed) != 0);
+				while (lock.exchange(1, std::memory_order_acquire) != 0)
+				{
+					// spin on a plain load so waiters don't keep stealing the cache line
+					while (lock.load(std::memory_order_relaxed) != 0)
+						std::this_thread::yield();
+				}
 			}
 			inline void Unlock()
 			{
-				lock.exchange(0, std::memory_order_relaxed);
+				lock.store(0, std::memory_order_release);
+			}
+		};
+
+		enum class WaitMode
+		{
+			Spin, // busy wait with backoff, never enters the kernel
+			Futex // sleep in the kernel (futex on Linux, condition variable elsewhere)
+		};
+
+		// Lets threads sleep until some condition they poll for may have changed.
+		// Waiter: key = PrepareWait(); re-check condition; then Wait(key) or CancelWait().
+		// Notifier: make the condition true, then Notify().
+		class EventCount
+		{
+		private:
+			std::atomic<int> epoch;
+			std::atomic<int> waiters;
+			WaitMode mode;
+#ifndef __linux__
+			std::mutex mutex;
+			std::condition_variable condition;
+#endif
+			void WakeAll();
+			void Sleep(int key);
+		public:
+			EventCount(WaitMode waitMode = WaitMode::Futex)
+				: epoch(0), waiters(0), mode(waitMode)
+			{}
+			inline int PrepareWait()
+			{
+				waiters.fetch_add(1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				return epoch.load(std::memory_order_acquire);
+			}
+			inline void CancelWait()
+			{
+				waiters.fetch_sub(1, std::memory_order_relaxed);
+			}
+			void Wait(int key);
+			inline void Notify()
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (waiters.load(std::memory_order_relaxed) != 0)
+					WakeAll();
 			}
 		};
 	}
@@ -1,12 +1,13 @@
 #include "VectorMath.h"
+#include "FastMath.h"
 
 namespace VectorMath
 {
 	const __m128 Matrix4_M128::VecOne = _mm_set_ps1(1.0f);
 	void Matrix4::Rotation(Matrix4 & rs, const Vec3 & axis, float angle)
 	{
-		float c = cosf(angle);
-		float s = sinf(angle);
+		float c, s;
+		FastMath::SinCos(angle, s, c);
 		float t = 1.0f - c;
 
 		Vec3 nAxis;
@@ -0,0 +1,50 @@
+#include "VectorMathWide.h"
+#include "SimdKernels.h"
+
+using namespace CoreLib::Basic;
+
+namespace VectorMath
+{
+	void TransformPoints(Vec3 * rs, const Matrix4 & m, const Vec3 * points, int count)
+	{
+		GetSimdKernels().TransformPoints(rs, m, points, count);
+	}
+
+	void TransformNormals(Vec3 * rs, const Matrix4 & m, const Vec3 * normals, int count)
+	{
+		GetSimdKernels().TransformNormals(rs, m, normals, count);
+	}
+
+	void TransformPointsHomogeneous(Vec3 * rs, const Matrix4 & m, const Vec3 * points, int count)
+	{
+		GetSimdKernels().TransformPointsHomogeneous(rs, m, points, count);
+	}
+
+	void TransformPoints(List<Vec3> & rs, const Matrix4 & m, const List<Vec3> & points)
+	{
+		rs.SetSize(points.Count());
+		TransformPoints(rs.Buffer(), m, points.Buffer(), points.Count());
+	}
+
+	void TransformNormals(List<Vec3> & rs, const Matrix4 & m, const List<Vec3> & normals)
+	{
+		rs.SetSize(normals.Count());
+		TransformNormals(rs.Buffer(), m, normals.Buffer(), normals.Count());
+	}
+
+	void TransformPointsHomogeneous(List<Vec3> & rs, const Matrix4 & m, const List<Vec3> & points)
+	{
+		rs.SetSize(points.Count());
+		TransformPointsHomogeneous(rs.Buffer(), m, points.Buffer(), points.Count());
+	}
+
+	void NormalizeAll(Vec3 * vectors, int count)
+	{
+		GetSimdKernels().NormalizeAll(vectors, count);
+	}
+
+	int CullSpheres(const Vec4 * planes, int planeCount, const Vec3 * centers, const float * radii, int count, int * visible)
+	{
+		return GetSimdKernels().CullSpheres(planes, planeCount, centers, radii, count, visible);
+	}
+}
@@ -0,0 +1,1029 @@
+#ifndef VECTOR_MATH_WIDE_H
+#define VECTOR_MATH_WIDE_H
+
+#include "VectorMath.h"
+#include "List.h"
+
+// Structure-of-arrays math over 4, 8 and 16 lanes. Each width uses the widest instruction set
+// the translation unit is compiled for and falls back to two halves of the next narrower width,
+// or to plain floats without SSE (or with VECTOR_MATH_WIDE_NO_SIMD defined). No backend uses
+// FMA, so every backend gives the same results.
+#if !defined(VECTOR_MATH_WIDE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VECTOR_MATH_WIDE_SSE
+#include <emmintrin.h>
+#endif
+#if defined(VECTOR_MATH_WIDE_SSE) && defined(__AVX2__)
+#define VECTOR_MATH_WIDE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(VECTOR_MATH_WIDE_AVX2) && defined(__AVX512F__)
+#define VECTOR_MATH_WIDE_AVX512
+#endif
+
+// The types live in a namespace named after the instruction set, so the SIMD kernels built
+// for several tiers (SimdKernels.h) never share the inline functions of another tier.
+#if defined(VECTOR_MATH_WIDE_AVX512)
+#define VECTOR_MATH_WIDE_TIER Wide_Avx512
+#elif defined(VECTOR_MATH_WIDE_AVX2)
+#define VECTOR_MATH_WIDE_TIER Wide_Avx2
+#elif defined(VECTOR_MATH_WIDE_SSE)
+#define VECTOR_MATH_WIDE_TIER Wide_Sse2
+#else
+#define VECTOR_MATH_WIDE_TIER Wide_Scalar
+#endif
+
+namespace VectorMath
+{
+namespace VECTOR_MATH_WIDE_TIER
+{
+	// Lane-wise comparison result. Bit i of GetBits() is lane i.
+	template<int N>
+	class FloatScalarMask
+	{
+	public:
+		int Bits;
+		FloatScalarMask()
+		{}
+		FloatScalarMask(int bits)
+			:Bits(bits)
+		{}
+		inline FloatScalarMask operator & (const FloatScalarMask & m) const
+		{
+			return FloatScalarMask(Bits & m.Bits);
+		}
+		inline FloatScalarMask operator | (const FloatScalarMask & m) const
+		{
+			return FloatScalarMask(Bits | m.Bits);
+		}
+		inline FloatScalarMask operator ^ (const FloatScalarMask & m) const
+		{
+			return FloatScalarMask(Bits ^ m.Bits);
+		}
+		inline FloatScalarMask operator ~ () const
+		{
+			return FloatScalarMask(~Bits & ((1<<N)-1));
+		}
+		inline int GetBits() const
+		{
+			return Bits;
+		}
+		inline bool Any() const
+		{
+			return Bits != 0;
+		}
+		inline bool All() const
+		{
+			return Bits == (1<<N)-1;
+		}
+	};
+
+	template<int N>
+	class FloatScalar
+	{
+	public:
+		typedef FloatScalarMask<N> Mask;
+		static const int Width = N;
+		float v[N];
+		FloatScalar()
+		{}
+		FloatScalar(float s)
+		{
+			for (int i = 0; i<N; i++)
+				v[i] = s;
+		}
+		inline static FloatScalar Load(const float * p)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+				rs.v[i] = p[i];
+			return rs;
+		}
+		inline void Store(float * p) const
+		{
+			for (int i = 0; i<N; i++)
+				p[i] = v[i];
+		}
+		// loads N Vec3 stored one after another
+		inline static void Load3(const float * p, FloatScalar & x, FloatScalar & y, FloatScalar & z)
+		{
+			for (int i = 0; i<N; i++)
+			{
+				x.v[i] = p[i*3];
+				y.v[i] = p[i*3+1];
+				z.v[i] = p[i*3+2];
+			}
+		}
+		inline static void Store3(float * p, const FloatScalar & x, const FloatScalar & y, const FloatScalar & z)
+		{
+			for (int i = 0; i<N; i++)
+			{
+				p[i*3] = x.v[i];
+				p[i*3+1] = y.v[i];
+				p[i*3+2] = z.v[i];
+			}
+		}
+#define VECTOR_MATH_WIDE_SCALAR_OP(op) \
+		inline FloatScalar operator op (const FloatScalar & b) const \
+		{ \
+			FloatScalar rs; \
+			for (int i = 0; i<N; i++) \
+				rs.v[i] = v[i] op b.v[i]; \
+			return rs; \
+		} \
+		inline FloatScalar & operator op##= (const FloatScalar & b) \
+		{ \
+			for (int i = 0; i<N; i++) \
+				v[i] = v[i] op b.v[i]; \
+			return *this; \
+		}
+		VECTOR_MATH_WIDE_SCALAR_OP(+)
+		VECTOR_MATH_WIDE_SCALAR_OP(-)
+		VECTOR_MATH_WIDE_SCALAR_OP(*)
+		VECTOR_MATH_WIDE_SCALAR_OP(/)
+#undef VECTOR_MATH_WIDE_SCALAR_OP
+#define VECTOR_MATH_WIDE_SCALAR_CMP(op) \
+		inline Mask operator op (const FloatScalar & b) const \
+		{ \
+			int bits = 0; \
+			for (int i = 0; i<N; i++) \
+				if (v[i] op b.v[i]) \
+					bits |= 1<<i; \
+			return Mask(bits); \
+		}
+		VECTOR_MATH_WIDE_SCALAR_CMP(<)
+		VECTOR_MATH_WIDE_SCALAR_CMP(<=)
+		VECTOR_MATH_WIDE_SCALAR_CMP(>)
+		VECTOR_MATH_WIDE_SCALAR_CMP(>=)
+		VECTOR_MATH_WIDE_SCALAR_CMP(==)
+		VECTOR_MATH_WIDE_SCALAR_CMP(!=)
+#undef VECTOR_MATH_WIDE_SCALAR_CMP
+		inline FloatScalar operator - () const
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+				rs.v[i] = -v[i];
+			return rs;
+		}
+		inline static FloatScalar Min(const FloatScalar & a, const FloatScalar & b)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+				rs.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+			return rs;
+		}
+		inline static FloatScalar Max(const FloatScalar & a, const FloatScalar & b)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+				rs.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+			return rs;
+		}
+		inline static FloatScalar Sqrt(const FloatScalar & a)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+				rs.v[i] = sqrtf(a.v[i]);
+			return rs;
+		}
+		inline static FloatScalar Abs(const FloatScalar & a)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+				rs.v[i] = fabsf(a.v[i]);
+			return rs;
+		}
+		// Bit-level helpers for FastMath.h. Exp2Int(n) is 2^n for whole n in [-126, 127].
+		inline static FloatScalar Exp2Int(const FloatScalar & n)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+			{
+				int bits = ((int)n.v[i] + 127) << 23;
+				memcpy(&rs.v[i], &bits, sizeof(float));
+			}
+			return rs;
+		}
+		// a = m * 2^exponent with m in [1, 2), for positive normal a
+		inline static FloatScalar Frexp(const FloatScalar & a, FloatScalar & exponent)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+			{
+				int bits;
+				memcpy(&bits, &a.v[i], sizeof(float));
+				exponent.v[i] = (float)(((bits >> 23) & 255) - 127);
+				bits = (bits & 0x007FFFFF) | 0x3F800000;
+				memcpy(&rs.v[i], &bits, sizeof(float));
+			}
+			return rs;
+		}
+		// 1/sqrt(a) within 3.5%, by halving the exponent bits
+		inline static FloatScalar RsqrtEstimate(const FloatScalar & a)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+			{
+				int bits;
+				memcpy(&bits, &a.v[i], sizeof(float));
+				bits = 0x5F375A86 - (bits >> 1);
+				memcpy(&rs.v[i], &bits, sizeof(float));
+			}
+			return rs;
+		}
+		// a where m is set, b elsewhere
+		inline static FloatScalar Select(const Mask & m, const FloatScalar & a, const FloatScalar & b)
+		{
+			FloatScalar rs;
+			for (int i = 0; i<N; i++)
+				rs.v[i] = (m.Bits>>i)&1 ? a.v[i] : b.v[i];
+			return rs;
+		}
+	};
+
+	// Twice the width of H, as two halves.
+	template<typename H>
+	class FloatPairMask
+	{
+	public:
+		typename H::Mask Lo, Hi;
+		FloatPairMask()
+		{}
+		FloatPairMask(const typename H::Mask & lo, const typename H::Mask & hi)
+			:Lo(lo), Hi(hi)
+		{}
+		inline FloatPairMask operator & (const FloatPairMask & m) const
+		{
+			return FloatPairMask(Lo & m.Lo, Hi & m.Hi);
+		}
+		inline FloatPairMask operator | (const FloatPairMask & m) const
+		{
+			return FloatPairMask(Lo | m.Lo, Hi | m.Hi);
+		}
+		inline FloatPairMask operator ^ (const FloatPairMask & m) const
+		{
+			return FloatPairMask(Lo ^ m.Lo, Hi ^ m.Hi);
+		}
+		inline FloatPairMask operator ~ () const
+		{
+			return FloatPairMask(~Lo, ~Hi);
+		}
+		inline int GetBits() const
+		{
+			return Lo.GetBits() | (Hi.GetBits() << H::Width);
+		}
+		inline bool Any() const
+		{
+			return Lo.Any() || Hi.Any();
+		}
+		inline bool All() const
+		{
+			return Lo.All() && Hi.All();
+		}
+	};
+
+	template<typename H>
+	class FloatPair
+	{
+	public:
+		typedef FloatPairMask<H> Mask;
+		static const int Width = H::Width * 2;
+		H Lo, Hi;
+		FloatPair()
+		{}
+		FloatPair(float s)
+			:Lo(s), Hi(s)
+		{}
+		FloatPair(const H & lo, const H & hi)
+			:Lo(lo), Hi(hi)
+		{}
+		inline static FloatPair Load(const float * p)
+		{
+			return FloatPair(H::Load(p), H::Load(p + H::Width));
+		}
+		inline void Store(float * p) const
+		{
+			Lo.Store(p);
+			Hi.Store(p + H::Width);
+		}
+		inline static void Load3(const float * p, FloatPair & x, FloatPair & y, FloatPair & z)
+		{
+			H::Load3(p, x.Lo, y.Lo, z.Lo);
+			H::Load3(p + H::Width*3, x.Hi, y.Hi, z.Hi);
+		}
+		inline static void Store3(float * p, const FloatPair & x, const FloatPair & y, const FloatPair & z)
+		{
+			H::Store3(p, x.Lo, y.Lo, z.Lo);
+			H::Store3(p + H::Width*3, x.Hi, y.Hi, z.Hi);
+		}
+#define VECTOR_MATH_WIDE_PAIR_OP(op) \
+		inline FloatPair operator op (const FloatPair & b) const \
+		{ \
+			return FloatPair(Lo op b.Lo, Hi op b.Hi); \
+		} \
+		inline FloatPair & operator op##= (const FloatPair & b) \
+		{ \
+			Lo op##= b.Lo; \
+			Hi op##= b.Hi; \
+			return *this; \
+		}
+		VECTOR_MATH_WIDE_PAIR_OP(+)
+		VECTOR_MATH_WIDE_PAIR_OP(-)
+		VECTOR_MATH_WIDE_PAIR_OP(*)
+		VECTOR_MATH_WIDE_PAIR_OP(/)
+#undef VECTOR_MATH_WIDE_PAIR_OP
+#define VECTOR_MATH_WIDE_PAIR_CMP(op) \
+		inline Mask operator op (const FloatPair & b) const \
+		{ \
+			return Mask(Lo op b.Lo, Hi op b.Hi); \
+		}
+		VECTOR_MATH_WIDE_PAIR_CMP(<)
+		VECTOR_MATH_WIDE_PAIR_CMP(<=)
+		VECTOR_MATH_WIDE_PAIR_CMP(>)
+		VECTOR_MATH_WIDE_PAIR_CMP(>=)
+		VECTOR_MATH_WIDE_PAIR_CMP(==)
+		VECTOR_MATH_WIDE_PAIR_CMP(!=)
+#undef VECTOR_MATH_WIDE_PAIR_CMP
+		inline FloatPair operator - () const
+		{
+			return FloatPair(-Lo, -Hi);
+		}
+		inline static FloatPair Min(const FloatPair & a, const FloatPair & b)
+		{
+			return FloatPair(H::Min(a.Lo, b.Lo), H::Min(a.Hi, b.Hi));
+		}
+		inline static FloatPair Max(const FloatPair & a, const FloatPair & b)
+		{
+			return FloatPair(H::Max(a.Lo, b.Lo), H::Max(a.Hi, b.Hi));
+		}
+		inline static FloatPair Sqrt(const FloatPair & a)
+		{
+			return FloatPair(H::Sqrt(a.Lo), H::Sqrt(a.Hi));
+		}
+		inline static FloatPair Abs(const FloatPair & a)
+		{
+			return FloatPair(H::Abs(a.Lo), H::Abs(a.Hi));
+		}
+		inline static FloatPair Exp2Int(const FloatPair & n)
+		{
+			return FloatPair(H::Exp2Int(n.Lo), H::Exp2Int(n.Hi));
+		}
+		inline static FloatPair Frexp(const FloatPair & a, FloatPair & exponent)
+		{
+			return FloatPair(H::Frexp(a.Lo, exponent.Lo), H::Frexp(a.Hi, exponent.Hi));
+		}
+		inline static FloatPair RsqrtEstimate(const FloatPair & a)
+		{
+			return FloatPair(H::RsqrtEstimate(a.Lo), H::RsqrtEstimate(a.Hi));
+		}
+		inline static FloatPair Select(const Mask & m, const FloatPair & a, const FloatPair & b)
+		{
+			return FloatPair(H::Select(m.Lo, a.Lo, b.Lo), H::Select(m.Hi, a.Hi, b.Hi));
+		}
+	};
+
+#ifdef VECTOR_MATH_WIDE_SSE
+	// p holds x0 y0 z0 x1 y1 z1 x2 y2 z2 x3 y3 z3
+	inline void LoadTransposed3x4(const float * p, __m128 & x, __m128 & y, __m128 & z)
+	{
+		__m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+		x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+		y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+		z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), c, _MM_SHUFFLE(3,0,2,0));
+	}
+	inline void StoreTransposed3x4(float * p, __m128 x, __m128 y, __m128 z)
+	{
+		_mm_storeu_ps(p, _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0,0,0,0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0)));
+		_mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1,1,1,1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0)));
+		_mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3,3,2,2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0)));
+	}
+
+	class FloatSSEMask
+	{
+	public:
+		__m128 m;
+		FloatSSEMask()
+		{}
+		FloatSSEMask(__m128 m)
+			:m(m)
+		{}
+		inline FloatSSEMask operator & (const FloatSSEMask & b) const
+		{
+			return _mm_and_ps(m, b.m);
+		}
+		inline FloatSSEMask operator | (const FloatSSEMask & b) const
+		{
+			return _mm_or_ps(m, b.m);
+		}
+		inline FloatSSEMask operator ^ (const FloatSSEMask & b) const
+		{
+			return _mm_xor_ps(m, b.m);
+		}
+		inline FloatSSEMask operator ~ () const
+		{
+			return _mm_xor_ps(m, _mm_castsi128_ps(_mm_set1_epi32(-1)));
+		}
+		inline int GetBits() const
+		{
+			return _mm_movemask_ps(m);
+		}
+		inline bool Any() const
+		{
+			return GetBits() != 0;
+		}
+		inline bool All() const
+		{
+			return GetBits() == 0xF;
+		}
+	};
+
+	class FloatSSE
+	{
+	public:
+		typedef FloatSSEMask Mask;
+		static const int Width = 4;
+		__m128 v;
+		FloatSSE()
+		{}
+		FloatSSE(float s)
+			:v(_mm_set1_ps(s))
+		{}
+		FloatSSE(__m128 v)
+			:v(v)
+		{}
+		inline static FloatSSE Load(const float * p)
+		{
+			return _mm_loadu_ps(p);
+		}
+		inline void Store(float * p) const
+		{
+			_mm_storeu_ps(p, v);
+		}
+		inline static void Load3(const float * p, FloatSSE & x, FloatSSE & y, FloatSSE & z)
+		{
+			LoadTransposed3x4(p, x.v, y.v, z.v);
+		}
+		inline static void Store3(float * p, const FloatSSE & x, const FloatSSE & y, const FloatSSE & z)
+		{
+			StoreTransposed3x4(p, x.v, y.v, z.v);
+		}
+		inline FloatSSE operator + (const FloatSSE & b) const { return _mm_add_ps(v, b.v); }
+		inline FloatSSE operator - (const FloatSSE & b) const { return _mm_sub_ps(v, b.v); }
+		inline FloatSSE operator * (const FloatSSE & b) const { return _mm_mul_ps(v, b.v); }
+		inline FloatSSE operator / (const FloatSSE & b) const { return _mm_div_ps(v, b.v); }
+		inline FloatSSE & operator += (const FloatSSE & b) { v = _mm_add_ps(v, b.v); return *this; }
+		inline FloatSSE & operator -= (const FloatSSE & b) { v = _mm_sub_ps(v, b.v); return *this; }
+		inline FloatSSE & operator *= (const FloatSSE & b) { v = _mm_mul_ps(v, b.v); return *this; }
+		inline FloatSSE & operator /= (const FloatSSE & b) { v = _mm_div_ps(v, b.v); return *this; }
+		inline Mask operator < (const FloatSSE & b) const { return _mm_cmplt_ps(v, b.v); }
+		inline Mask operator <= (const FloatSSE & b) const { return _mm_cmple_ps(v, b.v); }
+		inline Mask operator > (const FloatSSE & b) const { return _mm_cmpgt_ps(v, b.v); }
+		inline Mask operator >= (const FloatSSE & b) const { return _mm_cmpge_ps(v, b.v); }
+		inline Mask operator == (const FloatSSE & b) const { return _mm_cmpeq_ps(v, b.v); }
+		inline Mask operator != (const FloatSSE & b) const { return _mm_cmpneq_ps(v, b.v); }
+		inline FloatSSE operator - () const
+		{
+			return _mm_xor_ps(v, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000)));
+		}
+		// a < b ? a : b, also for NaN and signed zeros
+		inline static FloatSSE Min(const FloatSSE & a, const FloatSSE & b)
+		{
+			return _mm_min_ps(a.v, b.v);
+		}
+		inline static FloatSSE Max(const FloatSSE & a, const FloatSSE & b)
+		{
+			return _mm_max_ps(a.v, b.v);
+		}
+		inline static FloatSSE Sqrt(const FloatSSE & a)
+		{
+			return _mm_sqrt_ps(a.v);
+		}
+		inline static FloatSSE Abs(const FloatSSE & a)
+		{
+			return _mm_and_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+		}
+		inline static FloatSSE Exp2Int(const FloatSSE & n)
+		{
+			return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127)), 23));
+		}
+		inline static FloatSSE Frexp(const FloatSSE & a, FloatSSE & exponent)
+		{
+			__m128i bits = _mm_castps_si128(a.v);
+			exponent.v = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(255)), _mm_set1_epi32(127)));
+			return _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000)));
+		}
+		inline static FloatSSE RsqrtEstimate(const FloatSSE & a)
+		{
+			return _mm_castsi128_ps(_mm_sub_epi32(_mm_set1_epi32(0x5F375A86), _mm_srai_epi32(_mm_castps_si128(a.v), 1)));
+		}
+		inline static FloatSSE Select(const Mask & m, const FloatSSE & a, const FloatSSE & b)
+		{
+			return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+		}
+	};
+	typedef FloatSSE FloatX4;
+#else
+	typedef FloatScalar<4> FloatX4;
+#endif
+
+#ifdef VECTOR_MATH_WIDE_AVX2
+	class FloatAVXMask
+	{
+	public:
+		__m256 m;
+		FloatAVXMask()
+		{}
+		FloatAVXMask(__m256 m)
+			:m(m)
+		{}
+		inline FloatAVXMask operator & (const FloatAVXMask & b) const
+		{
+			return _mm256_and_ps(m, b.m);
+		}
+		inline FloatAVXMask operator | (const FloatAVXMask & b) const
+		{
+			return _mm256_or_ps(m, b.m);
+		}
+		inline FloatAVXMask operator ^ (const FloatAVXMask & b) const
+		{
+			return _mm256_xor_ps(m, b.m);
+		}
+		inline FloatAVXMask operator ~ () const
+		{
+			return _mm256_xor_ps(m, _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+		}
+		inline int GetBits() const
+		{
+			return _mm256_movemask_ps(m);
+		}
+		inline bool Any() const
+		{
+			return GetBits() != 0;
+		}
+		inline bool All() const
+		{
+			return GetBits() == 0xFF;
+		}
+	};
+
+	class FloatAVX
+	{
+	public:
+		typedef FloatAVXMask Mask;
+		static const int Width = 8;
+		__m256 v;
+		FloatAVX()
+		{}
+		FloatAVX(float s)
+			:v(_mm256_set1_ps(s))
+		{}
+		FloatAVX(__m256 v)
+			:v(v)
+		{}
+		inline static FloatAVX Load(const float * p)
+		{
+			return _mm256_loadu_ps(p);
+		}
+		inline void Store(float * p) const
+		{
+			_mm256_storeu_ps(p, v);
+		}
+		inline static void Load3(const float * p, FloatAVX & x, FloatAVX & y, FloatAVX & z)
+		{
+			__m128 x0, y0, z0, x1, y1, z1;
+			LoadTransposed3x4(p, x0, y0, z0);
+			LoadTransposed3x4(p + 12, x1, y1, z1);
+			x.v = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+			y.v = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+			z.v = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+		}
+		inline static void Store3(float * p, const FloatAVX & x, const FloatAVX & y, const FloatAVX & z)
+		{
+			StoreTransposed3x4(p, _mm256_castps256_ps128(x.v), _mm256_castps256_ps128(y.v), _mm256_castps256_ps128(z.v));
+			StoreTransposed3x4(p + 12, _mm256_extractf128_ps(x.v, 1), _mm256_extractf128_ps(y.v, 1), _mm256_extractf128_ps(z.v, 1));
+		}
+		inline FloatAVX operator + (const FloatAVX & b) const { return _mm256_add_ps(v, b.v); }
+		inline FloatAVX operator - (const FloatAVX & b) const { return _mm256_sub_ps(v, b.v); }
+		inline FloatAVX operator * (const FloatAVX & b) const { return _mm256_mul_ps(v, b.v); }
+		inline FloatAVX operator / (const FloatAVX & b) const { return _mm256_div_ps(v, b.v); }
+		inline FloatAVX & operator += (const FloatAVX & b) { v = _mm256_add_ps(v, b.v); return *this; }
+		inline FloatAVX & operator -= (const FloatAVX & b) { v = _mm256_sub_ps(v, b.v); return *this; }
+		inline FloatAVX & operator *= (const FloatAVX & b) { v = _mm256_mul_ps(v, b.v); return *this; }
+		inline FloatAVX & operator /= (const FloatAVX & b) { v = _mm256_div_ps(v, b.v); return *this; }
+		inline Mask operator < (const FloatAVX & b) const { return _mm256_cmp_ps(v, b.v, _CMP_LT_OQ); }
+		inline Mask operator <= (const FloatAVX & b) const { return _mm256_cmp_ps(v, b.v, _CMP_LE_OQ); }
+		inline Mask operator > (const FloatAVX & b) const { return _mm256_cmp_ps(v, b.v, _CMP_GT_OQ); }
+		inline Mask operator >= (const FloatAVX & b) const { return _mm256_cmp_ps(v, b.v, _CMP_GE_OQ); }
+		inline Mask operator == (const FloatAVX & b) const { return _mm256_cmp_ps(v, b.v, _CMP_EQ_OQ); }
+		inline Mask operator != (const FloatAVX & b) const { return _mm256_cmp_ps(v, b.v, _CMP_NEQ_UQ); }
+		inline FloatAVX operator - () const
+		{
+			return _mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000)));
+		}
+		inline static FloatAVX Min(const FloatAVX & a, const FloatAVX & b)
+		{
+			return _mm256_min_ps(a.v, b.v);
+		}
+		inline static FloatAVX Max(const FloatAVX & a, const FloatAVX & b)
+		{
+			return _mm256_max_ps(a.v, b.v);
+		}
+		inline static FloatAVX Sqrt(const FloatAVX & a)
+		{
+			return _mm256_sqrt_ps(a.v);
+		}
+		inline static FloatAVX Abs(const FloatAVX & a)
+		{
+			return _mm256_and_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)));
+		}
+		inline static FloatAVX Exp2Int(const FloatAVX & n)
+		{
+			return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127)), 23));
+		}
+		inline static FloatAVX Frexp(const FloatAVX & a, FloatAVX & exponent)
+		{
+			__m256i bits = _mm256_castps_si256(a.v);
+			exponent.v = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(255)), _mm256_set1_epi32(127)));
+			return _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000)));
+		}
+		inline static FloatAVX RsqrtEstimate(const FloatAVX & a)
+		{
+			return _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_set1_epi32(0x5F375A86), _mm256_srai_epi32(_mm256_castps_si256(a.v), 1)));
+		}
+		inline static FloatAVX Select(const Mask & m, const FloatAVX & a, const FloatAVX & b)
+		{
+			return _mm256_blendv_ps(b.v, a.v, m.m);
+		}
+	};
+	typedef FloatAVX FloatX8;
+#else
+	typedef FloatPair<FloatX4> FloatX8;
+#endif
+
+#ifdef VECTOR_MATH_WIDE_AVX512
+	class FloatAVX512Mask
+	{
+	public:
+		__mmask16 m;
+		FloatAVX512Mask()
+		{}
+		FloatAVX512Mask(__mmask16 m)
+			:m(m)
+		{}
+		inline FloatAVX512Mask operator & (const FloatAVX512Mask & b) const
+		{
+			return (__mmask16)(m & b.m);
+		}
+		inline FloatAVX512Mask operator | (const FloatAVX512Mask & b) const
+		{
+			return (__mmask16)(m | b.m);
+		}
+		inline FloatAVX512Mask operator ^ (const FloatAVX512Mask & b) const
+		{
+			return (__mmask16)(m ^ b.m);
+		}
+		inline FloatAVX512Mask operator ~ () const
+		{
+			return (__mmask16)(~m);
+		}
+		inline int GetBits() const
+		{
+			return (int)m;
+		}
+		inline bool Any() const
+		{
+			return m != 0;
+		}
+		inline bool All() const
+		{
+			return m == 0xFFFF;
+		}
+	};
+
+	class FloatAVX512
+	{
+	public:
+		typedef FloatAVX512Mask Mask;
+		static const int Width = 16;
+		__m512 v;
+		FloatAVX512()
+		{}
+		FloatAVX512(float s)
+			:v(_mm512_set1_ps(s))
+		{}
+		FloatAVX512(__m512 v)
+			:v(v)
+		{}
+		inline static FloatAVX512 Load(const float * p)
+		{
+			return _mm512_loadu_ps(p);
+		}
+		inline void Store(float * p) const
+		{
+			_mm512_storeu_ps(p, v);
+		}
+		inline static void Load3(const float * p, FloatAVX512 & x, FloatAVX512 & y, FloatAVX512 & z)
+		{
+			__m128 xs[4], ys[4], zs[4];
+			for (int i = 0; i<4; i++)
+				LoadTransposed3x4(p + i*12, xs[i], ys[i], zs[i]);
+			x.v = _mm512_insertf32x4(_mm512_insertf32x4(_mm512_insertf32x4(_mm512_castps128_ps512(xs[0]), xs[1], 1), xs[2], 2), xs[3], 3);
+			y.v = _mm512_insertf32x4(_mm512_insertf32x4(_mm512_insertf32x4(_mm512_castps128_ps512(ys[0]), ys[1], 1), ys[2], 2), ys[3], 3);
+			z.v = _mm512_insertf32x4(_mm512_insertf32x4(_mm512_insertf32x4(_mm512_castps128_ps512(zs[0]), zs[1], 1), zs[2], 2), zs[3], 3);
+		}
+		inline static void Store3(float * p, const FloatAVX512 & x, const FloatAVX512 & y, const FloatAVX512 & z)
+		{
+			StoreTransposed3x4(p, _mm512_extractf32x4_ps(x.v, 0), _mm512_extractf32x4_ps(y.v, 0), _mm512_extractf32x4_ps(z.v, 0));
+			StoreTransposed3x4(p + 12, _mm512_extractf32x4_ps(x.v, 1), _mm512_extractf32x4_ps(y.v, 1), _mm512_extractf32x4_ps(z.v, 1));
+			StoreTransposed3x4(p + 24, _mm512_extractf32x4_ps(x.v, 2), _mm512_extractf32x4_ps(y.v, 2), _mm512_extractf32x4_ps(z.v, 2));
+			StoreTransposed3x4(p + 36, _mm512_extractf32x4_ps(x.v, 3), _mm512_extractf32x4_ps(y.v, 3), _mm512_extractf32x4_ps(z.v, 3));
+		}
+		inline FloatAVX512 operator + (const FloatAVX512 & b) const { return _mm512_add_ps(v, b.v); }
+		inline FloatAVX512 operator - (const FloatAVX512 & b) const { return _mm512_sub_ps(v, b.v); }
+		inline FloatAVX512 operator * (const FloatAVX512 & b) const { return _mm512_mul_ps(v, b.v); }
+		inline FloatAVX512 operator / (const FloatAVX512 & b) const { return _mm512_div_ps(v, b.v); }
+		inline FloatAVX512 & operator += (const FloatAVX512 & b) { v = _mm512_add_ps(v, b.v); return *this; }
+		inline FloatAVX512 & operator -= (const FloatAVX512 & b) { v = _mm512_sub_ps(v, b.v); return *this; }
+		inline FloatAVX512 & operator *= (const FloatAVX512 & b) { v = _mm512_mul_ps(v, b.v); return *this; }
+		inline FloatAVX512 & operator /= (const FloatAVX512 & b) { v = _mm512_div_ps(v, b.v); return *this; }
+		inline Mask operator < (const FloatAVX512 & b) const { return _mm512_cmp_ps_mask(v, b.v, _CMP_LT_OQ); }
+		inline Mask operator <= (const FloatAVX512 & b) const { return _mm512_cmp_ps_mask(v, b.v, _CMP_LE_OQ); }
+		inline Mask operator > (const FloatAVX512 & b) const { return _mm512_cmp_ps_mask(v, b.v, _CMP_GT_OQ); }
+		inline Mask operator >= (const FloatAVX512 & b) const { return _mm512_cmp_ps_mask(v, b.v, _CMP_GE_OQ); }
+		inline Mask operator == (const FloatAVX512 & b) const { return _mm512_cmp_ps_mask(v, b.v, _CMP_EQ_OQ); }
+		inline Mask operator != (const FloatAVX512 & b) const { return _mm512_cmp_ps_mask(v, b.v, _CMP_NEQ_UQ); }
+		inline FloatAVX512 operator - () const
+		{
+			return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v), _mm512_set1_epi32((int)0x80000000)));
+		}
+		inline static FloatAVX512 Min(const FloatAVX512 & a, const FloatAVX512 & b)
+		{
+			return _mm512_min_ps(a.v, b.v);
+		}
+		inline static FloatAVX512 Max(const FloatAVX512 & a, const FloatAVX512 & b)
+		{
+			return _mm512_max_ps(a.v, b.v);
+		}
+		inline static FloatAVX512 Sqrt(const FloatAVX512 & a)
+		{
+			return _mm512_sqrt_ps(a.v);
+		}
+		inline static FloatAVX512 Abs(const FloatAVX512 & a)
+		{
+			return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(0x7FFFFFFF)));
+		}
+		inline static FloatAVX512 Exp2Int(const FloatAVX512 & n)
+		{
+			return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(n.v), _mm512_set1_epi32(127)), 23));
+		}
+		inline static FloatAVX512 Frexp(const FloatAVX512 & a, FloatAVX512 & exponent)
+		{
+			__m512i bits = _mm512_castps_si512(a.v);
+			exponent.v = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_and_si512(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(255)), _mm512_set1_epi32(127)));
+			return _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)), _mm512_set1_epi32(0x3F800000)));
+		}
+		inline static FloatAVX512 RsqrtEstimate(const FloatAVX512 & a)
+		{
+			return _mm512_castsi512_ps(_mm512_sub_epi32(_mm512_set1_epi32(0x5F375A86), _mm512_srai_epi32(_mm512_castps_si512(a.v), 1)));
+		}
+		inline static FloatAVX512 Select(const Mask & m, const FloatAVX512 & a, const FloatAVX512 & b)
+		{
+			return _mm512_mask_blend_ps(m.m, b.v, a.v);
+		}
+	};
+	typedef FloatAVX512 FloatX16;
+#else
+	typedef FloatPair<FloatX8> FloatX16;
+#endif
+
+	// the widest lane type with native support in this translation unit
+#if defined(VECTOR_MATH_WIDE_AVX512)
+	typedef FloatX16 FloatXN;
+#elif defined(VECTOR_MATH_WIDE_AVX2)
+	typedef FloatX8 FloatXN;
+#else
+	typedef FloatX4 FloatXN;
+#endif
+
+	template<typename F>
+	inline float GetLane(const F & v, int lane)
+	{
+		float buffer[F::Width];
+		v.Store(buffer);
+		return buffer[lane];
+	}
+	template<typename F>
+	inline float ReduceMin(const F & v)
+	{
+		float buffer[F::Width];
+		v.Store(buffer);
+		float rs = buffer[0];
+		for (int i = 1; i<F::Width; i++)
+			rs = buffer[i] < rs ? buffer[i] : rs;
+		return rs;
+	}
+	template<typename F>
+	inline float ReduceMax(const F & v)
+	{
+		float buffer[F::Width];
+		v.Store(buffer);
+		float rs = buffer[0];
+		for (int i = 1; i<F::Width; i++)
+			rs = buffer[i] > rs ? buffer[i] : rs;
+		return rs;
+	}
+	template<typename F>
+	inline float ReduceAdd(const F & v)
+	{
+		float buffer[F::Width];
+		v.Store(buffer);
+		float rs = buffer[0];
+		for (int i = 1; i<F::Width; i++)
+			rs += buffer[i];
+		return rs;
+	}
+
+	// F::Width Vec3s, one per lane
+	template<typename F>
+	class Vec3xN
+	{
+	public:
+		typedef typename F::Mask Mask;
+		static const int Width = F::Width;
+		F x, y, z;
+		Vec3xN()
+		{}
+		Vec3xN(const F & x, const F & y, const F & z)
+			:x(x), y(y), z(z)
+		{}
+		Vec3xN(const Vec3 & v)
+			:x(v.x), y(v.y), z(v.z)
+		{}
+		inline static Vec3xN Load(const Vec3 * v)
+		{
+			Vec3xN rs;
+			F::Load3((const float*)v, rs.x, rs.y, rs.z);
+			return rs;
+		}
+		// loads count < Width vectors, the remaining lanes are zero
+		inline static Vec3xN Load(const Vec3 * v, int count)
+		{
+			float buffer[Width*3];
+			memset(buffer, 0, sizeof(buffer));
+			memcpy(buffer, v, sizeof(Vec3)*count);
+			Vec3xN rs;
+			F::Load3(buffer, rs.x, rs.y, rs.z);
+			return rs;
+		}
+		inline void Store(Vec3 * v) const
+		{
+			F::Store3((float*)v, x, y, z);
+		}
+		inline void Store(Vec3 * v, int count) const
+		{
+			float buffer[Width*3];
+			F::Store3(buffer, x, y, z);
+			memcpy((float*)v, buffer, sizeof(Vec3)*count);
+		}
+		inline Vec3 GetLane(int lane) const
+		{
+			return Vec3(VECTOR_MATH_WIDE_TIER::GetLane(x, lane), VECTOR_MATH_WIDE_TIER::GetLane(y, lane), VECTOR_MATH_WIDE_TIER::GetLane(z, lane));
+		}
+		inline Vec3xN operator + (const Vec3xN & v) const
+		{
+			return Vec3xN(x + v.x, y + v.y, z + v.z);
+		}
+		inline Vec3xN operator - (const Vec3xN & v) const
+		{
+			return Vec3xN(x - v.x, y - v.y, z - v.z);
+		}
+		inline Vec3xN operator * (const Vec3xN & v) const
+		{
+			return Vec3xN(x * v.x, y * v.y, z * v.z);
+		}
+		inline Vec3xN operator * (const F & s) const
+		{
+			return Vec3xN(x * s, y * s, z * s);
+		}
+		inline Vec3xN operator / (const F & s) const
+		{
+			return Vec3xN(x / s, y / s, z / s);
+		}
+		inline Vec3xN operator - () const
+		{
+			return Vec3xN(-x, -y, -z);
+		}
+		inline Vec3xN & operator += (const Vec3xN & v)
+		{
+			x += v.x; y += v.y; z += v.z;
+			return *this;
+		}
+		inline Vec3xN & operator -= (const Vec3xN & v)
+		{
+			x -= v.x; y -= v.y; z -= v.z;
+			return *this;
+		}
+		inline Vec3xN & operator *= (const F & s)
+		{
+			x *= s; y *= s; z *= s;
+			return *this;
+		}
+		inline F Length2() const
+		{
+			return x*x + y*y + z*z;
+		}
+		inline F Length() const
+		{
+			return F::Sqrt(Length2());
+		}
+		// zero-length lanes become NaN, like Vec3::NormalizeFPU
+		inline Vec3xN Normalize() const
+		{
+			F invLen = F(1.0f) / Length();
+			return (*this) * invLen;
+		}
+		inline static F Dot(const Vec3xN & v1, const Vec3xN & v2)
+		{
+			return v1.x*v2.x + v1.y*v2.y + v1.z*v2.z;
+		}
+		inline static void Cross(Vec3xN & rs_d, const Vec3xN & v1, const Vec3xN & v2)
+		{
+			rs_d.x = v1.y*v2.z - v1.z*v2.y;
+			rs_d.y = v1.z*v2.x - v1.x*v2.z;
+			rs_d.z = v1.x*v2.y - v1.y*v2.x;
+		}
+		inline static Vec3xN Min(const Vec3xN & v1, const Vec3xN & v2)
+		{
+			return Vec3xN(F::Min(v1.x, v2.x), F::Min(v1.y, v2.y), F::Min(v1.z, v2.z));
+		}
+		inline static Vec3xN Max(const Vec3xN & v1, const Vec3xN & v2)
+		{
+			return Vec3xN(F::Max(v1.x, v2.x), F::Max(v1.y, v2.y), F::Max(v1.z, v2.z));
+		}
+		inline static Vec3xN Select(const Mask & m, const Vec3xN & v1, const Vec3xN & v2)
+		{
+			return Vec3xN(F::Select(m, v1.x, v2.x), F::Select(m, v1.y, v2.y), F::Select(m, v1.z, v2.z));
+		}
+	};
+	typedef Vec3xN<FloatX4> Vec3x4;
+	typedef Vec3xN<FloatX8> Vec3x8;
+	typedef Vec3xN<FloatX16> Vec3x16;
+
+	// One Matrix4 broadcast to every lane.
+	template<typename F>
+	class Matrix4xN
+	{
+	public:
+		F values[16];
+		Matrix4xN()
+		{}
+		Matrix4xN(const Matrix4 & mat)
+		{
+			for (int i = 0; i<16; i++)
+				values[i] = F(mat.values[i]);
+		}
+		// same as Matrix4::Transform
+		inline Vec3xN<F> Transform(const Vec3xN<F> & v) const
+		{
+			Vec3xN<F> rs;
+			rs.x = values[0]*v.x + values[4]*v.y + values[8]*v.z + values[12];
+			rs.y = values[1]*v.x + values[5]*v.y + values[9]*v.z + values[13];
+			rs.z = values[2]*v.x + values[6]*v.y + values[10]*v.z + values[14];
+			return rs;
+		}
+		inline Vec3xN<F> TransformNormal(const Vec3xN<F> & v) const
+		{
+			Vec3xN<F> rs;
+			rs.x = values[0]*v.x + values[4]*v.y + values[8]*v.z;
+			rs.y = values[1]*v.x + values[5]*v.y + values[9]*v.z;
+			rs.z = values[2]*v.x + values[6]*v.y + values[10]*v.z;
+			return rs;
+		}
+		inline Vec3xN<F> TransformHomogeneous(const Vec3xN<F> & v) const
+		{
+			Vec3xN<F> rs = Transform(v);
+			F w = F(1.0f) / (values[3]*v.x + values[7]*v.y + values[11]*v.z + values[15]);
+			rs *= w;
+			return rs;
+		}
+	};
+
+}
+	using namespace VECTOR_MATH_WIDE_TIER;
+
+	// Batch kernels over arrays of Vec3, run with the widest lanes the cpu supports
+	// (see SimdKernels.h). rs may be the input array.
+	void TransformPoints(Vec3 * rs, const Matrix4 & m, const Vec3 * points, int count);
+	void TransformNormals(Vec3 * rs, const Matrix4 & m, const Vec3 * normals, int count);
+	void TransformPointsHomogeneous(Vec3 * rs, const Matrix4 & m, const Vec3 * points, int count);
+	void TransformPoints(List<Vec3> & rs, const Matrix4 & m, const List<Vec3> & points);
+	void TransformNormals(List<Vec3> & rs, const Matrix4 & m, const List<Vec3> & normals);
+	void TransformPointsHomogeneous(List<Vec3> & rs, const Matrix4 & m, const List<Vec3> & points);
+	// normalizes every vector in place
+	void NormalizeAll(Vec3 * vectors, int count);
+	// Writes the indices of the spheres inside every plane to visible and returns how many
+	// there are. A sphere is inside a plane (x, y, z, w) if x*cx + y*cy + z*cz + w >= -radius,
+	// so plane normals point into the volume.
+	int CullSpheres(const Vec4 * planes, int planeCount, const Vec3 * centers, const float * radii, int count, int * visible);
+}
+
+#endif
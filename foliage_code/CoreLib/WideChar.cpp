@@ -6,7 +6,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <wchar.h>
 #include "SecureCRT.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CORE_LIB_WIDE_CHAR_SSE2
+#include <emmintrin.h>
+#endif
 
 class DefaultLocaleSetter
 {
@@ -78,3 +83,277 @@ void MByteToWideChar(wchar_t * buffer, int bufferSize, const char * str, int len
 	mbstowcs_s(&ret, buffer, bufferSize, str, _TRUNCATE);
 #endif
 }
+
+#ifdef CORE_LIB_WIDE_CHAR_SSE2
+// stores 8 zero-extended 16-bit units
+static inline void StoreWide(wchar_t * dest, __m128i units)
+{
+	if (sizeof(wchar_t) == 2)
+		_mm_storeu_si128((__m128i*)dest, units);
+	else
+	{
+		__m128i zero = _mm_setzero_si128();
+		_mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi16(units, zero));
+		_mm_storeu_si128((__m128i*)(dest + 4), _mm_unpackhi_epi16(units, zero));
+	}
+}
+#endif
+
+static int AsciiRunLength(const unsigned char * src, int length)
+{
+	int i = 0;
+#ifdef CORE_LIB_WIDE_CHAR_SSE2
+	for (; i + 16 <= length; i += 16)
+	{
+		int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + i)));
+		if (mask)
+		{
+			while (!(mask & 1))
+			{
+				mask >>= 1;
+				i++;
+			}
+			return i;
+		}
+	}
+#endif
+	while (i < length && src[i] < 0x80)
+		i++;
+	return i;
+}
+
+int AsciiToWideChar(wchar_t * dest, const char * str, int length)
+{
+	const unsigned char * src = (const unsigned char *)str;
+	int i = 0;
+#ifdef CORE_LIB_WIDE_CHAR_SSE2
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+		if (_mm_movemask_epi8(bytes))
+			break;
+		StoreWide(dest + i, _mm_unpacklo_epi8(bytes, zero));
+		StoreWide(dest + i + 8, _mm_unpackhi_epi8(bytes, zero));
+	}
+#endif
+	while (i < length && src[i] < 0x80)
+	{
+		dest[i] = (wchar_t)src[i];
+		i++;
+	}
+	return i;
+}
+
+int Utf16ToWideChar(wchar_t * dest, const char * str, int length, bool bigEndian)
+{
+	const unsigned char * src = (const unsigned char *)str;
+	int count = length / 2;
+	int i = 0;
+	int rs = 0;
+#ifdef CORE_LIB_WIDE_CHAR_SSE2
+	if (dest)
+	{
+		const __m128i surrogateMask = _mm_set1_epi16((short)0xF800);
+		const __m128i surrogate = _mm_set1_epi16((short)0xD800);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i units = _mm_loadu_si128((const __m128i*)(src + i * 2));
+			if (bigEndian)
+				units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+			// blocks holding surrogates take the scalar path below, one unit at a time
+			if (sizeof(wchar_t) != 2 && _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, surrogateMask), surrogate)))
+				break;
+			StoreWide(dest + rs, units);
+			rs += 8;
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		unsigned int unit = bigEndian ? (src[i * 2] << 8) | src[i * 2 + 1] : src[i * 2] | (src[i * 2 + 1] << 8);
+		if (sizeof(wchar_t) != 2 && unit >= 0xD800 && unit <= 0xDFFF)
+		{
+			unsigned int next = 0;
+			if (i + 1 < count)
+				next = bigEndian ? (src[i * 2 + 2] << 8) | src[i * 2 + 3] : src[i * 2 + 2] | (src[i * 2 + 3] << 8);
+			if (unit <= 0xDBFF && next >= 0xDC00 && next <= 0xDFFF)
+			{
+				unit = 0x10000 + ((unit - 0xD800) << 10) + (next - 0xDC00);
+				i++;
+			}
+			else
+				unit = 0xFFFD;
+		}
+		if (dest)
+			dest[rs] = (wchar_t)unit;
+		rs++;
+	}
+	return rs;
+}
+
+int MByteToWideCharPartial(wchar_t * dest, const char * str, int length, int * consumed)
+{
+	const unsigned char * src = (const unsigned char *)str;
+	int rs = 0;
+	int i = 0;
+	while (i < length)
+	{
+		if (src[i] < 0x80)
+		{
+			int run = AsciiToWideChar(dest + rs, str + i, length - i);
+			rs += run;
+			i += run;
+			continue;
+		}
+#ifdef WINDOWS_PLATFORM
+		int charLength = IsDBCSLeadByte(src[i]) ? 2 : 1;
+		if (i + charLength > length)
+			break;
+		if (MultiByteToWideChar(CP_ACP, 0, str + i, charLength, dest + rs, 1) != 1)
+			dest[rs] = 0xFFFD;
+		rs++;
+		i += charLength;
+#else
+		static DefaultLocaleSetter setter;
+		mbstate_t state;
+		memset(&state, 0, sizeof(state));
+		wchar_t ch;
+		size_t charLength = mbrtowc(&ch, str + i, length - i, &state);
+		if (charLength == (size_t)-2)
+			break;
+		if (charLength == (size_t)-1)
+		{
+			ch = 0xFFFD;
+			charLength = 1;
+		}
+		dest[rs++] = ch;
+		i += (int)charLength;
+#endif
+	}
+	*consumed = i;
+	return rs;
+}
+
+int Utf8ToWideChar(wchar_t * dest, const char * str, int length)
+{
+	const unsigned char * src = (const unsigned char *)str;
+	int rs = 0;
+	int i = 0;
+	while (i < length)
+	{
+		// ascii runs are by far the common case
+		if (src[i] < 0x80)
+		{
+			int run = dest ? AsciiToWideChar(dest + rs, str + i, length - i) : AsciiRunLength(src + i, length - i);
+			rs += run;
+			i += run;
+			continue;
+		}
+		unsigned int codePoint = 0xFFFD;
+		int extra = 0;
+		unsigned int lead = src[i];
+		if (lead >= 0xC2 && lead <= 0xDF)
+		{
+			extra = 1;
+			codePoint = lead & 0x1F;
+		}
+		else if (lead >= 0xE0 && lead <= 0xEF)
+		{
+			extra = 2;
+			codePoint = lead & 0x0F;
+		}
+		else if (lead >= 0xF0 && lead <= 0xF4)
+		{
+			extra = 3;
+			codePoint = lead & 0x07;
+		}
+		i++;
+		if (extra)
+		{
+			int k = 0;
+			for (; k < extra && i + k < length && (src[i + k] & 0xC0) == 0x80; k++)
+				codePoint = (codePoint << 6) | (src[i + k] & 0x3F);
+			if (k != extra || (extra == 2 && codePoint < 0x800) || (extra == 3 && (codePoint < 0x10000 || codePoint > 0x10FFFF))
+				|| (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+				codePoint = 0xFFFD;
+			i += k;
+		}
+		if (sizeof(wchar_t) == 2 && codePoint >= 0x10000)
+		{
+			codePoint -= 0x10000;
+			if (dest)
+			{
+				dest[rs] = (wchar_t)(0xD800 + (codePoint >> 10));
+				dest[rs + 1] = (wchar_t)(0xDC00 + (codePoint & 0x3FF));
+			}
+			rs += 2;
+		}
+		else
+		{
+			if (dest)
+				dest[rs] = (wchar_t)codePoint;
+			rs++;
+		}
+	}
+	return rs;
+}
+
+int WideCharToUtf8(char * dest, const wchar_t * str, int length)
+{
+	int rs = 0;
+	for (int i = 0; i < length; i++)
+	{
+		unsigned int codePoint = (unsigned int)str[i];
+		if (codePoint < 0x80)
+		{
+			if (dest)
+				dest[rs] = (char)codePoint;
+			rs++;
+			continue;
+		}
+		if (sizeof(wchar_t) == 2 && codePoint >= 0xD800 && codePoint <= 0xDFFF)
+		{
+			if (codePoint <= 0xDBFF && i + 1 < length && str[i + 1] >= 0xDC00 && str[i + 1] <= 0xDFFF)
+			{
+				codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + ((unsigned int)str[i + 1] - 0xDC00);
+				i++;
+			}
+			else
+				codePoint = 0xFFFD;
+		}
+		if (codePoint > 0x10FFFF)
+			codePoint = 0xFFFD;
+		if (codePoint < 0x800)
+		{
+			if (dest)
+			{
+				dest[rs] = (char)(0xC0 | (codePoint >> 6));
+				dest[rs + 1] = (char)(0x80 | (codePoint & 0x3F));
+			}
+			rs += 2;
+		}
+		else if (codePoint < 0x10000)
+		{
+			if (dest)
+			{
+				dest[rs] = (char)(0xE0 | (codePoint >> 12));
+				dest[rs + 1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+				dest[rs + 2] = (char)(0x80 | (codePoint & 0x3F));
+			}
+			rs += 3;
+		}
+		else
+		{
+			if (dest)
+			{
+				dest[rs] = (char)(0xF0 | (codePoint >> 18));
+				dest[rs + 1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+				dest[rs + 2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+				dest[rs + 3] = (char)(0x80 | (codePoint & 0x3F));
+			}
+			rs += 4;
+		}
+	}
+	return rs;
+}
\ No newline at end of file
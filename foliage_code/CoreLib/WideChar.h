@@ -5,4 +5,20 @@ void MByteToWideChar(wchar_t * buffer, int bufferSize, const char * str, int len
 char * WideCharToMByte(const wchar_t * buffer, int length);
 wchar_t * MByteToWideChar(const char * buffer, int length);
 
-#endif
\ No newline at end of file
+// UTF-8 <-> wchar_t (UTF-16 where wchar_t is 2 bytes, UTF-32 otherwise).
+// Both return the number of units produced; pass a null dest to only measure.
+// Invalid sequences decode to U+FFFD.
+int Utf8ToWideChar(wchar_t * dest, const char * str, int length);
+int WideCharToUtf8(char * dest, const wchar_t * str, int length);
+
+// Widens the leading run of 7-bit ASCII bytes in str; returns the number of bytes converted.
+int AsciiToWideChar(wchar_t * dest, const char * str, int length);
+// UTF-16 -> wchar_t, length is in bytes and must be even. Where wchar_t is 4 bytes surrogate
+// pairs are combined and unpaired surrogates decode to U+FFFD. Returns the units produced.
+int Utf16ToWideChar(wchar_t * dest, const char * str, int length, bool bigEndian);
+// Converts the complete characters of a multi-byte (ANSI code page) string; an incomplete
+// character at the end is left alone. Returns the units produced, consumed receives the
+// bytes used.
+int MByteToWideCharPartial(wchar_t * dest, const char * str, int length, int * consumed);
+
+#endif
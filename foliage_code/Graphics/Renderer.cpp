@@ -9,8 +9,8 @@ bool Renderer::initialize( const char *scenefile, HWND * hWnd, int width, int he
 	dxManager.setViewMatrix( m );
 	XMMATRIX proj = XMMatrixPerspectiveFovLH( .4f * CoreLib::Basic::Math::Pi, (float) width / height, 1.f, z_far );
 	dxManager.setProjMatrix( proj );
-	BoundingFrustum::CreateFromMatrix( camera_frustum, proj );
 	this->z_far = z_far;
+	pixel_scale = 0.5f * height / tanf( .2f * CoreLib::Basic::Math::Pi );
 
 	// Load the scene file
 	if ( scenefile != NULL )
@@ -42,8 +42,11 @@ void Renderer::run()
 	camera.GetTransform( mat );
 	dxManager.setViewMatrix( mat );
 
-	BoundingFrustum frustum;
-	camera_frustum.Transform( frustum, XMMatrixInverse( nullptr, mat ) );
+	// world-space frustum; a stored XMMATRIX has the layout of a Matrix4
+	XMFLOAT4X4 viewproj;
+	XMStoreFloat4x4( &viewproj, XMMatrixMultiply( mat, dxManager.projectionMatrix ) );
+	CoreLib::Graphics::Frustum frustum;
+	CoreLib::Graphics::Frustum::FromMatrix( frustum, *(const VectorMath::Matrix4*) &viewproj, true );
 
 #ifdef _DEBUG
 	static bool j = true, k = true;
@@ -109,7 +112,7 @@ void Renderer::run()
 	// draw the scene to the D3D device
 	float fps = 1.f / dtime;
 	UINT modelCount = scene.computePVS( frustum );
-	UINT meshCount = scene.computeLODs( camera.GetEyePos(), camera.GetEyeDir(), z_far );
+	UINT meshCount = scene.computeLODs( camera.GetEyePos(), camera.GetEyeDir(), z_far, pixel_scale );
 	UINT leafcount = scene.Render( dxManager, camera.GetEyePos() );
 
 	wchar_t buf[100];
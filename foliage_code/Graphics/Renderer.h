@@ -10,8 +10,8 @@ private:
 	DxManager dxManager;
 	Scene scene;
 	Camera camera;
-	BoundingFrustum camera_frustum;
 	float z_far;
+	float pixel_scale;
 	CoreLib::Diagnostics::TimePoint time;
 
 	ID3D11BlendState *textBlend;
@@ -2,11 +2,86 @@
 #include "..\CoreLib\Basic.h"
 #include "..\CoreLib\LibString.h"
 #include "..\CoreLib\LibIO.h"
+#include "..\CoreLib\AsyncIO.h"
+#include "..\CoreLib\InstanceBounds.h"
+#include "..\CoreLib\Quat.h"
+#include "..\CoreLib\FastMath.h"
+#include "..\CoreLib\Graphics\MeshOptimizer.h"
+#include "..\CoreLib\Graphics\MeshSimplifier.h"
 #include "..\DirectXTK\Inc\WICTextureLoader.h"
 #include <d3dcompiler.h>
 
 #define checkResult(succ) if (!(succ)){printf("Format error reading from file.\n"); return false;}
 
+// reorders a mesh for the post-transform vertex cache, then for overdraw and vertex fetch; verbose
+// reports the vertex cache efficiency before and after
+static void optimizeMesh( const CoreLib::Basic::String & meshName, Mesh & mesh, MeshVertex * vertices, UINT32 * indices, bool verbose )
+{
+	using namespace CoreLib::Graphics;
+	VertexCacheStats before = { 0.f, 0.f };
+	if ( verbose )
+		before = AnalyzeVertexCache( indices, mesh.indexCount, mesh.vertexCount );
+	OptimizeVertexCache( indices, indices, mesh.indexCount, mesh.vertexCount );
+	OptimizeOverdraw( indices, indices, mesh.indexCount, &vertices->position.x, sizeof(MeshVertex) / sizeof(float), mesh.vertexCount );
+	mesh.vertexCount = OptimizeVertexFetch( vertices, indices, mesh.indexCount, mesh.vertexCount, sizeof(MeshVertex) );
+	if ( verbose )
+	{
+		VertexCacheStats after = AnalyzeVertexCache( indices, mesh.indexCount, mesh.vertexCount );
+		printf( "Mesh \"%s\": ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", meshName.Buffer(), before.Acmr, after.Acmr, before.Atvr, after.Atvr );
+	}
+}
+
+// simplifies a mesh into a chain of coarser levels of detail, each with about half the triangles of the one before,
+// and appends them to its index buffer; normals and texcoords weigh on the error so the shading holds up
+static void buildMeshLODs( const CoreLib::Basic::String & meshName, Mesh & mesh, MeshVertex * vertices, bool verbose )
+{
+	const UINT32 minLODTriangles = 32;
+	const float attributeWeights[5] = { 0.1f, 0.1f, 0.1f, 0.1f, 0.1f };
+
+	CoreLib::Basic::List<UINT32> lodIndices;
+	lodIndices.AddRange( mesh.indices, mesh.indexCount );
+	mesh.lodCount = 1;
+	mesh.lods[0].indexOffset = 0;
+	mesh.lods[0].indexCount = mesh.indexCount;
+	mesh.lods[0].error = 0.f;
+	mesh.lod = 0;
+	while ( mesh.lodCount < maxMeshLODs )
+	{
+		const MeshLOD & last = mesh.lods[mesh.lodCount - 1];
+		UINT32 target = last.indexCount / 6 * 3;
+		if ( target < minLODTriangles * 3 )
+			break;
+		UINT32 start = lodIndices.Count();
+		lodIndices.SetSize( start + last.indexCount );
+		float error;
+		UINT32 count = CoreLib::Graphics::SimplifyMesh( lodIndices.Buffer() + start, lodIndices.Buffer() + last.indexOffset, last.indexCount,
+														&vertices->position.x, sizeof(MeshVertex) / sizeof(float), mesh.vertexCount,
+														5, attributeWeights, target, D3D11_FLOAT32_MAX, error );
+		// stop once the mesh is mostly seam and border corners, which are kept
+		if ( count > last.indexCount * 3 / 4 )
+		{
+			lodIndices.SetSize( start );
+			break;
+		}
+		CoreLib::Graphics::OptimizeVertexCache( lodIndices.Buffer() + start, lodIndices.Buffer() + start, count, mesh.vertexCount );
+		lodIndices.SetSize( start + count );
+
+		// each level is simplified from the one before, so the errors add up
+		MeshLOD & lod = mesh.lods[mesh.lodCount++];
+		lod.indexOffset = start;
+		lod.indexCount = count;
+		lod.error = last.error + error;
+		if ( verbose )
+			printf( "Mesh \"%s\": LOD %u, %u triangles, error %f\n", meshName.Buffer(), mesh.lodCount - 1, count / 3, lod.error );
+	}
+
+	UINT32 * indices = new UINT32[lodIndices.Count()];
+	memcpy( indices, lodIndices.Buffer(), lodIndices.Count() * sizeof(UINT32) );
+	delete[] mesh.indices;
+	mesh.indices = indices;
+	mesh.indexCount = lodIndices.Count();
+}
+
 Scene::Scene()
 {
 	stable_struct.lightDir = XMFLOAT4( 0.f, -1.f, 0.f, 0.f );
@@ -14,6 +89,9 @@ Scene::Scene()
 	stable_struct.ambient = XMFLOAT4( 1.f, 1.f, 1.f, 1.f );
 
 	linear_falloff_count = 50;
+	lod_pixel_error = 1.f;
+
+	clearD3D( );
 }
 
 Scene::~Scene()
@@ -21,10 +99,12 @@ Scene::~Scene()
 }
 
 // loads an individual model from text (.fmt) file
-bool Model::LoadFromFile( const char *filename )
+bool Model::LoadFromFile( const char *filename, bool verbose )
 {
 	CoreLib::Basic::String name( filename );
 	CoreLib::Basic::String directory = CoreLib::IO::Path::GetDirectoryName( name );
+	// maps the normalized path of each texture to its index in texfiles
+	CoreLib::Basic::Dictionary<CoreLib::Basic::Symbol, int> textureIDs;
 	if ( name.EndsWith( CoreLib::Basic::String( ".fmt" ) ) )
 	{
 		FILE* f = 0;
@@ -38,18 +118,12 @@ bool Model::LoadFromFile( const char *filename )
 
 		while ( !feof( f ) )
 		{
-			// get the oriented bounding box
+			// *BOUNDS and other lines are skipped; the obb is fit to the meshes and leaves once they are loaded
 			checkResult( fscanf_s( f, "%s", buf, bufferSize ) );
-			if ( _stricmp( buf, "*BOUNDS" ) == 0 )
-			{
-				checkResult( fscanf_s( f, " %f %f %f %f %f %f", &obb.Center.x, &obb.Center.y, &obb.Center.z,
-																&obb.Extents.x, &obb.Extents.y, &obb.Extents.z ) );
-				while ( !feof( f ) && fgetc( f ) != '\n' );
-			}
 			// look for a regular mesh declaration
-			else if ( _stricmp( buf, "*MESH" ) == 0 )
+			if ( _stricmp( buf, "*MESH" ) == 0 )
 			{
-				Mesh mesh;
+				Mesh mesh = Mesh( ); // no buffers until initializeD3D
 
 				// get the mesh name for debugging
 				checkResult( fscanf_s( f, " %s", buf, bufferSize ) );
@@ -75,14 +149,16 @@ bool Model::LoadFromFile( const char *filename )
 					checkResult( fscanf_s( f, " %s", buf, bufferSize ) );
 
 					CoreLib::Basic::String texfile = CoreLib::IO::Path::Combine( directory, CoreLib::Basic::String( buf ) );
-					int index = texfiles.IndexOf( texfile );
-					if ( index >= 0 )
+					CoreLib::Basic::Symbol texsym = CoreLib::Basic::InternPath( texfile );
+					int index;
+					if ( textureIDs.TryGetValue( texsym, index ) )
 					{
 						mesh.material.textureID = index;
 					}
 					else
 					{
 						mesh.material.textureID = texfiles.Count( );
+						textureIDs.Add( texsym, texfiles.Count( ) );
 						texfiles.Add( texfile );
 					}
 						
@@ -157,6 +233,8 @@ bool Model::LoadFromFile( const char *filename )
 							}
 						}
 						mesh.indices = indices;
+						optimizeMesh( meshName, mesh, vertices, indices, verbose );
+						buildMeshLODs( meshName, mesh, vertices, verbose );
 					}
 					else
 					{
@@ -178,7 +256,7 @@ bool Model::LoadFromFile( const char *filename )
 				CoreLib::Basic::String meshName( buf );
 				while ( !feof( f ) && fgetc( f ) != '\n' );
 				
-				InstancedMesh mesh;
+				InstancedMesh mesh = InstancedMesh( ); // no buffers until initializeD3D
 
 				checkResult( fscanf_s( f, "%s", buf, bufferSize ) );
 				if ( _stricmp( buf, "*MATERIAL" ) == 0 )
@@ -196,17 +274,18 @@ bool Model::LoadFromFile( const char *filename )
 				checkResult( fscanf_s( f, "%s", buf, bufferSize ) );
 				if ( _stricmp( buf, "*TEXTURE" ) == 0 )
 				{
-					// TODO: filter duplicate textures
 					checkResult( fscanf_s( f, " %s", buf, bufferSize ) );
 					CoreLib::Basic::String texfile = CoreLib::IO::Path::Combine( directory, CoreLib::Basic::String( buf ) );
-					int index = texfiles.IndexOf( texfile );
-					if ( index >= 0 )
+					CoreLib::Basic::Symbol texsym = CoreLib::Basic::InternPath( texfile );
+					int index;
+					if ( textureIDs.TryGetValue( texsym, index ) )
 					{
 						mesh.material.textureID = index;
 					}
 					else
 					{
 						mesh.material.textureID = texfiles.Count( );
+						textureIDs.Add( texsym, texfiles.Count( ) );
 						texfiles.Add( texfile );
 					}
 					while ( !feof( f ) && fgetc( f ) != '\n' );
@@ -293,6 +372,13 @@ bool Model::LoadFromFile( const char *filename )
 							}
 						}
 						mesh.indices = indices;
+						optimizeMesh( meshName, mesh, vertices, indices, verbose );
+						// the leaves are simplified by their instance count
+						mesh.lodCount = 1;
+						mesh.lods[0].indexOffset = 0;
+						mesh.lods[0].indexCount = mesh.indexCount;
+						mesh.lods[0].error = 0.f;
+						mesh.lod = 0;
 					}
 					else
 					{
@@ -306,13 +392,21 @@ bool Model::LoadFromFile( const char *filename )
 						checkResult( fscanf_s( f, " %d", &mesh.instanceCount ) );
 						while ( !feof( f ) && fgetc( f ) != '\n' );
 						MeshInstance* instances = new MeshInstance[mesh.instanceCount];
-						for ( MeshInstance* instance = instances; instance < instances + mesh.instanceCount; instance++ )
+						CoreLib::Basic::List<VectorMath::Quat> rotations;
+						rotations.SetSize( mesh.instanceCount );
+						for ( int i = 0; i < mesh.instanceCount; i++ )
 						{
 							float x, y, z, roll, pitch, yaw;
 							checkResult( fscanf_s( f, "%f %f %f %f %f %f", &x, &y, &z, &pitch, &yaw, &roll ) );
-							XMStoreFloat3x3( &instance->rotation, XMMatrixTranspose( XMMatrixRotationRollPitchYaw( pitch, yaw, roll ) ) );
-							instance->translation = XMFLOAT3( x, y, z );
+							// same rotation as XMMatrixTranspose( XMMatrixRotationRollPitchYaw( pitch, yaw, roll ) )
+							VectorMath::Quat qx, qy;
+							VectorMath::Quat::FromAxisAngle( rotations[i], VectorMath::Vec3( 0.f, 0.f, 1.f ), roll );
+							VectorMath::Quat::FromAxisAngle( qx, VectorMath::Vec3( 1.f, 0.f, 0.f ), pitch );
+							VectorMath::Quat::FromAxisAngle( qy, VectorMath::Vec3( 0.f, 1.f, 0.f ), yaw );
+							rotations[i] = rotations[i] * qx * qy;
+							instances[i].translation = XMFLOAT3( x, y, z );
 						}
+						VectorMath::QuatsToRotations( &instances->rotation._11, sizeof(MeshInstance) / sizeof(float), rotations.Buffer(), mesh.instanceCount );
 						mesh.instances = instances;
 					}
 					else
@@ -331,6 +425,7 @@ bool Model::LoadFromFile( const char *filename )
 			}
 		}
 
+		ComputeBounds();
 		return true;
 	}
 	else
@@ -340,8 +435,62 @@ bool Model::LoadFromFile( const char *filename )
 	}
 }
 
+// fits the model-space box of the obb to the meshes and placed leaves, replacing the authored *BOUNDS
+void Model::ComputeBounds()
+{
+	static_assert( sizeof(MeshInstance) == sizeof(VectorMath::LeafInstance), "MeshInstance must match LeafInstance" );
+	BoundingBox box;
+	bool empty = true;
+	for ( Mesh* mesh = meshes.begin(); mesh != meshes.end(); mesh++ )
+	{
+		if ( mesh->vertexCount == 0 )
+			continue;
+		BoundingBox meshBox;
+		BoundingBox::CreateFromPoints( meshBox, mesh->vertexCount, &mesh->vertices->position, sizeof(MeshVertex) );
+		if ( empty )
+			box = meshBox;
+		else
+			BoundingBox::CreateMerged( box, box, meshBox );
+		empty = false;
+	}
+	VectorMath::Matrix4 identity;
+	VectorMath::Matrix4::CreateIdentityMatrix( identity );
+	for ( InstancedMesh* mesh = instancedMeshes.begin(); mesh != instancedMeshes.end(); mesh++ )
+	{
+		if ( mesh->vertexCount == 0 || mesh->instanceCount == 0 )
+			continue;
+		// Only the first lambda * instanceCount leaves are drawn, scaled by up to 1 / lambda, so
+		// leaf i may be drawn at up to instanceCount / i times its size. The leaves are bounded in
+		// runs that halve in length towards the front, each at the largest scale in the run.
+		BoundingBox leafBox;
+		BoundingBox::CreateFromPoints( leafBox, mesh->vertexCount, &mesh->vertices->position, sizeof(MeshVertex) );
+		VectorMath::Vec3 leafMin( leafBox.Center.x - leafBox.Extents.x, leafBox.Center.y - leafBox.Extents.y, leafBox.Center.z - leafBox.Extents.z );
+		VectorMath::Vec3 leafMax( leafBox.Center.x + leafBox.Extents.x, leafBox.Center.y + leafBox.Extents.y, leafBox.Center.z + leafBox.Extents.z );
+		for ( UINT32 end = mesh->instanceCount; end > 0; end /= 2 )
+		{
+			UINT32 start = end / 2;
+			float leafScale = start > 0 ? fminf( (float) mesh->instanceCount / start, 1.f / minLeafLambda ) : 1.f / minLeafLambda;
+			VectorMath::InstanceBounds bounds = VectorMath::TransformInstances( 0, identity, (const VectorMath::LeafInstance*) mesh->instances + start,
+																				end - start, leafMin, leafMax, leafScale );
+			BoundingBox leavesBox;
+			BoundingBox::CreateFromPoints( leavesBox, XMVectorSet( bounds.LocalMin.x, bounds.LocalMin.y, bounds.LocalMin.z, 0.f ),
+												  XMVectorSet( bounds.LocalMax.x, bounds.LocalMax.y, bounds.LocalMax.z, 0.f ) );
+			if ( empty )
+				box = leavesBox;
+			else
+				BoundingBox::CreateMerged( box, box, leavesBox );
+			empty = false;
+		}
+	}
+	// a model without geometry gets an empty box at its origin
+	if ( empty )
+		box = BoundingBox( XMFLOAT3( 0.f, 0.f, 0.f ), XMFLOAT3( 0.f, 0.f, 0.f ) );
+	obb.Center = VectorMath::Vec3( box.Center.x, box.Center.y, box.Center.z );
+	obb.Extents = VectorMath::Vec3( box.Extents.x, box.Extents.y, box.Extents.z );
+}
+
 // loads the scene models and materials from a text (.fst) file
-bool Scene::LoadFromFile( const char *filename )
+bool Scene::LoadFromFile( const char *filename, bool verbose )
 {
 	CoreLib::Basic::String name( filename );
 	CoreLib::Basic::String path = CoreLib::IO::Path::GetDirectoryName( name );
@@ -364,23 +513,23 @@ bool Scene::LoadFromFile( const char *filename )
 			// read in a model and its world placement
 			if ( _stricmp( buf, "*MODEL" ) == 0 )
 			{
-				// TODO: maintain a map of names, so we can re-use models
 				checkResult( fscanf_s( f, " %s", buf, bufferSize ) );
 				CoreLib::Basic::String modelfile = CoreLib::Basic::String( buf );
+				CoreLib::Basic::Symbol modelsym = CoreLib::Basic::InternPath( modelfile );
 				models.GrowToSize( models.Count() + 1 );
 
 				Model& mdl = models.Last();
 
-				int index = modelnames.IndexOf( modelfile );
-				if ( index >= 0 )
+				int index;
+				if ( modelIndices.TryGetValue( modelsym, index ) )
 				{
 					mdl = models[index]; // shallow copy
 				}
 				else
 				{
-					mdl.modelID = modelnames.Count();
-					modelnames.Add( modelfile );
-					if ( !mdl.LoadFromFile( CoreLib::IO::Path::Combine( path, modelfile ).ToMultiByteString() ) )
+					mdl.modelID = modelIndices.Count();
+					modelIndices.Add( modelsym, models.Count() - 1 );
+					if ( !mdl.LoadFromFile( CoreLib::IO::Path::Combine( path, modelfile ).ToMultiByteString(), verbose ) )
 						 return false;
 				}
 
@@ -400,7 +549,7 @@ bool Scene::LoadFromFile( const char *filename )
 					while ( !feof( f ) && fgetc( f ) != '\n' );
 				}
 				XMVECTOR q = XMQuaternionRotationRollPitchYaw( -pitch * XM_PI / 180, -yaw * XM_PI / 180, -roll * XM_PI / 180 );
-				XMStoreFloat4( &mdl.obb.Orientation, q );
+				XMStoreFloat4( (XMFLOAT4*) &mdl.obb.Orientation, q );
 				XMStoreFloat4x4( &mdl.transform, XMMatrixMultiplyTranspose( XMMatrixRotationQuaternion( q ), XMMatrixTranslation( mdl.position.x, mdl.position.y, mdl.position.z ) ) );
 			}
 			// read in custom directional+ambient light for the scene
@@ -432,19 +581,25 @@ bool Scene::LoadFromFile( const char *filename )
 				checkResult( fscanf_s( f, " %u", &linear_falloff_count ) );
 				while ( !feof( f ) && fgetc( f ) != '\n' );
 			}
+			// custom on-screen error of the mesh levels of detail
+			else if ( _stricmp( buf, "*LODERROR" ) == 0 )
+			{
+				checkResult( fscanf_s( f, " %f", &lod_pixel_error ) );
+				while ( !feof( f ) && fgetc( f ) != '\n' );
+			}
 			else
 			{
 				while ( !feof( f ) && fgetc( f ) != '\n' );
 			}
 		}
 
-		// fix up obb positions, and sort models by resource data
+		// move the model-space obbs into place, and sort models by resource data
 		models.Sort();
 		for ( Model * m = models.begin(); m != models.end(); m++ )
 		{
-			m->obb.Center.x += m->position.x;
-			m->obb.Center.y += m->position.y;
-			m->obb.Center.z += m->position.z;
+			VectorMath::Vec3 center;
+			VectorMath::Quat::Transform( center, m->obb.Orientation, m->obb.Center );
+			m->obb.Center = VectorMath::Vec3( center.x + m->position.x, center.y + m->position.y, center.z + m->position.z );
 		}
 		return true;
 	}
@@ -455,6 +610,13 @@ bool Scene::LoadFromFile( const char *filename )
 	}
 }
 
+// cancels the texture reads that have not started yet, so a failed initialization does not wait for them
+static void cancelTextureReads( CoreLib::Basic::List<CoreLib::Basic::RefPtr<CoreLib::IO::AsyncReadRequest>> & textureReads )
+{
+	for ( int i = 0; i < textureReads.Count( ); i++ )
+		textureReads[i]->Cancel( );
+}
+
 // this method should be called after LoadFromFile
 bool Scene::initializeD3D( const DxManager & dxManager )
 {
@@ -580,6 +742,17 @@ bool Scene::initializeD3D( const DxManager & dxManager )
 	indexBufferData.SysMemPitch = 0;
 	indexBufferData.SysMemSlicePitch = 0;
 
+	// start reading every texture file now, the reads complete while the geometry buffers are created
+	CoreLib::IO::AsyncFileReader textureReader;
+	CoreLib::Basic::List<CoreLib::Basic::String> textureFiles;
+	for ( Model * model = models.begin(); model != models.end(); model++ )
+	{
+		if ( model == models.begin() || model->modelID != (model - 1)->modelID )
+			textureFiles.AddRange( model->texfiles );
+	}
+	CoreLib::Basic::List<CoreLib::Basic::RefPtr<CoreLib::IO::AsyncReadRequest>> textureReads = textureReader.ReadBatch( textureFiles );
+	int nextTextureRead = 0;
+
 	for ( Model * model = models.begin(); model != models.end(); model++ )
 	{
 		// initialize the first model
@@ -623,9 +796,20 @@ bool Scene::initializeD3D( const DxManager & dxManager )
 		{
 			Texture texture;
 
-			HRESULT hr = CreateWICTextureFromFileEx( dxManager.pD3DDevice,
+			CoreLib::IO::AsyncReadRequest * textureRead = textureReads[nextTextureRead++].Ptr();
+			textureRead->Wait();
+			if ( textureRead->GetStatus() != CoreLib::IO::AsyncReadStatus::Completed )
+			{
+				printf( "Error: failed to read texture %s\n", texfile->ToMultiByteString( ) );
+				cancelTextureReads( textureReads );
+				releaseD3D( );
+				return false;
+			}
+
+			HRESULT hr = CreateWICTextureFromMemoryEx( dxManager.pD3DDevice,
 													 dxManager.pD3DDeviceContext,
-													 texfile->Buffer( ),
+													 textureRead->GetData( ).Buffer( ),
+													 textureRead->GetData( ).Count( ),
 													 0,
 													 D3D11_USAGE_DEFAULT,
 													 D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET,
@@ -637,10 +821,13 @@ bool Scene::initializeD3D( const DxManager & dxManager )
 			if ( FAILED( hr ) )
 			{
 				printf( "Error: failed to load texture %s\n", texfile->Buffer( ) );
+				cancelTextureReads( textureReads );
+				releaseD3D( );
 				return false;
 			}
 
 			model->textures.Add( texture );
+			textureRead->GetData( ) = CoreLib::Basic::List<unsigned char>( );
 		}
 
 		// copy the pointers for identical models
@@ -683,6 +870,7 @@ bool Scene::initializeD3D( const DxManager & dxManager )
 	return true;
 }
 
+// safe to call again after a failed initializeD3D: everything released is reset
 void Scene::releaseD3D()
 {
 	for ( Model * mdl = models.begin(); mdl != models.end(); mdl++ )
@@ -693,6 +881,10 @@ void Scene::releaseD3D()
 			if ( m->indexBuffer ) m->indexBuffer->Release();
 			if ( m->vertices ) delete( m->vertices );
 			if ( m->indices ) delete( m->indices );
+			m->vertexBuffer = NULL;
+			m->indexBuffer = NULL;
+			m->vertices = NULL;
+			m->indices = NULL;
 		}
 
 		for ( InstancedMesh * m = mdl->instancedMeshes.begin(); m != mdl->instancedMeshes.end(); m++ )
@@ -703,6 +895,12 @@ void Scene::releaseD3D()
 			if ( m->instances ) delete(m->instances);
 			if ( m->vertices ) delete(m->vertices);
 			if ( m->indices ) delete(m->indices);
+			m->vertexBuffer = NULL;
+			m->indexBuffer = NULL;
+			m->instanceBuffer = NULL;
+			m->instances = NULL;
+			m->vertices = NULL;
+			m->indices = NULL;
 		}
 
 		for ( Texture * texture = mdl->textures.begin( ); texture != mdl->textures.end( ); texture++ )
@@ -710,6 +908,7 @@ void Scene::releaseD3D()
 			texture->texture->Release();
 			texture->view->Release();
 		}
+		mdl->textures.Clear( );
 
 		while ( mdl + 1 < models.end() && (mdl + 1)->modelID == mdl->modelID )
 			mdl++;
@@ -729,23 +928,35 @@ void Scene::releaseD3D()
 	if ( leafPixelShaderBlob ) leafPixelShaderBlob->Release();
 	if ( leafPixelShader ) leafPixelShader->Release();
 	if ( basicSampler ) basicSampler->Release();
+	clearD3D( );
+}
+
+void Scene::clearD3D()
+{
+	vertexInputLayout = instanceInputLayout = NULL;
+	stableBuffer = perMdlBuffer = perMshBuffer = NULL;
+	basicVertexShaderBlob = basicPixelShaderBlob = leafVertexShaderBlob = leafPixelShaderBlob = NULL;
+	basicVertexShader = leafVertexShader = NULL;
+	basicPixelShader = leafPixelShader = NULL;
+	basicSampler = NULL;
 }
 
 // perform OBB-frustum culling
-UINT Scene::computePVS( const BoundingFrustum & frustum )
+UINT Scene::computePVS( const CoreLib::Graphics::Frustum & frustum )
 {
 	UINT count = 0;
 	for ( Model * model = models.begin(); model != models.end(); model++ )
 	{
-		model->visible = frustum.Contains( model->obb ) > 0;
+		model->visible = CoreLib::Graphics::Contains( frustum, model->obb ) != CoreLib::Graphics::Containment::Outside;
 		count++;
 	}
 
 	return count;
 }
 
-// update lambda values for all leaf meshes
-UINT Scene::computeLODs( XMVECTOR eyepos, XMVECTOR eyedir, float z_far )
+// update lambda values for all leaf meshes, and pick the levels of detail of the other meshes
+// pixel_scale is the size in pixels of one unit at unit distance from the eye
+UINT Scene::computeLODs( XMVECTOR eyepos, XMVECTOR eyedir, float z_far, float pixel_scale )
 {
 	UINT count = 0;
 	float d_max = 0.f, d_min = z_far;
@@ -757,7 +968,7 @@ UINT Scene::computeLODs( XMVECTOR eyepos, XMVECTOR eyedir, float z_far )
 			continue;
 
 		XMVECTOR delta = XMVectorSet( model->position.x, model->position.y, model->position.z, 1.f ) - eyepos;
-		float d = sqrtf( XMVector3Dot( delta, delta ).m128_f32[0] );
+		float d = VectorMath::FastMath::Sqrt( XMVector3Dot( delta, delta ).m128_f32[0] );
 		model->d = d < z_far ? d : z_far;
 
 		if ( d < d_min )
@@ -765,10 +976,23 @@ UINT Scene::computeLODs( XMVECTOR eyepos, XMVECTOR eyedir, float z_far )
 		if ( d > d_max )
 			d_max = d;
 
+		// coarsest level of each mesh whose error stays under lod_pixel_error on screen, measured
+		// from the closest point of the model bounds
+		XMVECTOR center = XMVectorSet( model->obb.Center.x, model->obb.Center.y, model->obb.Center.z, 1.f ) - eyepos;
+		XMVECTOR extents = XMVectorSet( model->obb.Extents.x, model->obb.Extents.y, model->obb.Extents.z, 0.f );
+		float d_near = VectorMath::FastMath::Sqrt( XMVector3Dot( center, center ).m128_f32[0] ) - VectorMath::FastMath::Sqrt( XMVector3Dot( extents, extents ).m128_f32[0] );
+		float max_error = d_near > 0.f ? lod_pixel_error * d_near / pixel_scale : 0.f;
+		for ( Mesh * mesh = model->meshes.begin(); mesh != model->meshes.end(); mesh++ )
+		{
+			mesh->lod = 0;
+			while ( mesh->lod + 1 < mesh->lodCount && mesh->lods[mesh->lod + 1].error <= max_error )
+				mesh->lod++;
+		}
+
 		for ( InstancedMesh * mesh = model->instancedMeshes.begin(); mesh != model->instancedMeshes.end(); mesh++ )
 		{				
 			count++;
-			mesh->lambda = mesh->d0 > d ? 1.f : powf( mesh->d0 / d, mesh->h );
+			mesh->lambda = mesh->d0 > d ? 1.f : VectorMath::FastMath::Pow( mesh->d0 / d, mesh->h );
 		}
 	}
 
@@ -781,18 +1005,18 @@ UINT Scene::computeLODs( XMVECTOR eyepos, XMVECTOR eyedir, float z_far )
 		float w = d_range / z_far;
 		for ( Model * model = models.begin(); model != models.end(); model++ )
 		{
-			float dc_lambda = 1.f - 0.5f * w * powf( (model->d - d_min) / d_range, n );
+			float dc_lambda = 1.f - 0.5f * w * VectorMath::FastMath::Pow( (model->d - d_min) / d_range, n );
 
 			for ( InstancedMesh * mesh = model->instancedMeshes.begin(); mesh != model->instancedMeshes.end(); mesh++ )
 			{
 				mesh->lambda *= dc_lambda;
 
 				// scaling breaks at extremely aggressive simplification
-				// models/scenes should be tuned so that at this point the meshes can be ignored or replaced by billboards
-				if ( mesh->lambda < 0.005f )
+				// models/scenes should be tuned so that at this point the leaves can be ignored or replaced by billboards
+				// the branches stay, at their coarsest levels of detail
+				if ( mesh->lambda < minLeafLambda )
 				{
 					mesh->lambda = 0.f;
-					model->visible = false; // since i don't have lods for the branches, toggle everything
 					count--;
 				}	
 			}
@@ -862,7 +1086,7 @@ UINT Scene::Render( DxManager & dxManager, XMVECTOR eyepos )
 			dxManager.pD3DDeviceContext->IASetIndexBuffer( m->indexBuffer, DXGI_FORMAT_R32_UINT, 0 );
 			dxManager.pD3DDeviceContext->PSSetShaderResources( 0, 1, &mdl->textures[m->material.textureID].view );
 
-			dxManager.pD3DDeviceContext->DrawIndexed( m->indexCount, 0, 0 );
+			dxManager.pD3DDeviceContext->DrawIndexed( m->lods[m->lod].indexCount, m->lods[m->lod].indexOffset, 0 );
 		}
 	}
 
@@ -4,6 +4,9 @@
 #include <DirectXCollision.h>
 #include "..\CoreLib\List.h"
 #include "..\CoreLib\LibString.h"
+#include "..\CoreLib\Dictionary.h"
+#include "..\CoreLib\Symbol.h"
+#include "..\CoreLib\Graphics\Bounds.h"
 
 using namespace DirectX;
 
@@ -50,16 +53,31 @@ struct Material
 	UINT textureID;
 };
 
+// a level of detail of a mesh: a range of its index buffer, and how far (in model space) its surface may be from the full mesh
+struct MeshLOD
+{
+	UINT32 indexOffset;
+	UINT32 indexCount;
+	float error;
+};
+
+const UINT32 maxMeshLODs = 8;
+
 // base mesh data
 struct Mesh
 {
 	UINT32 vertexCount;
-	UINT32 indexCount;
+	UINT32 indexCount; // all levels of detail
 	const MeshVertex *vertices;
 	const UINT32 *indices;
 	ID3D11Buffer *vertexBuffer;
 	ID3D11Buffer *indexBuffer;
 	Material material;
+	UINT32 lodCount;
+	MeshLOD lods[maxMeshLODs]; // lods[0] is the full mesh
+
+	// updated per-frame
+	UINT32 lod;
 };
 
 // additional data for alpha-mapped, instanced meshes
@@ -75,6 +93,9 @@ struct InstancedMesh : Mesh
 	float lambda;
 };
 
+// a leaf mesh is not drawn below this lambda, so its leaves are never scaled up by more than 1 / minLeafLambda
+const float minLeafLambda = 0.005f;
+
 struct Texture
 {
 	ID3D11Resource *texture;
@@ -91,14 +112,16 @@ struct Model
 	// persistent data
 	UINT modelID;
 	XMFLOAT3 position;
-	BoundingOrientedBox obb;
+	CoreLib::Graphics::OrientedBox obb;
 	XMFLOAT4X4 transform;
 	CoreLib::Basic::List<Mesh> meshes;
 	CoreLib::Basic::List<InstancedMesh> instancedMeshes;
 	CoreLib::Basic::List<Texture> textures;
 	CoreLib::Basic::List<CoreLib::Basic::String> texfiles;
 
-	bool LoadFromFile( const char *filename );
+	// verbose prints the vertex cache statistics and the levels of detail of each mesh
+	bool LoadFromFile( const char *filename, bool verbose = false );
+	void ComputeBounds();
 	bool operator<(const Model& rhs) const
 	{
 		return modelID < rhs.modelID;
@@ -113,23 +136,27 @@ class Scene
 public:
 	Scene();
 	~Scene();
-	bool LoadFromFile( const char *filename );
+	bool LoadFromFile( const char *filename, bool verbose = false );
 	bool initializeD3D( const DxManager & dxManager );
 	void releaseD3D();
-	UINT computePVS( const BoundingFrustum& frustum );
-	UINT computeLODs( XMVECTOR eyepos, XMVECTOR eyedir, float z_far );
+	UINT computePVS( const CoreLib::Graphics::Frustum& frustum );
+	UINT computeLODs( XMVECTOR eyepos, XMVECTOR eyedir, float z_far, float pixel_scale );
 	UINT Render( DxManager & dxManager, XMVECTOR eyepos );
 protected:
 	CoreLib::Basic::List<Model> models;
 	UINT linear_falloff_count;
+	float lod_pixel_error; // largest on-screen error, in pixels, of the mesh levels of detail
 private:
-	CoreLib::Basic::List<CoreLib::Basic::String> modelnames;
+	// first placement of each model file, keyed by normalized path
+	CoreLib::Basic::Dictionary<CoreLib::Basic::Symbol, int> modelIndices;
 	CoreLib::Basic::List<MeshVertex *> vertices;
 	CoreLib::Basic::List<ID3D11Buffer *> vertexBuffers;
 	CoreLib::Basic::List<UINT32 *> indices;
 	CoreLib::Basic::List<ID3D11Buffer *> indexBuffers;
 	CoreLib::Basic::List<MeshInstance *> instances;
 	CoreLib::Basic::List<ID3D11Buffer *> instanceBuffers;
+	// sets the scene-wide D3D objects to NULL, before they are created and after they are released
+	void clearD3D();
 
 	struct StableBuffer
 	{